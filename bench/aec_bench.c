@@ -0,0 +1,103 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "../src/aec.h"
+
+#define BENCH_SECONDS   (30)
+#define SAMPLE_RATE     (16000)
+#define BLOCK           (16)
+#define OUTPUT_LATENCY  (0.020)     /* DAC time ahead of the callback */
+#define INPUT_LATENCY   (0.010)     /* ADC time behind the callback */
+#define ROOM_DELAY      (40)        /* samples of acoustic path before the first reflection */
+#define ROOM_TAPS       (600)
+
+/*
+ *  Plays coloured noise through a synthetic room and cancels it from the
+ *  simulated microphone, fed block by block with the timestamps a duplex
+ *  callback would see. The second half adds near-end speech to exercise
+ *  the double-talk and barge-in paths.
+ */
+int main(void)
+{
+    long total = (long)BENCH_SECONDS * SAMPLE_RATE;
+    long delay = ROOM_DELAY + (long)((OUTPUT_LATENCY + INPUT_LATENCY) * SAMPLE_RATE);
+    short *far = (short *)malloc(total * sizeof(short));
+    short *mic = (short *)malloc(total * sizeof(short));
+    float *room = (float *)malloc(ROOM_TAPS * sizeof(float));
+    echoCanceller *ec = (echoCanceller *)malloc(sizeof(echoCanceller));
+
+    if(far == NULL || mic == NULL || room == NULL || ec == NULL)
+    {
+        fprintf(stderr, "Could not allocate benchmark buffers.\n");
+        return 127;
+    }
+
+    unsigned seed = 1;
+    float smooth = 0.0f;
+    for(long i = 0; i < total; i++)
+    {
+        float white = (float)((int)(benchRand(&seed) % 20001) - 10000);
+        smooth = 0.9f * smooth + 0.1f * white;
+        far[i] = (short)(smooth * (1.5f + sinf(i * 0.0005f)));
+    }
+    for(int k = 0; k < ROOM_TAPS; k++)
+    {
+        float noise = (float)((int)(benchRand(&seed) % 2001) - 1000) / 1000.0f;
+        room[k] = 0.02f * noise * expf(-k / 120.0f);
+    }
+    for(long i = 0; i < total; i++)
+    {
+        float echo = 0.0f;
+        for(int k = 0; k < ROOM_TAPS && i - delay - k >= 0; k++)
+        {
+            echo += room[k] * far[i - delay - k];
+        }
+        float near = 0.0f;
+        if(i > total / 2 && (i / SAMPLE_RATE) % 3 == 0)
+        {
+            near = 8000.0f * sinf(2.0f * 3.14159265f * 180.0f * i / SAMPLE_RATE);
+        }
+        float s = echo + near;
+        mic[i] = (short)(s > 32767.0f ? 32767.0f : (s < -32768.0f ? -32768.0f : s));
+    }
+
+    aecInit(ec, SAMPLE_RATE, delay);
+
+    double start = benchNow();
+    unsigned long bargeIns = 0;
+    for(long i = 0; i < total; i += BLOCK)
+    {
+        double now = 1.0 + (double)i / SAMPLE_RATE;
+        aecReference(ec, far + i, BLOCK, now + OUTPUT_LATENCY);
+        bargeIns += aecCancel(ec, mic + i, BLOCK, now - INPUT_LATENCY);
+    }
+    double elapsed = benchNow() - start;
+
+    /* Echo return loss enhancement over the converged, single-talk part. */
+    double in = 0.0, out = 0.0;
+    for(long i = SAMPLE_RATE * 5; i < total / 2; i++)
+    {
+        double e = 0.0;
+        for(int k = 0; k < ROOM_TAPS && i - delay - k >= 0; k++)
+        {
+            e += room[k] * far[i - delay - k];
+        }
+        in += e * e;
+        out += (double)mic[i] * mic[i];
+    }
+
+    printf("{\"bench\":\"aec\",\"taps\":%d,\"block\":%d,\"seconds\":%.6f,\"realtime_factor\":%.1f,"
+           "\"mean_block_us\":%.2f,\"max_block_us\":%.2f,\"budget_us\":%.1f,\"over_budget\":%lu,"
+           "\"erle_db\":%.1f,\"barge_ins\":%lu}\n",
+           AEC_TAPS, BLOCK, elapsed, BENCH_SECONDS / elapsed,
+           ec->stats.seconds * 1e6 / ec->stats.blocks, ec->stats.maxSeconds * 1e6,
+           BLOCK * 1e6 / SAMPLE_RATE, ec->stats.overBudget,
+           10.0 * log10(in / (out + 1.0)), bargeIns);
+
+    free(ec);
+    free(room);
+    free(mic);
+    free(far);
+    return 0;
+}
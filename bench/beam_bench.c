@@ -0,0 +1,151 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "../src/beam.h"
+
+#define BENCH_SECONDS   (20)
+#define SAMPLE_RATE     (16000)
+#define BLOCK           (16)
+#define STEP_DELAY      (1.5)       /* samples between neighbouring mics: 5 cm spacing, 40 degrees */
+#define SPEECH_LEVEL    (4000.0f)
+#define NOISE_LEVEL     (4000.0f)
+#define INTERP_HALF     (32)        /* taps each side for the reference delays */
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* out[t] = x(t - d) by long windowed-sinc interpolation, as ground truth for the array. */
+static void delayed(const float *x, long count, double d, float *out)
+{
+    for(long t = 0; t < count; t++)
+    {
+        double u = t - d;
+        long centre = (long)floor(u);
+        double s = 0.0;
+        for(long m = centre - INTERP_HALF + 1; m <= centre + INTERP_HALF; m++)
+        {
+            if(m < 0 || m >= count)
+            {
+                continue;
+            }
+            double v = u - m;
+            double sinc = fabs(v) < 1e-9 ? 1.0 : sin(M_PI * v) / (M_PI * v);
+            double w = 0.5 + 0.5 * cos(M_PI * v / INTERP_HALF);
+            s += x[m] * sinc * w;
+        }
+        out[t] = (float)s;
+    }
+}
+
+/* Band-limited noise in bursts of ~250 ms, a rough stand-in for syllables. */
+static void talker(float *x, long count, unsigned *seed)
+{
+    float a = 0.0f, b = 0.0f;
+    for(long i = 0; i < count; i++)
+    {
+        float white = (float)((int)(benchRand(seed) % 20001) - 10000) / 10000.0f;
+        a = 0.6f * a + 0.4f * white;
+        b = 0.6f * b + 0.4f * a;
+        float envelope = (i / (SAMPLE_RATE / 4)) % 3 == 2 ? 0.05f : 1.0f;
+        x[i] = SPEECH_LEVEL * 2.0f * b * envelope;
+    }
+}
+
+static void run(int channels)
+{
+    long total = (long)BENCH_SECONDS * SAMPLE_RATE;
+    unsigned seed = 7;
+    float *source = (float *)malloc(total * sizeof(float));
+    float *mic = (float *)malloc(total * sizeof(float));
+    float *target = (float *)malloc(total * sizeof(float));
+    float *noise0 = (float *)malloc(total * sizeof(float));
+    short *input = (short *)malloc(total * channels * sizeof(short));
+    short *output = (short *)malloc(total * sizeof(short));
+    beamformer *bf = (beamformer *)malloc(sizeof(beamformer));
+
+    if(source == NULL || mic == NULL || target == NULL || noise0 == NULL || input == NULL
+       || output == NULL || bf == NULL || beamInit(bf, channels) != 0)
+    {
+        fprintf(stderr, "Could not allocate benchmark buffers.\n");
+        exit(127);
+    }
+
+    talker(source, total, &seed);
+    for(int c = 0; c < channels; c++)
+    {
+        delayed(source, total, c * STEP_DELAY, mic);
+        float n = 0.0f;
+        for(long i = 0; i < total; i++)
+        {
+            float white = (float)((int)(benchRand(&seed) % 20001) - 10000) / 10000.0f;
+            n = 0.6f * n + 0.4f * white;
+            float noise = NOISE_LEVEL * 2.0f * n;
+            if(c == 0)
+            {
+                noise0[i] = noise;
+            }
+            float s = mic[i] + noise;
+            input[i * channels + c] = (short)(s > 32767.0f ? 32767.0f : (s < -32768.0f ? -32768.0f : s));
+        }
+    }
+    delayed(source, total, BEAM_LATENCY, target);
+
+    double start = benchNow();
+    for(long i = 0; i < total; i += BLOCK)
+    {
+        beamProcess(bf, input + i * channels, BLOCK, output + i);
+    }
+    double elapsed = benchNow() - start;
+
+    /* SNR against the talker alone, over the converged second half. */
+    double signalIn = 0.0, noiseIn = 0.0, signalOut = 0.0, noiseOut = 0.0;
+    for(long i = total / 2; i < total; i++)
+    {
+        double s = target[i];
+        signalIn += (double)source[i] * source[i];
+        noiseIn += (double)noise0[i] * noise0[i];
+        signalOut += s * s;
+        noiseOut += (output[i] - s) * (output[i] - s);
+    }
+    double snrIn = 10.0 * log10(signalIn / noiseIn);
+    double snrOut = 10.0 * log10(signalOut / noiseOut);
+
+    double worst = 0.0;
+    for(int c = 1; c < channels; c++)
+    {
+        double error = fabs(bf->delay[c] - c * STEP_DELAY);
+        worst = error > worst ? error : worst;
+    }
+
+    printf("{\"bench\":\"beam\",\"channels\":%d,\"block\":%d,\"seconds\":%.6f,\"realtime_factor\":%.1f,"
+           "\"core_load\":%.4f,\"estimates\":%lu,\"trusted\":%lu,\"max_delay_error\":%.3f,"
+           "\"snr_in_db\":%.1f,\"snr_out_db\":%.1f,\"gain_db\":%.1f}\n",
+           channels, BLOCK, elapsed, BENCH_SECONDS / elapsed, elapsed / BENCH_SECONDS,
+           bf->stats.estimates, bf->stats.updates, worst, snrIn, snrOut, snrOut - snrIn);
+
+    beamFree(bf);
+    free(bf);
+    free(output);
+    free(input);
+    free(noise0);
+    free(target);
+    free(mic);
+    free(source);
+}
+
+/*
+ *  A talker reaching a linear array with a fixed fractional delay between
+ *  neighbouring mics, plus independent noise on every mic. Reports the
+ *  cost per second of audio and the SNR gained over a single microphone.
+ */
+int main(void)
+{
+    int counts[] = { 2, 4, 8 };
+    for(unsigned i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+    {
+        run(counts[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,159 @@
+#ifndef JARVIS_BENCH_H
+#define JARVIS_BENCH_H
+
+/*
+ *  Shared helpers for the programs under bench/. Each benchmark prints
+ *  one JSON object per result line so runs can be collected and compared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/clock.h"
+#include "../src/net.h"
+#ifndef _WIN32
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#endif
+
+#define benchNow    clockNow
+
+/* Deterministic noise so every run benchmarks the same input. */
+static inline unsigned benchRand(unsigned *state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+/* CPU seconds used by the process so far and its peak resident set in KiB (0 where unknown). */
+static inline void benchUsage(double *cpuSeconds, long *maxRssKb)
+{
+#ifdef _WIN32
+    *cpuSeconds = 0.0;
+    *maxRssKb = 0;
+#else
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    *cpuSeconds = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+    *maxRssKb = ru.ru_maxrss;
+#endif
+}
+
+static inline int benchCompare(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* q-quantile of values (sorted in place), nearest rank. */
+static inline double benchPercentile(double *values, long count, double q)
+{
+    if(count <= 0)
+    {
+        return 0.0;
+    }
+    qsort(values, (size_t)count, sizeof(double), benchCompare);
+    long rank = (long)(q * count + 0.5);
+    rank = rank < 1 ? 1 : (rank > count ? count : rank);
+    return values[rank - 1];
+}
+
+#ifndef _WIN32
+#define BENCH_MOCK_BINARY   "mockrec"       /* next to the benchmark */
+#define BENCH_MOCK_STARTUP  (5.0)
+#define BENCH_MOCK_ARGS     (16)
+
+/*
+ *  Starts bin/mockrec on port with extra options (NULL-terminated, may be
+ *  NULL) and waits until it reports over a pipe that it listens there;
+ *  -1 if it exits or stays silent instead. A successful connect would
+ *  not do: it also reaches a stale server left on the port.
+ */
+static inline pid_t benchMockStart(const char *self, int port, const char *const *options)
+{
+    char path[512];
+    const char *slash = strrchr(self, '/');
+    snprintf(path, sizeof(path), "%.*s%s", slash != NULL ? (int)(slash - self + 1) : 0, self, BENCH_MOCK_BINARY);
+    char portText[16];
+    snprintf(portText, sizeof(portText), "%d", port);
+
+    int ready[2];
+    if(pipe(ready) != 0)
+    {
+        return -1;
+    }
+    char readyText[16];
+    snprintf(readyText, sizeof(readyText), "%d", ready[1]);
+
+    char *args[BENCH_MOCK_ARGS + 6] = { path, "-p", portText, "-r", readyText };
+    int n = 5;
+    for(int i = 0; options != NULL && options[i] != NULL && i < BENCH_MOCK_ARGS; i++)
+    {
+        args[n++] = (char *)options[i];
+    }
+    args[n] = NULL;
+
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        close(ready[0]);
+        /* Keep the server's banner out of the results. */
+        if(freopen("/dev/null", "w", stdout) == NULL)
+        {
+            _exit(127);
+        }
+        execv(path, args);
+        _exit(127);
+    }
+    close(ready[1]);
+    if(pid < 0)
+    {
+        close(ready[0]);
+        return -1;
+    }
+
+    /* The port and a newline once it listens; end of file if it exited first. */
+    char text[16];
+    size_t got = 0;
+    double deadline = clockNow() + BENCH_MOCK_STARTUP;
+    while(got < sizeof(text) - 1 && memchr(text, '\n', got) == NULL)
+    {
+        struct pollfd p = { ready[0], POLLIN, 0 };
+        int wait = (int)((deadline - clockNow()) * 1000.0);
+        if(wait <= 0 || poll(&p, 1, wait) <= 0)
+        {
+            break;
+        }
+        ssize_t r = read(ready[0], text + got, sizeof(text) - 1 - got);
+        if(r <= 0)
+        {
+            break;
+        }
+        got += (size_t)r;
+    }
+    close(ready[0]);
+    text[got] = '\0';
+    if(memchr(text, '\n', got) != NULL && atoi(text) == port)
+    {
+        return pid;
+    }
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+static inline void benchMockStop(pid_t pid)
+{
+    if(pid > 0)
+    {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+}
+#endif
+
+#endif
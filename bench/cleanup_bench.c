@@ -0,0 +1,286 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "../include/sndfile.h"
+#include "../src/cleanup.h"
+
+#define SAMPLE_RATE     (16000)
+#define BLOCK           (16)
+#define ITEM_SECONDS    (8)
+#define SEGMENT         (1600)          /* 100 ms SNR segments */
+#define SEGMENT_ACTIVE  (1e-4)          /* -40 dB under the loudest segment */
+#define CONFIG_FILE     "jarvis.conf"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/*
+ *  Throughput and before/after SNR of the clean-up stage.
+ *
+ *  Without arguments a synthetic corpus is used: voiced "speech" with a
+ *  syllable envelope at two levels, mixed with white, brown and hum+hiss
+ *  noise at several SNRs. Real recordings can be given as pairs of mono
+ *  16 kHz files, `cleanup_bench clean.wav noisy.wav ...`. The stage is
+ *  configured from jarvis.conf when present, like the main program.
+ *
+ *  SNR is segmental and scale invariant (each 100 ms segment of output is
+ *  projected on the clean signal), so AGC gain is not counted as change.
+ */
+
+static double segmentalSnr(const short *clean, const short *signal, long count)
+{
+    double peak = 0.0;
+    for(long s = 0; s + SEGMENT <= count; s += SEGMENT)
+    {
+        double e = 0.0;
+        for(long i = s; i < s + SEGMENT; i++)
+        {
+            e += (double)clean[i] * clean[i];
+        }
+        peak = e > peak ? e : peak;
+    }
+
+    double total = 0.0;
+    int segments = 0;
+    for(long s = 0; s + SEGMENT <= count; s += SEGMENT)
+    {
+        double cc = 0.0, cs = 0.0, ss = 0.0;
+        for(long i = s; i < s + SEGMENT; i++)
+        {
+            cc += (double)clean[i] * clean[i];
+            cs += (double)clean[i] * signal[i];
+            ss += (double)signal[i] * signal[i];
+        }
+        if(cc < SEGMENT_ACTIVE * peak || cc == 0.0)
+        {
+            continue;
+        }
+        double a = cs / cc;
+        double target = a * a * cc;
+        double error = ss - 2.0 * a * cs + target;
+        double snr = 10.0 * log10((target + 1e-9) / (error + 1e-9));
+        total += snr < -10.0 ? -10.0 : (snr > 35.0 ? 35.0 : snr);
+        segments++;
+    }
+    return segments ? total / segments : 0.0;
+}
+
+static double rmsDb(const short *x, long count)
+{
+    double e = 0.0;
+    for(long i = 0; i < count; i++)
+    {
+        e += (double)x[i] * x[i];
+    }
+    return 10.0 * log10(e / count / (32768.0 * 32768.0) + 1e-12);
+}
+
+static void synthSpeech(float *out, long count, unsigned *seed)
+{
+    double phase = 0.0;
+    for(long i = 0; i < count; i++)
+    {
+        double t = (double)i / SAMPLE_RATE;
+        double f0 = 140.0 + 30.0 * sin(2.0 * M_PI * 0.7 * t) + (benchRand(seed) % 100) * 0.02;
+        phase += 2.0 * M_PI * f0 / SAMPLE_RATE;
+        double v = 0.0;
+        for(int h = 1; h <= 20; h++)
+        {
+            double f = h * f0;
+            double formant = 1.0 / (1.0 + pow((f - 500.0) / 300.0, 2)) + 0.5 / (1.0 + pow((f - 1500.0) / 400.0, 2));
+            v += formant * sin(h * phase) / h;
+        }
+        double syllable = sin(M_PI * fmod(t * 4.0, 1.0));
+        double pause = fmod(t, 2.0) < 1.5 ? 1.0 : 0.0;
+        out[i] = (float)(v * syllable * syllable * pause);
+    }
+}
+
+static void synthNoise(float *out, long count, int kind, unsigned *seed)
+{
+    float brown = 0.0f;
+    for(long i = 0; i < count; i++)
+    {
+        float white = (float)((int)(benchRand(seed) % 20001) - 10000) / 10000.0f;
+        switch(kind)
+        {
+            case 0:
+                out[i] = white;
+                break;
+            case 1:
+                brown = 0.98f * brown + 0.1f * white;
+                out[i] = brown;
+                break;
+            default:
+                out[i] = (float)sin(2.0 * M_PI * 50.0 * i / SAMPLE_RATE)
+                       + 0.5f * (float)sin(2.0 * M_PI * 150.0 * i / SAMPLE_RATE) + 0.2f * white;
+                break;
+        }
+    }
+}
+
+static double energy(const float *x, long count)
+{
+    double e = 0.0;
+    for(long i = 0; i < count; i++)
+    {
+        e += (double)x[i] * x[i];
+    }
+    return e;
+}
+
+/* Runs one item and prints its result line; returns processing seconds. */
+static double runItem(const char *name, const short *clean, const short *noisy, long count,
+                      const cleanConfig *cfg, cleaner *c)
+{
+    short *out = (short *)malloc((count + CLEAN_LATENCY) * sizeof(short));
+    short zeros[BLOCK] = { 0 };
+    if(out == NULL)
+    {
+        return 0.0;
+    }
+
+    cleanInit(c, cfg);
+    double start = benchNow();
+    long i = 0;
+    for(; i + BLOCK <= count; i += BLOCK)
+    {
+        cleanProcess(c, noisy + i, out + i, BLOCK);
+    }
+    cleanProcess(c, noisy + i, out + i, count - i);
+    for(long flushed = 0; flushed < cleanLatency(c); flushed += BLOCK)
+    {
+        cleanProcess(c, zeros, out + count + flushed, BLOCK);
+    }
+    double elapsed = benchNow() - start;
+
+    const short *aligned = out + cleanLatency(c);
+    printf("{\"bench\":\"cleanup\",\"item\":\"%s\",\"seconds_audio\":%.1f,"
+           "\"snr_before_db\":%.1f,\"snr_after_db\":%.1f,\"level_before_dbfs\":%.1f,"
+           "\"level_after_dbfs\":%.1f,\"limited\":%lu}\n",
+           name, (double)count / SAMPLE_RATE, segmentalSnr(clean, noisy, count),
+           segmentalSnr(clean, aligned, count), rmsDb(noisy, count), rmsDb(aligned, count),
+           c->stats.limited);
+
+    free(out);
+    return elapsed;
+}
+
+static short *readMono(const char *path, long *count)
+{
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+    SNDFILE *f = sf_open(path, SFM_READ, &info);
+    if(f == NULL)
+    {
+        fprintf(stderr, "Cannot open %s.\n", path);
+        return NULL;
+    }
+    if(info.channels != 1 || info.samplerate != SAMPLE_RATE)
+    {
+        fprintf(stderr, "%s: expected mono 16 kHz audio.\n", path);
+        sf_close(f);
+        return NULL;
+    }
+    short *x = (short *)malloc((size_t)info.frames * sizeof(short));
+    *count = x != NULL ? (long)sf_readf_short(f, x, info.frames) : 0;
+    sf_close(f);
+    return x;
+}
+
+int main(int argc, char **argv)
+{
+    cleanConfig cfg;
+    config settings;
+    cleanDefaults(&cfg);
+    configLoad(&settings, CONFIG_FILE);
+    cleanConfigure(&cfg, &settings);
+
+    cleaner *c = (cleaner *)malloc(sizeof(cleaner));
+    if(c == NULL)
+    {
+        fprintf(stderr, "Could not allocate benchmark buffers.\n");
+        return 127;
+    }
+
+    double processing = 0.0, audio = 0.0;
+
+    if(argc > 2)
+    {
+        for(int a = 1; a + 1 < argc; a += 2)
+        {
+            long cleanCount, noisyCount;
+            short *clean = readMono(argv[a], &cleanCount);
+            short *noisy = readMono(argv[a + 1], &noisyCount);
+            if(clean != NULL && noisy != NULL)
+            {
+                long n = cleanCount < noisyCount ? cleanCount : noisyCount;
+                processing += runItem(argv[a + 1], clean, noisy, n, &cfg, c);
+                audio += (double)n / SAMPLE_RATE;
+            }
+            free(clean);
+            free(noisy);
+        }
+    }
+    else
+    {
+        static const char *noiseNames[] = { "white", "brown", "hum" };
+        static const float speechDb[] = { -35.0f, -18.0f };
+        static const float snrDb[] = { 0.0f, 5.0f, 10.0f, 20.0f };
+
+        long count = (long)ITEM_SECONDS * SAMPLE_RATE;
+        float *speech = (float *)malloc(count * sizeof(float));
+        float *noise = (float *)malloc(count * sizeof(float));
+        short *clean = (short *)malloc(count * sizeof(short));
+        short *noisy = (short *)malloc(count * sizeof(short));
+        if(speech == NULL || noise == NULL || clean == NULL || noisy == NULL)
+        {
+            fprintf(stderr, "Could not allocate benchmark buffers.\n");
+            return 127;
+        }
+
+        unsigned seed = 1;
+        synthSpeech(speech, count, &seed);
+        double speechRms = sqrt(energy(speech, count) / count);
+
+        for(int kind = 0; kind < 3; kind++)
+        {
+            synthNoise(noise, count, kind, &seed);
+            double noiseRms = sqrt(energy(noise, count) / count);
+            for(size_t l = 0; l < sizeof(speechDb) / sizeof(speechDb[0]); l++)
+            {
+                for(size_t s = 0; s < sizeof(snrDb) / sizeof(snrDb[0]); s++)
+                {
+                    double level = pow(10.0, speechDb[l] / 20.0) * 32768.0;
+                    double sg = level / speechRms;
+                    double ng = level / pow(10.0, snrDb[s] / 20.0) / noiseRms;
+                    for(long i = 0; i < count; i++)
+                    {
+                        double v = speech[i] * sg;
+                        double m = v + noise[i] * ng;
+                        clean[i] = (short)v;
+                        noisy[i] = (short)(m > 32767.0 ? 32767.0 : (m < -32768.0 ? -32768.0 : m));
+                    }
+                    char name[64];
+                    snprintf(name, sizeof(name), "%s_%+.0fdBFS_%.0fdB", noiseNames[kind], speechDb[l], snrDb[s]);
+                    processing += runItem(name, clean, noisy, count, &cfg, c);
+                    audio += (double)count / SAMPLE_RATE;
+                }
+            }
+        }
+        free(speech);
+        free(noise);
+        free(clean);
+        free(noisy);
+    }
+
+    printf("{\"bench\":\"cleanup\",\"seconds_audio\":%.1f,\"seconds\":%.6f,"
+           "\"samples_per_sec_per_core\":%.0f,\"realtime_factor\":%.1f}\n",
+           audio, processing, audio * SAMPLE_RATE / processing, audio / processing);
+
+    free(c);
+    return 0;
+}
@@ -0,0 +1,214 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "../src/aec.h"
+#include "../src/cleanup.h"
+#include "../src/mfcc.h"
+#include "../src/simd.h"
+
+#define SAMPLE_RATE     (16000)
+#define BLOCK           (16)            /* what recordCallback hands over */
+#define SECONDS         (60)
+
+/*
+ *  What the int16 <-> float conversions cost per second of audio.
+ *
+ *  The single-utterance path used to run int16 through echo
+ *  cancellation, clean-up and features, each stage converting to float
+ *  and (the first two) back: three conversions in and two out per
+ *  block. It now converts once as the block arrives (none with
+ *  capture_float) and quantizes once, dithered, after capture.
+ *
+ *      convert     the conversions alone: the old per-stage scalar loops
+ *                  against the SIMD kernels of the float path
+ *      chain       echo canceller (no playback), clean-up and features
+ *                  through the int16 API against the float API
+ *
+ *      convert_bench [seconds]
+ *
+ *  Times are microseconds per second of audio, best of three runs.
+ */
+
+/*------ OLD CONVERSIONS ------*/
+
+static void toFloat(float *y, const short *x, int n)
+{
+    for(int i = 0; i < n; i++)
+    {
+        y[i] = x[i] * (1.0f / 32768.0f);
+    }
+}
+
+static void toShort(short *y, const float *x, int n)
+{
+    for(int i = 0; i < n; i++)
+    {
+        float s = x[i] * 32768.0f;
+        y[i] = (short)lrintf(s > 32767.0f ? 32767.0f : (s < -32768.0f ? -32768.0f : s));
+    }
+}
+
+/*------ RUNS ------*/
+
+typedef struct
+{
+    const short    *pcm;        /* int16 capture */
+    const float    *audio;      /* float capture, the same signal */
+    short          *out;
+    float          *work;
+    long            count;
+    int             floatInput;
+    echoCanceller  *echo;
+    cleaner        *cleanup;
+    featExtractor  *features;
+}
+run;
+
+static void convertOld(run *r)
+{
+    float f[BLOCK];
+    short s[BLOCK];
+    for(long i = 0; i + BLOCK <= r->count; i += BLOCK)
+    {
+        memcpy(s, r->pcm + i, sizeof(s));
+        toFloat(f, s, BLOCK);           /* echo canceller */
+        toShort(s, f, BLOCK);
+        toFloat(f, s, BLOCK);           /* clean-up */
+        toShort(s, f, BLOCK);
+        toFloat(f, s, BLOCK);           /* features */
+        memcpy(r->out + i, s, sizeof(s));
+    }
+}
+
+static void convertFloat(run *r)
+{
+    simdDither dither;
+    simdDitherInit(&dither, 1);
+    if(!r->floatInput)
+    {
+        for(long i = 0; i + BLOCK <= r->count; i += BLOCK)
+        {
+            simdFromInt16(r->work + i, r->pcm + i, BLOCK);
+        }
+    }
+    simdQuantize(r->out, r->floatInput ? r->audio : r->work, (int)r->count, &dither);
+}
+
+static void chainOld(run *r)
+{
+    short s[BLOCK];
+    for(long i = 0; i + BLOCK <= r->count; i += BLOCK)
+    {
+        memcpy(s, r->pcm + i, sizeof(s));
+        aecCancel(r->echo, s, BLOCK, 0.0);
+        cleanProcess(r->cleanup, s, s, BLOCK);
+        featPush(r->features, s, BLOCK);
+        memcpy(r->out + i, s, sizeof(s));
+    }
+}
+
+static void chainFloat(run *r)
+{
+    simdDither dither;
+    simdDitherInit(&dither, 1);
+    for(long i = 0; i + BLOCK <= r->count; i += BLOCK)
+    {
+        float *f = r->work + i;
+        if(r->floatInput)
+        {
+            memcpy(f, r->audio + i, BLOCK * sizeof(float));
+        }
+        else
+        {
+            simdFromInt16(f, r->pcm + i, BLOCK);
+        }
+        aecCancelFloat(r->echo, f, BLOCK, 0.0);
+        cleanProcessFloat(r->cleanup, f, f, BLOCK);
+        featPushFloat(r->features, f, BLOCK);
+    }
+    simdQuantize(r->out, r->work, (int)r->count, &dither);
+}
+
+static double timeRun(void (*func)(run *), run *r, const cleanConfig *cfg)
+{
+    double best = 0.0;
+    for(int k = 0; k < 3; k++)
+    {
+        aecInit(r->echo, SAMPLE_RATE, SAMPLE_RATE / 20);
+        cleanInit(r->cleanup, cfg);
+        featInit(r->features);
+        double start = benchNow();
+        func(r);
+        double t = benchNow() - start;
+        best = k == 0 || t < best ? t : best;
+    }
+    return best * 1e6 * SAMPLE_RATE / r->count;
+}
+
+static void report(const char *mode, const char *path, double us, double baseline)
+{
+    printf("{\"bench\":\"convert\",\"mode\":\"%s\",\"path\":\"%s\",\"us_per_audio_s\":%.1f,"
+           "\"saved_us_per_audio_s\":%.1f}\n", mode, path, us, baseline - us);
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : SECONDS;
+    seconds = seconds > 0 ? seconds : SECONDS;
+
+    run r;
+    memset(&r, 0, sizeof(r));
+    r.count = (long)seconds * SAMPLE_RATE;
+    short *pcm = (short *)malloc(r.count * sizeof(short));
+    float *audio = (float *)malloc(r.count * sizeof(float));
+    r.out = (short *)malloc(r.count * sizeof(short));
+    r.work = (float *)malloc(r.count * sizeof(float));
+    r.echo = (echoCanceller *)malloc(sizeof(echoCanceller));
+    r.cleanup = (cleaner *)malloc(sizeof(cleaner));
+    r.features = (featExtractor *)malloc(sizeof(featExtractor));
+    if(pcm == NULL || audio == NULL || r.out == NULL || r.work == NULL || r.echo == NULL || r.cleanup == NULL
+       || r.features == NULL)
+    {
+        return 1;
+    }
+
+    /* A syllable-rate tone in noise, at speech level. */
+    unsigned seed = 1;
+    for(long i = 0; i < r.count; i++)
+    {
+        double envelope = 0.5 + 0.5 * sin(i * 2.0 * 3.14159265 * 4.0 / SAMPLE_RATE);
+        double x = 0.2 * envelope * sin(i * 0.07) + ((double)(benchRand(&seed) % 2000) - 1000.0) / 32768.0;
+        audio[i] = (float)x;
+        pcm[i] = (short)lrint(x * 32767.0);
+    }
+    r.pcm = pcm;
+    r.audio = audio;
+
+    cleanConfig cfg;
+    cleanDefaults(&cfg);
+
+    double old = timeRun(convertOld, &r, &cfg);
+    report("convert", "int16", old, old);
+    r.floatInput = 0;
+    report("convert", "float_int16_capture", timeRun(convertFloat, &r, &cfg), old);
+    r.floatInput = 1;
+    report("convert", "float_float_capture", timeRun(convertFloat, &r, &cfg), old);
+
+    r.floatInput = 0;
+    old = timeRun(chainOld, &r, &cfg);
+    report("chain", "int16", old, old);
+    report("chain", "float_int16_capture", timeRun(chainFloat, &r, &cfg), old);
+    r.floatInput = 1;
+    report("chain", "float_float_capture", timeRun(chainFloat, &r, &cfg), old);
+
+    free(r.features);
+    free(r.cleanup);
+    free(r.echo);
+    free(r.work);
+    free(r.out);
+    free(audio);
+    free(pcm);
+    return 0;
+}
@@ -0,0 +1,354 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "bench.h"
+#include "../include/sndfile.h"
+#include "../src/cleanup.h"
+#include "../src/config.h"
+#include "../src/intent.h"
+#include "../src/mfcc.h"
+#include "../src/net.h"
+#include "../src/recognizer.h"
+#include "../src/response.h"
+#include "../src/trim.h"
+
+#define SAMPLE_RATE     (16000)
+#define BLOCK           (16)            /* what recordCallback hands over */
+#define UTTER_SECONDS   (4)
+#define REC_PATH        "/speech-api/v2/recognize?lang=en-us"
+#define REMOTE_TIMEOUT  (10.0)
+#define CONFIG_FILE     "jarvis.conf"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/*
+ *  End-to-end throughput: N simulated users each push utterances through
+ *  the whole post-capture path, the way main.c runs it:
+ *
+ *      dsp         clean-up and feature extraction, in callback-sized blocks
+ *      trim        silence trimming before upload
+ *      recognize   FLAC encoding, HTTP upload and reply parsing
+ *      respond     intent matching and reply rendering
+ *
+ *      e2e_bench [-u users] [-n utterances] [-p port] [-d ms] [-e] [file.wav ...]
+ *
+ *  Recognition goes to a local mockrec (from bin/) answering after -d ms, which
+ *  is started and stopped here; with -e an already running server on the
+ *  port is used instead. Files (mono 16 kHz) are cycled through; without
+ *  them a synthetic utterance is used. One JSON line per stage with its
+ *  latency percentiles, then a summary with throughput, CPU and peak RSS.
+ */
+
+enum { STAGE_DSP, STAGE_TRIM, STAGE_RECOGNIZE, STAGE_RESPOND, STAGE_TOTAL, STAGE_COUNT };
+
+static const char *stageNames[STAGE_COUNT] = { "dsp", "trim", "recognize", "respond", "total" };
+
+typedef struct
+{
+    short      *samples;
+    long        count;
+}
+clip;
+
+typedef struct
+{
+    int             id;
+    int             utterances;
+    int             port;
+    const clip     *clips;
+    int             clipCount;
+    const config   *settings;
+    double         *latencies[STAGE_COUNT];     /* this user's rows */
+    int             recognized;
+    int             failed;
+}
+user;
+
+static void synthesize(clip *c, unsigned seed)
+{
+    c->count = (long)UTTER_SECONDS * SAMPLE_RATE;
+    c->samples = (short *)malloc(c->count * sizeof(short));
+    double phase = 0.0;
+    for(long i = 0; i < c->count; i++)
+    {
+        /* Half a second of silence either side, syllables in between. */
+        double t = (double)i / SAMPLE_RATE;
+        double envelope = t < 0.5 || t > UTTER_SECONDS - 0.5 ? 0.0 : pow(sin(M_PI * 4.0 * t), 2.0);
+        double pitch = 140.0 + 30.0 * sin(2.0 * M_PI * 0.7 * t);
+        phase += 2.0 * M_PI * pitch / SAMPLE_RATE;
+        double voiced = sin(phase) + 0.5 * sin(2.0 * phase) + 0.25 * sin(3.0 * phase);
+        double noise = (double)((int)(benchRand(&seed) % 2001) - 1000);
+        c->samples[i] = (short)(6000.0 * envelope * voiced + 0.3 * noise);
+    }
+}
+
+static int loadClip(clip *c, const char *path)
+{
+    SF_INFO info = { 0 };
+    SNDFILE *f = sf_open(path, SFM_READ, &info);
+    if(f == NULL || info.channels != 1 || info.frames <= 0)
+    {
+        if(f != NULL)
+        {
+            sf_close(f);
+        }
+        return -1;
+    }
+    c->samples = (short *)malloc((size_t)info.frames * sizeof(short));
+    c->count = c->samples != NULL ? (long)sf_read_short(f, c->samples, info.frames) : 0;
+    sf_close(f);
+    return c->count > 0 ? 0 : -1;
+}
+
+static void *runUser(void *arg)
+{
+    user *u = (user *)arg;
+    cleanConfig cfg;
+    trimConfig trimCfg;
+    cleaner *c = (cleaner *)malloc(sizeof(cleaner));
+    featExtractor *fx = (featExtractor *)malloc(sizeof(featExtractor));
+    responder replies;
+    volatile int cancel = 0;
+    recognizer *rec = recRemoteCreate("127.0.0.1", u->port, REC_PATH, REMOTE_TIMEOUT);
+
+    cleanDefaults(&cfg);
+    cleanConfigure(&cfg, u->settings);
+    trimDefaults(&trimCfg);
+    trimConfigure(&trimCfg, u->settings);
+    if(c == NULL || fx == NULL || rec == NULL || responderInit(&replies, 16, time(NULL)) != 0)
+    {
+        u->failed = u->utterances;
+        free(fx);
+        free(c);
+        recDestroy(rec);
+        return NULL;
+    }
+
+    long longest = 0;
+    for(int k = 0; k < u->clipCount; k++)
+    {
+        longest = u->clips[k].count > longest ? u->clips[k].count : longest;
+    }
+    short *cleaned = (short *)malloc(longest * sizeof(short));
+
+    for(int n = 0; n < u->utterances && cleaned != NULL; n++)
+    {
+        const clip *in = &u->clips[(u->id + n) % u->clipCount];
+        double stamp[STAGE_COUNT + 1];
+
+        stamp[0] = benchNow();
+        cleanInit(c, &cfg);
+        featInit(fx);
+        for(long i = 0; i < in->count; i += BLOCK)
+        {
+            long block = in->count - i < BLOCK ? in->count - i : BLOCK;
+            cleanProcess(c, &in->samples[i], &cleaned[i], block);
+            featPush(fx, &cleaned[i], block);
+        }
+
+        stamp[1] = benchNow();
+        trimResult trimmed;
+        int trimOk = trimUtterance(cleaned, in->count, SAMPLE_RATE, &trimCfg, &trimmed) == 0 && trimmed.count > 0;
+
+        stamp[2] = benchNow();
+        unsigned long frames = featRingWritten(&fx->ring);
+        unsigned long firstFrame = frames > FEAT_RING_FRAMES - 1 ? frames - (FEAT_RING_FRAMES - 1) : 0;
+        recUtterance utt =
+        {
+            .samples        =   trimOk ? trimmed.samples : cleaned,
+            .sampleCount    =   trimOk ? trimmed.count : in->count,
+            .sampleRate     =   SAMPLE_RATE,
+            .features       =   &fx->ring,
+            .firstFrame     =   firstFrame,
+            .frameCount     =   frames - firstFrame,
+            .deadline       =   0.0,
+        };
+        recResult result;
+        int status = recRun(rec, &utt, &cancel, &result);
+
+        stamp[3] = benchNow();
+        if(status == REC_OK)
+        {
+            respReply reply;
+            respondTo(&replies, intentMatch(result.text, NULL), result.text, time(NULL), &reply);
+            u->recognized++;
+        }
+        else
+        {
+            u->failed++;
+        }
+        stamp[4] = benchNow();
+        trimFree(&trimmed);
+
+        for(int s = 0; s < STAGE_TOTAL; s++)
+        {
+            u->latencies[s][n] = stamp[s + 1] - stamp[s];
+        }
+        u->latencies[STAGE_TOTAL][n] = stamp[4] - stamp[0];
+    }
+
+    free(cleaned);
+    responderFree(&replies);
+    recDestroy(rec);
+    free(fx);
+    free(c);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int users = 4, utterances = 8, port = 8099, delayMs = 50, external = 0;
+    int opt;
+    while((opt = getopt(argc, argv, "u:n:p:d:e")) != -1)
+    {
+        switch(opt)
+        {
+            case 'u': users = atoi(optarg); break;
+            case 'n': utterances = atoi(optarg); break;
+            case 'p': port = atoi(optarg); break;
+            case 'd': delayMs = atoi(optarg); break;
+            case 'e': external = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-u users] [-n utterances] [-p port] [-d ms] [-e] [file.wav ...]\n", argv[0]);
+                return 2;
+        }
+    }
+    if(users < 1 || utterances < 1)
+    {
+        fprintf(stderr, "Need at least one user and one utterance.\n");
+        return 2;
+    }
+
+    int clipCount = argc > optind ? argc - optind : 1;
+    clip *clips = (clip *)calloc((size_t)clipCount, sizeof(clip));
+    if(argc > optind)
+    {
+        for(int k = 0; k < clipCount; k++)
+        {
+            if(loadClip(&clips[k], argv[optind + k]) != 0)
+            {
+                fprintf(stderr, "Cannot read %s (mono 16 kHz expected).\n", argv[optind + k]);
+                return 1;
+            }
+        }
+    }
+    else
+    {
+        synthesize(&clips[0], 7);
+    }
+
+    config settings;
+    configLoad(&settings, CONFIG_FILE);
+
+    if(netStartup() != NET_OK)
+    {
+        fprintf(stderr, "Network startup failed.\n");
+        return 1;
+    }
+#ifndef _WIN32
+    pid_t mock = 0;
+    char delayText[16];
+    snprintf(delayText, sizeof(delayText), "%d", delayMs);
+    const char *options[] = { "-d", delayText, NULL };
+    if(!external && (mock = benchMockStart(argv[0], port, options)) < 0)
+    {
+        fprintf(stderr, "Could not start %s on port %d (build it with `make tools`, or use -e).\n",
+                BENCH_MOCK_BINARY, port);
+        return 1;
+    }
+#else
+    if(!external)
+    {
+        fprintf(stderr, "Start bin/%s -p %d yourself and pass -e.\n", BENCH_MOCK_BINARY, port);
+        return 1;
+    }
+#endif
+
+    long total = (long)users * utterances;
+    double *latencies[STAGE_COUNT];
+    for(int s = 0; s < STAGE_COUNT; s++)
+    {
+        latencies[s] = (double *)calloc((size_t)total, sizeof(double));
+    }
+    user *pool = (user *)calloc((size_t)users, sizeof(user));
+    pthread_t *threads = (pthread_t *)calloc((size_t)users, sizeof(pthread_t));
+
+    double cpuStart, cpuEnd;
+    long rss;
+    benchUsage(&cpuStart, &rss);
+    double start = benchNow();
+    for(int i = 0; i < users; i++)
+    {
+        pool[i].id = i;
+        pool[i].utterances = utterances;
+        pool[i].port = port;
+        pool[i].clips = clips;
+        pool[i].clipCount = clipCount;
+        pool[i].settings = &settings;
+        for(int s = 0; s < STAGE_COUNT; s++)
+        {
+            pool[i].latencies[s] = latencies[s] + (long)i * utterances;
+        }
+        pthread_create(&threads[i], NULL, runUser, &pool[i]);
+    }
+
+    int recognized = 0, failed = 0;
+    double audioSeconds = 0.0;
+    for(int i = 0; i < users; i++)
+    {
+        pthread_join(threads[i], NULL);
+        recognized += pool[i].recognized;
+        failed += pool[i].failed;
+        for(int n = 0; n < utterances; n++)
+        {
+            audioSeconds += (double)clips[(i + n) % clipCount].count / SAMPLE_RATE;
+        }
+    }
+    double elapsed = benchNow() - start;
+    benchUsage(&cpuEnd, &rss);
+
+#ifndef _WIN32
+    benchMockStop(mock);
+#endif
+
+    for(int s = 0; s < STAGE_COUNT; s++)
+    {
+        double sum = 0.0;
+        for(long i = 0; i < total; i++)
+        {
+            sum += latencies[s][i];
+        }
+        /* benchPercentile sorts, so the maximum is the last value afterwards. */
+        double p50 = benchPercentile(latencies[s], total, 0.50);
+        double p90 = benchPercentile(latencies[s], total, 0.90);
+        double p99 = benchPercentile(latencies[s], total, 0.99);
+        printf("{\"bench\":\"e2e\",\"stage\":\"%s\",\"count\":%ld,\"mean_ms\":%.3f,\"p50_ms\":%.3f,"
+               "\"p90_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f}\n",
+               stageNames[s], total, sum * 1000.0 / total, p50 * 1000.0, p90 * 1000.0, p99 * 1000.0,
+               latencies[s][total - 1] * 1000.0);
+    }
+    printf("{\"bench\":\"e2e\",\"users\":%d,\"utterances\":%ld,\"recognized\":%d,\"failed\":%d,"
+           "\"server_delay_ms\":%d,\"seconds\":%.3f,\"utterances_per_sec\":%.2f,\"audio_realtime_factor\":%.1f,"
+           "\"cpu_seconds\":%.3f,\"cpu_per_utterance_ms\":%.3f,\"max_rss_kb\":%ld}\n",
+           users, total, recognized, failed, external ? -1 : delayMs, elapsed, total / elapsed,
+           audioSeconds / elapsed, cpuEnd - cpuStart, (cpuEnd - cpuStart) * 1000.0 / total, rss);
+
+    for(int s = 0; s < STAGE_COUNT; s++)
+    {
+        free(latencies[s]);
+    }
+    for(int k = 0; k < clipCount; k++)
+    {
+        free(clips[k].samples);
+    }
+    free(clips);
+    free(threads);
+    free(pool);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,232 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "../src/evloop.h"
+#include "../src/flac.h"
+#include "../src/net.h"
+#include "../src/recognizer.h"
+
+#define SAMPLE_RATE     (16000)
+#define REQUESTS        (60)
+#define PORT            (8101)          /* primary; the hedge endpoint listens on the next port */
+#define REC_PATH        "/rec"
+#define DELAY_MS        (30)
+#define STALL_MS        (800)
+#define BUDGET          (2.0)           /* seconds per request, the deadline budget */
+#define TIGHT_BUDGET    (0.015)         /* shorter than DELAY_MS: every request must run out */
+#define DEADLINE_SLACK  (0.05)          /* how late a timed-out request may return */
+
+/*
+ *  Hedging, retries and the deadline budget of the remote recognizer,
+ *  against two local mockrec instances (from bin/):
+ *
+ *      primary     answers after DELAY_MS, but stalls 10% of requests for
+ *                  STALL_MS and answers 15% with 503
+ *      hedge       answers every request after DELAY_MS
+ *
+ *      hedge_bench [-n requests] [-p port]
+ *
+ *  The same requests go out through recRemoteSend (blocking) and
+ *  recRemoteSubmit (on an event loop). For each way, one run within
+ *  BUDGET must recognize every request. It must hedge, and the hedge
+ *  must win. It must retry the 503s. p99 must stay far below the stall,
+ *  so hedged losers are cancelled and not waited for. A second run with
+ *  a budget shorter than any answer must time out every request, and no
+ *  later than DEADLINE_SLACK past its deadline. One JSON line per run;
+ *  the exit status is 1 if any check fails.
+ */
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  finished;
+    int             done;
+    int             status;
+}
+submission;
+
+static void submitDone(void *ctx, int status, httpResponse *response)
+{
+    submission *s = (submission *)ctx;
+    if(status == REC_OK)
+    {
+        httpResponseFree(response);
+    }
+    pthread_mutex_lock(&s->lock);
+    s->status = status;
+    s->done = 1;
+    pthread_cond_signal(&s->finished);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* One request either way; returns its status. */
+static int sendOne(recognizer *rec, evLoop *loop, flacPayload *payload, double deadline)
+{
+    if(loop == NULL)
+    {
+        httpResponse response;
+        volatile int cancel = 0;
+        int status = recRemoteSend(rec, payload, SAMPLE_RATE, deadline, &cancel, &response);
+        if(status == REC_OK)
+        {
+            httpResponseFree(&response);
+        }
+        return status;
+    }
+    submission s;
+    memset(&s, 0, sizeof(s));
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.finished, NULL);
+    if(recRemoteSubmit(rec, loop, payload, SAMPLE_RATE, deadline, submitDone, &s) != REC_OK)
+    {
+        s.done = 1;
+        s.status = REC_ERROR;
+    }
+    pthread_mutex_lock(&s.lock);
+    while(!s.done)
+    {
+        pthread_cond_wait(&s.finished, &s.lock);
+    }
+    pthread_mutex_unlock(&s.lock);
+    pthread_cond_destroy(&s.finished);
+    pthread_mutex_destroy(&s.lock);
+    return s.status;
+}
+
+/* Runs count requests with the given budget and checks the outcome; returns 0 if it is as expected. */
+static int run(const char *mode, int port, evLoop *loop, flacPayload *payload, int count, double budget)
+{
+    recognizer *rec = recRemoteCreate("127.0.0.1", port, REC_PATH, 10.0);
+    double *latencies = (double *)calloc((size_t)count, sizeof(double));
+    if(rec == NULL || latencies == NULL || recRemoteAddEndpoint(rec, "127.0.0.1", port + 1, REC_PATH) != REC_OK)
+    {
+        fprintf(stderr, "Could not create the recognizer.\n");
+        return 1;
+    }
+    /* The fallback hedge delay only until enough latencies are known; well below the stall. */
+    recRemotePolicy policy = { 3, 0.02, 0.95, 0.1 };
+    recRemoteSetPolicy(rec, &policy);
+
+    int ok = 0, timeouts = 0;
+    double late = 0.0;
+    for(int i = 0; i < count; i++)
+    {
+        double start = benchNow();
+        double deadline = start + budget;
+        int status = sendOne(rec, loop, payload, deadline);
+        double end = benchNow();
+        latencies[i] = end - start;
+        ok += status == REC_OK;
+        timeouts += status == REC_TIMEOUT;
+        late = end - deadline > late ? end - deadline : late;
+    }
+
+    recRemoteStats st;
+    recRemoteGetStats(rec, &st);
+    double p50 = benchPercentile(latencies, count, 0.50);
+    double p99 = benchPercentile(latencies, count, 0.99);
+    int tight = budget < DELAY_MS / 1000.0;
+    const char *failure = NULL;
+    if(tight)
+    {
+        failure = ok != 0 || timeouts != count || (long)st.timeouts != count ? "not every request timed out"
+                  : late > DEADLINE_SLACK ? "a request returned well after its deadline" : NULL;
+    }
+    else
+    {
+        failure = ok != count ? "not every request was recognized"
+                  : st.hedges == 0 || st.hedgeWins == 0 ? "no hedge was sent or won"
+                  : st.retries == 0 ? "no failed attempt was retried"
+                  : st.timeouts != 0 ? "a request timed out"
+                  : p99 >= STALL_MS / 2000.0 ? "stalled attempts were waited for" : NULL;
+    }
+
+    printf("{\"bench\":\"hedge\",\"mode\":\"%s\",\"budget_ms\":%.0f,\"requests\":%d,\"ok\":%d,\"attempts\":%lu,"
+           "\"retries\":%lu,\"hedges\":%lu,\"hedge_wins\":%lu,\"timeouts\":%lu,\"p50_ms\":%.1f,\"p99_ms\":%.1f,"
+           "\"worst_overrun_ms\":%.1f,\"pass\":%s}\n",
+           mode, budget * 1000.0, count, ok, st.attempts, st.retries, st.hedges, st.hedgeWins, st.timeouts,
+           p50 * 1000.0, p99 * 1000.0, late > 0.0 ? late * 1000.0 : 0.0, failure == NULL ? "true" : "false");
+    if(failure != NULL)
+    {
+        fprintf(stderr, "hedge_bench %s: %s.\n", mode, failure);
+    }
+    recDestroy(rec);
+    free(latencies);
+    return failure != NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int count = REQUESTS, port = PORT;
+    int opt;
+    while((opt = getopt(argc, argv, "n:p:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n': count = atoi(optarg); break;
+            case 'p': port = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-n requests] [-p port]\n", argv[0]);
+                return 2;
+        }
+    }
+    count = count > 0 ? count : REQUESTS;
+
+#ifdef _WIN32
+    fprintf(stderr, "hedge_bench starts its servers with fork and does not run on Windows.\n");
+    return 0;
+#else
+    if(netStartup() != NET_OK)
+    {
+        fprintf(stderr, "Network startup failed.\n");
+        return 1;
+    }
+    char delayText[16], stallText[16];
+    snprintf(delayText, sizeof(delayText), "%d", DELAY_MS);
+    snprintf(stallText, sizeof(stallText), "%d", STALL_MS);
+    const char *flaky[] = { "-d", delayText, "-s", "0.1", "-S", stallText, "-f", "0.15", NULL };
+    const char *steady[] = { "-d", delayText, NULL };
+    pid_t primary = benchMockStart(argv[0], port, flaky);
+    pid_t hedge = benchMockStart(argv[0], port + 1, steady);
+    if(primary < 0 || hedge < 0)
+    {
+        fprintf(stderr, "Could not start %s on ports %d and %d (build it with `make tools`).\n",
+                BENCH_MOCK_BINARY, port, port + 1);
+        benchMockStop(primary);
+        benchMockStop(hedge);
+        return 1;
+    }
+
+    short *audio = (short *)malloc(SAMPLE_RATE * sizeof(short));
+    unsigned seed = 3;
+    for(int i = 0; audio != NULL && i < SAMPLE_RATE; i++)
+    {
+        audio[i] = (short)(3000.0 * sin(i * 0.07) + (double)(benchRand(&seed) % 600) - 300.0);
+    }
+    flacPayload *payload = audio != NULL ? flacPayloadCreate(audio, SAMPLE_RATE, SAMPLE_RATE) : NULL;
+    evLoop *loop = evLoopCreate(EV_BACKEND_AUTO);
+    int failed = 1;
+    if(payload != NULL && loop != NULL && evLoopSpawn(loop) == 0)
+    {
+        failed = run("blocking", port, NULL, payload, count, BUDGET)
+                 + run("blocking", port, NULL, payload, count / 4 + 1, TIGHT_BUDGET)
+                 + run("loop", port, loop, payload, count, BUDGET)
+                 + run("loop", port, loop, payload, count / 4 + 1, TIGHT_BUDGET);
+    }
+    else
+    {
+        fprintf(stderr, "Could not set up the requests.\n");
+    }
+
+    evLoopDestroy(loop);
+    flacPayloadRelease(payload);
+    free(audio);
+    benchMockStop(primary);
+    benchMockStop(hedge);
+    return failed ? 1 : 0;
+#endif
+}
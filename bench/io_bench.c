@@ -0,0 +1,388 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "../src/evloop.h"
+#include "../src/net.h"
+#include "../src/recognizer.h"
+
+#define REQUESTS        (200)
+#define DELAY_MS        (50.0)
+#define PORT            (8097)
+#define SAMPLE_RATE     (16000)
+#define HEADER_MAX      (2048)
+#define REPLY           "{\"status\":0,\"hypotheses\":[{\"utterance\":\"what time is it\",\"confidence\":0.9}]}\n"
+
+/*
+ *  Many recognition requests in flight at once, the load a server full
+ *  of sessions puts on the remote recognizer. The same N uploads of one
+ *  second of audio go to a local stand-in that answers each after a
+ *  fixed delay:
+ *
+ *      thread      recRemoteSend from a thread per request (each send
+ *                  runs its attempt on a thread of its own)
+ *      uring, epoll, poll
+ *                  recRemoteSubmit, all N on one event loop thread
+ *
+ *      io_bench [-n requests] [-d delay_ms] [-p port]
+ *
+ *  For each: wall time, requests per second, latency p50/p99, the
+ *  threads it took and the CPU time spent. The stand-in runs on an
+ *  event loop of its own, so it costs every mode the same. Loop modes
+ *  run first: max_rss_kb is the process peak so far.
+ */
+
+/*------ STAND-IN SERVER ------*/
+
+typedef struct
+{
+    evLoop     *loop;
+    double      delay;
+    int         listenFd;
+}
+server;
+
+typedef struct
+{
+    server     *owner;
+    int         fd;
+    char        header[HEADER_MAX + 1];
+    size_t      headerLength;
+    long        bodyLeft;           /* -1 until the header is complete */
+    const char *out;
+    size_t      outLength;
+    char        reply[256];
+}
+serverConn;
+
+static void connClose(serverConn *c)
+{
+    evUnwatch(c->owner->loop, c->fd);
+    netClose(c->fd);
+    free(c);
+}
+
+static void connWrite(evLoop *loop, int fd, int events, void *ctx)
+{
+    serverConn *c = (serverConn *)ctx;
+    (void)fd;
+    (void)events;
+    while(c->outLength > 0)
+    {
+        long n = netSendSome(c->fd, c->out, c->outLength);
+        if(n == NET_PENDING)
+        {
+            evWatch(loop, c->fd, EV_WRITE, connWrite, c);
+            return;
+        }
+        if(n < 0)
+        {
+            break;
+        }
+        c->out += n;
+        c->outLength -= (size_t)n;
+    }
+    connClose(c);
+}
+
+static void connReply(evLoop *loop, void *ctx)
+{
+    serverConn *c = (serverConn *)ctx;
+    int n = snprintf(c->reply, sizeof(c->reply),
+                     "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %d\r\n"
+                     "Connection: close\r\n\r\n%s", (int)strlen(REPLY), REPLY);
+    c->out = c->reply;
+    c->outLength = (size_t)n;
+    connWrite(loop, c->fd, EV_WRITE, c);
+}
+
+static void connRead(evLoop *loop, int fd, int events, void *ctx)
+{
+    serverConn *c = (serverConn *)ctx;
+    (void)fd;
+    (void)events;
+    for(;;)
+    {
+        char chunk[8192];
+        long n = netRecvSome(c->fd, chunk, sizeof(chunk));
+        if(n == NET_PENDING)
+        {
+            evWatch(loop, c->fd, EV_READ, connRead, c);
+            return;
+        }
+        if(n < 0)
+        {
+            connClose(c);
+            return;
+        }
+        if(c->bodyLeft < 0)
+        {
+            /* Header bytes go to the buffer, whatever follows counts against the body. */
+            size_t take = HEADER_MAX - c->headerLength < (size_t)n ? HEADER_MAX - c->headerLength : (size_t)n;
+            memcpy(c->header + c->headerLength, chunk, take);
+            c->headerLength += take;
+            c->header[c->headerLength] = '\0';
+            char *end = strstr(c->header, "\r\n\r\n");
+            if(end == NULL)
+            {
+                if(c->headerLength == HEADER_MAX)
+                {
+                    connClose(c);
+                    return;
+                }
+                continue;
+            }
+            const char *cl = strstr(c->header, "Content-Length:");
+            size_t headerEnd = (size_t)(end - c->header) + 4;
+            c->bodyLeft = (cl != NULL ? atol(cl + 15) : 0) - (long)(c->headerLength - headerEnd) - (n - (long)take);
+        }
+        else
+        {
+            c->bodyLeft -= n;
+        }
+        if(c->bodyLeft <= 0)
+        {
+            evTimerStart(loop, benchNow() + c->owner->delay, connReply, c);
+            return;
+        }
+    }
+}
+
+static void serverAccept(evLoop *loop, int fd, int events, void *ctx)
+{
+    server *s = (server *)ctx;
+    (void)events;
+    int client;
+    /* A deadline in the past: take what is queued, never wait. */
+    while((client = netAccept(fd, 0.0, NULL)) >= 0)
+    {
+        serverConn *c = (serverConn *)calloc(1, sizeof(serverConn));
+        if(c == NULL)
+        {
+            netClose(client);
+            continue;
+        }
+        c->owner = s;
+        c->fd = client;
+        c->bodyLeft = -1;
+        connRead(loop, client, EV_READ, c);
+    }
+    evWatch(loop, fd, EV_READ, serverAccept, s);
+}
+
+/*------ CLIENTS ------*/
+
+typedef struct
+{
+    recognizer         *remote;
+    flacPayload        *payload;
+    double             *latencies;
+    int                 count;
+    int                 ok;
+    int                 done;
+    pthread_mutex_t     lock;
+    pthread_cond_t      finished;
+}
+batch;
+
+typedef struct
+{
+    batch              *b;
+    int                 index;
+    double              started;
+}
+request;
+
+static void finishOne(batch *b, request *r, int status)
+{
+    pthread_mutex_lock(&b->lock);
+    b->latencies[r->index] = benchNow() - r->started;
+    b->ok += status == REC_OK;
+    if(++b->done == b->count)
+    {
+        pthread_cond_signal(&b->finished);
+    }
+    pthread_mutex_unlock(&b->lock);
+}
+
+static void *sendThread(void *arg)
+{
+    request *r = (request *)arg;
+    volatile int cancel = 0;
+    httpResponse response;
+    int status = recRemoteSend(r->b->remote, r->b->payload, SAMPLE_RATE, 0.0, &cancel, &response);
+    if(status == REC_OK)
+    {
+        httpResponseFree(&response);
+    }
+    finishOne(r->b, r, status);
+    return NULL;
+}
+
+static void submitDone(void *ctx, int status, httpResponse *response)
+{
+    request *r = (request *)ctx;
+    httpResponseFree(response);
+    finishOne(r->b, r, status);
+}
+
+static void waitAll(batch *b)
+{
+    pthread_mutex_lock(&b->lock);
+    while(b->done < b->count)
+    {
+        pthread_cond_wait(&b->finished, &b->lock);
+    }
+    pthread_mutex_unlock(&b->lock);
+}
+
+static void report(const char *mode, batch *b, int threads, double wall, double cpu)
+{
+    double cpuNow;
+    long rss;
+    benchUsage(&cpuNow, &rss);
+    double p50 = benchPercentile(b->latencies, b->count, 0.50) * 1000.0;
+    double p99 = benchPercentile(b->latencies, b->count, 0.99) * 1000.0;
+    printf("{\"bench\":\"io\",\"mode\":\"%s\",\"requests\":%d,\"ok\":%d,\"wall_ms\":%.1f,\"req_per_s\":%.1f,"
+           "\"p50_ms\":%.1f,\"p99_ms\":%.1f,\"threads\":%d,\"cpu_ms\":%.1f,\"max_rss_kb\":%ld}\n",
+           mode, b->count, b->ok, wall * 1000.0, wall > 0.0 ? b->count / wall : 0.0, p50, p99, threads,
+           (cpuNow - cpu) * 1000.0, rss);
+    fflush(stdout);
+}
+
+static void runBatch(batch *b, evBackend backend, request *requests)
+{
+    double cpu;
+    long rss;
+    pthread_t *threads = NULL;
+    evLoop *loop = NULL;
+    const char *mode = "thread";
+
+    if(backend != EV_BACKEND_AUTO)
+    {
+        if((loop = evLoopCreate(backend)) == NULL || evLoopSpawn(loop) != 0)
+        {
+            evLoopDestroy(loop);
+            return;
+        }
+        mode = evLoopBackendName(loop);
+    }
+    else if((threads = (pthread_t *)calloc((size_t)b->count, sizeof(pthread_t))) == NULL)
+    {
+        return;
+    }
+
+    b->ok = 0;
+    b->done = 0;
+    benchUsage(&cpu, &rss);
+    double start = benchNow();
+    int started = 0;
+    for(int i = 0; i < b->count; i++)
+    {
+        requests[i] = (request){ b, i, benchNow() };
+        if(loop != NULL)
+        {
+            if(recRemoteSubmit(b->remote, loop, b->payload, SAMPLE_RATE, 0.0, submitDone, &requests[i]) != REC_OK)
+            {
+                finishOne(b, &requests[i], REC_ERROR);
+            }
+        }
+        else if(pthread_create(&threads[started], NULL, sendThread, &requests[i]) == 0)
+        {
+            started++;
+        }
+        else
+        {
+            finishOne(b, &requests[i], REC_ERROR);
+        }
+    }
+    waitAll(b);
+    double wall = benchNow() - start;
+
+    for(int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    /* A send on a thread holds a caller thread and an attempt thread. */
+    report(mode, b, loop != NULL ? 1 : 2 * started, wall, cpu);
+    evLoopDestroy(loop);
+    free(threads);
+}
+
+int main(int argc, char **argv)
+{
+    int count = REQUESTS;
+    double delay = DELAY_MS;
+    int port = PORT;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        if(strcmp(argv[i], "-n") == 0)
+        {
+            count = atoi(argv[i + 1]);
+        }
+        else if(strcmp(argv[i], "-d") == 0)
+        {
+            delay = atof(argv[i + 1]);
+        }
+        else if(strcmp(argv[i], "-p") == 0)
+        {
+            port = atoi(argv[i + 1]);
+        }
+    }
+    count = count > 0 ? count : 1;
+
+    if(netStartup() != NET_OK)
+    {
+        return 1;
+    }
+    server s = { evLoopCreate(EV_BACKEND_AUTO), delay / 1000.0, netListen("127.0.0.1", port, 1024) };
+    if(s.loop == NULL || s.listenFd < 0 || evWatch(s.loop, s.listenFd, EV_READ, serverAccept, &s) != 0
+       || evLoopSpawn(s.loop) != 0)
+    {
+        fprintf(stderr, "Could not start the stand-in server on port %d.\n", port);
+        return 1;
+    }
+
+    short *audio = (short *)malloc(SAMPLE_RATE * sizeof(short));
+    unsigned seed = 1;
+    for(int i = 0; i < SAMPLE_RATE; i++)
+    {
+        audio[i] = (short)(3000.0 * sin(i * 0.07) + (double)(benchRand(&seed) % 600) - 300.0);
+    }
+
+    batch b;
+    memset(&b, 0, sizeof(b));
+    b.count = count;
+    b.payload = flacPayloadCreate(audio, SAMPLE_RATE, SAMPLE_RATE);
+    b.latencies = (double *)calloc((size_t)count, sizeof(double));
+    b.remote = recRemoteCreate("127.0.0.1", port, "/rec", 10.0);
+    request *requests = (request *)calloc((size_t)count, sizeof(request));
+    if(b.payload == NULL || b.latencies == NULL || b.remote == NULL || requests == NULL)
+    {
+        return 1;
+    }
+    /* One attempt each: retries and hedges would only blur the transport being compared. */
+    recRemotePolicy policy = { 1, 0.05, 0.95, 10.0 };
+    recRemoteSetPolicy(b.remote, &policy);
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_cond_init(&b.finished, NULL);
+
+    const evBackend backends[] = { EV_BACKEND_URING, EV_BACKEND_EPOLL, EV_BACKEND_POLL, EV_BACKEND_AUTO };
+    for(int i = 0; i < 4; i++)
+    {
+        runBatch(&b, backends[i], requests);
+    }
+
+    evLoopDestroy(s.loop);
+    netClose(s.listenFd);
+    pthread_cond_destroy(&b.finished);
+    pthread_mutex_destroy(&b.lock);
+    recDestroy(b.remote);
+    flacPayloadRelease(b.payload);
+    free(requests);
+    free(b.latencies);
+    free(audio);
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "bench.h"
+#include "../src/mempool.h"
+#include "../src/metrics.h"
+
+#define UPDATES         (4000000)
+#define MAX_THREADS     (8)
+#define SERIES          (64)            /* labelled series registered to render, about what Jarvis has */
+
+/*
+ *  Cost of a metric update on the updating thread, and of a scrape:
+ *
+ *      counter     metricInc
+ *      histogram   metricObserve into 11 buckets
+ *      threads     histogram updates from several threads on one series
+ *      scraped     the same while another thread renders the registry
+ *                  back to back, which must not slow the updates down
+ *
+ *      metrics_bench [updates] [threads]
+ *
+ *  Times are thread CPU nanoseconds per update, worst thread. Then the
+ *  render and file dump of the registry, in microseconds.
+ */
+
+static const double buckets[] = { 0.05, 0.1, 0.2, 0.3, 0.5, 0.75, 1.0, 1.5, 2.0, 3.0, 5.0 };
+
+typedef struct
+{
+    metric     *m;
+    long        updates;
+    int         histogram;
+    double      seconds;
+}
+worker;
+
+static double threadSeconds(void)
+{
+#ifdef _WIN32
+    return benchNow();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+static void *update(void *arg)
+{
+    worker *w = (worker *)arg;
+    unsigned seed = 11;
+    double start = threadSeconds();
+    for(long i = 0; i < w->updates; i++)
+    {
+        if(w->histogram)
+        {
+            metricObserve(w->m, (double)(benchRand(&seed) % 4000) * 0.001);
+        }
+        else
+        {
+            metricInc(w->m);
+        }
+    }
+    w->seconds = threadSeconds() - start;
+    return NULL;
+}
+
+static int scraping;
+
+static void *scrape(void *arg)
+{
+    long *renders = (long *)arg;
+    while(atomicLoad(&scraping))
+    {
+        size_t length;
+        memFree(metricsRender(&length));
+        (*renders)++;
+    }
+    return NULL;
+}
+
+static double run(metric *m, int histogram, int threads, long updates)
+{
+    worker w[MAX_THREADS];
+    pthread_t t[MAX_THREADS];
+    for(int i = 0; i < threads; i++)
+    {
+        w[i] = (worker){ m, updates, histogram, 0.0 };
+        pthread_create(&t[i], NULL, update, &w[i]);
+    }
+    double worst = 0.0;
+    for(int i = 0; i < threads; i++)
+    {
+        pthread_join(t[i], NULL);
+        worst = w[i].seconds > worst ? w[i].seconds : worst;
+    }
+    return worst * 1e9 / updates;
+}
+
+int main(int argc, char **argv)
+{
+    long updates = argc > 1 ? atol(argv[1]) : UPDATES;
+    int threads = argc > 2 ? atoi(argv[2]) : 4;
+    updates = updates > 0 ? updates : UPDATES;
+    threads = threads < 1 ? 1 : (threads > MAX_THREADS ? MAX_THREADS : threads);
+
+    int count = (int)(sizeof(buckets) / sizeof(buckets[0]));
+    metric *counter = metricCounter("bench_updates_total", "", "Bench counter.");
+    metric *histogram = metricHistogram("bench_seconds", "", "Bench histogram.", buckets, count);
+    for(int i = 0; i < SERIES; i++)
+    {
+        char labels[METRICS_LABELS_MAX];
+        snprintf(labels, sizeof(labels), "series=\"%d\"", i);
+        metricObserve(metricHistogram("bench_series_seconds", labels, "Bench series.", buckets, count), 0.1 * i);
+    }
+
+    printf("{\"bench\":\"metrics\",\"mode\":\"counter\",\"threads\":1,\"ns_per_update\":%.2f}\n",
+           run(counter, 0, 1, updates));
+    printf("{\"bench\":\"metrics\",\"mode\":\"histogram\",\"threads\":1,\"ns_per_update\":%.2f}\n",
+           run(histogram, 1, 1, updates));
+    printf("{\"bench\":\"metrics\",\"mode\":\"threads\",\"threads\":%d,\"ns_per_update\":%.2f}\n",
+           threads, run(histogram, 1, threads, updates));
+
+    long renders = 0;
+    pthread_t scraper;
+    atomicStore(&scraping, 1);
+    pthread_create(&scraper, NULL, scrape, &renders);
+    double perUpdate = run(histogram, 1, 1, updates);
+    atomicStore(&scraping, 0);
+    pthread_join(scraper, NULL);
+    printf("{\"bench\":\"metrics\",\"mode\":\"scraped\",\"threads\":1,\"ns_per_update\":%.2f,\"renders\":%ld}\n",
+           perUpdate, renders);
+
+    size_t length = 0;
+    double start = benchNow();
+    char *text = metricsRender(&length);
+    double render = benchNow() - start;
+    memFree(text);
+    start = benchNow();
+    int status = metricsDump("metrics_bench.prom");
+    double dump = benchNow() - start;
+    remove("metrics_bench.prom");
+    if(text == NULL || status != 0)
+    {
+        fprintf(stderr, "Could not render or write the metrics.\n");
+        return 1;
+    }
+    printf("{\"bench\":\"metrics\",\"mode\":\"render\",\"bytes\":%lu,\"render_us\":%.1f,\"dump_us\":%.1f}\n",
+           (unsigned long)length, render * 1e6, dump * 1e6);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "../src/mfcc.h"
+
+#define BENCH_SECONDS   (60)
+#define BLOCK           (16)
+
+int main(void)
+{
+    long total = (long)BENCH_SECONDS * FEAT_SAMPLE_RATE;
+    short *samples = (short *)malloc(total * sizeof(short));
+    featExtractor *fx = (featExtractor *)malloc(sizeof(featExtractor));
+
+    if(samples == NULL || fx == NULL)
+    {
+        fprintf(stderr, "Could not allocate benchmark buffers.\n");
+        return 127;
+    }
+
+    unsigned seed = 1;
+    for(long i = 0; i < total; i++)
+    {
+        double tone = 6000.0 * sin(2.0 * 3.14159265358979 * 440.0 * i / FEAT_SAMPLE_RATE);
+        samples[i] = (short)(tone + (int)(benchRand(&seed) % 2001) - 1000);
+    }
+
+    featInit(fx);
+
+    /* Fed in capture-sized blocks, exactly as recordCallback does. */
+    double start = benchNow();
+    for(long i = 0; i < total; i += BLOCK)
+    {
+        featPush(fx, samples + i, BLOCK);
+    }
+    double elapsed = benchNow() - start;
+
+    unsigned long frames = featRingWritten(&fx->ring);
+    printf("{\"bench\":\"mfcc\",\"frames\":%lu,\"seconds\":%.6f,"
+           "\"frames_per_sec_per_core\":%.0f,\"realtime_factor\":%.1f}\n",
+           frames, elapsed, frames / elapsed, BENCH_SECONDS / elapsed);
+
+    free(fx);
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,248 @@
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "../src/capture.h"
+#include "../src/flac.h"
+#include "../src/intent.h"
+#include "../src/json.h"
+#include "../src/ring.h"
+#include "../src/simd.h"
+
+#define SAMPLE_RATE     (16000)
+#define RING_SAMPLES    (200000000L)
+#define RING_BLOCK      (16)            /* what recordCallback hands over */
+#define RING_HANDOFF    (20000000L)
+#define SIMD_LENGTH     (1024)
+#define SIMD_CALLS      (2000000L)
+#define VAD_FRAMES      (50000000L)
+#define ENCODE_SECONDS  (30)
+#define JSON_PARSES     (2000000L)
+#define INTENT_MATCHES  (2000000L)
+
+/*
+ *  Microbenchmarks of the hot paths outside the DSP stages (those have
+ *  their own programs): sample ring, SIMD kernels, VAD, FLAC encoder,
+ *  JSON tokenizer and intent matcher. One JSON line per kernel.
+ */
+
+static volatile float sink;
+
+static void ringSameThread(void)
+{
+    sampleRing ring;
+    short block[RING_BLOCK] = { 0 };
+    sampleRingInit(&ring, 16384);
+
+    double start = benchNow();
+    for(long i = 0; i < RING_SAMPLES; i += RING_BLOCK)
+    {
+        sampleRingWrite(&ring, block, RING_BLOCK);
+        sampleRingRead(&ring, block, RING_BLOCK);
+    }
+    double elapsed = benchNow() - start;
+
+    printf("{\"bench\":\"micro\",\"name\":\"ring\",\"block\":%d,\"samples\":%ld,\"seconds\":%.6f,"
+           "\"ns_per_sample\":%.3f}\n",
+           RING_BLOCK, RING_SAMPLES, elapsed, elapsed * 1e9 / RING_SAMPLES);
+    sampleRingFree(&ring);
+}
+
+static void *ringProducer(void *arg)
+{
+    sampleRing *ring = (sampleRing *)arg;
+    short block[RING_BLOCK] = { 0 };
+    for(long sent = 0; sent < RING_HANDOFF; )
+    {
+        size_t n = sampleRingWrite(ring, block, RING_BLOCK);
+        sent += (long)n;
+        if(n == 0)
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/* Producer and consumer on different cores, as callback and worker are. */
+static void ringTwoThreads(void)
+{
+    sampleRing ring;
+    short block[256];
+    pthread_t producer;
+    sampleRingInit(&ring, 16384);
+
+    double start = benchNow();
+    pthread_create(&producer, NULL, ringProducer, &ring);
+    for(long got = 0; got < RING_HANDOFF; )
+    {
+        size_t n = sampleRingRead(&ring, block, 256);
+        got += (long)n;
+        if(n == 0)
+        {
+            sched_yield();
+        }
+    }
+    pthread_join(producer, NULL);
+    double elapsed = benchNow() - start;
+
+    printf("{\"bench\":\"micro\",\"name\":\"ring_threads\",\"block\":%d,\"samples\":%ld,\"seconds\":%.6f,"
+           "\"msamples_per_sec\":%.1f}\n",
+           RING_BLOCK, RING_HANDOFF, elapsed, RING_HANDOFF / elapsed / 1e6);
+    sampleRingFree(&ring);
+}
+
+static void simdKernels(void)
+{
+    float *a = (float *)malloc(SIMD_LENGTH * sizeof(float));
+    float *b = (float *)malloc(SIMD_LENGTH * sizeof(float));
+    float *y = (float *)malloc(SIMD_LENGTH * sizeof(float));
+    unsigned seed = 3;
+    for(int i = 0; i < SIMD_LENGTH; i++)
+    {
+        a[i] = (float)(benchRand(&seed) % 1000) / 1000.0f;
+        b[i] = (float)(benchRand(&seed) % 1000) / 1000.0f;
+    }
+
+    const char *names[] = { "simd_dot", "simd_mul", "simd_muladd", "simd_energy" };
+    const int flops[] = { 2, 1, 2, 2 };
+    for(int k = 0; k < 4; k++)
+    {
+        float acc = 0.0f;
+        double start = benchNow();
+        for(long c = 0; c < SIMD_CALLS; c++)
+        {
+            switch(k)
+            {
+                case 0: acc += simdDot(a, b, SIMD_LENGTH); break;
+                case 1: simdMul(y, a, b, SIMD_LENGTH); acc += y[c & (SIMD_LENGTH - 1)]; break;
+                case 2: simdMulAdd(y, a, 1e-9f, SIMD_LENGTH); acc += y[c & (SIMD_LENGTH - 1)]; break;
+                default: acc += simdEnergy(a, SIMD_LENGTH); break;
+            }
+        }
+        double elapsed = benchNow() - start;
+        sink = acc;
+        printf("{\"bench\":\"micro\",\"name\":\"%s\",\"length\":%d,\"calls\":%ld,\"seconds\":%.6f,"
+               "\"ns_per_call\":%.1f,\"gflops\":%.2f}\n",
+               names[k], SIMD_LENGTH, SIMD_CALLS, elapsed, elapsed * 1e9 / SIMD_CALLS,
+               (double)flops[k] * SIMD_LENGTH * SIMD_CALLS / elapsed / 1e9);
+    }
+    free(y);
+    free(b);
+    free(a);
+}
+
+static void vadFrames(void)
+{
+    vad v;
+    vadInit(&v);
+    unsigned seed = 5;
+    float energies[1024];
+    for(int i = 0; i < 1024; i++)
+    {
+        energies[i] = -12.0f + (i / 64 % 3 == 0 ? 6.0f : 0.0f) + (float)(benchRand(&seed) % 100) / 100.0f;
+    }
+
+    double start = benchNow();
+    for(long i = 0; i < VAD_FRAMES; i++)
+    {
+        vadUpdate(&v, energies[i & 1023]);
+    }
+    double elapsed = benchNow() - start;
+
+    printf("{\"bench\":\"micro\",\"name\":\"vad\",\"frames\":%ld,\"seconds\":%.6f,\"ns_per_frame\":%.2f,"
+           "\"snr_db\":%.1f}\n",
+           VAD_FRAMES, elapsed, elapsed * 1e9 / VAD_FRAMES, vadSnr(&v));
+}
+
+static void encoder(void)
+{
+    long count = (long)ENCODE_SECONDS * SAMPLE_RATE;
+    short *samples = (short *)malloc(count * sizeof(short));
+    unsigned seed = 9;
+    for(long i = 0; i < count; i++)
+    {
+        double voice = (i / 4000) % 2 ? 5000.0 * sin(2.0 * 3.14159265358979 * 180.0 * i / SAMPLE_RATE) : 0.0;
+        samples[i] = (short)(voice + (int)(benchRand(&seed) % 401) - 200);
+    }
+
+    flacBuffer out;
+    double start = benchNow();
+    int status = flacEncode(samples, count, SAMPLE_RATE, &out);
+    double elapsed = benchNow() - start;
+
+    printf("{\"bench\":\"micro\",\"name\":\"flac_encode\",\"seconds_audio\":%d,\"seconds\":%.6f,"
+           "\"realtime_factor\":%.1f,\"bytes\":%lu,\"ratio\":%.2f,\"ok\":%s}\n",
+           ENCODE_SECONDS, elapsed, ENCODE_SECONDS / elapsed, status == 0 ? (unsigned long)out.length : 0UL,
+           status == 0 && out.length > 0 ? (double)count * sizeof(short) / out.length : 0.0,
+           status == 0 ? "true" : "false");
+    if(status == 0)
+    {
+        flacBufferFree(&out);
+    }
+    free(samples);
+}
+
+static void json(void)
+{
+    const char *body = "{\"status\":0,\"id\":\"c2f1a0b4e5\",\"hypotheses\":[{\"utterance\":\"what time is it\","
+                       "\"confidence\":0.9132},{\"utterance\":\"what tie is it\"},{\"utterance\":\"watch time\"}]}";
+    size_t length = strlen(body);
+    jsonToken tokens[64];
+    char text[128];
+    long found = 0;
+
+    /* Tokenize plus the lookups parseHypothesis does. */
+    double start = benchNow();
+    for(long i = 0; i < JSON_PARSES; i++)
+    {
+        int count = jsonParse(body, length, tokens, 64);
+        int hyps = jsonObjectGet(body, tokens, count, 0, "hypotheses");
+        int first = jsonArrayGet(tokens, count, hyps, 0);
+        int utter = jsonObjectGet(body, tokens, count, first, "utterance");
+        found += jsonString(body, &tokens[utter], text, sizeof(text)) > 0;
+    }
+    double elapsed = benchNow() - start;
+
+    printf("{\"bench\":\"micro\",\"name\":\"json\",\"bytes\":%lu,\"parses\":%ld,\"seconds\":%.6f,"
+           "\"ns_per_parse\":%.1f,\"mb_per_sec\":%.1f,\"found\":%ld}\n",
+           (unsigned long)length, JSON_PARSES, elapsed, elapsed * 1e9 / JSON_PARSES,
+           length * (double)JSON_PARSES / elapsed / 1e6, found);
+}
+
+static void intents(void)
+{
+    const char *transcripts[] =
+    {
+        "what time is it", "hello jarvis", "what's the date today", "thank you",
+        "who are you", "how are you doing", "goodbye", "play some music please",
+    };
+    int n = (int)(sizeof(transcripts) / sizeof(transcripts[0]));
+    long matched = 0;
+
+    double start = benchNow();
+    for(long i = 0; i < INTENT_MATCHES; i++)
+    {
+        matched += intentMatch(transcripts[i % n], NULL) != INTENT_UNKNOWN;
+    }
+    double elapsed = benchNow() - start;
+
+    printf("{\"bench\":\"micro\",\"name\":\"intent\",\"matches\":%ld,\"seconds\":%.6f,\"ns_per_match\":%.1f,"
+           "\"matched_fraction\":%.3f}\n",
+           INTENT_MATCHES, elapsed, elapsed * 1e9 / INTENT_MATCHES, (double)matched / INTENT_MATCHES);
+}
+
+int main(void)
+{
+    ringSameThread();
+    ringTwoThreads();
+    simdKernels();
+    vadFrames();
+    encoder();
+    json();
+    intents();
+    return 0;
+}
@@ -0,0 +1,440 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "../src/atomics.h"
+#include "../src/scheduler.h"
+
+#define JOBS            (4000)
+#define SHORT_US        (50.0)
+#define LONG_US         (20000.0)
+#define LONG_EVERY      (100)           /* one job in this many is long */
+#define SPLIT_EVERY     (40)            /* one in this many splits into children */
+#define SPLIT_CHILDREN  (8)
+#define THREAD_JOBS     (1000)          /* thread-per-task only runs this many */
+
+/*
+ *  Scheduling of skewed batch work, the shape transcribe and grammar
+ *  loading produce: mostly short jobs, a few very long ones, and some
+ *  that split into children. Three ways of running the same jobs:
+ *
+ *      thread      one thread per job (the old pattern), joined at the end
+ *      shared      a fixed pool taking jobs from one mutex-protected queue
+ *      steal       the work-stealing scheduler (src/scheduler.h)
+ *
+ *      sched_bench [-w workers] [-n jobs]
+ *
+ *  For each: makespan, core utilisation (CPU time over cores x wall
+ *  time) and the completion time of the jobs, p50/p99/max since the
+ *  batch started.
+ */
+
+typedef struct
+{
+    double      work;               /* microseconds of compute */
+    int         children;
+    double      finished;
+}
+job;
+
+typedef struct
+{
+    job        *jobs;
+    int         count;
+    double      spinsPerUs;
+}
+workload;
+
+static volatile double sink;
+
+/* Burns roughly us microseconds of CPU; the same arithmetic in every mode. */
+static void spin(const workload *w, double us)
+{
+    long n = (long)(us * w->spinsPerUs);
+    double x = 1.0;
+    for(long i = 0; i < n; i++)
+    {
+        x = x * 1.0000001 + 1e-9;
+    }
+    sink = x;
+}
+
+static void calibrate(workload *w)
+{
+    w->spinsPerUs = 100.0;
+    double start = benchNow();
+    spin(w, 100000.0);
+    double elapsed = benchNow() - start;
+    w->spinsPerUs = 100.0 * 0.1 / (elapsed > 0.0 ? elapsed : 0.1);
+}
+
+static void makeJobs(workload *w, int count)
+{
+    unsigned seed = 12345;
+    w->count = count;
+    w->jobs = (job *)calloc((size_t)count, sizeof(job));
+    for(int i = 0; i < count; i++)
+    {
+        unsigned r = benchRand(&seed);
+        w->jobs[i].work = r % LONG_EVERY == 0 ? LONG_US : SHORT_US * (0.5 + (double)(r % 1000) / 1000.0);
+        w->jobs[i].children = r % SPLIT_EVERY == 1 ? SPLIT_CHILDREN : 0;
+    }
+}
+
+/* A split job does its share, then its children do an equal share each. */
+static double childWork(const job *j)
+{
+    return j->work * 4.0 / SPLIT_CHILDREN;
+}
+
+/*------ THREAD PER TASK ------*/
+
+typedef struct
+{
+    const workload *w;
+    job            *j;
+    double          us;
+}
+threadArg;
+
+static void *childThread(void *arg)
+{
+    threadArg *a = (threadArg *)arg;
+    spin(a->w, a->us);
+    return NULL;
+}
+
+static void *jobThread(void *arg)
+{
+    threadArg *a = (threadArg *)arg;
+    spin(a->w, a->j->work);
+    pthread_t children[SPLIT_CHILDREN];
+    threadArg childArgs[SPLIT_CHILDREN];
+    int started = 0;
+    for(int c = 0; c < a->j->children; c++)
+    {
+        childArgs[c] = (threadArg){ a->w, a->j, childWork(a->j) };
+        if(pthread_create(&children[started], NULL, childThread, &childArgs[c]) == 0)
+        {
+            started++;
+        }
+        else
+        {
+            spin(a->w, childArgs[c].us);
+        }
+    }
+    for(int c = 0; c < started; c++)
+    {
+        pthread_join(children[c], NULL);
+    }
+    a->j->finished = benchNow();
+    return NULL;
+}
+
+static void runThreads(workload *w)
+{
+    pthread_t *threads = (pthread_t *)malloc(w->count * sizeof(pthread_t));
+    threadArg *args = (threadArg *)malloc(w->count * sizeof(threadArg));
+    char *ok = (char *)calloc((size_t)w->count, 1);
+    for(int i = 0; i < w->count; i++)
+    {
+        args[i] = (threadArg){ w, &w->jobs[i], 0.0 };
+        ok[i] = pthread_create(&threads[i], NULL, jobThread, &args[i]) == 0;
+        if(!ok[i])
+        {
+            jobThread(&args[i]);
+        }
+    }
+    for(int i = 0; i < w->count; i++)
+    {
+        if(ok[i])
+        {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    free(ok);
+    free(args);
+    free(threads);
+}
+
+/*------ SHARED QUEUE ------*/
+
+typedef struct
+{
+    job        *j;              /* NULL for a child */
+    double      us;
+    int        *parentLeft;
+}
+sharedItem;
+
+typedef struct
+{
+    workload       *w;
+    sharedItem     *items;          /* big enough for every job and child */
+    int             head;
+    int             tail;
+    int             outstanding;    /* queued or running */
+    pthread_mutex_t lock;
+    pthread_cond_t  ready;
+    int            *left;           /* children still running, per job */
+}
+sharedPool;
+
+static void sharedPush(sharedPool *p, sharedItem item)
+{
+    pthread_mutex_lock(&p->lock);
+    p->items[p->tail++] = item;
+    p->outstanding++;
+    pthread_cond_signal(&p->ready);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void *sharedThread(void *arg)
+{
+    sharedPool *p = (sharedPool *)arg;
+    for(;;)
+    {
+        pthread_mutex_lock(&p->lock);
+        while(p->head == p->tail && p->outstanding > 0)
+        {
+            pthread_cond_wait(&p->ready, &p->lock);
+        }
+        if(p->head == p->tail)
+        {
+            pthread_mutex_unlock(&p->lock);
+            return NULL;
+        }
+        sharedItem item = p->items[p->head++];
+        pthread_mutex_unlock(&p->lock);
+
+        if(item.j != NULL)
+        {
+            spin(p->w, item.j->work);
+            int index = (int)(item.j - p->w->jobs);
+            p->left[index] = item.j->children;
+            for(int c = 0; c < item.j->children; c++)
+            {
+                sharedPush(p, (sharedItem){ NULL, childWork(item.j), &p->left[index] });
+            }
+            if(item.j->children == 0)
+            {
+                item.j->finished = benchNow();
+            }
+        }
+        else
+        {
+            spin(p->w, item.us);
+            if(atomicAdd(item.parentLeft, -1) == 0)
+            {
+                p->w->jobs[item.parentLeft - p->left].finished = benchNow();
+            }
+        }
+
+        pthread_mutex_lock(&p->lock);
+        if(--p->outstanding == 0)
+        {
+            pthread_cond_broadcast(&p->ready);
+        }
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+static void runShared(workload *w, int workers)
+{
+    sharedPool p;
+    memset(&p, 0, sizeof(p));
+    p.w = w;
+    p.items = (sharedItem *)malloc((size_t)w->count * (SPLIT_CHILDREN + 1) * sizeof(sharedItem));
+    p.left = (int *)calloc((size_t)w->count, sizeof(int));
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.ready, NULL);
+    for(int i = 0; i < w->count; i++)
+    {
+        p.items[p.tail++] = (sharedItem){ &w->jobs[i], 0.0, NULL };
+    }
+    p.outstanding = p.tail;
+
+    pthread_t *threads = (pthread_t *)malloc(workers * sizeof(pthread_t));
+    int started = 0;
+    for(int i = 0; i < workers; i++)
+    {
+        started += pthread_create(&threads[started], NULL, sharedThread, &p) == 0;
+    }
+    if(started == 0)
+    {
+        sharedThread(&p);
+    }
+    for(int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_cond_destroy(&p.ready);
+    pthread_mutex_destroy(&p.lock);
+    free(threads);
+    free(p.left);
+    free(p.items);
+}
+
+/*------ WORK STEALING ------*/
+
+typedef struct
+{
+    workload   *w;
+    scheduler  *pool;
+    schedGroup *group;
+    job        *j;
+    double      us;
+    int        *left;
+}
+stealArg;
+
+static void stealChild(void *arg)
+{
+    stealArg *a = (stealArg *)arg;
+    spin(a->w, a->us);
+    if(atomicAdd(a->left, -1) == 0)
+    {
+        a->j->finished = benchNow();
+    }
+}
+
+static void stealJob(void *arg)
+{
+    stealArg *a = (stealArg *)arg;
+    spin(a->w, a->j->work);
+    if(a->j->children == 0)
+    {
+        a->j->finished = benchNow();
+        return;
+    }
+    *a->left = a->j->children;
+    for(int c = 0; c < a->j->children; c++)
+    {
+        stealArg *child = &a[1 + c];
+        *child = *a;
+        child->us = childWork(a->j);
+        if(schedSubmit(a->pool, a->group, stealChild, child) != 0)
+        {
+            stealChild(child);
+        }
+    }
+}
+
+static int runStealing(workload *w, int workers, schedStats *stats)
+{
+    scheduler pool;
+    schedGroup group;
+    if(schedInit(&pool, workers) != 0)
+    {
+        return -1;
+    }
+    schedGroupInit(&group);
+    stealArg *args = (stealArg *)malloc((size_t)w->count * (SPLIT_CHILDREN + 1) * sizeof(stealArg));
+    int *left = (int *)calloc((size_t)w->count, sizeof(int));
+    for(int i = 0; i < w->count; i++)
+    {
+        stealArg *a = &args[i * (SPLIT_CHILDREN + 1)];
+        *a = (stealArg){ w, &pool, &group, &w->jobs[i], 0.0, &left[i] };
+        if(schedSubmit(&pool, &group, stealJob, a) != 0)
+        {
+            stealJob(a);
+        }
+    }
+    schedWait(&pool, &group);
+    schedGetStats(&pool, stats);
+    schedFree(&pool);
+    schedGroupDestroy(&group);
+    free(left);
+    free(args);
+    return 0;
+}
+
+/*------ MAIN ------*/
+
+typedef struct
+{
+    double      wall;
+    double      cpu;
+}
+mark;
+
+static mark markNow(void)
+{
+    mark m;
+    long rss;
+    benchUsage(&m.cpu, &rss);
+    m.wall = benchNow();
+    return m;
+}
+
+static void report(const char *mode, const workload *w, int workers, mark from, const schedStats *stats)
+{
+    mark to = markNow();
+    double wall = to.wall - from.wall;
+    double *done = (double *)malloc(w->count * sizeof(double));
+    for(int i = 0; i < w->count; i++)
+    {
+        done[i] = (w->jobs[i].finished - from.wall) * 1000.0;
+    }
+    double p50 = benchPercentile(done, w->count, 0.50);
+    double p99 = benchPercentile(done, w->count, 0.99);
+    double max = benchPercentile(done, w->count, 1.0);
+    free(done);
+
+    printf("{\"bench\":\"sched\",\"mode\":\"%s\",\"workers\":%d,\"jobs\":%d,\"makespan_ms\":%.3f,"
+           "\"utilization\":%.3f,\"done_p50_ms\":%.3f,\"done_p99_ms\":%.3f,\"done_max_ms\":%.3f",
+           mode, workers, w->count, wall * 1000.0, wall > 0.0 ? (to.cpu - from.cpu) / (schedCores() * wall) : 0.0,
+           p50, p99, max);
+    if(stats != NULL)
+    {
+        printf(",\"steals\":%lu,\"stolen\":%lu,\"parks\":%lu,\"max_wait_ms\":%.3f",
+               stats->steals, stats->stolen, stats->parks, stats->maxWaitSeconds * 1000.0);
+    }
+    printf("}\n");
+}
+
+int main(int argc, char **argv)
+{
+    int workers = schedCores();
+    int count = JOBS;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        if(strcmp(argv[i], "-w") == 0)
+        {
+            workers = atoi(argv[i + 1]);
+        }
+        else if(strcmp(argv[i], "-n") == 0)
+        {
+            count = atoi(argv[i + 1]);
+        }
+    }
+    workers = workers > 0 ? (workers > SCHED_MAX_WORKERS ? SCHED_MAX_WORKERS : workers) : 1;
+    count = count > 0 ? count : 1;
+
+    workload w;
+    calibrate(&w);
+
+    /* Thread per task gets a smaller batch: thousands of live threads measure the kernel, not the job mix. */
+    makeJobs(&w, count < THREAD_JOBS ? count : THREAD_JOBS);
+    mark from = markNow();
+    runThreads(&w);
+    report("thread", &w, w.count, from, NULL);
+    free(w.jobs);
+
+    makeJobs(&w, count);
+    from = markNow();
+    runShared(&w, workers);
+    report("shared", &w, workers, from, NULL);
+    free(w.jobs);
+
+    schedStats stats;
+    makeJobs(&w, count);
+    from = markNow();
+    if(runStealing(&w, workers, &stats) == 0)
+    {
+        report("steal", &w, workers, from, &stats);
+    }
+    free(w.jobs);
+    return 0;
+}
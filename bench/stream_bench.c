@@ -0,0 +1,331 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+#include "bench.h"
+#include "../src/evloop.h"
+#include "../src/flac.h"
+#include "../src/net.h"
+#include "../src/notify.h"
+#include "../src/recognizer.h"
+
+#define SAMPLE_RATE     (16000)
+#define BLOCK           (SAMPLE_RATE / 50)      /* 20 ms, sent as it is captured */
+#define UTTER_SECONDS   (2)
+#define REC_PATH        "/speech-api/v2/recognize?lang=en-us"
+#define STREAM_PATH     "/stream"
+#define REMOTE_TIMEOUT  (10.0)
+#define MOCK_BINARY     "mockrec"               /* next to this program */
+#define MOCK_STARTUP    (5.0)
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/*
+ *  Time from the end of speech to the final transcript, uploading the
+ *  whole utterance as FLAC afterwards against streaming it while it is
+ *  spoken (recognizer_stream):
+ *
+ *      upload      FLAC encoding, then the HTTP upload and its reply
+ *      stream      the last block and the end message, then the final
+ *
+ *      stream_bench [-n utterances] [-p port] [-d ms] [-F ms] [-x speed]
+ *
+ *  The mockrec started here (from bin/) answers an upload after -d ms,
+ *  which stands for recognizing the whole utterance at once, and a
+ *  stream's end after -F ms, what is left once the audio has been
+ *  recognized as it arrived. Audio is streamed at -x times real time.
+ *  One JSON line per mode with its percentiles; the stream line also
+ *  has the time from the first audio to the first partial.
+ */
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    notifier        done;
+    double          firstPartial;
+    double          final;
+    int             status;
+}
+waiter;
+
+static void synthesize(short *samples, long count, unsigned seed)
+{
+    double phase = 0.0;
+    for(long i = 0; i < count; i++)
+    {
+        /* A quarter second of silence either side, syllables in between. */
+        double t = (double)i / SAMPLE_RATE;
+        double envelope = t < 0.25 || t > UTTER_SECONDS - 0.25 ? 0.0 : pow(sin(M_PI * 4.0 * t), 2.0);
+        double pitch = 140.0 + 30.0 * sin(2.0 * M_PI * 0.7 * t);
+        phase += 2.0 * M_PI * pitch / SAMPLE_RATE;
+        double voiced = sin(phase) + 0.5 * sin(2.0 * phase) + 0.25 * sin(3.0 * phase);
+        double noise = (double)((int)(benchRand(&seed) % 2001) - 1000);
+        samples[i] = (short)(6000.0 * envelope * voiced + 0.3 * noise);
+    }
+}
+
+static void sleepFor(double seconds)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - (double)ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+}
+
+/* Loop thread of the stream. */
+static void onResult(void *ctx, const recResult *result, int final)
+{
+    waiter *w = (waiter *)ctx;
+    pthread_mutex_lock(&w->lock);
+    if(!final && w->firstPartial == 0.0)
+    {
+        w->firstPartial = benchNow();
+    }
+    if(final)
+    {
+        w->final = benchNow();
+        w->status = result->status;
+    }
+    pthread_mutex_unlock(&w->lock);
+    if(final)
+    {
+        notifySignal(&w->done);
+    }
+}
+
+static int upload(recognizer *rec, const short *samples, long count, double *latency)
+{
+    volatile int cancel = 0;
+    double ended = benchNow();
+    flacPayload *payload = flacPayloadCreate(samples, count, SAMPLE_RATE);
+    if(payload == NULL)
+    {
+        return REC_ERROR;
+    }
+    httpResponse response;
+    int status = recRemoteSend(rec, payload, SAMPLE_RATE, ended + REMOTE_TIMEOUT, &cancel, &response);
+    flacPayloadRelease(payload);
+    if(status == REC_OK)
+    {
+        recResult result;
+        status = recRemoteParse(response.body, response.bodyLength, &result);
+        httpResponseFree(&response);
+    }
+    *latency = benchNow() - ended;
+    return status;
+}
+
+static int stream(recStream *s, const short *samples, long count, double speed, double *latency,
+                  double *firstPartial)
+{
+    waiter w;
+    memset(&w, 0, sizeof(w));
+    pthread_mutex_init(&w.lock, NULL);
+    notifyInit(&w.done);
+
+    double begun = benchNow();
+    unsigned long id = recStreamBegin(s, onResult, &w);
+    for(long i = 0; id != 0 && i < count; i += BLOCK)
+    {
+        recStreamAudio(s, id, samples + i, count - i < BLOCK ? count - i : BLOCK);
+        sleepFor((double)BLOCK / SAMPLE_RATE / speed);
+    }
+    double ended = benchNow();
+    if(id == 0 || recStreamEnd(s, id, ended + REMOTE_TIMEOUT) != REC_OK)
+    {
+        w.status = REC_ERROR;
+    }
+    else
+    {
+        for(;;)
+        {
+            unsigned seen = notifyPrepare(&w.done);
+            pthread_mutex_lock(&w.lock);
+            int done = w.final != 0.0;
+            pthread_mutex_unlock(&w.lock);
+            if(done)
+            {
+                break;
+            }
+            notifyWait(&w.done, seen, 0.1);
+        }
+    }
+
+    *latency = w.final != 0.0 ? w.final - ended : 0.0;
+    *firstPartial = w.firstPartial != 0.0 ? w.firstPartial - begun : 0.0;
+    notifyFree(&w.done);
+    pthread_mutex_destroy(&w.lock);
+    return w.status;
+}
+
+#ifndef _WIN32
+static pid_t startMock(const char *self, int port, int delayMs, int finalMs)
+{
+    char path[512];
+    const char *slash = strrchr(self, '/');
+    snprintf(path, sizeof(path), "%.*s%s", slash != NULL ? (int)(slash - self + 1) : 0, self, MOCK_BINARY);
+    char portText[16], delayText[16], finalText[16];
+    snprintf(portText, sizeof(portText), "%d", port);
+    snprintf(delayText, sizeof(delayText), "%d", delayMs);
+    snprintf(finalText, sizeof(finalText), "%d", finalMs);
+
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        if(freopen("/dev/null", "w", stdout) == NULL)
+        {
+            _exit(127);
+        }
+        execl(path, path, "-p", portText, "-d", delayText, "-F", finalText, (char *)NULL);
+        _exit(127);
+    }
+    if(pid < 0)
+    {
+        return -1;
+    }
+
+    double deadline = benchNow() + MOCK_STARTUP;
+    while(benchNow() < deadline)
+    {
+        int fd = netConnect("127.0.0.1", port, benchNow() + 0.5, NULL);
+        if(fd >= 0)
+        {
+            netClose(fd);
+            return pid;
+        }
+        if(waitpid(pid, NULL, WNOHANG) == pid)
+        {
+            return -1;
+        }
+        sleepFor(0.02);
+    }
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+static void stopMock(pid_t pid)
+{
+    if(pid > 0)
+    {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+}
+#endif
+
+static void report(const char *mode, double *latencies, int count, int failed, double *partials)
+{
+    double sum = 0.0;
+    for(int i = 0; i < count; i++)
+    {
+        sum += latencies[i];
+    }
+    double p50 = benchPercentile(latencies, count, 0.50);
+    double p90 = benchPercentile(latencies, count, 0.90);
+    printf("{\"bench\":\"stream\",\"mode\":\"%s\",\"count\":%d,\"failed\":%d,\"mean_ms\":%.1f,\"p50_ms\":%.1f,"
+           "\"p90_ms\":%.1f,\"max_ms\":%.1f", mode, count, failed, count ? sum * 1000.0 / count : 0.0,
+           p50 * 1000.0, p90 * 1000.0, count ? latencies[count - 1] * 1000.0 : 0.0);
+    if(partials != NULL)
+    {
+        printf(",\"first_partial_p50_ms\":%.1f", benchPercentile(partials, count, 0.50) * 1000.0);
+    }
+    printf("}\n");
+}
+
+int main(int argc, char **argv)
+{
+    int utterances = 5, port = 8098, delayMs = 300, finalMs = 30;
+    double speed = 4.0;
+    int opt;
+    while((opt = getopt(argc, argv, "n:p:d:F:x:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n': utterances = atoi(optarg); break;
+            case 'p': port = atoi(optarg); break;
+            case 'd': delayMs = atoi(optarg); break;
+            case 'F': finalMs = atoi(optarg); break;
+            case 'x': speed = atof(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-n utterances] [-p port] [-d ms] [-F ms] [-x speed]\n", argv[0]);
+                return 2;
+        }
+    }
+    utterances = utterances > 0 ? utterances : 1;
+    speed = speed > 0.0 ? speed : 1.0;
+
+    long count = (long)UTTER_SECONDS * SAMPLE_RATE;
+    short *samples = (short *)malloc(count * sizeof(short));
+    double *uploads = (double *)calloc((size_t)utterances, sizeof(double));
+    double *streams = (double *)calloc((size_t)utterances, sizeof(double));
+    double *partials = (double *)calloc((size_t)utterances, sizeof(double));
+    if(samples == NULL || uploads == NULL || streams == NULL || partials == NULL)
+    {
+        return 1;
+    }
+    synthesize(samples, count, 7);
+
+    if(netStartup() != NET_OK)
+    {
+        fprintf(stderr, "Network startup failed.\n");
+        return 1;
+    }
+#ifndef _WIN32
+    pid_t mock = startMock(argv[0], port, delayMs, finalMs);
+    if(mock < 0)
+    {
+        fprintf(stderr, "Could not start %s on port %d (build it with `make tools`).\n", MOCK_BINARY, port);
+        return 1;
+    }
+#else
+    fprintf(stderr, "Needs fork() to start %s.\n", MOCK_BINARY);
+    return 1;
+#endif
+
+    recognizer *rec = recRemoteCreate("127.0.0.1", port, REC_PATH, REMOTE_TIMEOUT);
+    evLoop *loop = evLoopCreate(EV_BACKEND_AUTO);
+    recStream *s = NULL;
+    if(rec == NULL || loop == NULL || evLoopSpawn(loop) != 0
+       || (s = recStreamCreate(loop, "127.0.0.1", port, STREAM_PATH, SAMPLE_RATE)) == NULL)
+    {
+        fprintf(stderr, "Could not set up the recognizers.\n");
+        return 1;
+    }
+
+    int uploadFailed = 0, streamFailed = 0;
+    for(int n = 0; n < utterances; n++)
+    {
+        uploadFailed += upload(rec, samples, count, &uploads[n]) != REC_OK;
+        streamFailed += stream(s, samples, count, speed, &streams[n], &partials[n]) != REC_OK;
+    }
+
+    recStreamStats st;
+    recStreamGetStats(s, &st);
+    recStreamDestroy(s);
+    evLoopDestroy(loop);
+    recDestroy(rec);
+#ifndef _WIN32
+    stopMock(mock);
+#endif
+
+    report("upload", uploads, utterances, uploadFailed, NULL);
+    report("stream", streams, utterances, streamFailed, partials);
+    printf("{\"bench\":\"stream\",\"server_delay_ms\":%d,\"final_delay_ms\":%d,\"speed\":%.1f,\"connects\":%lu,"
+           "\"partials\":%lu,\"bytes_sent\":%lu}\n", delayMs, finalMs, speed, st.connects, st.partials, st.bytesSent);
+
+    free(partials);
+    free(streams);
+    free(uploads);
+    free(samples);
+    return 0;
+}
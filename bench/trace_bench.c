@@ -0,0 +1,105 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "bench.h"
+#include "../src/trace.h"
+
+#define EVENTS          (4000000)
+#define RING_EVENTS     (65536)
+#define MAX_THREADS     (8)
+
+/*
+ *  Cost of one trace event on the emitting thread:
+ *
+ *      off         tracing compiled in but not started (one relaxed load)
+ *      on          begin/end pairs into the thread's ring
+ *      threads     the same from several threads at once, each on its own ring
+ *
+ *      trace_bench [events] [threads]
+ *
+ *  Times are thread CPU nanoseconds per event, worst thread; the
+ *  timestamp read (rdtsc) is most of it. Also dumps the rings once and
+ *  reports how long that took.
+ */
+
+typedef struct
+{
+    long        events;
+    uint16_t    name;
+    double      seconds;
+}
+worker;
+
+/* CPU time of the calling thread, so threads sharing a core are not charged for each other. */
+static double threadSeconds(void)
+{
+#ifdef _WIN32
+    return benchNow();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+static void *emit(void *arg)
+{
+    worker *w = (worker *)arg;
+    double start = threadSeconds();
+    for(long i = 0; i < w->events; i += 2)
+    {
+        traceBegin(w->name);
+        traceEnd(w->name);
+    }
+    w->seconds = threadSeconds() - start;
+    return NULL;
+}
+
+static double run(int threads, long events, uint16_t name)
+{
+    worker w[MAX_THREADS];
+    pthread_t t[MAX_THREADS];
+    for(int i = 0; i < threads; i++)
+    {
+        w[i].events = events;
+        w[i].name = name;
+        pthread_create(&t[i], NULL, emit, &w[i]);
+    }
+    double worst = 0.0;
+    for(int i = 0; i < threads; i++)
+    {
+        pthread_join(t[i], NULL);
+        worst = w[i].seconds > worst ? w[i].seconds : worst;
+    }
+    return worst * 1e9 / events;
+}
+
+int main(int argc, char **argv)
+{
+    long events = argc > 1 ? atol(argv[1]) : EVENTS;
+    int threads = argc > 2 ? atoi(argv[2]) : 4;
+    events = events > 0 ? events : EVENTS;
+    threads = threads < 1 ? 1 : (threads > MAX_THREADS ? MAX_THREADS : threads);
+    uint16_t name = traceName("bench");
+
+    printf("{\"bench\":\"trace\",\"mode\":\"off\",\"threads\":1,\"ns_per_event\":%.2f}\n", run(1, events, name));
+    traceStart(RING_EVENTS);
+    printf("{\"bench\":\"trace\",\"mode\":\"on\",\"threads\":1,\"ns_per_event\":%.2f}\n", run(1, events, name));
+    printf("{\"bench\":\"trace\",\"mode\":\"threads\",\"threads\":%d,\"ns_per_event\":%.2f}\n",
+           threads, run(threads, events, name));
+
+    traceStats st;
+    double start = benchNow();
+    int status = traceDump("trace_bench.trace", &st);
+    double dump = benchNow() - start;
+    remove("trace_bench.trace");
+    if(status != 0)
+    {
+        fprintf(stderr, "Could not write the trace file.\n");
+        return 1;
+    }
+    printf("{\"bench\":\"trace\",\"mode\":\"dump\",\"threads\":%lu,\"events\":%lu,\"overwritten\":%lu,"
+           "\"dump_ms\":%.2f}\n", st.threads, st.events, st.overwritten, dump * 1000.0);
+    return 0;
+}
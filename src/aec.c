@@ -0,0 +1,161 @@
+#include <math.h>
+#include <string.h>
+#include "aec.h"
+#include "clock.h"
+#include "simd.h"
+
+#define AEC_MASK        (AEC_HISTORY - 1)
+#define AEC_EPSILON     (1e-6f * AEC_TAPS)  /* regularises the step on near-silent reference */
+#define AEC_FAR_ACTIVE  (1e-3f)             /* max |reference| that counts as playback */
+#define AEC_BLOCK       (256)               /* int16 samples converted at a time by aecCancel */
+
+void aecInit(echoCanceller *ec, double sampleRate, long fallbackDelay)
+{
+    memset(ec, 0, sizeof(*ec));
+    ec->sampleRate = sampleRate;
+    ec->fallbackDelay = fallbackDelay;
+    ec->nearEndSince = -1.0;
+}
+
+void aecReference(echoCanceller *ec, const short *played, long count, double dacTime)
+{
+    for(long i = 0; i < count; i++)
+    {
+        float x = played[i] * (1.0f / 32768.0f);
+        unsigned long at = ec->written++ & AEC_MASK;
+        ec->history[at] = x;
+        ec->history[at + AEC_HISTORY] = x;
+    }
+    ec->endTime = dacTime > 0.0 ? dacTime + count / ec->sampleRate : 0.0;
+}
+
+int aecCancel(echoCanceller *ec, short *mic, long count, double adcTime)
+{
+    float block[AEC_BLOCK];
+    int bargeIn = 0;
+    for(long done = 0; done < count; done += AEC_BLOCK)
+    {
+        int n = count - done < AEC_BLOCK ? (int)(count - done) : AEC_BLOCK;
+        simdFromInt16(block, mic + done, n);
+        bargeIn |= aecCancelFloat(ec, block, n, adcTime > 0.0 ? adcTime + done / ec->sampleRate : adcTime);
+        simdQuantize(mic + done, block, n, NULL);
+    }
+    return bargeIn;
+}
+
+int aecCancelFloat(echoCanceller *ec, float *mic, long count, double adcTime)
+{
+    double start = clockNow();
+    long written = (long)ec->written;
+    int stamped = adcTime > 0.0 && ec->endTime > 0.0;
+    if(adcTime <= 0.0)
+    {
+        adcTime = ec->captured / ec->sampleRate;
+    }
+    ec->captured += (unsigned long)count;
+
+    /* Reference index that was leaving the speaker as mic[0] was sampled. */
+    long current;
+    if(stamped)
+    {
+        current = written - lround((ec->endTime - adcTime) * ec->sampleRate);
+    }
+    else
+    {
+        current = written - count - ec->fallbackDelay;
+    }
+    long newest = current + AEC_LEAD;
+    long oldest = newest - AEC_TAPS + 1;
+
+    /* Peak of the reference the block can hear, for the double-talk test. */
+    float refMax = 0.0f, micMax = 0.0f;
+    int aligned = newest + count <= written && oldest >= written - AEC_HISTORY && oldest >= 0;
+    if(aligned)
+    {
+        const float *x = ec->history + (oldest & AEC_MASK);
+        for(long k = 0; k < AEC_TAPS + count - 1; k++)
+        {
+            float a = fabsf(x[k]);
+            refMax = a > refMax ? a : refMax;
+        }
+    }
+    for(long i = 0; i < count; i++)
+    {
+        float a = fabsf(mic[i]);
+        micMax = a > micMax ? a : micMax;
+    }
+
+    int farActive = aligned && refMax > AEC_FAR_ACTIVE;
+    int doubleTalk = farActive && micMax > AEC_GEIGEL * refMax;
+    double blockSeconds = count / ec->sampleRate;
+    if(doubleTalk)
+    {
+        ec->holdUntil = adcTime + blockSeconds + AEC_HANGOVER;
+    }
+    int adapt = farActive && !doubleTalk && adcTime >= ec->holdUntil;
+
+    double echo = 0.0, residual = 0.0;
+    if(farActive)
+    {
+        const float *x = ec->history + (oldest & AEC_MASK);
+        float energy = simdEnergy(x, AEC_TAPS);
+        for(long i = 0; i < count; i++, x++)
+        {
+            if(i > 0)
+            {
+                energy += x[AEC_TAPS - 1] * x[AEC_TAPS - 1] - x[-1] * x[-1];
+                energy = energy > 0.0f ? energy : 0.0f;
+            }
+            float d = mic[i];
+            float e = d - simdDot(ec->weights, x, AEC_TAPS);
+            if(adapt)
+            {
+                simdMulAdd(ec->weights, x, AEC_STEP * e / (energy + AEC_EPSILON), AEC_TAPS);
+            }
+
+            echo += (double)d * d;
+            residual += (double)e * e;
+            mic[i] = e;
+        }
+        if(!doubleTalk)
+        {
+            ec->stats.echoEnergy += echo;
+            ec->stats.residualEnergy += residual;
+        }
+    }
+
+    /* Barge-in: the near end keeps talking over playback. */
+    int bargeIn = 0;
+    float level = count > 0 ? (float)sqrt(residual / count) : 0.0f;
+    if(doubleTalk && level > AEC_BARGE_LEVEL)
+    {
+        if(ec->nearEndSince < 0.0)
+        {
+            ec->nearEndSince = adcTime;
+        }
+        if(!ec->bargeIn && adcTime + blockSeconds - ec->nearEndSince >= AEC_BARGE_IN)
+        {
+            ec->bargeIn = 1;
+            ec->stats.bargeIns++;
+            bargeIn = 1;
+        }
+    }
+    else if(adcTime >= ec->holdUntil)
+    {
+        ec->nearEndSince = -1.0;
+        ec->bargeIn = 0;
+    }
+
+    double elapsed = clockNow() - start;
+    ec->stats.blocks++;
+    ec->stats.seconds += elapsed;
+    if(elapsed > ec->stats.maxSeconds)
+    {
+        ec->stats.maxSeconds = elapsed;
+    }
+    if(elapsed > blockSeconds)
+    {
+        ec->stats.overBudget++;
+    }
+    return bargeIn;
+}
@@ -0,0 +1,67 @@
+#ifndef JARVIS_AEC_H
+#define JARVIS_AEC_H
+
+/*
+ *  Acoustic echo canceller.
+ *
+ *  Every block handed to the speaker is recorded as reference together
+ *  with its DAC time; every capture block is aligned against that history
+ *  by its ADC time, so the adaptive filter only has to model the room and
+ *  not the (varying) buffering delay. The filter is a normalised LMS over
+ *  AEC_TAPS samples using the SIMD kernels. Adaptation is frozen while the
+ *  near end talks (Geigel detector), and sustained near-end speech during
+ *  playback is reported as barge-in.
+ */
+
+#define AEC_TAPS            (1024)  /* 64 ms echo tail at 16 kHz */
+#define AEC_HISTORY         (8192)  /* reference samples kept, power of two */
+#define AEC_LEAD            (48)    /* taps ahead of the timestamped position, for jitter */
+#define AEC_STEP            (0.4f)
+#define AEC_GEIGEL          (0.5f)  /* near end talks when |mic| > this * max |reference| */
+#define AEC_HANGOVER        (0.05)  /* seconds adaptation stays frozen after double talk */
+#define AEC_BARGE_IN        (0.15)  /* seconds of near-end speech over playback */
+#define AEC_BARGE_LEVEL     (0.01f) /* residual RMS that counts as speech */
+
+typedef struct
+{
+    unsigned long   blocks;
+    unsigned long   overBudget;     /* blocks that took longer than they last */
+    double          seconds;
+    double          maxSeconds;
+    double          echoEnergy;     /* mic energy while the far end was active */
+    double          residualEnergy; /* ... and what was left after cancellation */
+    unsigned long   bargeIns;
+}
+aecStats;
+
+typedef struct
+{
+    float           weights[AEC_TAPS];
+    float           history[2 * AEC_HISTORY];   /* mirrored so any window is contiguous */
+    unsigned long   written;
+    unsigned long   captured;
+    double          endTime;        /* DAC time of reference sample `written` */
+    double          sampleRate;
+    long            fallbackDelay;  /* samples, for hosts that report no timestamps */
+    double          holdUntil;      /* adaptation frozen until this ADC time */
+    double          nearEndSince;   /* start of the current near-end run, or < 0 */
+    int             bargeIn;        /* already reported for this run */
+    aecStats        stats;
+}
+echoCanceller;
+
+void aecInit(echoCanceller *ec, double sampleRate, long fallbackDelay);
+
+/* Records a block sent to the speaker; dacTime is outputBufferDacTime. */
+void aecReference(echoCanceller *ec, const short *played, long count, double dacTime);
+
+/*
+ *  Removes the echo from a capture block in place; adcTime is
+ *  inputBufferAdcTime. Returns 1 on the block where barge-in is detected.
+ */
+int  aecCancel(echoCanceller *ec, short *mic, long count, double adcTime);
+
+/* Same for float samples in [-1, 1); the output is not clamped. */
+int  aecCancelFloat(echoCanceller *ec, float *mic, long count, double adcTime);
+
+#endif
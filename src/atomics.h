@@ -0,0 +1,23 @@
+#ifndef JARVIS_ATOMICS_H
+#define JARVIS_ATOMICS_H
+
+/*
+ *  Thin wrappers over the GCC __atomic builtins so the lock-free
+ *  structures can stay in -std=c99 (MinGW gcc and Linux gcc both
+ *  provide them).
+ */
+
+#define atomicLoad(p)           __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define atomicLoadRelaxed(p)    __atomic_load_n((p), __ATOMIC_RELAXED)
+#define atomicStore(p, v)       __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define atomicStoreRelaxed(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define atomicAdd(p, v)         __atomic_add_fetch((p), (v), __ATOMIC_ACQ_REL)
+#define atomicAddRelaxed(p, v)  __atomic_add_fetch((p), (v), __ATOMIC_RELAXED)
+#define atomicAddSeqCst(p, v)   __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define atomicLoadSeqCst(p)     __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define atomicExchange(p, v)    __atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+#define atomicCas(p, e, v)      __atomic_compare_exchange_n((p), (e), (v), 0, \
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define atomicFence()           __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#endif
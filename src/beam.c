@@ -0,0 +1,229 @@
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+#include "beam.h"
+#include "clock.h"
+#include "simd.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define BEAM_CHUNK          (BEAM_HOP)  /* frames filtered per pass over the history */
+#define BEAM_BASE_DELAY     (BEAM_LATENCY)
+#define CROSS_SMOOTHING     (0.8f)      /* per active window */
+#define DELAY_SMOOTHING     (0.5f)
+#define ACTIVE_RATIO        (1.4f)      /* window energy over the floor worth tracking, ~1.5 dB */
+#define FLOOR_RISE          (1.01f)
+#define MIN_PEAK            (0.08f)     /* whitened correlation peak, 1 = perfect match */
+
+static float phases[BEAM_PHASES][BEAM_TAPS];
+static float analysis[BEAM_WINDOW];
+static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT;
+
+static void buildTables(void)
+{
+    /*
+     *  Row p delays by p / BEAM_PHASES of a sample on top of the integer
+     *  part: tap j weights the history sample (BEAM_TAPS / 2 - 1 - j) after
+     *  the target position, Blackman-windowed and normalised to unity gain.
+     */
+    for(int p = 0; p < BEAM_PHASES; p++)
+    {
+        float f = (float)p / BEAM_PHASES;
+        float sum = 0.0f;
+        for(int j = 0; j < BEAM_TAPS; j++)
+        {
+            double x = BEAM_TAPS / 2 - 1 - j - f;
+            double sinc = fabs(x) < 1e-9 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+            double w = 0.42 + 0.5 * cos(2.0 * M_PI * x / BEAM_TAPS) + 0.08 * cos(4.0 * M_PI * x / BEAM_TAPS);
+            phases[p][j] = (float)(sinc * w);
+            sum += phases[p][j];
+        }
+        for(int j = 0; j < BEAM_TAPS; j++)
+        {
+            phases[p][j] /= sum;
+        }
+    }
+    for(int i = 0; i < BEAM_WINDOW; i++)
+    {
+        analysis[i] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * i / BEAM_WINDOW));
+    }
+}
+
+static void getTables(void)
+{
+    pthread_once(&tablesOnce, buildTables);
+}
+
+int beamInit(beamformer *b, int channels)
+{
+    getTables();
+    memset(b, 0, sizeof(*b));
+    if(channels < 1 || channels > BEAM_MAX_CHANNELS)
+    {
+        return -1;
+    }
+    b->channels = channels;
+    return fftPlanInit(&b->plan, BEAM_FFT);
+}
+
+void beamFree(beamformer *b)
+{
+    fftPlanFree(&b->plan);
+}
+
+/* Windowed, zero-padded spectrum of the newest BEAM_WINDOW samples of channel c, into re/im. */
+static float spectrum(beamformer *b, int c)
+{
+    const float *x = b->history[c] + ((b->written - BEAM_WINDOW) & (BEAM_HISTORY - 1));
+    simdMul(b->re, x, analysis, BEAM_WINDOW);
+    memset(b->re + BEAM_WINDOW, 0, (BEAM_FFT - BEAM_WINDOW) * sizeof(float));
+    memset(b->im, 0, sizeof(b->im));
+    float energy = simdEnergy(b->re, BEAM_WINDOW);
+    fftForward(&b->plan, b->re, b->im);
+    return energy;
+}
+
+/* GCC-PHAT over the newest window; nudges each channel's delay towards the trusted peaks. */
+static void estimate(beamformer *b)
+{
+    b->stats.estimates++;
+    float energy = spectrum(b, 0);
+    if(b->levelFloor == 0.0f || energy < b->levelFloor)
+    {
+        b->levelFloor = energy > 1e-12f ? energy : 1e-12f;
+    }
+    else
+    {
+        b->levelFloor *= FLOOR_RISE;
+    }
+    if(energy < ACTIVE_RATIO * b->levelFloor)
+    {
+        return;
+    }
+    memcpy(b->refRe, b->re, sizeof(b->refRe));
+    memcpy(b->refIm, b->im, sizeof(b->refIm));
+
+    int trusted = 0;
+    for(int c = 1; c < b->channels; c++)
+    {
+        spectrum(b, c);
+        float *sr = b->crossRe[c], *si = b->crossIm[c];
+        for(int k = 0; k < BEAM_BINS; k++)
+        {
+            /* X_c * conj(X_0): a lag of d samples on channel c turns into a peak at +d */
+            float cr = b->re[k] * b->refRe[k] + b->im[k] * b->refIm[k];
+            float ci = b->im[k] * b->refRe[k] - b->re[k] * b->refIm[k];
+            sr[k] = CROSS_SMOOTHING * sr[k] + (1.0f - CROSS_SMOOTHING) * cr;
+            si[k] = CROSS_SMOOTHING * si[k] + (1.0f - CROSS_SMOOTHING) * ci;
+        }
+
+        /* Phase transform: keep only the phase, so every band votes equally. */
+        for(int k = 0; k < BEAM_BINS; k++)
+        {
+            float m = sqrtf(sr[k] * sr[k] + si[k] * si[k]) + 1e-20f;
+            b->re[k] = sr[k] / m;
+            b->im[k] = si[k] / m;
+        }
+        for(int k = BEAM_BINS; k < BEAM_FFT; k++)
+        {
+            b->re[k] = b->re[BEAM_FFT - k];
+            b->im[k] = -b->im[BEAM_FFT - k];
+        }
+        fftInverse(&b->plan, b->re, b->im);
+
+        int best = 0;
+        for(int lag = -BEAM_MAX_LAG + 1; lag < BEAM_MAX_LAG; lag++)
+        {
+            if(b->re[lag & (BEAM_FFT - 1)] > b->re[best & (BEAM_FFT - 1)])
+            {
+                best = lag;
+            }
+        }
+        float peak = b->re[best & (BEAM_FFT - 1)] / BEAM_FFT;
+        if(peak < MIN_PEAK)
+        {
+            continue;
+        }
+        float before = b->re[(best - 1) & (BEAM_FFT - 1)];
+        float at = b->re[best & (BEAM_FFT - 1)];
+        float after = b->re[(best + 1) & (BEAM_FFT - 1)];
+        float curve = before - 2.0f * at + after;
+        float offset = curve < 0.0f ? 0.5f * (before - after) / curve : 0.0f;
+        float lag = best + (offset > 0.5f ? 0.5f : (offset < -0.5f ? -0.5f : offset));
+
+        b->delay[c] += DELAY_SMOOTHING * (lag - b->delay[c]);
+        trusted = 1;
+    }
+    b->stats.updates += trusted;
+}
+
+/* Aligns and averages `frames` just appended samples into out. */
+static void steer(beamformer *b, long frames, short *out)
+{
+    const float *taps[BEAM_MAX_CHANNELS];
+    unsigned long lead[BEAM_MAX_CHANNELS];
+    for(int c = 0; c < b->channels; c++)
+    {
+        /* Total delay BASE - d: late channels are held back less. */
+        float total = BEAM_BASE_DELAY - b->delay[c];
+        int whole = (int)floorf(total);
+        int phase = (int)lrintf((total - whole) * BEAM_PHASES);
+        if(phase == BEAM_PHASES)
+        {
+            whole++;
+            phase = 0;
+        }
+        taps[c] = phases[phase];
+        lead[c] = (unsigned long)(whole + BEAM_TAPS / 2 - 1);
+    }
+
+    float scale = 32768.0f / b->channels;
+    unsigned long first = b->written - (unsigned long)frames;
+    for(long i = 0; i < frames; i++)
+    {
+        float sum = 0.0f;
+        for(int c = 0; c < b->channels; c++)
+        {
+            unsigned long start = (first + (unsigned long)i - lead[c]) & (BEAM_HISTORY - 1);
+            sum += simdDot(b->history[c] + start, taps[c], BEAM_TAPS);
+        }
+        float s = sum * scale;
+        out[i] = (short)lrintf(s > 32767.0f ? 32767.0f : (s < -32768.0f ? -32768.0f : s));
+    }
+}
+
+void beamProcess(beamformer *b, const short *in, long frames, short *out)
+{
+    double start = clockNow();
+
+    while(frames > 0)
+    {
+        long n = frames < BEAM_CHUNK ? frames : BEAM_CHUNK;
+        for(long i = 0; i < n; i++)
+        {
+            unsigned long at = (b->written + (unsigned long)i) & (BEAM_HISTORY - 1);
+            for(int c = 0; c < b->channels; c++)
+            {
+                float x = in[i * b->channels + c] * (1.0f / 32768.0f);
+                b->history[c][at] = x;
+                b->history[c][at + BEAM_HISTORY] = x;
+            }
+        }
+        b->written += (unsigned long)n;
+        b->sinceEstimate += (int)n;
+        if(b->sinceEstimate >= BEAM_HOP && b->written >= BEAM_WINDOW && b->channels > 1)
+        {
+            estimate(b);
+            b->sinceEstimate = 0;
+        }
+        steer(b, n, out);
+
+        in += n * b->channels;
+        out += n;
+        frames -= n;
+        b->stats.frames += (unsigned long)n;
+    }
+    b->stats.seconds += clockNow() - start;
+}
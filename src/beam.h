@@ -0,0 +1,68 @@
+#ifndef JARVIS_BEAM_H
+#define JARVIS_BEAM_H
+
+#include "fft.h"
+
+/*
+ *  Delay-and-sum beamformer for microphone arrays.
+ *
+ *  Every BEAM_HOP samples the delay of each channel against channel 0 is
+ *  estimated with GCC-PHAT: the cross spectrum of the last BEAM_WINDOW
+ *  samples is averaged over active frames, whitened, transformed back and
+ *  the peak within +-BEAM_MAX_LAG is refined by parabolic interpolation.
+ *  Channels are then aligned with windowed-sinc fractional-delay filters
+ *  (BEAM_TAPS taps, picked from a table of BEAM_PHASES sub-sample steps,
+ *  applied with the SIMD dot product) and averaged, which keeps the talker
+ *  and averages down noise that differs between microphones.
+ */
+
+#define BEAM_MAX_CHANNELS   (8)
+#define BEAM_MAX_LAG        (16)        /* samples, 1 ms = 34 cm of mic spacing at 16 kHz */
+#define BEAM_TAPS           (16)
+#define BEAM_PHASES         (32)
+#define BEAM_WINDOW         (512)
+#define BEAM_FFT            (2 * BEAM_WINDOW)   /* zero padded, so the correlation is linear */
+#define BEAM_BINS           (BEAM_FFT / 2 + 1)
+#define BEAM_HOP            (256)
+#define BEAM_HISTORY        (1024)      /* per channel, power of two */
+#define BEAM_LATENCY        (BEAM_MAX_LAG + BEAM_TAPS / 2 + 1)
+
+typedef struct
+{
+    unsigned long   frames;
+    double          seconds;            /* processing time */
+    unsigned long   estimates;          /* GCC-PHAT runs */
+    unsigned long   updates;            /* runs whose peaks were trusted */
+}
+beamStats;
+
+typedef struct
+{
+    int             channels;
+    fftPlan         plan;
+    float           history[BEAM_MAX_CHANNELS][2 * BEAM_HISTORY];   /* mirrored */
+    unsigned long   written;
+    int             sinceEstimate;
+    float           levelFloor;         /* quietest window energy, for the activity gate */
+
+    float           delay[BEAM_MAX_CHANNELS];       /* samples channel c lags channel 0 */
+    float           crossRe[BEAM_MAX_CHANNELS][BEAM_BINS];
+    float           crossIm[BEAM_MAX_CHANNELS][BEAM_BINS];
+    float           re[BEAM_FFT];
+    float           im[BEAM_FFT];
+    float           refRe[BEAM_BINS];
+    float           refIm[BEAM_BINS];
+    beamStats       stats;
+}
+beamformer;
+
+int  beamInit(beamformer *b, int channels);
+void beamFree(beamformer *b);
+
+/*
+ *  Consumes frames of interleaved input and writes as many mono samples,
+ *  delayed by BEAM_LATENCY. out must not alias in.
+ */
+void beamProcess(beamformer *b, const short *in, long frames, short *out);
+
+#endif
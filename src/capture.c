@@ -0,0 +1,376 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atomics.h"
+#include "capture.h"
+#include "mempool.h"
+
+#define VAD_SPEECH_ABOVE    (3.0f)      /* ln units over the floor, ~13 dB */
+#define VAD_FLOOR_RISE      (0.002f)    /* ln units per frame, ~0.9 dB/s */
+#define CAPTURE_RING        (16384)     /* ~1 s of backlog per channel */
+#define CAPTURE_CHUNK       (256)
+#define CAPTURE_WAIT        (0.1)       /* seconds; bounds a lost wake-up */
+
+void vadInit(vad *v)
+{
+    memset(v, 0, sizeof(*v));
+}
+
+int vadUpdate(vad *v, float logEnergy)
+{
+    if(v->frames == 0 || logEnergy < v->floor)
+    {
+        v->floor = logEnergy;
+    }
+    else
+    {
+        v->floor += VAD_FLOOR_RISE;
+    }
+    v->frames++;
+
+    v->speaking = logEnergy > v->floor + VAD_SPEECH_ABOVE;
+    if(v->speaking)
+    {
+        v->speechFrames++;
+        v->speechPower += exp(logEnergy);
+    }
+    else
+    {
+        v->noisePower += exp(logEnergy);
+    }
+    return v->speaking;
+}
+
+float vadSnr(const vad *v)
+{
+    unsigned long noiseFrames = v->frames - v->speechFrames;
+    if(v->speechFrames == 0 || noiseFrames == 0 || v->noisePower <= 0.0)
+    {
+        return 0.0f;
+    }
+    double noise = v->noisePower / noiseFrames;
+    double signal = v->speechPower / v->speechFrames - noise;
+    return signal > 0.0 ? (float)(10.0 * log10(signal / noise)) : 0.0f;
+}
+
+static int captureCallback(
+                    const void *inputBuffer,
+                    void *outputBuffer,
+                    unsigned long framesPerBuffer,
+                    const PaStreamCallbackTimeInfo* timeInfo,
+                    PaStreamCallbackFlags statusFlags,
+                    void *userData)
+{
+    (void) outputBuffer;
+    (void) timeInfo;
+    (void) statusFlags;
+
+    captureSource *s = (captureSource *)userData;
+    const short *in = (const short *)inputBuffer;
+
+    if(s->beamformed)
+    {
+        /* Whole frames only, so the worker never sees a torn frame. */
+        captureChannel *ch = s->first;
+        for(unsigned long done = 0; done < framesPerBuffer; )
+        {
+            unsigned long n = framesPerBuffer - done;
+            n = n < s->scratchFrames ? n : s->scratchFrames;
+            size_t count = n * s->channels;
+            if(sampleRingSpace(&ch->ring) < count)
+            {
+                atomicAddRelaxed(&ch->overruns, n);
+            }
+            else if(in != NULL)
+            {
+                sampleRingWrite(&ch->ring, in + done * s->channels, count);
+            }
+            else
+            {
+                memset(s->scratch, 0, count * sizeof(short));
+                sampleRingWrite(&ch->ring, s->scratch, count);
+            }
+            done += n;
+        }
+        notifySignal(&ch->filled);
+        return paContinue;
+    }
+
+    for(unsigned long done = 0; done < framesPerBuffer; )
+    {
+        unsigned long n = framesPerBuffer - done;
+        n = n < s->scratchFrames ? n : s->scratchFrames;
+        for(int c = 0; c < s->channels; c++)
+        {
+            captureChannel *ch = s->first + c;
+            for(unsigned long i = 0; i < n; i++)
+            {
+                s->scratch[i] = in != NULL ? in[(done + i) * s->channels + c] : 0;
+            }
+            size_t written = sampleRingWrite(&ch->ring, s->scratch, n);
+            if(written < n)
+            {
+                atomicAddRelaxed(&ch->overruns, n - written);
+            }
+        }
+        done += n;
+    }
+    for(int c = 0; c < s->channels; c++)
+    {
+        notifySignal(&s->first[c].filled);
+    }
+    return paContinue;
+}
+
+static void *captureWorker(void *arg)
+{
+    captureChannel *ch = (captureChannel *)arg;
+    short chunk[CAPTURE_CHUNK];
+    short frames[CAPTURE_CHUNK * CAPTURE_MAX_CHANNELS];
+
+    for(;;)
+    {
+        /* Ticket first: a block written after the ring came up empty still wakes the wait below. */
+        unsigned seen = notifyPrepare(&ch->filled);
+        size_t n;
+        if(ch->beam != NULL)
+        {
+            n = sampleRingRead(&ch->ring, frames, CAPTURE_CHUNK * ch->inputs) / ch->inputs;
+            if(n > 0)
+            {
+                beamProcess(ch->beam, frames, (long)n, chunk);
+            }
+        }
+        else
+        {
+            n = sampleRingRead(&ch->ring, chunk, CAPTURE_CHUNK);
+        }
+        if(n == 0)
+        {
+            if(!atomicLoad(ch->running))
+            {
+                break;
+            }
+            notifyWait(&ch->filled, seen, CAPTURE_WAIT);
+            continue;
+        }
+
+        cleanProcess(ch->cleanup, chunk, chunk, (long)n);
+        featPush(ch->features, chunk, (long)n);
+
+        long room = ch->capacity - ch->recordedCount;
+        long keep = (long)n < room ? (long)n : room;
+        memcpy(ch->recorded + ch->recordedCount, chunk, keep * sizeof(short));
+        ch->recordedCount += keep;
+
+        unsigned long written = featRingWritten(&ch->features->ring);
+        for(; ch->framesSeen < written; ch->framesSeen++)
+        {
+            const featFrame *f = featRingGet(&ch->features->ring, ch->framesSeen);
+            if(f != NULL)
+            {
+                vadUpdate(&ch->activity, f->logEnergy);
+            }
+        }
+    }
+    return NULL;
+}
+
+static int channelInit(captureChannel *ch, int inputs, int *running, long maxSamples, const cleanConfig *cleanCfg)
+{
+    memset(ch, 0, sizeof(*ch));
+    notifyInit(&ch->filled);
+    ch->running = running;
+    ch->capacity = maxSamples;
+    ch->inputs = inputs;
+    if(inputs > 1)
+    {
+        ch->beam = (beamformer *)memAlloc(sizeof(beamformer));
+        if(ch->beam == NULL || beamInit(ch->beam, inputs) != 0)
+        {
+            return -1;
+        }
+    }
+    ch->cleanup = (cleaner *)memAlloc(sizeof(cleaner));
+    ch->features = (featExtractor *)memAlloc(sizeof(featExtractor));
+    ch->recorded = (short *)memCalloc((size_t)maxSamples, sizeof(short));
+    if(ch->cleanup == NULL || ch->features == NULL || ch->recorded == NULL
+       || sampleRingInit(&ch->ring, (size_t)CAPTURE_RING * inputs) != 0
+       || cleanInit(ch->cleanup, cleanCfg) != 0 || featInit(ch->features) != 0)
+    {
+        return -1;
+    }
+    vadInit(&ch->activity);
+    return 0;
+}
+
+static void channelFree(captureChannel *ch)
+{
+    sampleRingFree(&ch->ring);
+    if(ch->beam != NULL)
+    {
+        beamFree(ch->beam);
+        memFree(ch->beam);
+    }
+    memFree(ch->cleanup);
+    memFree(ch->features);
+    memFree(ch->recorded);
+    ch->cleanup = NULL;
+    ch->features = NULL;
+    ch->recorded = NULL;
+    ch->beam = NULL;
+    notifyFree(&ch->filled);
+}
+
+PaError captureOpen(captureArray *a, const PaDeviceIndex *devices, int deviceCount, int channelsPerDevice,
+                    int beamform, double sampleRate, long maxSamples, const cleanConfig *cleanCfg)
+{
+    memset(a, 0, sizeof(*a));
+
+    for(int d = 0; d < deviceCount && a->sourceCount < CAPTURE_MAX_SOURCES; d++)
+    {
+        const PaDeviceInfo *info = Pa_GetDeviceInfo(devices[d]);
+        int steered = beamform && channelsPerDevice > 1;
+        int opened = steered ? 1 : channelsPerDevice;
+        if(info == NULL || info->maxInputChannels < channelsPerDevice || channelsPerDevice > BEAM_MAX_CHANNELS
+           || a->channelCount + opened > CAPTURE_MAX_CHANNELS)
+        {
+            captureClose(a);
+            return paInvalidChannelCount;
+        }
+
+        captureSource *s = &a->sources[a->sourceCount];
+        s->channels = channelsPerDevice;
+        s->beamformed = steered;
+        s->first = &a->channels[a->channelCount];
+        s->scratchFrames = CAPTURE_CHUNK;
+        s->scratch = (short *)memAlloc(s->scratchFrames * channelsPerDevice * sizeof(short));
+        a->sourceCount++;
+        if(s->scratch == NULL)
+        {
+            captureClose(a);
+            return paInsufficientMemory;
+        }
+
+        for(int c = 0; c < opened; c++)
+        {
+            captureChannel *ch = &a->channels[a->channelCount++];
+            if(channelInit(ch, steered ? channelsPerDevice : 1, &a->running, maxSamples, cleanCfg) != 0)
+            {
+                captureClose(a);
+                return paInsufficientMemory;
+            }
+            if(steered)
+            {
+                snprintf(ch->name, sizeof(ch->name), "%s beam x%d", info->name, channelsPerDevice);
+            }
+            else
+            {
+                snprintf(ch->name, sizeof(ch->name), "%s #%d", info->name, c + 1);
+            }
+        }
+
+        PaStreamParameters inP =
+        {
+            .device                     =   devices[d],
+            .channelCount               =   channelsPerDevice,
+            .sampleFormat               =   paInt16,
+            .suggestedLatency           =   info->defaultLowInputLatency,
+            .hostApiSpecificStreamInfo  =   NULL,
+        };
+        PaError e = Pa_OpenStream(&s->stream, &inP, NULL, sampleRate, paFramesPerBufferUnspecified,
+                                  paClipOff, captureCallback, s);
+        if(e != paNoError)
+        {
+            s->stream = NULL;
+            captureClose(a);
+            return e;
+        }
+    }
+    return paNoError;
+}
+
+PaError captureStart(captureArray *a)
+{
+    atomicStore(&a->running, 1);
+    for(int c = 0; c < a->channelCount; c++)
+    {
+        if(pthread_create(&a->channels[c].worker, NULL, captureWorker, &a->channels[c]) != 0)
+        {
+            captureStop(a);
+            return paInsufficientMemory;
+        }
+        a->workerCount++;
+    }
+    for(int s = 0; s < a->sourceCount; s++)
+    {
+        PaError e = Pa_StartStream(a->sources[s].stream);
+        if(e != paNoError)
+        {
+            captureStop(a);
+            return e;
+        }
+    }
+    return paNoError;
+}
+
+void captureStop(captureArray *a)
+{
+    if(!atomicLoad(&a->running))
+    {
+        return;
+    }
+    for(int s = 0; s < a->sourceCount; s++)
+    {
+        if(a->sources[s].stream != NULL && Pa_IsStreamActive(a->sources[s].stream) == 1)
+        {
+            Pa_StopStream(a->sources[s].stream);
+        }
+    }
+    atomicStore(&a->running, 0);
+    for(int c = 0; c < a->channelCount; c++)
+    {
+        notifySignal(&a->channels[c].filled);
+    }
+    for(int c = 0; c < a->workerCount; c++)
+    {
+        pthread_join(a->channels[c].worker, NULL);
+    }
+    a->workerCount = 0;
+}
+
+void captureClose(captureArray *a)
+{
+    captureStop(a);
+    for(int s = 0; s < a->sourceCount; s++)
+    {
+        if(a->sources[s].stream != NULL)
+        {
+            Pa_CloseStream(a->sources[s].stream);
+        }
+        memFree(a->sources[s].scratch);
+    }
+    for(int c = 0; c < a->channelCount; c++)
+    {
+        channelFree(&a->channels[c]);
+    }
+    a->sourceCount = 0;
+    a->channelCount = 0;
+}
+
+int captureBest(const captureArray *a)
+{
+    int best = -1;
+    float bestSnr = 0.0f;
+    for(int c = 0; c < a->channelCount; c++)
+    {
+        float snr = vadSnr(&a->channels[c].activity);
+        if(snr > bestSnr)
+        {
+            bestSnr = snr;
+            best = c;
+        }
+    }
+    return best;
+}
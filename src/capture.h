@@ -0,0 +1,105 @@
+#ifndef JARVIS_CAPTURE_H
+#define JARVIS_CAPTURE_H
+
+#include <pthread.h>
+#include "../include/portaudio.h"
+#include "beam.h"
+#include "cleanup.h"
+#include "mfcc.h"
+#include "notify.h"
+#include "ring.h"
+
+/*
+ *  Additional microphones.
+ *
+ *  Each input device (or each channel of a multichannel array) becomes a
+ *  capture channel with its own ring, worker thread, clean-up stage,
+ *  feature extractor and VAD. The PortAudio callback only deinterleaves
+ *  into the rings; everything else runs on the workers, so adding mics
+ *  spreads over cores instead of lengthening one callback. After an
+ *  utterance the channel with the best speech-to-noise ratio is used.
+ *
+ *  With beamforming on, a multichannel device becomes a single channel:
+ *  its ring carries whole interleaved frames and the worker steers them
+ *  into one mono stream before the clean-up stage.
+ */
+
+#define CAPTURE_MAX_CHANNELS    (8)
+#define CAPTURE_MAX_SOURCES     (8)
+
+/* Frame-level energy VAD; its running speech and noise powers give the channel SNR. */
+typedef struct
+{
+    float           floor;          /* log energy of the background */
+    int             speaking;
+    unsigned long   frames;
+    unsigned long   speechFrames;
+    double          speechPower;
+    double          noisePower;
+}
+vad;
+
+void  vadInit(vad *v);
+int   vadUpdate(vad *v, float logEnergy);
+float vadSnr(const vad *v);     /* dB, 0 if there was no speech or no background */
+
+typedef struct
+{
+    char            name[64];
+    sampleRing      ring;           /* callback -> worker, `inputs` interleaved samples per frame */
+    notifier        filled;         /* the callback wrote to the ring, or capture is stopping */
+    int             inputs;
+    beamformer     *beam;           /* NULL unless inputs > 1 */
+    cleaner        *cleanup;
+    featExtractor  *features;
+    vad             activity;
+    unsigned long   framesSeen;     /* feature frames already given to the VAD */
+    short          *recorded;
+    long            recordedCount;
+    long            capacity;
+    unsigned long   overruns;       /* samples dropped because the worker fell behind */
+    pthread_t       worker;
+    int            *running;
+}
+captureChannel;
+
+typedef struct
+{
+    PaStream       *stream;
+    int             channels;
+    int             beamformed;     /* all channels feed `first` */
+    captureChannel *first;          /* channels of this stream, in order */
+    short          *scratch;        /* one deinterleaved channel (or silent frames) of a callback block */
+    unsigned long   scratchFrames;
+}
+captureSource;
+
+typedef struct
+{
+    captureChannel  channels[CAPTURE_MAX_CHANNELS];
+    int             channelCount;
+    captureSource   sources[CAPTURE_MAX_SOURCES];
+    int             sourceCount;
+    int             workerCount;
+    int             running;
+}
+captureArray;
+
+/*
+ *  Opens channelsPerDevice channels on each device; every channel records
+ *  up to maxSamples cleaned samples. With beamform set, each device with
+ *  more than one channel is steered into a single channel instead. Returns paNoError or the first error
+ *  (the array is then closed again).
+ */
+PaError captureOpen(captureArray *a, const PaDeviceIndex *devices, int deviceCount, int channelsPerDevice,
+                    int beamform, double sampleRate, long maxSamples, const cleanConfig *cleanCfg);
+PaError captureStart(captureArray *a);
+
+/* Stops the streams and waits for the workers to drain their rings. */
+void captureStop(captureArray *a);
+void captureClose(captureArray *a);
+
+/* Channel with the highest SNR, or -1 if none heard speech. */
+int  captureBest(const captureArray *a);
+
+#endif
@@ -0,0 +1,249 @@
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+#include "cleanup.h"
+#include "clock.h"
+#include "fft.h"
+#include "simd.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define NOISE_INIT_FRAMES   (8)         /* frames averaged for the first noise estimate */
+#define NOISE_FALL          (0.3f)      /* per frame, towards a lower power */
+#define NOISE_RISE          (1.01f)     /* per frame, ~5 dB/s */
+#define POWER_SMOOTHING     (0.6f)
+#define PRIOR_SMOOTHING     (0.98f)     /* decision-directed a-priori SNR */
+#define AGC_SPEECH_RATIO    (4.0f)      /* hop RMS over the floor that counts as speech (12 dB) */
+#define AGC_MIN_LEVEL       (1e-3f)     /* -60 dBFS, never treated as speech */
+#define AGC_ATTACK          (0.02f)     /* per hop, in dB space, when lowering the gain */
+#define AGC_RELEASE         (0.004f)    /* per hop when raising it */
+#define FLOOR_RISE          (1.002f)
+#define LIMITER_RELEASE     (0.0005f)   /* per sample, back towards unity */
+
+typedef struct
+{
+    float       window[CLEAN_FRAME];
+    fftPlan     plan;
+    float       planRe[CLEAN_FRAME / 2];    /* the plan's storage, outside the memory pool */
+    float       planIm[CLEAN_FRAME / 2];
+    int         planOrder[CLEAN_FRAME];
+}
+cleanTables;
+
+static cleanTables tables;
+static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT;
+
+static void buildTables(void)
+{
+    cleanTables *t = &tables;
+    /* Periodic sqrt-Hann: analysis times synthesis sums to one at 50% overlap. */
+    for(int i = 0; i < CLEAN_FRAME; i++)
+    {
+        t->window[i] = (float)sqrt(0.5 - 0.5 * cos(2.0 * M_PI * i / CLEAN_FRAME));
+    }
+    fftPlanBuild(&t->plan, CLEAN_FRAME, t->planRe, t->planIm, t->planOrder);
+}
+
+static const cleanTables *getTables(void)
+{
+    pthread_once(&tablesOnce, buildTables);
+    return &tables;
+}
+
+static float fromDb(float db)
+{
+    return powf(10.0f, db / 20.0f);
+}
+
+void cleanDefaults(cleanConfig *cfg)
+{
+    cfg->suppress = 1;
+    cfg->floorDb = -18.0f;
+    cfg->agc = 1;
+    cfg->targetDb = -20.0f;
+    cfg->maxGainDb = 24.0f;
+    cfg->limiterDb = -1.0f;
+}
+
+void cleanConfigure(cleanConfig *cfg, const config *settings)
+{
+    cfg->suppress = (int)configNumber(settings, "noise_suppression", cfg->suppress);
+    cfg->floorDb = (float)configNumber(settings, "noise_floor_db", cfg->floorDb);
+    cfg->agc = (int)configNumber(settings, "agc", cfg->agc);
+    cfg->targetDb = (float)configNumber(settings, "agc_target_db", cfg->targetDb);
+    cfg->maxGainDb = (float)configNumber(settings, "agc_max_gain_db", cfg->maxGainDb);
+    cfg->limiterDb = (float)configNumber(settings, "limiter_db", cfg->limiterDb);
+}
+
+int cleanInit(cleaner *c, const cleanConfig *cfg)
+{
+    const cleanTables *t = getTables();
+    memset(c, 0, sizeof(*c));
+    c->cfg = *cfg;
+    c->cfg.suppress = cfg->suppress && t->plan.size > 0;
+    c->floorGain = fromDb(cfg->floorDb);
+    c->target = fromDb(cfg->targetDb);
+    c->maxGain = fromDb(cfg->maxGainDb);
+    c->ceiling = fromDb(cfg->limiterDb);
+    c->agcGain = 1.0f;
+    c->limiterGain = 1.0f;
+    return t->plan.size > 0 ? 0 : -1;
+}
+
+int cleanLatency(const cleaner *c)
+{
+    return c->cfg.suppress ? CLEAN_LATENCY : CLEAN_HOP;
+}
+
+/* Filters the current frame; leaves the finished first half in hop. */
+static void suppress(cleaner *c, float *hop)
+{
+    const cleanTables *t = getTables();
+    float re[CLEAN_FRAME], im[CLEAN_FRAME];
+
+    simdMul(re, c->frame, t->window, CLEAN_FRAME);
+    memset(im, 0, sizeof(im));
+    fftForward(&t->plan, re, im);
+
+    float gain[CLEAN_FRAME];
+    for(int k = 0; k < CLEAN_BINS; k++)
+    {
+        float power = re[k] * re[k] + im[k] * im[k];
+        c->smoothed[k] = POWER_SMOOTHING * c->smoothed[k] + (1.0f - POWER_SMOOTHING) * power;
+
+        if(c->stats.frames < NOISE_INIT_FRAMES)
+        {
+            c->noise[k] += (power - c->noise[k]) / (float)(c->stats.frames + 1);
+        }
+        else if(c->smoothed[k] < c->noise[k])
+        {
+            c->noise[k] += NOISE_FALL * (c->smoothed[k] - c->noise[k]);
+        }
+        else
+        {
+            c->noise[k] *= NOISE_RISE;
+        }
+
+        float noise = c->noise[k] + 1e-12f;
+        float post = power / noise;
+        float instant = post > 1.0f ? post - 1.0f : 0.0f;
+        float prior = PRIOR_SMOOTHING * c->priorSnr[k] + (1.0f - PRIOR_SMOOTHING) * instant;
+        float g = prior / (1.0f + prior);
+        g = g > c->floorGain ? g : c->floorGain;
+        c->priorSnr[k] = g * g * post;
+        gain[k] = g;
+    }
+    /* Mirror for the negative frequencies of the real signal. */
+    for(int k = CLEAN_BINS; k < CLEAN_FRAME; k++)
+    {
+        gain[k] = gain[CLEAN_FRAME - k];
+    }
+
+    simdMul(re, re, gain, CLEAN_FRAME);
+    simdMul(im, im, gain, CLEAN_FRAME);
+    fftInverse(&t->plan, re, im);
+
+    /* re is now N times the filtered frame; window it for overlap-add. */
+    simdMul(re, re, t->window, CLEAN_FRAME);
+    simdScale(re, re, 1.0f / CLEAN_FRAME, CLEAN_FRAME);
+    for(int i = 0; i < CLEAN_HOP; i++)
+    {
+        hop[i] = c->overlap[i] + re[i];
+    }
+    memcpy(c->overlap, re + CLEAN_HOP, sizeof(c->overlap));
+}
+
+/* Speech-gated gain riding, then a per-sample limiter. */
+static void level(cleaner *c, float *hop)
+{
+    float rms = sqrtf(simdEnergy(hop, CLEAN_HOP) / CLEAN_HOP);
+    float from = c->agcGain;
+
+    if(c->levelFloor == 0.0f || rms < c->levelFloor)
+    {
+        c->levelFloor = rms > AGC_MIN_LEVEL * 0.1f ? rms : AGC_MIN_LEVEL * 0.1f;
+    }
+    else
+    {
+        c->levelFloor *= FLOOR_RISE;
+    }
+
+    if(c->cfg.agc && rms > AGC_MIN_LEVEL && rms > AGC_SPEECH_RATIO * c->levelFloor)
+    {
+        float want = c->target / rms;
+        want = want < c->maxGain ? want : c->maxGain;
+        float rate = want < c->agcGain ? AGC_ATTACK : AGC_RELEASE;
+        c->agcGain *= powf(want / c->agcGain, rate);
+    }
+
+    /* Ramp across the hop so gain changes do not click. */
+    float step = (c->agcGain - from) / CLEAN_HOP;
+    float g = from;
+    for(int i = 0; i < CLEAN_HOP; i++)
+    {
+        g += step;
+        float y = hop[i] * g;
+        float peak = fabsf(y) * c->limiterGain;
+        if(peak > c->ceiling)
+        {
+            c->limiterGain = c->ceiling / fabsf(y);
+            c->stats.limited++;
+        }
+        else
+        {
+            c->limiterGain += LIMITER_RELEASE * (1.0f - c->limiterGain);
+        }
+        c->ready[i] = y * c->limiterGain;
+    }
+    c->stats.gainDb = 20.0f * log10f(c->agcGain);
+}
+
+void cleanProcess(cleaner *c, const short *in, short *out, long count)
+{
+    float block[CLEAN_HOP];
+    while(count > 0)
+    {
+        int n = count < CLEAN_HOP ? (int)count : CLEAN_HOP;
+        simdFromInt16(block, in, n);
+        cleanProcessFloat(c, block, block, n);
+        simdQuantize(out, block, n, NULL);
+        in += n;
+        out += n;
+        count -= n;
+    }
+}
+
+void cleanProcessFloat(cleaner *c, const float *in, float *out, long count)
+{
+    double start = clockNow();
+    float *current = c->frame + CLEAN_HOP;
+
+    for(long i = 0; i < count; i++)
+    {
+        float x = in[i];        /* in and out may alias */
+        out[i] = c->ready[c->position];
+        current[c->position] = x;
+        if(++c->position < CLEAN_HOP)
+        {
+            continue;
+        }
+
+        float hop[CLEAN_HOP];
+        if(c->cfg.suppress)
+        {
+            suppress(c, hop);
+        }
+        else
+        {
+            memcpy(hop, current, sizeof(hop));
+        }
+        level(c, hop);
+
+        memcpy(c->frame, current, CLEAN_HOP * sizeof(float));
+        c->position = 0;
+        c->stats.frames++;
+    }
+    c->stats.seconds += clockNow() - start;
+}
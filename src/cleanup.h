@@ -0,0 +1,84 @@
+#ifndef JARVIS_CLEANUP_H
+#define JARVIS_CLEANUP_H
+
+#include "config.h"
+
+/*
+ *  Capture clean-up between the microphone and everything downstream:
+ *  spectral noise suppression, automatic gain control and a peak limiter.
+ *
+ *  The stage works in float; cleanProcess converts int16 once on the
+ *  way in and once on the way out, cleanProcessFloat not at all. Suppression works on 16 ms frames with 50%
+ *  overlap (sqrt-Hann analysis and synthesis), a tracked noise spectrum
+ *  and a decision-directed Wiener gain; it delays the signal by
+ *  CLEAN_LATENCY samples. The AGC only adapts on speech, so pauses are
+ *  not pumped up to the target level, and the limiter keeps peaks under
+ *  the ceiling even while the AGC is still catching up.
+ */
+
+#define CLEAN_FRAME         (256)
+#define CLEAN_HOP           (CLEAN_FRAME / 2)
+#define CLEAN_BINS          (CLEAN_FRAME / 2 + 1)
+#define CLEAN_LATENCY       (CLEAN_FRAME)
+
+/* Config keys: noise_suppression, noise_floor_db, agc, agc_target_db, agc_max_gain_db, limiter_db. */
+typedef struct
+{
+    int     suppress;
+    float   floorDb;        /* strongest attenuation applied to noise-only bins */
+    int     agc;
+    float   targetDb;       /* speech RMS the AGC aims for, dBFS */
+    float   maxGainDb;
+    float   limiterDb;      /* output peak ceiling, dBFS */
+}
+cleanConfig;
+
+void cleanDefaults(cleanConfig *cfg);
+void cleanConfigure(cleanConfig *cfg, const config *settings);
+
+typedef struct
+{
+    unsigned long   frames;
+    double          seconds;        /* processing time */
+    float           gainDb;         /* current AGC gain */
+    unsigned long   limited;        /* samples the limiter had to pull down */
+}
+cleanStats;
+
+typedef struct
+{
+    cleanConfig     cfg;
+    float           floorGain;
+    float           target;
+    float           maxGain;
+    float           ceiling;
+
+    float           frame[CLEAN_FRAME];     /* previous hop followed by the current one */
+    float           overlap[CLEAN_HOP];     /* second half of the last synthesis frame */
+    float           ready[CLEAN_HOP];       /* processed output waiting to be handed out */
+    int             position;               /* samples of the current hop collected */
+
+    float           noise[CLEAN_BINS];
+    float           smoothed[CLEAN_BINS];
+    float           priorSnr[CLEAN_BINS];
+    float           levelFloor;             /* slowest hop RMS, for the AGC speech test */
+
+    float           agcGain;
+    float           limiterGain;
+    cleanStats      stats;
+}
+cleaner;
+
+/* Resets c for cfg; -1 if the shared tables could not be built (suppression is then off). */
+int  cleanInit(cleaner *c, const cleanConfig *cfg);
+
+/* Processes count samples; out (may equal in) receives as many, delayed by cleanLatency. */
+void cleanProcess(cleaner *c, const short *in, short *out, long count);
+
+/* Same for float samples in [-1, 1); the output is limited but not quantized. */
+void cleanProcessFloat(cleaner *c, const float *in, float *out, long count);
+
+/* Samples of delay cleanProcess adds with this configuration. */
+int cleanLatency(const cleaner *c);
+
+#endif
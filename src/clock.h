@@ -0,0 +1,56 @@
+#ifndef JARVIS_CLOCK_H
+#define JARVIS_CLOCK_H
+
+/* Monotonic seconds, used for deadlines and latency measurements. */
+
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <pthread.h>
+#endif
+
+static inline double clockNow(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER f, c;
+    QueryPerformanceFrequency(&f);
+    QueryPerformanceCounter(&c);
+    return (double)c.QuadPart / (double)f.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+/* Wall-clock seconds since the Unix epoch, for timestamps that outlive the process. */
+static inline double clockWall(void)
+{
+#ifdef _WIN32
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    unsigned long long t = ((unsigned long long)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    return t * 1e-7 - 11644473600.0;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+/* CLOCK_REALTIME point `seconds` from now, for pthread timed waits. */
+static inline struct timespec clockAbsolute(double seconds)
+{
+    struct timespec ts;
+    if(seconds < 0.0)
+    {
+        seconds = 0.0;
+    }
+    clock_gettime(CLOCK_REALTIME, &ts);
+    long nsec = ts.tv_nsec + (long)((seconds - (long)seconds) * 1e9);
+    ts.tv_sec += (time_t)seconds + nsec / 1000000000L;
+    ts.tv_nsec = nsec % 1000000000L;
+    return ts;
+}
+
+#endif
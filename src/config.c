@@ -0,0 +1,70 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+
+static char *trim(char *s)
+{
+    while(isspace((unsigned char)*s))
+    {
+        s++;
+    }
+    char *end = s + strlen(s);
+    while(end > s && isspace((unsigned char)end[-1]))
+    {
+        *--end = '\0';
+    }
+    return s;
+}
+
+int configLoad(config *cfg, const char *path)
+{
+    cfg->count = 0;
+    FILE *f = fopen(path, "r");
+    if(f == NULL)
+    {
+        return -1;
+    }
+
+    char line[CONFIG_KEY_MAX + CONFIG_VALUE_MAX + 16];
+    while(fgets(line, sizeof(line), f) != NULL && cfg->count < CONFIG_MAX_ENTRIES)
+    {
+        char *eq = strchr(line, '=');
+        if(line[0] == '#' || eq == NULL)
+        {
+            continue;
+        }
+        *eq = '\0';
+        configEntry *e = &cfg->entries[cfg->count++];
+        snprintf(e->key, sizeof(e->key), "%s", trim(line));
+        snprintf(e->value, sizeof(e->value), "%s", trim(eq + 1));
+    }
+    fclose(f);
+    return cfg->count;
+}
+
+const char *configString(const config *cfg, const char *key, const char *fallback)
+{
+    /* Later lines override earlier ones. */
+    for(int i = cfg->count - 1; i >= 0; i--)
+    {
+        if(strcmp(cfg->entries[i].key, key) == 0)
+        {
+            return cfg->entries[i].value;
+        }
+    }
+    return fallback;
+}
+
+double configNumber(const config *cfg, const char *key, double fallback)
+{
+    const char *value = configString(cfg, key, NULL);
+    if(value == NULL)
+    {
+        return fallback;
+    }
+    char *end;
+    double d = strtod(value, &end);
+    return end != value ? d : fallback;
+}
@@ -0,0 +1,35 @@
+#ifndef JARVIS_CONFIG_H
+#define JARVIS_CONFIG_H
+
+/*
+ *  Per-deployment settings, read from a "key = value" file in the same
+ *  format as grammar.txt ('#' starts a comment line). Stages look up
+ *  their own keys and fall back to built-in defaults, so a missing file
+ *  or key is never an error.
+ */
+
+#define CONFIG_MAX_ENTRIES  (64)
+#define CONFIG_KEY_MAX      (48)
+#define CONFIG_VALUE_MAX    (208)
+
+typedef struct
+{
+    char    key[CONFIG_KEY_MAX];
+    char    value[CONFIG_VALUE_MAX];
+}
+configEntry;
+
+typedef struct
+{
+    configEntry entries[CONFIG_MAX_ENTRIES];
+    int         count;
+}
+config;
+
+/* Returns the number of entries read, or -1 if the file cannot be opened (cfg is then empty). */
+int configLoad(config *cfg, const char *path);
+
+const char *configString(const config *cfg, const char *key, const char *fallback);
+double      configNumber(const config *cfg, const char *key, double fallback);
+
+#endif
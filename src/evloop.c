@@ -0,0 +1,1070 @@
+#ifdef __linux__
+#define _DEFAULT_SOURCE                 /* syscall() for io_uring */
+#endif
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atomics.h"
+#include "clock.h"
+#include "evloop.h"
+#include "mempool.h"
+#include "trace.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <io.h>
+#define poll            WSAPoll
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define EV_LINUX        (1)
+#endif
+
+#define EV_URING_ENTRIES    (256)
+#define EV_EPOLL_BATCH      (64)
+#define EV_MAX_WAIT         (1.0)       /* seconds; the loop re-checks its stop flag at least this often */
+
+/* io_uring user_data: the low two bits say what completed. */
+#define EV_TAG_POLL         (1)
+#define EV_TAG_WRITE        (2)
+#define EV_TAG_WAKE         (3)
+#define EV_TAG_MASK         (3)
+
+typedef struct
+{
+    evIoFunc        func;
+    void           *ctx;
+    int             events;
+    int             armed;
+    unsigned        gen;            /* bumped on every arm, so stale completions are ignored */
+    int             registered;     /* epoll: known to the kernel */
+}
+evWatcher;
+
+typedef struct
+{
+    double          at;
+    unsigned long   id;
+    evFunc          func;
+    void           *ctx;
+}
+evTimer;
+
+typedef struct evPostNode
+{
+    struct evPostNode  *next;
+    evFunc              func;
+    void               *ctx;
+}
+evPostNode;
+
+typedef struct evWriteOp
+{
+    struct evWriteOp   *next;
+    int                 fd;
+    const void         *buf;
+    size_t              length;
+    long long           offset;
+    evWriteFunc         func;
+    void               *ctx;
+}
+evWriteOp;
+
+#ifdef EV_LINUX
+typedef struct
+{
+    int                 fd;
+    unsigned           *sqHead;
+    unsigned           *sqTail;
+    unsigned           *sqMask;
+    unsigned           *sqArray;
+    struct io_uring_sqe *sqes;
+    unsigned           *cqHead;
+    unsigned           *cqTail;
+    unsigned           *cqMask;
+    struct io_uring_cqe *cqes;
+    void               *sqMap;
+    size_t              sqMapSize;
+    void               *cqMap;
+    size_t              cqMapSize;
+    size_t              sqesSize;
+    unsigned            entries;
+    unsigned            unsubmitted;
+    unsigned long long  wakeBuffer;
+}
+evUring;
+#endif
+
+struct evLoop
+{
+    evBackend       backend;
+
+    evWatcher      *watchers;       /* indexed by descriptor */
+    int             watcherCount;
+    int             armedCount;
+
+    evTimer        *timers;         /* binary min-heap on at */
+    int             timerCount;
+    int             timerCapacity;
+    unsigned long   nextTimer;
+
+    pthread_mutex_t postLock;
+    evPostNode     *postHead;
+    evPostNode     *postTail;
+    int             wakePending;
+    int             wakeFd;         /* eventfd, or a UDP socket connected to itself */
+
+    evWriteOp      *writeHead;      /* queued writes without io_uring */
+    evWriteOp      *writeTail;
+
+    int             stopping;
+    pthread_t       thread;
+    int             spawned;
+
+#ifdef EV_LINUX
+    int             epollFd;
+    evUring         ring;
+#endif
+
+    evStats         stats;
+};
+
+/*------ WAKE-UP ------*/
+
+static int wakeOpen(evLoop *loop)
+{
+#ifdef EV_LINUX
+    loop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return loop->wakeFd >= 0 ? 0 : -1;
+#else
+    /* No eventfd: a loopback datagram socket that sends to itself, which WSAPoll can watch too. */
+    struct sockaddr_in addr;
+    socklen_t length = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    loop->wakeFd = (int)socket(AF_INET, SOCK_DGRAM, 0);
+    if(loop->wakeFd < 0)
+    {
+        return -1;
+    }
+    if(bind(loop->wakeFd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+       || getsockname(loop->wakeFd, (struct sockaddr *)&addr, &length) != 0
+       || connect(loop->wakeFd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        return -1;
+    }
+#ifdef _WIN32
+    u_long on = 1;
+    ioctlsocket(loop->wakeFd, FIONBIO, &on);
+#else
+    fcntl(loop->wakeFd, F_SETFL, fcntl(loop->wakeFd, F_GETFL, 0) | O_NONBLOCK);
+#endif
+    return 0;
+#endif
+}
+
+static void wakeSignal(evLoop *loop)
+{
+#ifdef EV_LINUX
+    unsigned long long one = 1;
+    ssize_t n = write(loop->wakeFd, &one, sizeof(one));
+    (void)n;
+#else
+    char one = 1;
+    send(loop->wakeFd, &one, 1, 0);
+#endif
+}
+
+static void wakeDrain(evLoop *loop)
+{
+#ifdef EV_LINUX
+    unsigned long long count;
+    ssize_t n = read(loop->wakeFd, &count, sizeof(count));
+    (void)n;
+#else
+    char buf[64];
+    while(recv(loop->wakeFd, buf, sizeof(buf), 0) > 0)
+    {
+    }
+#endif
+}
+
+static void wakeClose(evLoop *loop)
+{
+    if(loop->wakeFd < 0)
+    {
+        return;
+    }
+#ifdef _WIN32
+    closesocket(loop->wakeFd);
+#else
+    close(loop->wakeFd);
+#endif
+}
+
+/*------ TIMERS ------*/
+
+static void timerSwap(evLoop *loop, int a, int b)
+{
+    evTimer t = loop->timers[a];
+    loop->timers[a] = loop->timers[b];
+    loop->timers[b] = t;
+}
+
+static void timerUp(evLoop *loop, int i)
+{
+    while(i > 0 && loop->timers[(i - 1) / 2].at > loop->timers[i].at)
+    {
+        timerSwap(loop, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void timerDown(evLoop *loop, int i)
+{
+    for(;;)
+    {
+        int least = i;
+        int l = 2 * i + 1, r = 2 * i + 2;
+        if(l < loop->timerCount && loop->timers[l].at < loop->timers[least].at)
+        {
+            least = l;
+        }
+        if(r < loop->timerCount && loop->timers[r].at < loop->timers[least].at)
+        {
+            least = r;
+        }
+        if(least == i)
+        {
+            return;
+        }
+        timerSwap(loop, i, least);
+        i = least;
+    }
+}
+
+static void timerRemoveAt(evLoop *loop, int i)
+{
+    loop->timers[i] = loop->timers[--loop->timerCount];
+    if(i < loop->timerCount)
+    {
+        timerDown(loop, i);
+        timerUp(loop, i);
+    }
+}
+
+unsigned long evTimerStart(evLoop *loop, double at, evFunc func, void *ctx)
+{
+    if(loop->timerCount == loop->timerCapacity)
+    {
+        int capacity = loop->timerCapacity ? loop->timerCapacity * 2 : 64;
+        evTimer *timers = (evTimer *)memRealloc(loop->timers, (size_t)capacity * sizeof(evTimer));
+        if(timers == NULL)
+        {
+            return 0;
+        }
+        loop->timers = timers;
+        loop->timerCapacity = capacity;
+    }
+    evTimer *t = &loop->timers[loop->timerCount];
+    t->at = at;
+    t->id = ++loop->nextTimer;
+    t->func = func;
+    t->ctx = ctx;
+    timerUp(loop, loop->timerCount++);
+    return loop->nextTimer;
+}
+
+void evTimerCancel(evLoop *loop, unsigned long id)
+{
+    for(int i = 0; i < loop->timerCount; i++)
+    {
+        if(loop->timers[i].id == id)
+        {
+            timerRemoveAt(loop, i);
+            return;
+        }
+    }
+}
+
+static void runTimers(evLoop *loop)
+{
+    double now = clockNow();
+    while(loop->timerCount > 0 && loop->timers[0].at <= now && !loop->stopping)
+    {
+        evTimer t = loop->timers[0];
+        timerRemoveAt(loop, 0);
+        loop->stats.timers++;
+        t.func(loop, t.ctx);
+    }
+}
+
+/* Seconds until the next timer, capped; 0 if something is already due. */
+static double nextWait(const evLoop *loop)
+{
+    if(loop->writeHead != NULL)
+    {
+        return 0.0;
+    }
+    double wait = EV_MAX_WAIT;
+    if(loop->timerCount > 0)
+    {
+        double left = loop->timers[0].at - clockNow();
+        wait = left < 0.0 ? 0.0 : (left < wait ? left : wait);
+    }
+    return wait;
+}
+
+/*------ POSTS AND QUEUED WRITES ------*/
+
+int evPost(evLoop *loop, evFunc func, void *ctx)
+{
+    evPostNode *node = (evPostNode *)memAlloc(sizeof(evPostNode));
+    if(node == NULL)
+    {
+        return -1;
+    }
+    node->next = NULL;
+    node->func = func;
+    node->ctx = ctx;
+
+    pthread_mutex_lock(&loop->postLock);
+    if(loop->postTail != NULL)
+    {
+        loop->postTail->next = node;
+    }
+    else
+    {
+        loop->postHead = node;
+    }
+    loop->postTail = node;
+    int wake = !loop->wakePending;
+    loop->wakePending = 1;
+    pthread_mutex_unlock(&loop->postLock);
+
+    /* One signal per batch; the loop clears wakePending when it takes the batch. */
+    if(wake)
+    {
+        wakeSignal(loop);
+    }
+    return 0;
+}
+
+static void runPosts(evLoop *loop)
+{
+    pthread_mutex_lock(&loop->postLock);
+    evPostNode *node = loop->postHead;
+    loop->postHead = NULL;
+    loop->postTail = NULL;
+    loop->wakePending = 0;
+    pthread_mutex_unlock(&loop->postLock);
+
+    while(node != NULL)
+    {
+        evPostNode *next = node->next;
+        if(node->func != NULL)
+        {
+            loop->stats.posts++;
+            node->func(loop, node->ctx);
+        }
+        memFree(node);
+        node = next;
+    }
+}
+
+static long writeNow(const evWriteOp *op)
+{
+#ifdef _WIN32
+    if(_lseeki64(op->fd, op->offset, SEEK_SET) < 0)
+    {
+        return -1;
+    }
+    return (long)_write(op->fd, op->buf, (unsigned)op->length);
+#else
+    const char *p = (const char *)op->buf;
+    size_t done = 0;
+    while(done < op->length)
+    {
+        ssize_t n = pwrite(op->fd, p + done, op->length - done, (off_t)(op->offset + (long long)done));
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n <= 0)
+        {
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return (long)done;
+#endif
+}
+
+static void runWrites(evLoop *loop)
+{
+    evWriteOp *op = loop->writeHead;
+    loop->writeHead = NULL;
+    loop->writeTail = NULL;
+    while(op != NULL)
+    {
+        evWriteOp *next = op->next;
+        long result = writeNow(op);
+        loop->stats.writes++;
+        op->func(loop, result, op->ctx);
+        memFree(op);
+        op = next;
+    }
+}
+
+/*------ WATCHERS ------*/
+
+static evWatcher *watcherFor(evLoop *loop, int fd)
+{
+    if(fd < 0)
+    {
+        return NULL;
+    }
+    if(fd >= loop->watcherCount)
+    {
+        int count = loop->watcherCount ? loop->watcherCount : 64;
+        while(count <= fd)
+        {
+            count *= 2;
+        }
+        evWatcher *w = (evWatcher *)memRealloc(loop->watchers, (size_t)count * sizeof(evWatcher));
+        if(w == NULL)
+        {
+            return NULL;
+        }
+        memset(w + loop->watcherCount, 0, (size_t)(count - loop->watcherCount) * sizeof(evWatcher));
+        loop->watchers = w;
+        loop->watcherCount = count;
+    }
+    return &loop->watchers[fd];
+}
+
+/* Disarms the watch and runs its callback; the callback may re-arm it. */
+static void fire(evLoop *loop, int fd, int events)
+{
+    evWatcher *w = &loop->watchers[fd];
+    w->armed = 0;
+    loop->armedCount--;
+    loop->stats.events++;
+    w->func(loop, fd, events, w->ctx);
+}
+
+/*------ IO_URING ------*/
+
+#ifdef EV_LINUX
+
+static int uringEnter(evUring *u, unsigned submit, unsigned wait, double timeout)
+{
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    unsigned flags = wait > 0 ? IORING_ENTER_GETEVENTS : 0;
+    memset(&arg, 0, sizeof(arg));
+    if(wait > 0)
+    {
+        ts.tv_sec = (long long)timeout;
+        ts.tv_nsec = (long long)((timeout - (double)ts.tv_sec) * 1e9);
+        arg.ts = (unsigned long long)(uintptr_t)&ts;
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+    int r = (int)syscall(__NR_io_uring_enter, u->fd, submit, wait, flags,
+                         wait > 0 ? (void *)&arg : NULL, wait > 0 ? sizeof(arg) : 0);
+    return r < 0 && errno != ETIME && errno != EINTR && errno != EBUSY ? -1 : (r < 0 ? 0 : r);
+}
+
+/* Next free submission entry, submitting what is queued if the ring is full. */
+static struct io_uring_sqe *uringSqe(evUring *u)
+{
+    unsigned tail = *u->sqTail;
+    if(tail - atomicLoad(u->sqHead) >= u->entries)
+    {
+        uringEnter(u, u->unsubmitted, 0, 0.0);
+        u->unsubmitted = 0;
+        if(tail - atomicLoad(u->sqHead) >= u->entries)
+        {
+            return NULL;
+        }
+    }
+    unsigned index = tail & *u->sqMask;
+    struct io_uring_sqe *sqe = &u->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sqArray[index] = index;
+    atomicStore(u->sqTail, tail + 1);
+    u->unsubmitted++;
+    return sqe;
+}
+
+static int uringPoll(evUring *u, int fd, int events, unsigned long long data)
+{
+    struct io_uring_sqe *sqe = uringSqe(u);
+    if(sqe == NULL)
+    {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = (events & EV_READ ? POLLIN : 0) | (events & EV_WRITE ? POLLOUT : 0);
+    sqe->user_data = data;
+    return 0;
+}
+
+static void uringRemove(evUring *u, unsigned long long data)
+{
+    struct io_uring_sqe *sqe = uringSqe(u);
+    if(sqe != NULL)
+    {
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = data;
+        sqe->user_data = 0;
+    }
+}
+
+static unsigned long long pollData(int fd, unsigned gen)
+{
+    return ((unsigned long long)(unsigned)fd << 32) | ((unsigned long long)(gen & 0x3fffffffu) << 2) | EV_TAG_POLL;
+}
+
+static void uringClose(evUring *u)
+{
+    if(u->sqes != NULL)
+    {
+        munmap(u->sqes, u->sqesSize);
+    }
+    if(u->cqMap != NULL && u->cqMap != u->sqMap)
+    {
+        munmap(u->cqMap, u->cqMapSize);
+    }
+    if(u->sqMap != NULL)
+    {
+        munmap(u->sqMap, u->sqMapSize);
+    }
+    if(u->fd >= 0)
+    {
+        close(u->fd);
+    }
+}
+
+static int uringOpen(evLoop *loop)
+{
+    evUring *u = &loop->ring;
+    struct io_uring_params p;
+    memset(u, 0, sizeof(*u));
+    memset(&p, 0, sizeof(p));
+
+    u->fd = (int)syscall(__NR_io_uring_setup, EV_URING_ENTRIES, &p);
+    if(u->fd < 0)
+    {
+        return -1;
+    }
+    /* Timed waits need EXT_ARG (5.11); without it epoll is the better choice. */
+    if(!(p.features & IORING_FEAT_EXT_ARG))
+    {
+        close(u->fd);
+        return -1;
+    }
+
+    u->sqMapSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cqMapSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        u->sqMapSize = u->cqMapSize > u->sqMapSize ? u->cqMapSize : u->sqMapSize;
+    }
+    u->sqMap = mmap(NULL, u->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if(u->sqMap == MAP_FAILED)
+    {
+        u->sqMap = NULL;
+        uringClose(u);
+        return -1;
+    }
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        u->cqMap = u->sqMap;
+    }
+    else
+    {
+        u->cqMap = mmap(NULL, u->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+        if(u->cqMap == MAP_FAILED)
+        {
+            u->cqMap = NULL;
+            uringClose(u);
+            return -1;
+        }
+    }
+    u->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = (struct io_uring_sqe *)mmap(NULL, u->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                          u->fd, IORING_OFF_SQES);
+    if(u->sqes == MAP_FAILED)
+    {
+        u->sqes = NULL;
+        uringClose(u);
+        return -1;
+    }
+
+    char *sq = (char *)u->sqMap;
+    char *cq = (char *)u->cqMap;
+    u->sqHead = (unsigned *)(sq + p.sq_off.head);
+    u->sqTail = (unsigned *)(sq + p.sq_off.tail);
+    u->sqMask = (unsigned *)(sq + p.sq_off.ring_mask);
+    u->sqArray = (unsigned *)(sq + p.sq_off.array);
+    u->cqHead = (unsigned *)(cq + p.cq_off.head);
+    u->cqTail = (unsigned *)(cq + p.cq_off.tail);
+    u->cqMask = (unsigned *)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    u->entries = p.sq_entries;
+    return 0;
+}
+
+/* The wake-up is a read of the eventfd kept in flight on the ring. */
+static int uringArmWake(evLoop *loop)
+{
+    struct io_uring_sqe *sqe = uringSqe(&loop->ring);
+    if(sqe == NULL)
+    {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = loop->wakeFd;
+    sqe->addr = (unsigned long long)(uintptr_t)&loop->ring.wakeBuffer;
+    sqe->len = sizeof(loop->ring.wakeBuffer);
+    sqe->user_data = EV_TAG_WAKE;
+    return 0;
+}
+
+static void uringIterate(evLoop *loop, double wait)
+{
+    evUring *u = &loop->ring;
+    unsigned submit = u->unsubmitted;
+    u->unsubmitted = 0;
+    if(uringEnter(u, submit, 1, wait) < 0)
+    {
+        return;
+    }
+
+    int woken = 0;
+    unsigned head = *u->cqHead;
+    while(head != atomicLoad(u->cqTail))
+    {
+        struct io_uring_cqe cqe = u->cqes[head & *u->cqMask];
+        atomicStore(u->cqHead, ++head);
+
+        unsigned tag = (unsigned)(cqe.user_data & EV_TAG_MASK);
+        if(tag == EV_TAG_WAKE)
+        {
+            woken = 1;
+        }
+        else if(tag == EV_TAG_WRITE)
+        {
+            evWriteOp *op = (evWriteOp *)(uintptr_t)(cqe.user_data & ~(unsigned long long)EV_TAG_MASK);
+            loop->stats.writes++;
+            op->func(loop, cqe.res >= 0 ? (long)cqe.res : -1, op->ctx);
+            memFree(op);
+        }
+        else if(tag == EV_TAG_POLL)
+        {
+            int fd = (int)(cqe.user_data >> 32);
+            evWatcher *w = fd < loop->watcherCount ? &loop->watchers[fd] : NULL;
+            if(w == NULL || !w->armed || cqe.user_data != pollData(fd, w->gen) || cqe.res == -ECANCELED)
+            {
+                continue;
+            }
+            int events = cqe.res < 0 ? EV_ERROR
+                       : (cqe.res & POLLIN ? EV_READ : 0) | (cqe.res & POLLOUT ? EV_WRITE : 0)
+                         | (cqe.res & (POLLERR | POLLHUP) ? EV_ERROR : 0);
+            fire(loop, fd, events);
+        }
+    }
+    if(woken)
+    {
+        /* The read already consumed the count; re-arm before taking the batch. */
+        uringArmWake(loop);
+        runPosts(loop);
+    }
+}
+
+/*------ EPOLL ------*/
+
+static void epollIterate(evLoop *loop, double wait)
+{
+    struct epoll_event events[EV_EPOLL_BATCH];
+    int ms = (int)(wait * 1000.0 + 0.999);
+    int n = epoll_wait(loop->epollFd, events, EV_EPOLL_BATCH, ms);
+    for(int i = 0; i < n; i++)
+    {
+        int fd = (int)(events[i].data.u64 & 0xffffffffu);
+        unsigned gen = (unsigned)(events[i].data.u64 >> 32);
+        if(fd == loop->wakeFd)
+        {
+            wakeDrain(loop);
+            runPosts(loop);
+            continue;
+        }
+        evWatcher *w = &loop->watchers[fd];
+        if(!w->armed || w->gen != gen)
+        {
+            continue;
+        }
+        unsigned e = events[i].events;
+        fire(loop, fd, (e & EPOLLIN ? EV_READ : 0) | (e & EPOLLOUT ? EV_WRITE : 0)
+                       | (e & (EPOLLERR | EPOLLHUP) ? EV_ERROR : 0));
+    }
+}
+
+#endif
+
+/*------ POLL ------*/
+
+static void pollIterate(evLoop *loop, double wait)
+{
+    int count = 1;
+    struct pollfd stackFds[64];
+    struct pollfd *fds = loop->armedCount + 1 <= 64 ? stackFds
+                       : (struct pollfd *)memAlloc((size_t)(loop->armedCount + 1) * sizeof(struct pollfd));
+    if(fds == NULL)
+    {
+        return;
+    }
+    fds[0].fd = loop->wakeFd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    for(int fd = 0; fd < loop->watcherCount && count < loop->armedCount + 1; fd++)
+    {
+        const evWatcher *w = &loop->watchers[fd];
+        if(w->armed)
+        {
+            fds[count].fd = fd;
+            fds[count].events = (short)((w->events & EV_READ ? POLLIN : 0) | (w->events & EV_WRITE ? POLLOUT : 0));
+            fds[count].revents = 0;
+            count++;
+        }
+    }
+
+    int n = poll(fds, (unsigned)count, (int)(wait * 1000.0 + 0.999));
+    for(int i = 1; i < count && n > 0; i++)
+    {
+        short r = fds[i].revents;
+        int fd = (int)fds[i].fd;
+        /* An earlier callback in this batch may have dropped or re-armed it. */
+        if(r == 0 || !loop->watchers[fd].armed)
+        {
+            continue;
+        }
+        fire(loop, fd, (r & POLLIN ? EV_READ : 0) | (r & POLLOUT ? EV_WRITE : 0)
+                       | (r & (POLLERR | POLLHUP | POLLNVAL) ? EV_ERROR : 0));
+    }
+    if(n > 0 && fds[0].revents != 0)
+    {
+        wakeDrain(loop);
+        runPosts(loop);
+    }
+    if(fds != stackFds)
+    {
+        memFree(fds);
+    }
+}
+
+/*------ API ------*/
+
+int evWatch(evLoop *loop, int fd, int events, evIoFunc func, void *ctx)
+{
+    evWatcher *w = watcherFor(loop, fd);
+    if(w == NULL)
+    {
+        return -1;
+    }
+    if(!w->armed)
+    {
+        loop->armedCount++;
+        if((unsigned long)loop->armedCount > loop->stats.maxWatched)
+        {
+            loop->stats.maxWatched = (unsigned long)loop->armedCount;
+        }
+    }
+#ifdef EV_LINUX
+    else if(loop->backend == EV_BACKEND_URING)
+    {
+        uringRemove(&loop->ring, pollData(fd, w->gen));
+    }
+#endif
+    w->func = func;
+    w->ctx = ctx;
+    w->events = events;
+    w->armed = 1;
+    w->gen++;
+
+#ifdef EV_LINUX
+    if(loop->backend == EV_BACKEND_URING)
+    {
+        return uringPoll(&loop->ring, fd, events, pollData(fd, w->gen));
+    }
+    if(loop->backend == EV_BACKEND_EPOLL)
+    {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = (events & EV_READ ? EPOLLIN : 0) | (events & EV_WRITE ? EPOLLOUT : 0) | EPOLLONESHOT;
+        ev.data.u64 = ((unsigned long long)w->gen << 32) | (unsigned)fd;
+        if(epoll_ctl(loop->epollFd, w->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            w->armed = 0;
+            loop->armedCount--;
+            return -1;
+        }
+        w->registered = 1;
+    }
+#endif
+    return 0;
+}
+
+void evUnwatch(evLoop *loop, int fd)
+{
+    if(fd < 0 || fd >= loop->watcherCount)
+    {
+        return;
+    }
+    evWatcher *w = &loop->watchers[fd];
+#ifdef EV_LINUX
+    if(loop->backend == EV_BACKEND_URING && w->armed)
+    {
+        uringRemove(&loop->ring, pollData(fd, w->gen));
+    }
+    if(loop->backend == EV_BACKEND_EPOLL && w->registered)
+    {
+        epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, fd, NULL);
+    }
+#endif
+    if(w->armed)
+    {
+        loop->armedCount--;
+    }
+    w->armed = 0;
+    w->registered = 0;
+    w->gen++;
+}
+
+int evWriteFile(evLoop *loop, int fd, const void *buf, size_t length, long long offset,
+                evWriteFunc func, void *ctx)
+{
+    evWriteOp *op = (evWriteOp *)memAlloc(sizeof(evWriteOp));
+    if(op == NULL)
+    {
+        return -1;
+    }
+    op->next = NULL;
+    op->fd = fd;
+    op->buf = buf;
+    op->length = length;
+    op->offset = offset;
+    op->func = func;
+    op->ctx = ctx;
+
+#ifdef EV_LINUX
+    if(loop->backend == EV_BACKEND_URING)
+    {
+        struct io_uring_sqe *sqe = uringSqe(&loop->ring);
+        if(sqe == NULL)
+        {
+            memFree(op);
+            return -1;
+        }
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = fd;
+        sqe->addr = (unsigned long long)(uintptr_t)buf;
+        sqe->len = (unsigned)length;
+        sqe->off = (unsigned long long)offset;
+        sqe->user_data = (unsigned long long)(uintptr_t)op | EV_TAG_WRITE;
+        return 0;
+    }
+#endif
+    if(loop->writeTail != NULL)
+    {
+        loop->writeTail->next = op;
+    }
+    else
+    {
+        loop->writeHead = op;
+    }
+    loop->writeTail = op;
+    return 0;
+}
+
+static int backendOpen(evLoop *loop, evBackend backend)
+{
+#ifdef EV_LINUX
+    if(backend == EV_BACKEND_URING || backend == EV_BACKEND_AUTO)
+    {
+        if(uringOpen(loop) == 0)
+        {
+            loop->backend = EV_BACKEND_URING;
+            return uringArmWake(loop);
+        }
+        if(backend == EV_BACKEND_URING)
+        {
+            return -1;
+        }
+    }
+    if(backend == EV_BACKEND_EPOLL || backend == EV_BACKEND_AUTO)
+    {
+        loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if(loop->epollFd < 0)
+        {
+            return -1;
+        }
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u64 = (unsigned)loop->wakeFd;
+        loop->backend = EV_BACKEND_EPOLL;
+        return epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->wakeFd, &ev);
+    }
+#else
+    if(backend == EV_BACKEND_URING || backend == EV_BACKEND_EPOLL)
+    {
+        return -1;
+    }
+#endif
+    loop->backend = EV_BACKEND_POLL;
+    return 0;
+}
+
+evLoop *evLoopCreate(evBackend backend)
+{
+    evLoop *loop = (evLoop *)memCalloc(1, sizeof(evLoop));
+    if(loop == NULL)
+    {
+        return NULL;
+    }
+    loop->wakeFd = -1;
+#ifdef EV_LINUX
+    loop->epollFd = -1;
+    loop->ring.fd = -1;
+#endif
+    pthread_mutex_init(&loop->postLock, NULL);
+    if(wakeOpen(loop) != 0 || backendOpen(loop, backend) != 0)
+    {
+        evLoopDestroy(loop);
+        return NULL;
+    }
+    return loop;
+}
+
+const char *evLoopBackendName(const evLoop *loop)
+{
+    switch(loop->backend)
+    {
+        case EV_BACKEND_URING:  return "io_uring";
+        case EV_BACKEND_EPOLL:  return "epoll";
+        default:                return "poll";
+    }
+}
+
+void evLoopRun(evLoop *loop)
+{
+    while(!atomicLoad(&loop->stopping))
+    {
+        double wait = nextWait(loop);
+        loop->stats.iterations++;
+#ifdef EV_LINUX
+        if(loop->backend == EV_BACKEND_URING)
+        {
+            uringIterate(loop, wait);
+        }
+        else if(loop->backend == EV_BACKEND_EPOLL)
+        {
+            epollIterate(loop, wait);
+        }
+        else
+#endif
+        {
+            pollIterate(loop, wait);
+        }
+        runWrites(loop);
+        runTimers(loop);
+    }
+}
+
+static void *loopThread(void *arg)
+{
+    traceThread("event loop");
+    evLoopRun((evLoop *)arg);
+    return NULL;
+}
+
+int evLoopSpawn(evLoop *loop)
+{
+    if(pthread_create(&loop->thread, NULL, loopThread, loop) != 0)
+    {
+        return -1;
+    }
+    loop->spawned = 1;
+    return 0;
+}
+
+void evLoopStop(evLoop *loop)
+{
+    atomicStore(&loop->stopping, 1);
+    evPost(loop, NULL, NULL);
+}
+
+void evLoopDestroy(evLoop *loop)
+{
+    if(loop == NULL)
+    {
+        return;
+    }
+    if(loop->spawned)
+    {
+        evLoopStop(loop);
+        pthread_join(loop->thread, NULL);
+    }
+    while(loop->postHead != NULL)
+    {
+        evPostNode *next = loop->postHead->next;
+        memFree(loop->postHead);
+        loop->postHead = next;
+    }
+    while(loop->writeHead != NULL)
+    {
+        evWriteOp *next = loop->writeHead->next;
+        memFree(loop->writeHead);
+        loop->writeHead = next;
+    }
+#ifdef EV_LINUX
+    if(loop->epollFd >= 0)
+    {
+        close(loop->epollFd);
+    }
+    if(loop->ring.fd >= 0)
+    {
+        /* Closing the ring cancels whatever is still in flight. */
+        uringClose(&loop->ring);
+    }
+#endif
+    wakeClose(loop);
+    pthread_mutex_destroy(&loop->postLock);
+    memFree(loop->timers);
+    memFree(loop->watchers);
+    memFree(loop);
+}
+
+void evGetStats(const evLoop *loop, evStats *out)
+{
+    *out = loop->stats;
+}
@@ -0,0 +1,94 @@
+#ifndef JARVIS_EVLOOP_H
+#define JARVIS_EVLOOP_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/*
+ *  Single-threaded asynchronous I/O core: socket readiness, timers, file
+ *  writes and callbacks posted from other threads, all dispatched on the
+ *  loop's thread with completion callbacks, so one thread can keep
+ *  hundreds of requests in flight instead of blocking one thread each.
+ *
+ *  Backends, picked at run time:
+ *      uring       io_uring (Linux 5.11+): polls, writes and the wake-up
+ *                  all go through the submission ring, one syscall per
+ *                  iteration
+ *      epoll       Linux default where io_uring is missing or disabled
+ *      poll        everywhere else (WSAPoll on Windows)
+ *
+ *  Everything except evPost and evLoopStop must be called on the loop's
+ *  thread, i.e. from inside a callback, or before the loop runs. Watches
+ *  are one-shot: the callback fires once, call evWatch again to re-arm.
+ */
+
+#define EV_READ         (1)
+#define EV_WRITE        (2)
+#define EV_ERROR        (4)     /* reported only: error or hang-up on the descriptor */
+
+typedef enum
+{
+    EV_BACKEND_AUTO,
+    EV_BACKEND_URING,
+    EV_BACKEND_EPOLL,
+    EV_BACKEND_POLL
+}
+evBackend;
+
+typedef struct evLoop evLoop;
+
+typedef void (*evIoFunc)(evLoop *loop, int fd, int events, void *ctx);
+typedef void (*evFunc)(evLoop *loop, void *ctx);
+typedef void (*evWriteFunc)(evLoop *loop, long result, void *ctx);     /* bytes written or -1 */
+
+typedef struct
+{
+    unsigned long   iterations;
+    unsigned long   events;         /* readiness callbacks */
+    unsigned long   timers;
+    unsigned long   posts;
+    unsigned long   writes;
+    unsigned long   maxWatched;     /* most descriptors armed at once */
+}
+evStats;
+
+/* NULL if the backend is unavailable (EV_BACKEND_AUTO always finds one). */
+evLoop     *evLoopCreate(evBackend backend);
+const char *evLoopBackendName(const evLoop *loop);
+
+/* Runs callbacks on the calling thread until evLoopStop. */
+void        evLoopRun(evLoop *loop);
+
+/* Runs the loop on a thread of its own; evLoopDestroy stops and joins it. */
+int         evLoopSpawn(evLoop *loop);
+
+/* Any thread. evLoopRun returns after the current iteration. */
+void        evLoopStop(evLoop *loop);
+
+/* Stops a spawned loop, then frees it. Outstanding watches and timers are dropped. */
+void        evLoopDestroy(evLoop *loop);
+
+/* Any thread: func(ctx) runs on the loop thread, in posting order. Returns -1 if out of memory. */
+int         evPost(evLoop *loop, evFunc func, void *ctx);
+
+/* One-shot readiness watch for a non-blocking descriptor. */
+int         evWatch(evLoop *loop, int fd, int events, evIoFunc func, void *ctx);
+
+/* Drops the watch on fd, if any; call before closing it. */
+void        evUnwatch(evLoop *loop, int fd);
+
+/* func(ctx) at clockNow() time `at`. Returns an id for evTimerCancel, 0 if out of memory. */
+unsigned long evTimerStart(evLoop *loop, double at, evFunc func, void *ctx);
+void        evTimerCancel(evLoop *loop, unsigned long id);
+
+/*
+ *  Writes length bytes at offset; buf must stay valid until func runs.
+ *  Asynchronous with io_uring, otherwise done on the loop thread at the
+ *  start of the next iteration (regular files are always "ready").
+ */
+int         evWriteFile(evLoop *loop, int fd, const void *buf, size_t length, long long offset,
+                        evWriteFunc func, void *ctx);
+
+void        evGetStats(const evLoop *loop, evStats *out);
+
+#endif
@@ -0,0 +1,120 @@
+#include <math.h>
+#include <stdlib.h>
+#include "fft.h"
+#include "mempool.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+int fftPlanBuild(fftPlan *p, int size, float *twiddleRe, float *twiddleIm, int *bitReverse)
+{
+    int bits = 0;
+    while((1 << bits) < size)
+    {
+        bits++;
+    }
+    p->size = 0;
+    if(size < 1 || (1 << bits) != size)
+    {
+        return -1;
+    }
+    p->twiddleRe = twiddleRe;
+    p->twiddleIm = twiddleIm;
+    p->bitReverse = bitReverse;
+    for(int i = 0; i < size / 2; i++)
+    {
+        p->twiddleRe[i] = (float)cos(-2.0 * M_PI * i / size);
+        p->twiddleIm[i] = (float)sin(-2.0 * M_PI * i / size);
+    }
+    for(int i = 0; i < size; i++)
+    {
+        int r = 0;
+        for(int b = 0; b < bits; b++)
+        {
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        p->bitReverse[i] = r;
+    }
+    p->size = size;
+    return 0;
+}
+
+int fftPlanInit(fftPlan *p, int size)
+{
+    float *twiddleRe = (float *)memAlloc((size / 2) * sizeof(float));
+    float *twiddleIm = (float *)memAlloc((size / 2) * sizeof(float));
+    int *bitReverse = (int *)memAlloc(size * sizeof(int));
+    if(twiddleRe == NULL || twiddleIm == NULL || bitReverse == NULL
+       || fftPlanBuild(p, size, twiddleRe, twiddleIm, bitReverse) != 0)
+    {
+        memFree(twiddleRe);
+        memFree(twiddleIm);
+        memFree(bitReverse);
+        p->twiddleRe = p->twiddleIm = NULL;
+        p->bitReverse = NULL;
+        p->size = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void fftPlanFree(fftPlan *p)
+{
+    memFree(p->twiddleRe);
+    memFree(p->twiddleIm);
+    memFree(p->bitReverse);
+    p->twiddleRe = p->twiddleIm = NULL;
+    p->bitReverse = NULL;
+    p->size = 0;
+}
+
+void fftForward(const fftPlan *p, float *re, float *im)
+{
+    int n = p->size;
+    for(int i = 0; i < n; i++)
+    {
+        int j = p->bitReverse[i];
+        if(j > i)
+        {
+            float tr = re[i]; re[i] = re[j]; re[j] = tr;
+            float ti = im[i]; im[i] = im[j]; im[j] = ti;
+        }
+    }
+
+    for(int size = 2; size <= n; size <<= 1)
+    {
+        int half = size >> 1;
+        int step = n / size;
+        for(int start = 0; start < n; start += size)
+        {
+            for(int k = 0; k < half; k++)
+            {
+                float wr = p->twiddleRe[k * step];
+                float wi = p->twiddleIm[k * step];
+                int a = start + k;
+                int b = a + half;
+                float xr = re[b] * wr - im[b] * wi;
+                float xi = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - xr;
+                im[b] = im[a] - xi;
+                re[a] += xr;
+                im[a] += xi;
+            }
+        }
+    }
+}
+
+void fftInverse(const fftPlan *p, float *re, float *im)
+{
+    /* conj(FFT(conj(x))) */
+    for(int i = 0; i < p->size; i++)
+    {
+        im[i] = -im[i];
+    }
+    fftForward(p, re, im);
+    for(int i = 0; i < p->size; i++)
+    {
+        im[i] = -im[i];
+    }
+}
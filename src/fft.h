@@ -0,0 +1,35 @@
+#ifndef JARVIS_FFT_H
+#define JARVIS_FFT_H
+
+/*
+ *  Radix-2 complex FFT shared by the MFCC front end (a real frame packed
+ *  into half as many complex points), clean-up and beamforming. A plan
+ *  holds the twiddles and bit-reversal table for one power-of-two size
+ *  and is read-only once built, so it can be shared between threads.
+ */
+
+typedef struct
+{
+    int         size;
+    float      *twiddleRe;      /* size / 2 entries */
+    float      *twiddleIm;
+    int        *bitReverse;
+}
+fftPlan;
+
+int  fftPlanInit(fftPlan *p, int size);
+void fftPlanFree(fftPlan *p);
+
+/*
+ *  Builds a plan in caller storage (size / 2, size / 2 and size entries)
+ *  instead of the pool; the shared tables use it so they cannot be
+ *  refused by a full memory budget. Such a plan is not passed to
+ *  fftPlanFree. Returns -1 if size is not a power of two.
+ */
+int  fftPlanBuild(fftPlan *p, int size, float *twiddleRe, float *twiddleIm, int *bitReverse);
+
+/* In place; the inverse is unscaled (divide by size). */
+void fftForward(const fftPlan *p, float *re, float *im);
+void fftInverse(const fftPlan *p, float *re, float *im);
+
+#endif
@@ -0,0 +1,339 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "clock.h"
+#include "fingerprint.h"
+#include "mempool.h"
+
+#define FP_MAX_DURATION_RATIO   (1.4f)
+#define FP_MIN_SHARED_BITS      (FP_BITS / 8)
+
+int fpCompute(const featRing *ring, unsigned long first, unsigned long count, audioFingerprint *out)
+{
+    unsigned long start;
+    unsigned long n = featSpeechRange(ring, first, count, &start);
+    if(n < FP_SEGMENTS)
+    {
+        return -1;
+    }
+
+    /* Per-band mean over the speech part. */
+    float mean[FP_BANDS] = { 0 };
+    unsigned long used = 0;
+    for(unsigned long i = start; i < start + n; i++)
+    {
+        const featFrame *f = featRingGet(ring, i);
+        if(f == NULL)
+        {
+            continue;
+        }
+        for(int b = 0; b < FP_BANDS; b++)
+        {
+            mean[b] += f->logMel[b + 1];
+        }
+        used++;
+    }
+    if(used < FP_SEGMENTS)
+    {
+        return -1;
+    }
+    for(int b = 0; b < FP_BANDS; b++)
+    {
+        mean[b] /= (float)used;
+    }
+
+    /* Average the normalised bands over equal time segments. */
+    float seg[FP_SEGMENTS][FP_BANDS];
+    memset(seg, 0, sizeof(seg));
+    int segCount[FP_SEGMENTS] = { 0 };
+    for(unsigned long i = start; i < start + n; i++)
+    {
+        const featFrame *f = featRingGet(ring, i);
+        if(f == NULL)
+        {
+            continue;
+        }
+        int s = (int)((i - start) * FP_SEGMENTS / n);
+        for(int b = 0; b < FP_BANDS; b++)
+        {
+            seg[s][b] += f->logMel[b + 1] - mean[b];
+        }
+        segCount[s]++;
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->frames = n;
+
+    float delta[FP_BITS];
+    float magnitude = 0.0f;
+    int bit = 0;
+    for(int s = 1; s < FP_SEGMENTS; s++)
+    {
+        float cur = segCount[s] ? 1.0f / segCount[s] : 0.0f;
+        float prev = segCount[s - 1] ? 1.0f / segCount[s - 1] : 0.0f;
+        for(int b = 0; b < FP_BANDS - 1; b++)
+        {
+            float d = (seg[s][b] - seg[s][b + 1]) * cur - (seg[s - 1][b] - seg[s - 1][b + 1]) * prev;
+            if(d > 0.0f)
+            {
+                out->bits[bit >> 5] |= 1u << (bit & 31);
+            }
+            delta[bit] = d;
+            magnitude += d > 0.0f ? d : -d;
+            bit++;
+        }
+    }
+
+    /* Differences above the mean magnitude are the reliable ones. */
+    magnitude /= (float)FP_BITS;
+    for(bit = 0; bit < FP_BITS; bit++)
+    {
+        if(delta[bit] > magnitude || delta[bit] < -magnitude)
+        {
+            out->reliable[bit >> 5] |= 1u << (bit & 31);
+        }
+    }
+    return 0;
+}
+
+float fpSimilarity(const audioFingerprint *a, const audioFingerprint *b)
+{
+    unsigned long lo = a->frames < b->frames ? a->frames : b->frames;
+    unsigned long hi = a->frames < b->frames ? b->frames : a->frames;
+    if(lo == 0 || (float)hi > FP_MAX_DURATION_RATIO * (float)lo)
+    {
+        return 0.0f;
+    }
+
+    int differ = 0, shared = 0;
+    for(int w = 0; w < FP_WORDS; w++)
+    {
+        unsigned int both = a->reliable[w] & b->reliable[w];
+        shared += __builtin_popcount(both);
+        differ += __builtin_popcount((a->bits[w] ^ b->bits[w]) & both);
+    }
+    if(shared < FP_MIN_SHARED_BITS)
+    {
+        return 0.0f;
+    }
+    return 1.0f - (float)differ / (float)shared;
+}
+
+/*------ CACHE ------*/
+
+fpCache *fpCacheCreate(int capacity, float threshold, int verifyEvery)
+{
+    fpCache *c = (fpCache *)memCalloc(1, sizeof(fpCache));
+    if(c == NULL)
+    {
+        return NULL;
+    }
+    c->entries = (fpCacheEntry *)memCalloc((size_t)capacity, sizeof(fpCacheEntry));
+    if(c->entries == NULL)
+    {
+        memFree(c);
+        return NULL;
+    }
+    pthread_mutex_init(&c->lock, NULL);
+    c->capacity = capacity;
+    c->threshold = threshold;
+    c->verifyEvery = verifyEvery;
+    c->metricLookups = metricCounter("jarvis_cache_lookups_total", "cache=\"audio\"", "");
+    c->metricHits = metricCounter("jarvis_cache_hits_total", "cache=\"audio\"", "");
+    return c;
+}
+
+void fpCacheDestroy(fpCache *c)
+{
+    if(c != NULL)
+    {
+        pthread_mutex_destroy(&c->lock);
+        memFree(c->entries);
+        memFree(c);
+    }
+}
+
+int fpCacheLookup(fpCache *c, const audioFingerprint *print, char *text, size_t capacity,
+                  float *confidence, int *verify)
+{
+    double start = clockNow();
+    int best = -1;
+    float bestSimilarity = c->threshold;
+
+    pthread_mutex_lock(&c->lock);
+    for(int i = 0; i < c->capacity; i++)
+    {
+        if(c->entries[i].lastUsed == 0)
+        {
+            continue;
+        }
+        float s = fpSimilarity(print, &c->entries[i].print);
+        if(s >= bestSimilarity)
+        {
+            bestSimilarity = s;
+            best = i;
+        }
+    }
+
+    c->stats.lookups++;
+    metricInc(c->metricLookups);
+    *verify = 0;
+    if(best >= 0)
+    {
+        fpCacheEntry *e = &c->entries[best];
+        e->lastUsed = ++c->clock;
+        snprintf(text, capacity, "%s", e->text);
+        *confidence = e->confidence;
+        c->stats.hits++;
+        metricInc(c->metricHits);
+        if(c->verifyEvery > 0 && c->stats.hits % (unsigned long)c->verifyEvery == 0)
+        {
+            *verify = 1;
+            c->stats.verifications++;
+        }
+    }
+    else
+    {
+        c->stats.misses++;
+    }
+
+    double elapsed = clockNow() - start;
+    c->stats.lookupSeconds += elapsed;
+    if(elapsed > c->stats.lookupMaxSeconds)
+    {
+        c->stats.lookupMaxSeconds = elapsed;
+    }
+    int bucket = 0;
+    for(double us = elapsed * 1e6; us >= 1.0 && bucket < FP_LATENCY_BUCKETS - 1; us /= 2.0)
+    {
+        bucket++;
+    }
+    c->stats.lookupBuckets[bucket]++;
+    pthread_mutex_unlock(&c->lock);
+
+    return best;
+}
+
+void fpCacheInsert(fpCache *c, const audioFingerprint *print, const char *text, float confidence)
+{
+    pthread_mutex_lock(&c->lock);
+
+    /* Refresh a near-identical print instead of storing it twice. */
+    int slot = -1;
+    for(int i = 0; i < c->capacity; i++)
+    {
+        if(c->entries[i].lastUsed != 0 && fpSimilarity(print, &c->entries[i].print) >= c->threshold)
+        {
+            slot = i;
+            break;
+        }
+    }
+    if(slot < 0)
+    {
+        slot = 0;
+        for(int i = 0; i < c->capacity; i++)
+        {
+            if(c->entries[i].lastUsed < c->entries[slot].lastUsed)
+            {
+                slot = i;
+            }
+        }
+        if(c->entries[slot].lastUsed != 0)
+        {
+            c->stats.evictions++;
+        }
+    }
+
+    fpCacheEntry *e = &c->entries[slot];
+    e->print = *print;
+    snprintf(e->text, sizeof(e->text), "%s", text);
+    e->confidence = confidence;
+    e->lastUsed = ++c->clock;
+    c->stats.inserts++;
+
+    pthread_mutex_unlock(&c->lock);
+}
+
+void fpCacheVerified(fpCache *c, int slot, const audioFingerprint *print, int matched)
+{
+    pthread_mutex_lock(&c->lock);
+    if(!matched)
+    {
+        c->stats.falseHits++;
+        fpCacheEntry *e = &c->entries[slot];
+        if(e->lastUsed != 0 && fpSimilarity(print, &e->print) >= c->threshold)
+        {
+            e->lastUsed = 0;
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+void fpCacheGetStats(fpCache *c, fpCacheStats *out)
+{
+    pthread_mutex_lock(&c->lock);
+    *out = c->stats;
+    pthread_mutex_unlock(&c->lock);
+}
+
+/*------ PERSISTENCE ------*/
+
+typedef struct
+{
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    entrySize;          /* sizeof(fpCacheEntry): a different layout is not read */
+    uint32_t    count;
+}
+fpCacheFileHeader;
+
+int fpCacheSave(fpCache *c, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if(f == NULL)
+    {
+        return -1;
+    }
+    pthread_mutex_lock(&c->lock);
+    fpCacheFileHeader h = { FP_CACHE_MAGIC, FP_CACHE_VERSION, (uint32_t)sizeof(fpCacheEntry), 0 };
+    for(int i = 0; i < c->capacity; i++)
+    {
+        h.count += c->entries[i].lastUsed != 0;
+    }
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    for(int i = 0; i < c->capacity && ok; i++)
+    {
+        if(c->entries[i].lastUsed != 0)
+        {
+            ok = fwrite(&c->entries[i], sizeof(fpCacheEntry), 1, f) == 1;
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+    ok = fclose(f) == 0 && ok;
+    return ok ? 0 : -1;
+}
+
+int fpCacheLoad(fpCache *c, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if(f == NULL)
+    {
+        return -1;
+    }
+    fpCacheFileHeader h;
+    int ok = fread(&h, sizeof(h), 1, f) == 1 && h.magic == FP_CACHE_MAGIC && h.version == FP_CACHE_VERSION
+             && h.entrySize == sizeof(fpCacheEntry);
+    for(uint32_t i = 0; i < h.count && ok; i++)
+    {
+        fpCacheEntry e;
+        ok = fread(&e, sizeof(e), 1, f) == 1;
+        if(ok && e.lastUsed != 0)
+        {
+            e.text[FP_CACHE_TEXT_MAX - 1] = '\0';
+            fpCacheInsert(c, &e.print, e.text, e.confidence);
+        }
+    }
+    fclose(f);
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,113 @@
+#ifndef JARVIS_FINGERPRINT_H
+#define JARVIS_FINGERPRINT_H
+
+#include <pthread.h>
+#include "metrics.h"
+#include "mfcc.h"
+
+/*
+ *  Compact acoustic fingerprint of an endpointed utterance and an LRU
+ *  transcript cache keyed by it.
+ *
+ *  The speech part of the log-mel frames is mean-normalised per band
+ *  (cancels stationary noise and gain), squeezed to FP_SEGMENTS time
+ *  segments, and each bit records the sign of the change of the band
+ *  energy difference between neighbouring segments. Differences larger
+ *  than the mean magnitude are marked reliable; similarity is measured
+ *  over bits reliable in both prints, so noise-dominated bands that flip
+ *  at random do not count against a match.
+ */
+
+#define FP_SEGMENTS         (33)
+#define FP_BANDS            (25)
+#define FP_BITS             ((FP_SEGMENTS - 1) * (FP_BANDS - 1))
+#define FP_WORDS            ((FP_BITS + 31) / 32)
+
+#define FP_CACHE_TEXT_MAX   (256)
+#define FP_CACHE_MAGIC      (0x4350464Au)   /* "JFPC" */
+#define FP_CACHE_VERSION    (1)
+#define FP_LATENCY_BUCKETS  (16)        /* powers of two, in microseconds */
+
+typedef struct
+{
+    unsigned int    bits[FP_WORDS];
+    unsigned int    reliable[FP_WORDS];
+    unsigned long   frames;             /* speech length, used to reject mismatched durations */
+}
+audioFingerprint;
+
+/* Returns 0 on success, -1 if the range holds no speech. */
+int   fpCompute(const featRing *ring, unsigned long first, unsigned long count, audioFingerprint *out);
+
+/* 1.0 for identical prints, ~0.5 for unrelated audio, 0 if not comparable. */
+float fpSimilarity(const audioFingerprint *a, const audioFingerprint *b);
+
+typedef struct
+{
+    unsigned long   lookups;
+    unsigned long   hits;
+    unsigned long   misses;
+    unsigned long   inserts;
+    unsigned long   evictions;
+    unsigned long   verifications;      /* hits that were re-recognized as a false-hit check */
+    unsigned long   falseHits;          /* verifications whose transcript disagreed */
+    double          lookupSeconds;      /* total time spent in fpCacheLookup */
+    double          lookupMaxSeconds;
+    unsigned long   lookupBuckets[FP_LATENCY_BUCKETS];
+}
+fpCacheStats;
+
+typedef struct
+{
+    audioFingerprint    print;
+    char                text[FP_CACHE_TEXT_MAX];
+    float               confidence;
+    unsigned long       lastUsed;       /* LRU stamp, 0 = empty slot */
+}
+fpCacheEntry;
+
+typedef struct
+{
+    pthread_mutex_t     lock;
+    fpCacheEntry       *entries;
+    int                 capacity;
+    float               threshold;
+    int                 verifyEvery;    /* re-check one hit in this many, 0 = never */
+    unsigned long       clock;
+    fpCacheStats        stats;
+    metric             *metricLookups;  /* jarvis_cache_lookups_total and _hits_total, cache="audio" */
+    metric             *metricHits;
+}
+fpCache;
+
+fpCache *fpCacheCreate(int capacity, float threshold, int verifyEvery);
+void     fpCacheDestroy(fpCache *c);
+
+/*
+ *  Looks for the most similar cached print above the threshold. On a hit
+ *  the transcript is copied out and *verify tells the caller whether
+ *  this hit was sampled for a false-hit check. Returns the slot index,
+ *  or -1 on a miss.
+ */
+int  fpCacheLookup(fpCache *c, const audioFingerprint *print, char *text, size_t capacity,
+                   float *confidence, int *verify);
+void fpCacheInsert(fpCache *c, const audioFingerprint *print, const char *text, float confidence);
+
+/*
+ *  Reports the outcome of a sampled verification. A mismatch drops the
+ *  slot, unless it has been reused for a different print meanwhile.
+ */
+void fpCacheVerified(fpCache *c, int slot, const audioFingerprint *print, int matched);
+
+void fpCacheGetStats(fpCache *c, fpCacheStats *out);
+
+/*
+ *  Keeps the entries across runs: fpCacheSave writes the live entries,
+ *  fpCacheLoad adds those of a file written by a build with the same
+ *  fingerprint layout (as many as fit). Both return -1 on failure; a
+ *  missing or foreign file leaves the cache as it was.
+ */
+int  fpCacheSave(fpCache *c, const char *path);
+int  fpCacheLoad(fpCache *c, const char *path);
+
+#endif
@@ -0,0 +1,165 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/sndfile.h"
+#include "atomics.h"
+#include "flac.h"
+#include "mempool.h"
+#include "metrics.h"
+
+/* Encoder totals for monitoring (metrics.h), registered on first use. */
+static pthread_once_t metricsOnce = PTHREAD_ONCE_INIT;
+static metric *pcmBytes;
+static metric *flacBytes;
+
+/* Compressed over raw size of everything encoded so far, 0 before the first encode. */
+static double encodeRatio(void *ctx)
+{
+    (void)ctx;
+    uint64_t in = atomicLoadRelaxed(&pcmBytes->count);
+    return in > 0 ? (double)atomicLoadRelaxed(&flacBytes->count) / (double)in : 0.0;
+}
+
+static void registerMetrics(void)
+{
+    pcmBytes = metricCounter("jarvis_encode_input_bytes_total", "", "PCM bytes given to the FLAC encoder.");
+    flacBytes = metricCounter("jarvis_encode_output_bytes_total", "", "FLAC bytes it produced.");
+    metricGaugeFunc("jarvis_encode_ratio", "", "FLAC bytes per PCM byte over all encodes.", encodeRatio, NULL);
+}
+
+static sf_count_t vioLength(void *user)
+{
+    return (sf_count_t)((flacBuffer *)user)->length;
+}
+
+static sf_count_t vioSeek(sf_count_t offset, int whence, void *user)
+{
+    flacBuffer *b = (flacBuffer *)user;
+    sf_count_t base = whence == SEEK_CUR ? (sf_count_t)b->position
+                    : whence == SEEK_END ? (sf_count_t)b->length : 0;
+    if(base + offset < 0)
+    {
+        return -1;
+    }
+    b->position = (size_t)(base + offset);
+    return (sf_count_t)b->position;
+}
+
+static sf_count_t vioRead(void *ptr, sf_count_t count, void *user)
+{
+    flacBuffer *b = (flacBuffer *)user;
+    if(b->position >= b->length)
+    {
+        return 0;
+    }
+    size_t n = b->length - b->position;
+    if((size_t)count < n)
+    {
+        n = (size_t)count;
+    }
+    memcpy(ptr, b->data + b->position, n);
+    b->position += n;
+    return (sf_count_t)n;
+}
+
+static sf_count_t vioWrite(const void *ptr, sf_count_t count, void *user)
+{
+    flacBuffer *b = (flacBuffer *)user;
+    size_t end = b->position + (size_t)count;
+    if(end > b->capacity)
+    {
+        size_t cap = b->capacity ? b->capacity : 16384;
+        while(cap < end)
+        {
+            cap *= 2;
+        }
+        unsigned char *d = (unsigned char *)memRealloc(b->data, cap);
+        if(d == NULL)
+        {
+            return 0;
+        }
+        b->data = d;
+        b->capacity = cap;
+    }
+    memcpy(b->data + b->position, ptr, (size_t)count);
+    b->position = end;
+    if(end > b->length)
+    {
+        b->length = end;
+    }
+    return count;
+}
+
+static sf_count_t vioTell(void *user)
+{
+    return (sf_count_t)((flacBuffer *)user)->position;
+}
+
+int flacEncode(const short *samples, long count, int sampleRate, flacBuffer *out)
+{
+    SF_VIRTUAL_IO vio = { vioLength, vioSeek, vioRead, vioWrite, vioTell };
+    SF_INFO info;
+
+    memset(out, 0, sizeof(*out));
+    memset(&info, 0, sizeof(info));
+    info.samplerate = sampleRate;
+    info.channels = 1;
+    info.format = SF_FORMAT_FLAC | SF_FORMAT_PCM_16;
+
+    SNDFILE *sf = sf_open_virtual(&vio, SFM_WRITE, &info, out);
+    if(sf == NULL)
+    {
+        return -1;
+    }
+
+    sf_count_t written = sf_write_short(sf, samples, count);
+    sf_close(sf);
+
+    if(written != count)
+    {
+        flacBufferFree(out);
+        return -1;
+    }
+    pthread_once(&metricsOnce, registerMetrics);
+    metricAdd(pcmBytes, (uint64_t)count * sizeof(short));
+    metricAdd(flacBytes, out->length);
+    return 0;
+}
+
+void flacBufferFree(flacBuffer *b)
+{
+    memFree(b->data);
+    memset(b, 0, sizeof(*b));
+}
+
+flacPayload *flacPayloadCreate(const short *samples, long count, int sampleRate)
+{
+    flacPayload *p = (flacPayload *)memAlloc(sizeof(flacPayload));
+    if(p == NULL)
+    {
+        return NULL;
+    }
+    if(flacEncode(samples, count, sampleRate, &p->buffer) != 0)
+    {
+        memFree(p);
+        return NULL;
+    }
+    p->refs = 1;
+    return p;
+}
+
+flacPayload *flacPayloadRetain(flacPayload *p)
+{
+    atomicAdd(&p->refs, 1);
+    return p;
+}
+
+void flacPayloadRelease(flacPayload *p)
+{
+    if(p != NULL && atomicAdd(&p->refs, -1) == 0)
+    {
+        flacBufferFree(&p->buffer);
+        memFree(p);
+    }
+}
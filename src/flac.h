@@ -0,0 +1,39 @@
+#ifndef JARVIS_FLAC_H
+#define JARVIS_FLAC_H
+
+#include <stddef.h>
+
+/*
+ *  Encodes PCM to FLAC entirely in memory through libsndfile's virtual
+ *  I/O, so the upload stage never touches the disk.
+ */
+
+typedef struct
+{
+    unsigned char  *data;
+    size_t          length;
+    size_t          capacity;
+    size_t          position;
+}
+flacBuffer;
+
+/* Returns 0 on success; out must be released with flacBufferFree. */
+int  flacEncode(const short *samples, long count, int sampleRate, flacBuffer *out);
+void flacBufferFree(flacBuffer *b);
+
+/*
+ *  Reference-counted, immutable encoded payload. Retries and hedged
+ *  requests all point at the same bytes; the last release frees them.
+ */
+typedef struct
+{
+    flacBuffer      buffer;
+    int             refs;
+}
+flacPayload;
+
+flacPayload *flacPayloadCreate(const short *samples, long count, int sampleRate);
+flacPayload *flacPayloadRetain(flacPayload *p);
+void         flacPayloadRelease(flacPayload *p);
+
+#endif
@@ -0,0 +1,415 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "http.h"
+#include "mempool.h"
+#include "net.h"
+
+typedef struct
+{
+    char       *data;
+    size_t      length;
+    size_t      capacity;
+}
+growBuffer;
+
+static int growAppend(growBuffer *g, const char *p, size_t n)
+{
+    if(g->length + n + 1 > g->capacity)
+    {
+        size_t cap = g->capacity ? g->capacity : 4096;
+        while(cap < g->length + n + 1)
+        {
+            cap *= 2;
+        }
+        char *d = (char *)memRealloc(g->data, cap);
+        if(d == NULL)
+        {
+            return NET_ERROR;
+        }
+        g->data = d;
+        g->capacity = cap;
+    }
+    memcpy(g->data + g->length, p, n);
+    g->length += n;
+    g->data[g->length] = '\0';
+    return NET_OK;
+}
+
+/* Finds a header value in the raw header block, case-insensitively. */
+static const char *findHeader(const char *headers, const char *name)
+{
+    size_t n = strlen(name);
+    for(const char *line = strstr(headers, "\r\n"); line != NULL; line = strstr(line, "\r\n"))
+    {
+        line += 2;
+        if(strncasecmp(line, name, n) == 0 && line[n] == ':')
+        {
+            const char *v = line + n + 1;
+            while(*v == ' ')
+            {
+                v++;
+            }
+            return v;
+        }
+    }
+    return NULL;
+}
+
+/* Decodes a chunked body in place; returns the decoded length or -1. */
+static long dechunk(char *body, size_t length)
+{
+    size_t in = 0, out = 0;
+    for(;;)
+    {
+        char *end;
+        if(in >= length)
+        {
+            return -1;
+        }
+        long size = strtol(body + in, &end, 16);
+        char *crlf = strstr(end, "\r\n");
+        if(size < 0 || crlf == NULL)
+        {
+            return -1;
+        }
+        in = (size_t)(crlf - body) + 2;
+        if(size == 0)
+        {
+            break;
+        }
+        if(in + (size_t)size > length)
+        {
+            return -1;
+        }
+        memmove(body + out, body + in, (size_t)size);
+        out += (size_t)size;
+        in += (size_t)size + 2;
+    }
+    body[out] = '\0';
+    return (long)out;
+}
+
+static int formatRequest(char *header, size_t size, const char *host, const char *path,
+                         const char *contentType, size_t length)
+{
+    return snprintf(header, size,
+                    "POST %s HTTP/1.1\r\n"
+                    "Host: %s\r\n"
+                    "Content-Type: %s\r\n"
+                    "Content-Length: %lu\r\n"
+                    "Connection: close\r\n"
+                    "\r\n",
+                    path, host, contentType, (unsigned long)length);
+}
+
+/*
+ *  Looks for the end of the header block once it has arrived. Returns 1
+ *  when the declared body is complete, 0 to keep reading, NET_ERROR if
+ *  the header is too large or memory ran out.
+ */
+static int receiveMore(growBuffer *g, const char *chunk, size_t n, size_t *headerEnd, long *contentLength)
+{
+    if(growAppend(g, chunk, n) != NET_OK)
+    {
+        return NET_ERROR;
+    }
+    if(*headerEnd == 0)
+    {
+        char *sep = strstr(g->data, "\r\n\r\n");
+        if(sep == NULL)
+        {
+            return g->length > HTTP_MAX_HEADER ? NET_ERROR : 0;
+        }
+        *headerEnd = (size_t)(sep - g->data) + 4;
+        *sep = '\0';
+        const char *cl = findHeader(g->data, "Content-Length");
+        *contentLength = cl != NULL ? strtol(cl, NULL, 10) : -1;
+        *sep = '\r';
+    }
+    return *contentLength >= 0 && g->length - *headerEnd >= (size_t)*contentLength;
+}
+
+/* Turns the raw bytes into *out, which takes over g's buffer on success. */
+static int finishResponse(growBuffer *g, size_t headerEnd, httpResponse *out)
+{
+    if(headerEnd == 0 || sscanf(g->data, "HTTP/%*d.%*d %d", &out->status) != 1)
+    {
+        memFree(g->data);
+        return NET_ERROR;
+    }
+
+    g->data[headerEnd - 2] = '\0';
+    const char *te = findHeader(g->data, "Transfer-Encoding");
+    int chunked = te != NULL && strncasecmp(te, "chunked", 7) == 0;
+
+    size_t bodyLength = g->length - headerEnd;
+    memmove(g->data, g->data + headerEnd, bodyLength);
+    g->data[bodyLength] = '\0';
+
+    if(chunked)
+    {
+        long n = dechunk(g->data, bodyLength);
+        if(n < 0)
+        {
+            memFree(g->data);
+            return NET_ERROR;
+        }
+        bodyLength = (size_t)n;
+    }
+
+    out->body = g->data;
+    out->bodyLength = bodyLength;
+    return NET_OK;
+}
+
+int httpPost(const char *host, int port, const char *path, const char *contentType,
+             const void *body, size_t length, double deadline, volatile int *cancel,
+             httpResponse *out)
+{
+    char header[1024];
+    growBuffer g = { NULL, 0, 0 };
+
+    out->status = 0;
+    out->body = NULL;
+    out->bodyLength = 0;
+
+    int fd = netConnect(host, port, deadline, cancel);
+    if(fd < 0)
+    {
+        return fd;
+    }
+
+    int hl = formatRequest(header, sizeof(header), host, path, contentType, length);
+    int e = netSendAll(fd, header, (size_t)hl, deadline, cancel);
+    if(e == NET_OK)
+    {
+        e = netSendAll(fd, body, length, deadline, cancel);
+    }
+
+    /* Read until the peer closes or the declared length has arrived. */
+    size_t headerEnd = 0;
+    long contentLength = -1;
+    while(e == NET_OK)
+    {
+        char chunk[4096];
+        long n = netRecv(fd, chunk, sizeof(chunk), deadline, cancel);
+        if(n == NET_CLOSED)
+        {
+            break;
+        }
+        if(n < 0)
+        {
+            e = (int)n;
+            break;
+        }
+        int done = receiveMore(&g, chunk, (size_t)n, &headerEnd, &contentLength);
+        if(done != 0)
+        {
+            e = done < 0 ? done : NET_OK;
+            break;
+        }
+    }
+    netClose(fd);
+
+    if(e != NET_OK)
+    {
+        memFree(g.data);
+        return e;
+    }
+    return finishResponse(&g, headerEnd, out);
+}
+
+/*------ ASYNCHRONOUS ------*/
+
+enum { ASYNC_CONNECTING, ASYNC_SENDING, ASYNC_RECEIVING };
+
+struct httpRequest
+{
+    evLoop         *loop;
+    int             fd;
+    int             state;
+    char            header[1024];
+    size_t          headerLength;
+    const char     *body;
+    size_t          length;
+    size_t          sent;           /* across header and body */
+    growBuffer      received;
+    size_t          headerEnd;
+    long            contentLength;
+    unsigned long   timer;
+    httpDoneFunc    done;
+    void           *ctx;
+};
+
+static void asyncRelease(httpRequest *q)
+{
+    if(q->timer != 0)
+    {
+        evTimerCancel(q->loop, q->timer);
+    }
+    if(q->fd >= 0)
+    {
+        evUnwatch(q->loop, q->fd);
+        netClose(q->fd);
+    }
+    memFree(q->received.data);
+    memFree(q);
+}
+
+static void asyncFinish(httpRequest *q, int e)
+{
+    httpResponse response = { 0, NULL, 0 };
+    if(e == NET_OK)
+    {
+        e = finishResponse(&q->received, q->headerEnd, &response);
+        q->received.data = NULL;
+    }
+    httpDoneFunc done = q->done;
+    void *ctx = q->ctx;
+    evLoop *loop = q->loop;
+    asyncRelease(q);
+    done(loop, e, &response, ctx);
+}
+
+static void asyncExpired(evLoop *loop, void *ctx)
+{
+    httpRequest *q = (httpRequest *)ctx;
+    (void)loop;
+    q->timer = 0;
+    asyncFinish(q, NET_TIMEOUT);
+}
+
+static void asyncReady(evLoop *loop, int fd, int events, void *ctx);
+
+static void asyncReceive(httpRequest *q)
+{
+    for(;;)
+    {
+        char chunk[4096];
+        long n = netRecvSome(q->fd, chunk, sizeof(chunk));
+        if(n == NET_PENDING)
+        {
+            if(evWatch(q->loop, q->fd, EV_READ, asyncReady, q) != 0)
+            {
+                asyncFinish(q, NET_ERROR);
+            }
+            return;
+        }
+        if(n == NET_CLOSED)
+        {
+            asyncFinish(q, NET_OK);
+            return;
+        }
+        if(n < 0)
+        {
+            asyncFinish(q, (int)n);
+            return;
+        }
+        int done = receiveMore(&q->received, chunk, (size_t)n, &q->headerEnd, &q->contentLength);
+        if(done != 0)
+        {
+            asyncFinish(q, done < 0 ? done : NET_OK);
+            return;
+        }
+    }
+}
+
+static void asyncSend(httpRequest *q)
+{
+    while(q->sent < q->headerLength + q->length)
+    {
+        const char *p = q->sent < q->headerLength ? q->header + q->sent : q->body + (q->sent - q->headerLength);
+        size_t n = q->sent < q->headerLength ? q->headerLength - q->sent : q->length - (q->sent - q->headerLength);
+        long w = netSendSome(q->fd, p, n);
+        if(w == NET_PENDING)
+        {
+            if(evWatch(q->loop, q->fd, EV_WRITE, asyncReady, q) != 0)
+            {
+                asyncFinish(q, NET_ERROR);
+            }
+            return;
+        }
+        if(w < 0)
+        {
+            asyncFinish(q, NET_ERROR);
+            return;
+        }
+        q->sent += (size_t)w;
+    }
+    q->state = ASYNC_RECEIVING;
+    asyncReceive(q);
+}
+
+static void asyncReady(evLoop *loop, int fd, int events, void *ctx)
+{
+    httpRequest *q = (httpRequest *)ctx;
+    (void)loop;
+    (void)fd;
+    (void)events;
+    switch(q->state)
+    {
+        case ASYNC_CONNECTING:
+            if(netConnectFinish(q->fd) != NET_OK)
+            {
+                asyncFinish(q, NET_ERROR);
+                return;
+            }
+            q->state = ASYNC_SENDING;
+            asyncSend(q);
+            break;
+        case ASYNC_SENDING:
+            asyncSend(q);
+            break;
+        default:
+            asyncReceive(q);
+            break;
+    }
+}
+
+httpRequest *httpPostAsync(evLoop *loop, const char *host, const netAddress *address, const char *path,
+                           const char *contentType, const void *body, size_t length,
+                           double deadline, httpDoneFunc done, void *ctx)
+{
+    httpRequest *q = (httpRequest *)memCalloc(1, sizeof(httpRequest));
+    if(q == NULL)
+    {
+        return NULL;
+    }
+    q->loop = loop;
+    q->body = (const char *)body;
+    q->length = length;
+    q->contentLength = -1;
+    q->done = done;
+    q->ctx = ctx;
+    q->headerLength = (size_t)formatRequest(q->header, sizeof(q->header), host, path, contentType, length);
+
+    int e = netConnectStart(address, &q->fd);
+    if(e != NET_OK && e != NET_PENDING)
+    {
+        q->fd = -1;
+        asyncRelease(q);
+        return NULL;
+    }
+    q->timer = evTimerStart(loop, deadline, asyncExpired, q);
+    q->state = e == NET_OK ? ASYNC_SENDING : ASYNC_CONNECTING;
+    if(q->timer == 0 || evWatch(loop, q->fd, EV_WRITE, asyncReady, q) != 0)
+    {
+        asyncRelease(q);
+        return NULL;
+    }
+    return q;
+}
+
+void httpCancel(httpRequest *q)
+{
+    asyncRelease(q);
+}
+
+void httpResponseFree(httpResponse *r)
+{
+    memFree(r->body);
+    r->body = NULL;
+    r->bodyLength = 0;
+}
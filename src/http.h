@@ -0,0 +1,47 @@
+#ifndef JARVIS_HTTP_H
+#define JARVIS_HTTP_H
+
+#include <stddef.h>
+#include "evloop.h"
+#include "net.h"
+
+/*
+ *  Minimal HTTP/1.1 client: one request per connection, Content-Length
+ *  and chunked bodies. Errors are the NET_* codes from net.h.
+ */
+
+#define HTTP_MAX_HEADER     (8192)
+
+typedef struct
+{
+    int         status;
+    char       *body;           /* NUL terminated, owned by the response */
+    size_t      bodyLength;
+}
+httpResponse;
+
+int  httpPost(const char *host, int port, const char *path, const char *contentType,
+              const void *body, size_t length, double deadline, volatile int *cancel,
+              httpResponse *out);
+void httpResponseFree(httpResponse *r);
+
+/*
+ *  The same request driven by an event loop, for keeping many in flight
+ *  on one thread. Call on the loop thread. done runs there exactly once,
+ *  with NET_OK and a response it must free, or an error (NET_TIMEOUT once
+ *  deadline passes) - unless the request is cancelled first. body must
+ *  stay valid until then. Returns NULL if the request could not start.
+ *  The peer is an address resolved beforehand (netResolve), so nothing
+ *  here waits for the resolver; host only goes into the Host header.
+ */
+typedef struct httpRequest httpRequest;
+typedef void (*httpDoneFunc)(evLoop *loop, int result, httpResponse *response, void *ctx);
+
+httpRequest *httpPostAsync(evLoop *loop, const char *host, const netAddress *address, const char *path,
+                           const char *contentType, const void *body, size_t length,
+                           double deadline, httpDoneFunc done, void *ctx);
+
+/* Loop thread: abandons the request without calling done. */
+void         httpCancel(httpRequest *request);
+
+#endif
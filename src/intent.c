@@ -0,0 +1,103 @@
+#include <ctype.h>
+#include <string.h>
+#include "intent.h"
+
+static const intentDef intents[INTENT_COUNT] =
+{
+    [INTENT_UNKNOWN]    = { "unknown",  { NULL },
+                            "I heard \"{transcript}\", but I do not know what to do with it." },
+    [INTENT_TIME]       = { "time",     { "what time", "the time", "time is it" },
+                            "It is {time}." },
+    [INTENT_DATE]       = { "date",     { "what day", "the date", "what is today", "day is it" },
+                            "Today is {weekday}, {month} {day}." },
+    [INTENT_GREETING]   = { "greeting", { "hello", "hi jarvis", "good morning", "good evening", "hey jarvis" },
+                            "Hello. How can I help?" },
+    [INTENT_IDENTITY]   = { "identity", { "who are you", "your name", "what are you" },
+                            "I am Jarvis, your speech assistant." },
+    [INTENT_THANKS]     = { "thanks",   { "thank you", "thanks" },
+                            "You are welcome." },
+    [INTENT_STATUS]     = { "status",   { "how are you", "are you there", "you okay" },
+                            "All systems are running normally." },
+    [INTENT_GOODBYE]    = { "goodbye",  { "goodbye", "good bye", "see you", "good night" },
+                            "Goodbye." },
+};
+
+const intentDef *intentTable(void)
+{
+    return intents;
+}
+
+/* Lowercases and splits on anything that is not a letter, digit or apostrophe. */
+static int splitWords(const char *text, char words[][INTENT_WORD_MAX], int maxWords)
+{
+    int count = 0;
+    while(*text != '\0' && count < maxWords)
+    {
+        while(*text != '\0' && !isalnum((unsigned char)*text) && *text != '\'')
+        {
+            text++;
+        }
+        int n = 0;
+        while(*text != '\0' && (isalnum((unsigned char)*text) || *text == '\''))
+        {
+            if(n < INTENT_WORD_MAX - 1)
+            {
+                words[count][n++] = (char)tolower((unsigned char)*text);
+            }
+            text++;
+        }
+        if(n > 0)
+        {
+            words[count++][n] = '\0';
+        }
+    }
+    return count;
+}
+
+/* Number of phrase words if all occur in order in the transcript, else 0. */
+static int phraseMatch(const char *phrase, char words[][INTENT_WORD_MAX], int wordCount)
+{
+    char want[INTENT_MAX_WORDS][INTENT_WORD_MAX];
+    int wantCount = splitWords(phrase, want, INTENT_MAX_WORDS);
+    int at = 0;
+    for(int w = 0; w < wantCount; w++)
+    {
+        while(at < wordCount && strcmp(words[at], want[w]) != 0)
+        {
+            at++;
+        }
+        if(at == wordCount)
+        {
+            return 0;
+        }
+        at++;
+    }
+    return wantCount;
+}
+
+intentId intentMatch(const char *transcript, int *score)
+{
+    char words[INTENT_MAX_WORDS][INTENT_WORD_MAX];
+    int wordCount = splitWords(transcript, words, INTENT_MAX_WORDS);
+
+    intentId best = INTENT_UNKNOWN;
+    int bestScore = 0;
+    for(int i = 1; i < INTENT_COUNT; i++)
+    {
+        for(int p = 0; p < INTENT_MAX_PHRASES && intents[i].phrases[p] != NULL; p++)
+        {
+            int s = phraseMatch(intents[i].phrases[p], words, wordCount);
+            if(s > bestScore)
+            {
+                bestScore = s;
+                best = (intentId)i;
+            }
+        }
+    }
+
+    if(score != NULL)
+    {
+        *score = bestScore;
+    }
+    return best;
+}
@@ -0,0 +1,44 @@
+#ifndef JARVIS_INTENT_H
+#define JARVIS_INTENT_H
+
+/*
+ *  Maps a transcript to one of a fixed set of intents. Each intent lists
+ *  trigger phrases; a phrase matches when all of its words occur in the
+ *  transcript in order. The longest matching phrase wins.
+ */
+
+#define INTENT_MAX_PHRASES  (6)
+#define INTENT_MAX_WORDS    (32)
+#define INTENT_WORD_MAX     (24)
+
+typedef enum
+{
+    INTENT_UNKNOWN = 0,
+    INTENT_TIME,
+    INTENT_DATE,
+    INTENT_GREETING,
+    INTENT_IDENTITY,
+    INTENT_THANKS,
+    INTENT_STATUS,
+    INTENT_GOODBYE,
+    INTENT_COUNT
+}
+intentId;
+
+typedef struct
+{
+    const char *name;
+    const char *phrases[INTENT_MAX_PHRASES];
+    const char *reply;              /* response template, see response.h */
+}
+intentDef;
+
+const intentDef *intentTable(void);
+
+/*
+ *  Returns the matched intent and, through score, the number of words
+ *  of the phrase that matched (0 for INTENT_UNKNOWN).
+ */
+intentId intentMatch(const char *transcript, int *score);
+
+#endif
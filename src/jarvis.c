@@ -0,0 +1,236 @@
+#include <stdlib.h>
+#include <string.h>
+#include "atomics.h"
+#include "config.h"
+#include "evloop.h"
+#include "intent.h"
+#include "jarvis.h"
+#include "listen.h"
+#include "mempool.h"
+#include "net.h"
+
+#define JARVIS_SAMPLE_RATE  (16000)     /* what clean-up, VAD and features are built for */
+
+struct jarvisIo
+{
+    evLoop         *loop;
+};
+
+struct jarvisSession
+{
+    jarvisOptions   options;
+    config          settings;
+    cleanConfig     cleanCfg;
+    trimConfig      trimCfg;
+    listenConfig    listenCfg;
+    recognizer     *remote;
+    evLoop         *ownLoop;        /* streaming without a shared jarvisIo */
+    recStream      *stream;
+    listener        utterances;
+    int             finished;
+};
+
+static void emit(jarvisSession *s, const jarvisEvent *event)
+{
+    if(s->options.onEvent != NULL)
+    {
+        s->options.onEvent(s->options.ctx, event);
+    }
+}
+
+static void onSpeech(void *ctx, unsigned long id, int ended)
+{
+    jarvisEvent event = { 0 };
+    event.type = ended ? JARVIS_SPEECH_END : JARVIS_SPEECH_START;
+    event.utterance = id;
+    event.text = "";
+    event.intent = "";
+    emit((jarvisSession *)ctx, &event);
+}
+
+static void onReply(void *ctx, const listenReply *r)
+{
+    jarvisSession *s = (jarvisSession *)ctx;
+    jarvisEvent event = { 0 };
+    event.type = JARVIS_TRANSCRIPT;
+    event.utterance = r->id;
+    event.status = r->result->status;       /* REC_* and JARVIS_* share their values */
+    event.text = r->reply != NULL ? r->result->text : "";
+    event.confidence = r->reply != NULL ? r->result->confidence : 0.0f;
+    event.intent = "";
+    event.latency = r->latency;
+    emit(s, &event);
+
+    if(r->reply != NULL)
+    {
+        event.type = JARVIS_INTENT;
+        event.text = r->reply->text;
+        event.intent = intentTable()[r->intent].name;
+        emit(s, &event);
+    }
+}
+
+static void onPartial(void *ctx, unsigned long id, const recResult *partial, intentId intent)
+{
+    jarvisEvent event = { 0 };
+    event.type = JARVIS_PARTIAL;
+    event.utterance = id;
+    event.status = partial->status;
+    event.text = partial->text;
+    event.confidence = partial->confidence;
+    event.intent = intentTable()[intent].name;
+    emit((jarvisSession *)ctx, &event);
+}
+
+jarvisIo *jarvisIoCreate(void)
+{
+    if(netStartup() != NET_OK)
+    {
+        return NULL;
+    }
+    jarvisIo *io = (jarvisIo *)memCalloc(1, sizeof(jarvisIo));
+    if(io == NULL)
+    {
+        return NULL;
+    }
+    io->loop = evLoopCreate(EV_BACKEND_AUTO);
+    if(io->loop == NULL || evLoopSpawn(io->loop) != 0)
+    {
+        evLoopDestroy(io->loop);
+        memFree(io);
+        return NULL;
+    }
+    return io;
+}
+
+void jarvisIoDestroy(jarvisIo *io)
+{
+    if(io != NULL)
+    {
+        evLoopDestroy(io->loop);
+        memFree(io);
+    }
+}
+
+void jarvisDefaults(jarvisOptions *options)
+{
+    memset(options, 0, sizeof(*options));
+    options->sampleRate = JARVIS_SAMPLE_RATE;
+    options->realtime = 1;
+}
+
+jarvisSession *jarvisCreate(const jarvisOptions *options)
+{
+    if(options->sampleRate != JARVIS_SAMPLE_RATE || netStartup() != NET_OK)
+    {
+        return NULL;
+    }
+    jarvisSession *s = (jarvisSession *)memCalloc(1, sizeof(jarvisSession));
+    if(s == NULL)
+    {
+        return NULL;
+    }
+    s->options = *options;
+
+    /* A missing file just means the defaults. */
+    if(options->configPath != NULL)
+    {
+        configLoad(&s->settings, options->configPath);
+    }
+    cleanDefaults(&s->cleanCfg);
+    cleanConfigure(&s->cleanCfg, &s->settings);
+    trimDefaults(&s->trimCfg);
+    trimConfigure(&s->trimCfg, &s->settings);
+    listenDefaults(&s->listenCfg);
+    listenConfigure(&s->listenCfg, &s->settings);
+    s->listenCfg.io = options->io != NULL ? options->io->loop : NULL;
+
+    if(configNumber(&s->settings, "recognizer_stream", 0) != 0)
+    {
+        evLoop *loop = s->listenCfg.io;
+        if(loop == NULL)
+        {
+            s->ownLoop = evLoopCreate(EV_BACKEND_AUTO);
+            if(s->ownLoop != NULL && evLoopSpawn(s->ownLoop) != 0)
+            {
+                evLoopDestroy(s->ownLoop);
+                s->ownLoop = NULL;
+            }
+            loop = s->ownLoop;
+        }
+        s->stream = loop != NULL ? recStreamConfigure(loop, &s->settings, options->sampleRate) : NULL;
+        if(s->stream == NULL)
+        {
+            evLoopDestroy(s->ownLoop);
+            memFree(s);
+            return NULL;
+        }
+        s->listenCfg.stream = s->stream;
+    }
+
+    listenCallbacks callbacks = { onSpeech, onReply, s, onPartial };
+    s->remote = recRemoteConfigure(&s->settings);
+    if(s->remote == NULL || listenOpen(&s->utterances, &s->listenCfg, options->sampleRate, &s->cleanCfg,
+                                       &s->trimCfg, s->remote, &callbacks) != 0)
+    {
+        recDestroy(s->remote);
+        recStreamDestroy(s->stream);
+        evLoopDestroy(s->ownLoop);
+        memFree(s);
+        return NULL;
+    }
+    return s;
+}
+
+int jarvisPush(jarvisSession *s, const short *pcm, long count)
+{
+    if(atomicLoadRelaxed(&s->finished))
+    {
+        return JARVIS_ERROR;
+    }
+    if(s->options.realtime)
+    {
+        listenPush(&s->utterances, pcm, count);
+    }
+    else
+    {
+        listenPushWait(&s->utterances, pcm, count);
+    }
+    return JARVIS_OK;
+}
+
+void jarvisFinish(jarvisSession *s)
+{
+    if(!s->finished)
+    {
+        atomicStore(&s->finished, 1);
+        listenFinish(&s->utterances);
+    }
+}
+
+void jarvisGetStats(const jarvisSession *s, jarvisStats *out)
+{
+    const listenStats *st = &s->utterances.stats;
+    out->utterances = st->utterances;
+    out->recognized = st->recognized;
+    out->failed = st->failed;
+    out->dropped = st->overruns;
+    out->speculationHits = st->speculationHits;
+    out->speculationMisses = st->speculationMisses;
+    out->deferred = st->deferred;
+    out->cached = st->cached;
+}
+
+void jarvisDestroy(jarvisSession *s)
+{
+    if(s == NULL)
+    {
+        return;
+    }
+    jarvisFinish(s);
+    listenClose(&s->utterances);
+    recStreamDestroy(s->stream);
+    recDestroy(s->remote);
+    evLoopDestroy(s->ownLoop);
+    memFree(s);
+}
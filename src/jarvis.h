@@ -0,0 +1,125 @@
+#ifndef JARVIS_H
+#define JARVIS_H
+
+/*
+ *  libjarvis: the listening path of Jarvis as a library. The caller owns
+ *  the audio and pushes PCM blocks; each session cuts them into
+ *  utterances, cleans, trims and encodes them, has them recognized and
+ *  matched to an intent, and reports all of it through one callback.
+ *
+ *      jarvisOptions o;
+ *      jarvisDefaults(&o);
+ *      o.onEvent = handler;
+ *      jarvisSession *s = jarvisCreate(&o);
+ *      while(...) jarvisPush(s, pcm, count);
+ *      jarvisFinish(s);            (optional: flush and wait for the last events)
+ *      jarvisDestroy(s);
+ *
+ *  Any number of sessions can run in one process, each fed from its own
+ *  thread. Their pipelines are separate; what they share is process-wide
+ *  and thread-safe: the memory pool (memory_budget_kb), the metrics
+ *  registry, the trace rings, read-only tables built on first use and,
+ *  if given one, a jarvisIo upload thread. Build with `make lib` for
+ *  bin/libjarvis.a and the shared library.
+ */
+
+/* What the shared library exports; the rest of it stays internal. */
+#if defined(_WIN32) && defined(JARVIS_BUILD)
+#define JARVIS_API          __declspec(dllexport)
+#elif defined(__GNUC__) && !defined(_WIN32)
+#define JARVIS_API          __attribute__((visibility("default")))
+#else
+#define JARVIS_API
+#endif
+
+#define JARVIS_OK           (0)
+#define JARVIS_NO_MATCH     (1)
+#define JARVIS_ERROR        (-1)
+#define JARVIS_CANCELLED    (-2)
+#define JARVIS_TIMEOUT      (-3)
+
+typedef enum
+{
+    JARVIS_SPEECH_START,        /* an utterance has enough speech to be kept */
+    JARVIS_SPEECH_END,          /* it was cut and is on its way to the recognizer */
+    JARVIS_TRANSCRIPT,          /* recognition finished, status says how */
+    JARVIS_INTENT,              /* after a successful transcript: intent and reply */
+    JARVIS_PARTIAL              /* interim hypothesis while speech is streamed (recognizer_stream) */
+}
+jarvisEventType;
+
+typedef struct
+{
+    jarvisEventType     type;
+    unsigned long       utterance;      /* same for all events of one utterance */
+    int                 status;         /* TRANSCRIPT: JARVIS_OK or why not */
+    const char         *text;           /* TRANSCRIPT and PARTIAL: hypothesis, INTENT: reply */
+    float               confidence;     /* TRANSCRIPT and PARTIAL */
+    const char         *intent;         /* INTENT: name, "unknown" if none matched; PARTIAL: the likely one */
+    double              latency;        /* TRANSCRIPT and INTENT: seconds since the end of speech */
+}
+jarvisEvent;
+
+/*
+ *  Speech events arrive on the session's capture thread, transcripts
+ *  and intents on its respond thread; never two at once for one session.
+ *  Partials are the exception: they arrive on the I/O thread and may
+ *  overlap the others. Strings are only valid during the call.
+ */
+typedef void (*jarvisEventFunc)(void *ctx, const jarvisEvent *event);
+
+/*
+ *  An I/O thread sessions can share: their uploads then run on its
+ *  event loop (io_uring, epoll or poll) instead of blocking a thread per
+ *  session, so hundreds of sessions need one network thread. Destroy it
+ *  after the last session using it.
+ */
+typedef struct jarvisIo jarvisIo;
+
+JARVIS_API jarvisIo      *jarvisIoCreate(void);
+JARVIS_API void           jarvisIoDestroy(jarvisIo *io);
+
+typedef struct
+{
+    int                 sampleRate;     /* of the pushed PCM; 16000 is the only rate supported */
+    int                 realtime;       /* 1: push never blocks and drops what does not fit, 0: push waits */
+    const char         *configPath;     /* jarvis.conf-style settings, NULL for the defaults */
+    jarvisEventFunc     onEvent;
+    void               *ctx;
+    jarvisIo           *io;             /* NULL: the session uploads on a thread of its own */
+                                        /* (and streams, if configured, on a loop of its own) */
+}
+jarvisOptions;
+
+typedef struct
+{
+    unsigned long       utterances;
+    unsigned long       recognized;
+    unsigned long       failed;
+    unsigned long       dropped;        /* samples lost because a realtime session fell behind */
+    unsigned long       speculationHits;    /* replies prepared from a partial and committed */
+    unsigned long       speculationMisses;  /* replies prepared from a partial and discarded */
+    unsigned long       deferred;       /* speech blocks heard with no memory for an utterance (mempool.h) */
+    unsigned long       cached;         /* utterances answered from the fingerprint cache, without an upload */
+}
+jarvisStats;
+
+typedef struct jarvisSession jarvisSession;
+
+JARVIS_API void           jarvisDefaults(jarvisOptions *options);
+
+/* Starts the session's threads; NULL if the options are unusable or something could not be set up. */
+JARVIS_API jarvisSession *jarvisCreate(const jarvisOptions *options);
+
+/* Mono 16-bit PCM at the session's rate. Returns JARVIS_ERROR once the session is finished. */
+JARVIS_API int            jarvisPush(jarvisSession *s, const short *pcm, long count);
+
+/* Ends the utterance in progress and returns after every event has been delivered. Later pushes fail. */
+JARVIS_API void           jarvisFinish(jarvisSession *s);
+
+JARVIS_API void           jarvisGetStats(const jarvisSession *s, jarvisStats *out);
+
+/* Finishes the session if needed and frees it. */
+JARVIS_API void           jarvisDestroy(jarvisSession *s);
+
+#endif
@@ -0,0 +1,222 @@
+#include <stdlib.h>
+#include <string.h>
+#include "json.h"
+
+#define JSON_MAX_DEPTH  (32)
+
+static int newToken(jsonToken *tokens, int *count, int maxTokens, jsonType type, int start, int end)
+{
+    if(*count >= maxTokens)
+    {
+        return JSON_ERROR_NOMEM;
+    }
+    jsonToken *t = &tokens[*count];
+    t->type = type;
+    t->start = start;
+    t->end = end;
+    t->size = 0;
+    return (*count)++;
+}
+
+int jsonParse(const char *js, size_t length, jsonToken *tokens, int maxTokens)
+{
+    int stack[JSON_MAX_DEPTH];
+    int depth = 0;
+    int count = 0;
+    int isKey = 0;      /* next string inside an object is a key */
+
+    for(size_t i = 0; i < length; i++)
+    {
+        char c = js[i];
+        int parent = depth > 0 ? stack[depth - 1] : -1;
+
+        switch(c)
+        {
+            case '{':
+            case '[':
+            {
+                if(depth == JSON_MAX_DEPTH)
+                {
+                    return JSON_ERROR_INVALID;
+                }
+                int t = newToken(tokens, &count, maxTokens, c == '{' ? JSON_OBJECT : JSON_ARRAY, (int)i, -1);
+                if(t < 0)
+                {
+                    return t;
+                }
+                if(parent >= 0 && tokens[parent].type == JSON_ARRAY)
+                {
+                    tokens[parent].size++;
+                }
+                stack[depth++] = t;
+                isKey = c == '{';
+                break;
+            }
+            case '}':
+            case ']':
+                if(parent < 0 || tokens[parent].type != (c == '}' ? JSON_OBJECT : JSON_ARRAY))
+                {
+                    return JSON_ERROR_INVALID;
+                }
+                tokens[parent].end = (int)i + 1;
+                depth--;
+                isKey = depth > 0 && tokens[stack[depth - 1]].type == JSON_OBJECT;
+                break;
+            case '"':
+            {
+                size_t start = ++i;
+                for(; i < length && js[i] != '"'; i++)
+                {
+                    if(js[i] == '\\')
+                    {
+                        i++;
+                    }
+                }
+                if(i >= length)
+                {
+                    return JSON_ERROR_INVALID;
+                }
+                int t = newToken(tokens, &count, maxTokens, JSON_STRING, (int)start, (int)i);
+                if(t < 0)
+                {
+                    return t;
+                }
+                if(parent >= 0 && (tokens[parent].type == JSON_ARRAY || isKey))
+                {
+                    tokens[parent].size++;
+                }
+                isKey = 0;
+                break;
+            }
+            case ':':
+                isKey = 0;
+                break;
+            case ',':
+                isKey = parent >= 0 && tokens[parent].type == JSON_OBJECT;
+                break;
+            case ' ':
+            case '\t':
+            case '\r':
+            case '\n':
+                break;
+            default:
+            {
+                size_t start = i;
+                while(i < length && strchr(",]} \t\r\n", js[i]) == NULL)
+                {
+                    i++;
+                }
+                int t = newToken(tokens, &count, maxTokens, JSON_PRIMITIVE, (int)start, (int)i);
+                if(t < 0)
+                {
+                    return t;
+                }
+                if(parent >= 0 && tokens[parent].type == JSON_ARRAY)
+                {
+                    tokens[parent].size++;
+                }
+                i--;
+                break;
+            }
+        }
+    }
+
+    return depth == 0 ? count : JSON_ERROR_INVALID;
+}
+
+int jsonNext(const jsonToken *tokens, int count, int i)
+{
+    int end = tokens[i].end;
+    int j = i + 1;
+    if(tokens[i].type == JSON_OBJECT || tokens[i].type == JSON_ARRAY)
+    {
+        while(j < count && tokens[j].start < end)
+        {
+            j++;
+        }
+    }
+    return j;
+}
+
+int jsonObjectGet(const char *js, const jsonToken *tokens, int count, int obj, const char *key)
+{
+    if(obj < 0 || obj >= count || tokens[obj].type != JSON_OBJECT)
+    {
+        return -1;
+    }
+    size_t keyLength = strlen(key);
+    int j = obj + 1;
+    for(int m = 0; m < tokens[obj].size && j + 1 < count; m++)
+    {
+        const jsonToken *k = &tokens[j];
+        if(k->type == JSON_STRING && (size_t)(k->end - k->start) == keyLength &&
+           memcmp(js + k->start, key, keyLength) == 0)
+        {
+            return j + 1;
+        }
+        j = jsonNext(tokens, count, j + 1);
+    }
+    return -1;
+}
+
+int jsonArrayGet(const jsonToken *tokens, int count, int arr, int idx)
+{
+    if(arr < 0 || arr >= count || tokens[arr].type != JSON_ARRAY || idx >= tokens[arr].size)
+    {
+        return -1;
+    }
+    int j = arr + 1;
+    for(int e = 0; e < idx; e++)
+    {
+        j = jsonNext(tokens, count, j);
+    }
+    return j < count ? j : -1;
+}
+
+int jsonString(const char *js, const jsonToken *t, char *out, size_t capacity)
+{
+    size_t n = 0;
+    if(t->type != JSON_STRING || capacity == 0)
+    {
+        return -1;
+    }
+    for(int i = t->start; i < t->end && n + 1 < capacity; i++)
+    {
+        char c = js[i];
+        if(c == '\\' && i + 1 < t->end)
+        {
+            c = js[++i];
+            switch(c)
+            {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'u':
+                    /* Non-ASCII is not needed for command text; keep a placeholder. */
+                    i += 4;
+                    c = '?';
+                    break;
+                default:
+                    break;
+            }
+        }
+        out[n++] = c;
+    }
+    out[n] = '\0';
+    return (int)n;
+}
+
+double jsonNumber(const char *js, const jsonToken *t)
+{
+    char buf[64];
+    size_t n = (size_t)(t->end - t->start);
+    if(t->type != JSON_PRIMITIVE || n >= sizeof(buf))
+    {
+        return 0.0;
+    }
+    memcpy(buf, js + t->start, n);
+    buf[n] = '\0';
+    return strtod(buf, NULL);
+}
@@ -0,0 +1,50 @@
+#ifndef JARVIS_JSON_H
+#define JARVIS_JSON_H
+
+#include <stddef.h>
+
+/*
+ *  Non-allocating JSON tokenizer. The caller supplies the token array;
+ *  tokens reference the original text by offset, so parsing a response
+ *  costs one pass and no copies.
+ */
+
+#define JSON_ERROR_NOMEM    (-1)
+#define JSON_ERROR_INVALID  (-2)
+
+typedef enum
+{
+    JSON_OBJECT,
+    JSON_ARRAY,
+    JSON_STRING,
+    JSON_PRIMITIVE
+}
+jsonType;
+
+typedef struct
+{
+    jsonType    type;
+    int         start;      /* offset of the first character (after the quote for strings) */
+    int         end;        /* offset one past the last character */
+    int         size;       /* members for objects, elements for arrays */
+}
+jsonToken;
+
+/* Returns the number of tokens used, or a JSON_ERROR_* code. */
+int jsonParse(const char *js, size_t length, jsonToken *tokens, int maxTokens);
+
+/* Index of the first token after the subtree rooted at i. */
+int jsonNext(const jsonToken *tokens, int count, int i);
+
+/* Value token for key in object obj, or -1. */
+int jsonObjectGet(const char *js, const jsonToken *tokens, int count, int obj, const char *key);
+
+/* Element idx of array arr, or -1. */
+int jsonArrayGet(const jsonToken *tokens, int count, int arr, int idx);
+
+/* Copies a string token with escapes resolved; returns its length or -1. */
+int jsonString(const char *js, const jsonToken *t, char *out, size_t capacity);
+
+double jsonNumber(const char *js, const jsonToken *t);
+
+#endif
@@ -0,0 +1,804 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atomics.h"
+#include "clock.h"
+#include "listen.h"
+#include "mempool.h"
+#include "trace.h"
+
+#define LISTEN_RING         (65536)     /* ~4 s of backlog at 16 kHz */
+#define LISTEN_MIN_SPEECH   (10)        /* blocks of speech an utterance needs to be uploaded */
+#define LISTEN_ZERO         (256)       /* samples per clean-up chunk and per silent push */
+#define LISTEN_WAIT         (0.1)       /* seconds; bounds a lost wake-up */
+#define LISTEN_UPLOAD       (3)         /* stage index of upload */
+#define LISTEN_MIN_SECONDS  (0.1)       /* shortest listen_max_seconds, room past the pre-roll */
+#define LISTEN_CACHE_SIMILARITY (0.85f)
+#define LISTEN_CACHE_VERIFY     (20)    /* one hit in this many is uploaded anyway */
+#define LISTEN_CACHE_CONFIDENCE (0.5f)  /* remote answers below this are not cached */
+
+/* Upper bounds of the reply latency histogram, seconds. */
+static const double latencyBuckets[] = { 0.05, 0.1, 0.2, 0.3, 0.5, 0.75, 1.0, 1.5, 2.0, 3.0, 5.0 };
+
+struct utterJob
+{
+    listener       *owner;
+    unsigned long   id;
+    short          *samples;        /* raw, then cleaned */
+    long            count;
+    long            capacity;
+    int             speechBlocks;
+    double          ended;          /* clockNow() at the end of speech */
+    int             status;
+    trimResult      trimmed;
+    flacPayload    *payload;
+    httpResponse    response;
+    recResult       result;
+    unsigned long   streamId;       /* streamed to the recognizer, 0 if not */
+    int             streamFinal;    /* its final is in result (streamLock) */
+    int             parked;         /* the async upload stage left it to the final (streamLock) */
+    int             transcribed;    /* result came from the stream, nothing to parse */
+    intentId        specIntent;     /* reply prepared from a partial, INTENT_UNKNOWN if none */
+    char            specHeard[REC_TEXT_MAX];    /* the partial it was prepared from */
+    char            specText[RESP_TEXT_MAX];
+    size_t          specLength;
+    time_t          specUntil;      /* render goes stale here, 0 = never */
+    audioFingerprint print;
+    int             printed;        /* print is valid */
+    int             cacheSlot;      /* hit sampled for verification, -1 if none */
+    char            cachedText[REC_TEXT_MAX];
+};
+
+void listenDefaults(listenConfig *cfg)
+{
+    cfg->seconds = 0.0;
+    cfg->queue = 4;
+    cfg->prerollMs = 300;
+    cfg->hangoverMs = 600;
+    cfg->maxSeconds = 10.0;
+    cfg->cacheEntries = 64;
+    cfg->budget = 3.0;
+    cfg->io = NULL;
+    cfg->stream = NULL;
+}
+
+void listenConfigure(listenConfig *cfg, const config *settings)
+{
+    cfg->seconds = configNumber(settings, "listen_seconds", cfg->seconds);
+    cfg->queue = (int)configNumber(settings, "listen_queue", cfg->queue);
+    cfg->prerollMs = (int)configNumber(settings, "listen_preroll_ms", cfg->prerollMs);
+    cfg->hangoverMs = (int)configNumber(settings, "listen_hangover_ms", cfg->hangoverMs);
+    cfg->maxSeconds = configNumber(settings, "listen_max_seconds", cfg->maxSeconds);
+    cfg->cacheEntries = (int)configNumber(settings, "listen_cache_entries", cfg->cacheEntries);
+}
+
+static void jobFree(utterJob *job)
+{
+    if(job->payload != NULL)
+    {
+        flacPayloadRelease(job->payload);
+    }
+    httpResponseFree(&job->response);
+    trimFree(&job->trimmed);
+    memFree(job->samples);
+    memFree(job);
+}
+
+/*------ CAPTURE ------*/
+
+static void prerollPush(listener *l, const short *block)
+{
+    if(l->prerollBlocks == 0)
+    {
+        return;
+    }
+    memcpy(l->preroll + (long)l->prerollNext * l->block, block, l->block * sizeof(short));
+    l->prerollNext = (l->prerollNext + 1) % l->prerollBlocks;
+    if(l->prerollUsed < l->prerollBlocks)
+    {
+        l->prerollUsed++;
+    }
+}
+
+static utterJob *startUtterance(listener *l)
+{
+    utterJob *job = (utterJob *)memCalloc(1, sizeof(utterJob));
+    if(job == NULL)
+    {
+        return NULL;
+    }
+    job->capacity = (long)(l->cfg.maxSeconds * l->sampleRate) + (long)l->prerollBlocks * l->block;
+    job->samples = (short *)memAlloc(job->capacity * sizeof(short));
+    if(job->samples == NULL)
+    {
+        memFree(job);
+        return NULL;
+    }
+    job->owner = l;
+    job->id = ++l->nextId;
+    job->status = REC_OK;
+    job->cacheSlot = -1;
+
+    /* Oldest pre-roll block first. */
+    for(int i = 0; i < l->prerollUsed; i++)
+    {
+        int b = (l->prerollNext - l->prerollUsed + i + l->prerollBlocks) % l->prerollBlocks;
+        memcpy(job->samples + job->count, l->preroll + (long)b * l->block, l->block * sizeof(short));
+        job->count += l->block;
+    }
+    l->prerollUsed = 0;
+    l->silentBlocks = 0;
+    return job;
+}
+
+/* Hands the current utterance on, or drops it if it was only a click. */
+static utterJob *finishUtterance(listener *l)
+{
+    utterJob *job = l->current;
+    l->current = NULL;
+    if(job == NULL)
+    {
+        return NULL;
+    }
+    if(job->speechBlocks < LISTEN_MIN_SPEECH)
+    {
+        l->stats.discarded++;
+        metricInc(l->metricDiscarded);
+        jobFree(job);
+        return NULL;
+    }
+    job->ended = clockNow();
+    traceInstant(l->traceCut, job->id);
+    if(job->streamId != 0)
+    {
+        recStreamEnd(l->cfg.stream, job->streamId, job->ended + l->cfg.budget);
+    }
+    l->stats.utterances++;
+    if(l->callbacks.onSpeech != NULL)
+    {
+        l->callbacks.onSpeech(l->callbacks.ctx, job->id, 1);
+    }
+    return job;
+}
+
+static void streamResult(void *ctx, const recResult *result, int final);
+
+/* Opens the utterance on the streaming recognizer with everything heard so far. */
+static void streamBegin(listener *l, utterJob *job)
+{
+    if(l->cfg.stream == NULL)
+    {
+        return;
+    }
+    job->streamId = recStreamBegin(l->cfg.stream, streamResult, job);
+    if(job->streamId != 0)
+    {
+        recStreamAudio(l->cfg.stream, job->streamId, job->samples, job->count);
+    }
+}
+
+static utterJob *segmentBlock(listener *l, const short *block)
+{
+    float energy = 0.0f;
+    for(int i = 0; i < l->block; i++)
+    {
+        float x = block[i] * (1.0f / 32768.0f);
+        energy += x * x;
+    }
+    int speech = vadUpdate(&l->activity, logf(energy + 1e-10f));
+
+    if(l->current == NULL)
+    {
+        if(!speech)
+        {
+            prerollPush(l, block);
+            return NULL;
+        }
+        if((l->current = startUtterance(l)) == NULL)
+        {
+            /* No memory for an utterance: keep the pre-roll rolling, so the speech start is kept once there is. */
+            l->stats.deferred++;
+            prerollPush(l, block);
+            return NULL;
+        }
+    }
+
+    utterJob *job = l->current;
+    if(job->count + l->block > job->capacity)
+    {
+        /* Full; the check after the copy normally cuts it a block earlier. */
+        return finishUtterance(l);
+    }
+    memcpy(job->samples + job->count, block, l->block * sizeof(short));
+    job->count += l->block;
+    if(job->streamId != 0)
+    {
+        recStreamAudio(l->cfg.stream, job->streamId, block, l->block);
+    }
+    if(speech)
+    {
+        /* Reported and streamed once it is clearly not a click, which finishUtterance would drop. */
+        if(++job->speechBlocks == LISTEN_MIN_SPEECH)
+        {
+            traceInstant(l->traceSpeech, job->id);
+            if(l->callbacks.onSpeech != NULL)
+            {
+                l->callbacks.onSpeech(l->callbacks.ctx, job->id, 0);
+            }
+            streamBegin(l, job);
+        }
+        l->silentBlocks = 0;
+    }
+    else
+    {
+        l->silentBlocks++;
+    }
+
+    if(l->silentBlocks * 10 >= l->cfg.hangoverMs || job->count + l->block > job->capacity)
+    {
+        return finishUtterance(l);
+    }
+    return NULL;
+}
+
+static void *captureStage(void *ctx, void *item)
+{
+    listener *l = (listener *)ctx;
+    (void)item;
+
+    for(;;)
+    {
+        size_t n = sampleRingRead(&l->ring, l->pending + l->pendingCount, (size_t)(l->block - l->pendingCount));
+        if(n > 0)
+        {
+            notifySignal(&l->room);
+        }
+        l->pendingCount += (int)n;
+        if(l->pendingCount < l->block)
+        {
+            /* Once the callback has stopped, whatever is in progress is the last utterance. */
+            return atomicLoad(&l->closing) ? finishUtterance(l) : NULL;
+        }
+        l->pendingCount = 0;
+
+        utterJob *job = segmentBlock(l, l->pending);
+        if(job != NULL)
+        {
+            return job;
+        }
+    }
+}
+
+/*------ DSP, ENCODE, UPLOAD, PARSE ------*/
+
+/* Answers a repeated utterance from the cache; a verified or missed one goes on to the upload. */
+static void cacheLookup(listener *l, utterJob *job)
+{
+    featInit(l->features);
+    featPush(l->features, job->trimmed.samples, job->trimmed.count);
+    unsigned long frames = featRingWritten(&l->features->ring);
+    unsigned long first = frames > FEAT_RING_FRAMES - 1 ? frames - (FEAT_RING_FRAMES - 1) : 0;
+    job->printed = fpCompute(&l->features->ring, first, frames - first, &job->print) == 0;
+    if(!job->printed)
+    {
+        return;
+    }
+    int verify = 0;
+    float confidence = 0.0f;
+    int slot = fpCacheLookup(l->cache, &job->print, job->cachedText, sizeof(job->cachedText), &confidence, &verify);
+    if(slot >= 0 && !verify)
+    {
+        snprintf(job->result.text, sizeof(job->result.text), "%s", job->cachedText);
+        job->result.confidence = confidence;
+        job->result.backend = "cache";
+        job->result.status = REC_OK;
+        job->transcribed = 1;
+        atomicAddRelaxed(&l->stats.cached, 1);
+    }
+    else if(slot >= 0)
+    {
+        job->cacheSlot = slot;
+    }
+}
+
+/* Parse stage: checks a sampled hit against the remote answer and remembers confident ones. */
+static void cacheLearn(listener *l, utterJob *job)
+{
+    if(!job->printed || job->status != REC_OK)
+    {
+        return;
+    }
+    if(job->cacheSlot >= 0)
+    {
+        fpCacheVerified(l->cache, job->cacheSlot, &job->print, strcmp(job->cachedText, job->result.text) == 0);
+    }
+    if(job->result.confidence >= LISTEN_CACHE_CONFIDENCE)
+    {
+        fpCacheInsert(l->cache, &job->print, job->result.text, job->result.confidence);
+    }
+}
+
+static void *dspStage(void *ctx, void *item)
+{
+    listener *l = (listener *)ctx;
+    utterJob *job = (utterJob *)item;
+
+    /*
+     *  Cleaned in place, a chunk at a time: the output lags the input by
+     *  the clean-up delay, so it only ever overwrites samples already read.
+     *  The delay is flushed with silence so the output lines up with the input.
+     */
+    long latency = cleanLatency(l->cleanup);
+    long total = job->count + latency;
+    short in[LISTEN_ZERO];
+    short out[LISTEN_ZERO];
+    cleanInit(l->cleanup, &l->cleanCfg);
+    for(long done = 0; done < total; done += LISTEN_ZERO)
+    {
+        long n = total - done < LISTEN_ZERO ? total - done : LISTEN_ZERO;
+        long heard = job->count - done > n ? n : (job->count > done ? job->count - done : 0);
+        memcpy(in, job->samples + done, heard * sizeof(short));
+        memset(in + heard, 0, (n - heard) * sizeof(short));
+        cleanProcess(l->cleanup, in, out, n);
+        long skip = done < latency ? latency - done : 0;
+        if(skip < n)
+        {
+            memcpy(job->samples + done + skip - latency, out + skip, (n - skip) * sizeof(short));
+        }
+    }
+
+    if(trimUtterance(job->samples, job->count, l->sampleRate, &l->trimCfg, &job->trimmed) != 0
+       || job->trimmed.count == 0)
+    {
+        job->status = REC_NO_MATCH;
+    }
+    else if(l->cache != NULL && job->streamId == 0)
+    {
+        cacheLookup(l, job);
+    }
+    return job;
+}
+
+static void *encodeStage(void *ctx, void *item)
+{
+    listener *l = (listener *)ctx;
+    utterJob *job = (utterJob *)item;
+    /* A streamed utterance is only encoded if the stream fails; a cached one not at all. */
+    if(job->status == REC_OK && job->streamId == 0 && !job->transcribed)
+    {
+        job->payload = flacPayloadCreate(job->trimmed.samples, job->trimmed.count, l->sampleRate);
+        job->status = job->payload != NULL ? REC_OK : REC_ERROR;
+    }
+    return job;
+}
+
+/*
+ *  After a streamed utterance's final: returns 1 if it failed with budget
+ *  left and has been encoded to be uploaded instead, else takes the
+ *  stream's answer.
+ */
+static int streamFallback(listener *l, utterJob *job)
+{
+    if(job->status == REC_OK && job->result.status == REC_ERROR && clockNow() < job->ended + l->cfg.budget)
+    {
+        job->payload = flacPayloadCreate(job->trimmed.samples, job->trimmed.count, l->sampleRate);
+        if(job->payload != NULL)
+        {
+            atomicAddRelaxed(&l->stats.fallbacks, 1);
+            metricInc(l->metricFallbacks);
+            return 1;
+        }
+    }
+    job->status = job->result.status;
+    job->transcribed = 1;
+    return 0;
+}
+
+static void uploadDone(void *ctx, int status, httpResponse *response);
+
+/*
+ *  Loop thread: renders the reply a partial points to. The compiled
+ *  templates are only read after listenOpen, so this can run beside the
+ *  respond stage; the final's hand-over orders it before the commit.
+ */
+static intentId speculate(listener *l, utterJob *job, const char *heard)
+{
+    intentId intent = intentMatch(heard, NULL);
+    const respTemplate *t = &l->replies.templates[intent];
+    if(intent == INTENT_UNKNOWN || (intent == job->specIntent && !t->uncacheable))
+    {
+        return intent;
+    }
+    time_t now = time(NULL);
+    respContext ctx = { heard, now };
+    size_t length = tplRender(t, &ctx, job->specText, sizeof(job->specText));
+    job->specLength = length < sizeof(job->specText) ? length : sizeof(job->specText) - 1;
+    job->specUntil = tplValidUntil(t, now);
+    snprintf(job->specHeard, sizeof(job->specHeard), "%s", heard);
+    job->specIntent = intent;
+    atomicAddRelaxed(&l->stats.speculations, 1);
+    return intent;
+}
+
+/* Loop thread of the stream: partials are speculated on and go to the callback, the final to the job. */
+static void streamResult(void *ctx, const recResult *result, int final)
+{
+    utterJob *job = (utterJob *)ctx;
+    listener *l = job->owner;
+    if(!final)
+    {
+        traceInstant(l->tracePartial, job->id);
+        intentId intent = speculate(l, job, result->text);
+        if(l->callbacks.onPartial != NULL)
+        {
+            l->callbacks.onPartial(l->callbacks.ctx, job->id, result, intent);
+        }
+        return;
+    }
+
+    traceInstant(l->traceFinal, job->id);
+    pthread_mutex_lock(&l->streamLock);
+    job->result = *result;
+    job->streamFinal = 1;
+    int parked = job->parked;
+    pthread_mutex_unlock(&l->streamLock);
+    notifySignal(&l->streamed);
+
+    if(parked)
+    {
+        if(streamFallback(l, job))
+        {
+            if(recRemoteSubmit(l->remote, l->cfg.io, job->payload, l->sampleRate, job->ended + l->cfg.budget,
+                               uploadDone, job) == REC_OK)
+            {
+                return;
+            }
+            job->status = REC_ERROR;
+        }
+        pipelineComplete(&l->pipe, LISTEN_UPLOAD, job);
+    }
+}
+
+/* Upload stage thread; the stream's deadline bounds the wait. */
+static void streamWait(listener *l, utterJob *job)
+{
+    for(;;)
+    {
+        unsigned seen = notifyPrepare(&l->streamed);
+        pthread_mutex_lock(&l->streamLock);
+        int done = job->streamFinal;
+        pthread_mutex_unlock(&l->streamLock);
+        if(done)
+        {
+            return;
+        }
+        notifyWait(&l->streamed, seen, LISTEN_WAIT);
+    }
+}
+
+static void *uploadStage(void *ctx, void *item)
+{
+    listener *l = (listener *)ctx;
+    utterJob *job = (utterJob *)item;
+    if(job->streamId != 0)
+    {
+        streamWait(l, job);
+        if(!streamFallback(l, job))
+        {
+            return job;
+        }
+    }
+    if(job->status == REC_OK && !job->transcribed)
+    {
+        job->status = recRemoteSend(l->remote, job->payload, l->sampleRate, job->ended + l->cfg.budget,
+                                    &l->cancel, &job->response);
+        flacPayloadRelease(job->payload);
+        job->payload = NULL;
+    }
+    return job;
+}
+
+/* Loop thread: the upload is over either way. */
+static void uploadDone(void *ctx, int status, httpResponse *response)
+{
+    utterJob *job = (utterJob *)ctx;
+    job->status = status;
+    if(status == REC_OK)
+    {
+        job->response = *response;
+    }
+    flacPayloadRelease(job->payload);
+    job->payload = NULL;
+    pipelineComplete(&job->owner->pipe, LISTEN_UPLOAD, job);
+}
+
+static void *uploadStartStage(void *ctx, void *item)
+{
+    listener *l = (listener *)ctx;
+    utterJob *job = (utterJob *)item;
+    if(job->streamId != 0)
+    {
+        /* Parked: streamResult completes it, or uploads it if the stream failed. */
+        pthread_mutex_lock(&l->streamLock);
+        job->parked = !job->streamFinal;
+        int parked = job->parked;
+        pthread_mutex_unlock(&l->streamLock);
+        if(parked)
+        {
+            return NULL;
+        }
+        if(!streamFallback(l, job))
+        {
+            return job;
+        }
+    }
+    if(job->status != REC_OK || job->transcribed)
+    {
+        return job;
+    }
+    recRemoteResolve(l->remote);        /* endpoints the resolver missed at startup; the loop cannot wait */
+    if(recRemoteSubmit(l->remote, l->cfg.io, job->payload, l->sampleRate, job->ended + l->cfg.budget,
+                       uploadDone, job) != REC_OK)
+    {
+        job->status = REC_ERROR;
+        return job;
+    }
+    return NULL;
+}
+
+static void *parseStage(void *ctx, void *item)
+{
+    listener *l = (listener *)ctx;
+    utterJob *job = (utterJob *)item;
+    if(job->transcribed)
+    {
+        return job;
+    }
+    job->result.backend = "remote";
+    if(job->status == REC_OK)
+    {
+        job->status = recRemoteParse(job->response.body, job->response.bodyLength, &job->result);
+        httpResponseFree(&job->response);
+    }
+    job->result.status = job->status;
+    cacheLearn(l, job);
+    return job;
+}
+
+/*------ RESPOND ------*/
+
+/* The prepared reply, if the final agrees with it and it has not gone stale. */
+static int commitSpeculation(listener *l, utterJob *job, intentId intent, time_t now, respReply *out)
+{
+    if(job->specIntent == INTENT_UNKNOWN || job->specIntent != intent
+       || (job->specUntil != 0 && now >= job->specUntil)
+       || (l->replies.templates[intent].uncacheable && strcmp(job->specHeard, job->result.text) != 0))
+    {
+        return 0;
+    }
+    out->text = job->specText;
+    out->length = job->specLength;
+    out->pcm = NULL;
+    out->pcmCount = 0;
+    out->cached = 0;
+    return 1;
+}
+
+static void *respondStage(void *ctx, void *item)
+{
+    listener *l = (listener *)ctx;
+    utterJob *job = (utterJob *)item;
+    respReply reply;
+    listenReply out =
+    {
+        .id         =   job->id,
+        .seconds    =   (double)job->trimmed.count / l->sampleRate,
+        .result     =   &job->result,
+        .intent     =   INTENT_UNKNOWN,
+        .reply      =   NULL,
+    };
+
+    l->stats.streamed += job->transcribed && job->streamId != 0;
+    if(job->status == REC_OK)
+    {
+        time_t now = time(NULL);
+        out.intent = intentMatch(job->result.text, NULL);
+        out.speculated = commitSpeculation(l, job, out.intent, now, &reply);
+        if(!out.speculated)
+        {
+            respondTo(&l->replies, out.intent, job->result.text, now, &reply);
+        }
+        out.reply = &reply;
+        l->stats.recognized++;
+        metricInc(l->metricRecognized);
+    }
+    else
+    {
+        l->stats.failed++;
+        metricInc(l->metricFailed);
+    }
+    if(job->specIntent != INTENT_UNKNOWN)
+    {
+        l->stats.speculationHits += out.speculated;
+        l->stats.speculationMisses += !out.speculated;
+        metricInc(out.speculated ? l->metricCommitted : l->metricWasted);
+    }
+    out.latency = clockNow() - job->ended;
+    metricObserve(l->metricLatency, out.latency);
+    l->stats.latencySum += out.latency;
+    if(out.latency > l->stats.latencyMax)
+    {
+        l->stats.latencyMax = out.latency;
+    }
+
+    if(l->callbacks.onReply != NULL)
+    {
+        l->callbacks.onReply(l->callbacks.ctx, &out);
+    }
+    jobFree(job);
+    return NULL;
+}
+
+/*------ SETUP ------*/
+
+int listenOpen(listener *l, const listenConfig *cfg, int sampleRate, const cleanConfig *cleanCfg,
+               const trimConfig *trimCfg, recognizer *remote, const listenCallbacks *callbacks)
+{
+    memset(l, 0, sizeof(*l));
+    l->cfg = *cfg;
+    /* An utterance must have room past its pre-roll; negative times mean none. */
+    l->cfg.maxSeconds = cfg->maxSeconds > LISTEN_MIN_SECONDS ? cfg->maxSeconds : LISTEN_MIN_SECONDS;
+    l->cfg.prerollMs = cfg->prerollMs > 0 ? cfg->prerollMs : 0;
+    l->cfg.hangoverMs = cfg->hangoverMs > 0 ? cfg->hangoverMs : 0;
+    l->sampleRate = sampleRate;
+    l->block = sampleRate / 100;
+    l->prerollBlocks = l->cfg.prerollMs / 10;
+    l->cleanCfg = *cleanCfg;
+    l->trimCfg = *trimCfg;
+    l->remote = remote;
+    if(callbacks != NULL)
+    {
+        l->callbacks = *callbacks;
+    }
+    vadInit(&l->activity);
+
+    l->pending = (short *)memAlloc(l->block * sizeof(short));
+    l->preroll = (short *)memAlloc(((long)l->prerollBlocks * l->block + 1) * sizeof(short));
+    l->cleanup = (cleaner *)memAlloc(sizeof(cleaner));
+    if(cfg->cacheEntries > 0)
+    {
+        l->features = (featExtractor *)memAlloc(sizeof(featExtractor));
+        l->cache = fpCacheCreate(cfg->cacheEntries, LISTEN_CACHE_SIMILARITY, LISTEN_CACHE_VERIFY);
+    }
+    if(l->pending == NULL || l->preroll == NULL || l->cleanup == NULL || remote == NULL
+       || (cfg->cacheEntries > 0 && (l->features == NULL || l->cache == NULL || featInit(l->features) != 0))
+       || cleanInit(l->cleanup, cleanCfg) != 0 || sampleRingInit(&l->ring, LISTEN_RING) != 0)
+    {
+        fpCacheDestroy(l->cache);
+        memFree(l->features);
+        memFree(l->cleanup);
+        memFree(l->preroll);
+        memFree(l->pending);
+        return -1;
+    }
+    if(responderInit(&l->replies, 16, time(NULL)) != 0)
+    {
+        sampleRingFree(&l->ring);
+        fpCacheDestroy(l->cache);
+        memFree(l->features);
+        memFree(l->cleanup);
+        memFree(l->preroll);
+        memFree(l->pending);
+        return -1;
+    }
+
+    l->traceSpeech = traceName("speech");
+    l->traceCut = traceName("speech end");
+    l->tracePartial = traceName("partial");
+    l->traceFinal = traceName("final");
+    l->metricRecognized = metricCounter("jarvis_utterances_total", "result=\"recognized\"",
+                                        "Utterances cut from continuous listening, by outcome.");
+    l->metricFailed = metricCounter("jarvis_utterances_total", "result=\"failed\"", "");
+    l->metricDiscarded = metricCounter("jarvis_utterances_total", "result=\"discarded\"", "");
+    l->metricDropped = metricCounter("jarvis_dropped_samples_total", "",
+                                     "Samples lost because the capture stage fell behind.");
+    l->metricFallbacks = metricCounter("jarvis_stream_fallbacks_total", "",
+                                       "Streamed utterances uploaded after the stream failed.");
+    l->metricCommitted = metricCounter("jarvis_speculations_total", "outcome=\"committed\"",
+                                       "Replies prepared from partials, by what became of them.");
+    l->metricWasted = metricCounter("jarvis_speculations_total", "outcome=\"discarded\"", "");
+    l->metricLatency = metricHistogram("jarvis_reply_latency_seconds", "", "End of speech to reply ready.",
+                                       latencyBuckets, (int)(sizeof(latencyBuckets) / sizeof(latencyBuckets[0])));
+    notifyInit(&l->room);
+    notifyInit(&l->streamed);
+    pthread_mutex_init(&l->streamLock, NULL);
+    pipelineInit(&l->pipe, (size_t)(cfg->queue > 0 ? cfg->queue : 1));
+    if(pipelineAdd(&l->pipe, "capture", captureStage, l) != 0
+       || pipelineAdd(&l->pipe, "dsp", dspStage, l) != 0
+       || pipelineAdd(&l->pipe, "encode", encodeStage, l) != 0
+       || (cfg->io != NULL ? pipelineAddAsync(&l->pipe, "upload", uploadStartStage, l) != LISTEN_UPLOAD
+                           : pipelineAdd(&l->pipe, "upload", uploadStage, l) != 0)
+       || pipelineAdd(&l->pipe, "parse", parseStage, l) != 0
+       || pipelineAdd(&l->pipe, "respond", respondStage, l) != 0
+       || pipelineStart(&l->pipe) != 0)
+    {
+        pipelineFree(&l->pipe);
+        pthread_mutex_destroy(&l->streamLock);
+        notifyFree(&l->streamed);
+        notifyFree(&l->room);
+        responderFree(&l->replies);
+        sampleRingFree(&l->ring);
+        fpCacheDestroy(l->cache);
+        memFree(l->features);
+        memFree(l->cleanup);
+        memFree(l->preroll);
+        memFree(l->pending);
+        return -1;
+    }
+    return 0;
+}
+
+void listenPush(listener *l, const short *samples, long count)
+{
+    static const short zero[LISTEN_ZERO] = { 0 };
+    if(atomicLoadRelaxed(&l->closing))
+    {
+        return;
+    }
+    while(count > 0)
+    {
+        long n = samples != NULL ? count : (count < LISTEN_ZERO ? count : LISTEN_ZERO);
+        size_t written = sampleRingWrite(&l->ring, samples != NULL ? samples : zero, (size_t)n);
+        l->stats.overruns += (unsigned long)n - (unsigned long)written;
+        if(written < (size_t)n)
+        {
+            metricAdd(l->metricDropped, (uint64_t)n - written);
+        }
+        count -= n;
+        samples = samples != NULL ? samples + n : NULL;
+    }
+    pipelineWake(&l->pipe);
+}
+
+void listenPushWait(listener *l, const short *samples, long count)
+{
+    while(count > 0 && !atomicLoadRelaxed(&l->closing))
+    {
+        unsigned seen = notifyPrepare(&l->room);
+        size_t written = sampleRingWrite(&l->ring, samples, (size_t)count);
+        if(written == 0)
+        {
+            notifyWait(&l->room, seen, LISTEN_WAIT);
+        }
+        else
+        {
+            pipelineWake(&l->pipe);
+        }
+        samples += written;
+        count -= (long)written;
+    }
+}
+
+void listenFinish(listener *l)
+{
+    atomicStore(&l->closing, 1);
+    notifySignal(&l->room);
+    pipelineStop(&l->pipe);
+}
+
+void listenClose(listener *l)
+{
+    listenFinish(l);
+    pipelineFree(&l->pipe);
+    pthread_mutex_destroy(&l->streamLock);
+    notifyFree(&l->streamed);
+    notifyFree(&l->room);
+    responderFree(&l->replies);
+    sampleRingFree(&l->ring);
+    fpCacheDestroy(l->cache);
+    memFree(l->features);
+    memFree(l->cleanup);
+    memFree(l->preroll);
+    memFree(l->pending);
+}
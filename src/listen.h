@@ -0,0 +1,208 @@
+#ifndef JARVIS_LISTEN_H
+#define JARVIS_LISTEN_H
+
+#include "capture.h"
+#include "cleanup.h"
+#include "config.h"
+#include "fingerprint.h"
+#include "pipeline.h"
+#include "recognizer.h"
+#include "response.h"
+#include "ring.h"
+#include "trim.h"
+
+/*
+ *  Continuous listening: utterance after utterance through a pipeline.
+ *
+ *      capture     splits the microphone stream into utterances (VAD with
+ *                  a pre-roll before the onset and a hangover after it)
+ *      dsp         clean-up and silence trimming
+ *      encode      FLAC
+ *      upload      remote recognizer, retries and hedging included
+ *      parse       hypothesis from the JSON answer
+ *      respond     intent and reply, handed to the caller's callback
+ *
+ *  Every stage has its own thread and bounded queue (see pipeline.h), so
+ *  the next utterance is captured and encoded while the previous one is
+ *  still on the network. With an I/O loop in the config the upload stage
+ *  is asynchronous: up to listen_queue uploads are in flight at once, and
+ *  one loop thread can carry the uploads of many listeners. If a stage
+ *  falls behind, the stages in front of it stall and, last, the capture
+ *  ring overflows; dropped samples are counted. Outcomes, drops and
+ *  reply latencies also feed the process-wide metrics (metrics.h).
+ *
+ *  With a streaming recognizer in the config, the capture stage streams
+ *  each utterance's raw audio as it is heard (from the point it counts as
+ *  speech, pre-roll included) and the upload stage only waits for the
+ *  final hypothesis, so encoding and uploading drop out of the time after
+ *  the end of speech. Partials are handed to onPartial on the way. If the
+ *  stream fails while there is budget left, the utterance is encoded and
+ *  uploaded as before.
+ *
+ *  Partials are also matched to an intent as they arrive, and the reply
+ *  for it is rendered ahead of time. When the final lands on the same
+ *  intent (and the reply is still current) the respond stage commits the
+ *  prepared reply instead of rendering one; otherwise it is discarded.
+ *  Replies have no side effects, so a wrong guess costs only the render.
+ *
+ *  Uploaded utterances are fingerprinted in the dsp stage and looked up
+ *  in the listener's fingerprint cache (fingerprint.h) first: a repeated
+ *  command is answered from it and skips encoding and the round-trip.
+ *  Confident remote answers are remembered, and one hit in
+ *  LISTEN_CACHE_VERIFY is uploaded anyway to catch false hits.
+ */
+
+/*
+ *  Config keys: listen_seconds (0 = record a single utterance instead),
+ *  listen_queue, listen_preroll_ms, listen_hangover_ms, listen_max_seconds,
+ *  listen_cache_entries (0 = no fingerprint cache).
+ */
+typedef struct
+{
+    double      seconds;        /* how long to listen */
+    int         queue;          /* items between two stages */
+    int         prerollMs;      /* kept from before the speech onset */
+    int         hangoverMs;     /* silence that ends an utterance */
+    double      maxSeconds;     /* longer utterances are cut */
+    int         cacheEntries;   /* fingerprint cache size, 0 = none */
+    double      budget;         /* end of speech to transcript, as UTTERANCE_BUDGET */
+    evLoop     *io;             /* shared I/O loop for uploads; NULL: the upload stage blocks on each */
+    recStream  *stream;         /* streaming recognizer, borrowed; NULL: upload each utterance at its end */
+}
+listenConfig;
+
+void listenDefaults(listenConfig *cfg);
+void listenConfigure(listenConfig *cfg, const config *settings);
+
+typedef struct
+{
+    unsigned long       id;
+    double              seconds;        /* audio uploaded */
+    double              latency;        /* end of speech to reply */
+    const recResult    *result;
+    intentId            intent;
+    const respReply    *reply;          /* NULL unless result->status is REC_OK */
+    int                 speculated;     /* reply was prepared from a partial */
+}
+listenReply;
+
+/* Runs on the respond stage's thread; may block (e.g. to play the reply). */
+typedef void (*listenReplyFunc)(void *ctx, const listenReply *reply);
+
+/*
+ *  Runs on the capture stage's thread and should return quickly: ended is
+ *  0 once an utterance has enough speech to be kept, 1 when it is cut.
+ */
+typedef void (*listenSpeechFunc)(void *ctx, unsigned long id, int ended);
+
+/*
+ *  Interim hypotheses of a streamed utterance and the intent a reply is
+ *  being prepared for (INTENT_UNKNOWN if none); run on the stream's loop
+ *  thread and must return quickly.
+ */
+typedef void (*listenPartialFunc)(void *ctx, unsigned long id, const recResult *partial, intentId intent);
+
+typedef struct
+{
+    listenSpeechFunc    onSpeech;       /* may be NULL */
+    listenReplyFunc     onReply;        /* may be NULL */
+    void               *ctx;
+    listenPartialFunc   onPartial;      /* may be NULL */
+}
+listenCallbacks;
+
+typedef struct
+{
+    unsigned long   utterances;     /* cut by the capture stage */
+    unsigned long   discarded;      /* too little speech to upload */
+    unsigned long   recognized;
+    unsigned long   failed;
+    unsigned long   overruns;       /* samples dropped because capture fell behind */
+    unsigned long   deferred;       /* speech blocks heard while no utterance could be allocated */
+    unsigned long   streamed;       /* answered by the streaming recognizer */
+    unsigned long   fallbacks;      /* streams that failed and were uploaded instead */
+    unsigned long   speculations;   /* replies prepared from partials */
+    unsigned long   speculationHits;    /* utterances answered with a prepared reply */
+    unsigned long   speculationMisses;  /* utterances whose prepared reply was discarded */
+    unsigned long   cached;         /* answered from the fingerprint cache, without an upload */
+    double          latencySum;
+    double          latencyMax;
+}
+listenStats;
+
+typedef struct utterJob utterJob;
+
+typedef struct
+{
+    listenConfig    cfg;
+    int             sampleRate;
+    int             block;          /* samples per VAD block, 10 ms */
+
+    /* Callback -> capture stage. */
+    sampleRing      ring;
+    int             closing;
+    notifier        room;           /* capture stage took samples out of the ring */
+
+    /* Capture stage. */
+    vad             activity;
+    short          *pending;        /* one block being filled */
+    int             pendingCount;
+    short          *preroll;        /* last prerollBlocks blocks of silence */
+    int             prerollBlocks;
+    int             prerollNext;
+    int             prerollUsed;
+    utterJob       *current;
+    int             silentBlocks;
+    unsigned long   nextId;
+
+    /* Later stages. */
+    cleanConfig     cleanCfg;
+    trimConfig      trimCfg;
+    cleaner        *cleanup;
+    featExtractor  *features;       /* dsp stage: fingerprints for the cache */
+    fpCache        *cache;          /* NULL if cacheEntries is 0 */
+    recognizer     *remote;         /* borrowed */
+    volatile int    cancel;
+    pthread_mutex_t streamLock;     /* stream finals against the upload stage */
+    notifier        streamed;       /* a stream final arrived */
+    responder       replies;
+    listenCallbacks callbacks;
+
+    pipeline        pipe;
+    listenStats     stats;
+    uint16_t        traceSpeech;    /* trace instants, arg = utterance id */
+    uint16_t        traceCut;
+    uint16_t        tracePartial;
+    uint16_t        traceFinal;
+    metric         *metricRecognized;   /* jarvis_utterances_total by result */
+    metric         *metricFailed;
+    metric         *metricDiscarded;
+    metric         *metricDropped;
+    metric         *metricFallbacks;
+    metric         *metricCommitted;    /* jarvis_speculations_total by outcome */
+    metric         *metricWasted;
+    metric         *metricLatency;
+}
+listener;
+
+/* Starts the pipeline threads; returns -1 if anything could not be set up. */
+int  listenOpen(listener *l, const listenConfig *cfg, int sampleRate, const cleanConfig *cleanCfg,
+                const trimConfig *trimCfg, recognizer *remote, const listenCallbacks *callbacks);
+
+/* Callback side: never blocks; samples may be NULL for silence. Ignored after listenFinish. */
+void listenPush(listener *l, const short *samples, long count);
+
+/* As listenPush, but waits for room instead of dropping: for input faster than real time. */
+void listenPushWait(listener *l, const short *samples, long count);
+
+/*
+ *  Stops taking input, cuts the utterance in progress and returns once
+ *  everything queued has been answered. The stream may keep running,
+ *  e.g. to play the last reply.
+ */
+void listenFinish(listener *l);
+
+/* Frees everything; the callback must no longer be calling listenPush. */
+void listenClose(listener *l);
+
+#endif
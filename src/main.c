@@ -1,25 +1,84 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "../include/portaudio.h"
 #include "../include/sndfile.h"
+#include "aec.h"
+#include "capture.h"
+#include "cleanup.h"
+#include "clock.h"
+#include "config.h"
+#include "listen.h"
+#include "mempool.h"
+#include "metrics.h"
+#include "mfcc.h"
+#include "net.h"
+#include "notify.h"
+#include "playback.h"
+#include "recognizer.h"
+#include "response.h"
+#include "session.h"
+#include "simd.h"
+#include "spool.h"
+#include "trace.h"
+#include "trim.h"
 
 #define SAMPLE_RATE         (16000)
 #define FRAMES_PER_BUFFER   (16)
 #define NUM_SECONDS         (5)
 #define WRITE_TO_FILE       (0)
 
-#define PA_SAMPLE_TYPE      paInt16
-#define SAMPLE_SILENCE      (0)
+#define PA_SAMPLE_TYPE      paInt16                 /* paFloat32 with capture_float = 1 */
+#define SAMPLE_SILENCE      (0.0f)
 #define PRINTF_S_FORMAT     "%d"
+#define DITHER_SEED         (0x4a617276u)
+
+#define UTTERANCE_BUDGET    (3.0)                   /* seconds from end of capture to transcript */
+#define GRAMMAR_FILE        "grammar.txt"
+#define MIN_CONFIDENCE      (0.5f)
+
+#define CACHE_ENTRIES       (64)
+#define CACHE_SIMILARITY    (0.85f)
+#define CACHE_VERIFY_EVERY  (20)                    /* one hit in this many is re-checked remotely */
+#define CACHE_FILE          "jarvis.cache"          /* `cache_file`: kept across runs, "" = not kept */
+#define RESPONSE_CACHE      (16)
+
+#define FULL_DUPLEX         (1)                     /* play replies on the capture stream */
+#define PLAYBACK_RING       (SAMPLE_RATE)           /* one second of queued reply audio */
+#define PLAYBACK_TIMEOUT    (30.0)
+#define AEC_FALLBACK_DELAY  (SAMPLE_RATE / 20)      /* assumed round trip when the host has no timestamps */
+#define CONFIG_FILE         "jarvis.conf"           /* per-deployment settings, see config.h */
+#define VOICE_DIR           "voice"                 /* <intent>.wav clips spoken as replies */
+#define TRACE_EVENTS        (65536)                 /* per thread, 1 MiB each */
+#define METRICS_HOST        "127.0.0.1"             /* the endpoint is for a local scraper or agent */
+#define METRICS_INTERVAL    (10.0)                  /* seconds between rewrites of metrics_file */
 
 typedef struct
 {
     int         frameIndex;
     int         maxFrameIndex;
-    short      *recordedSamples;
+    float      *recordedSamples;    /* float from the callback on; quantized once after capture */
+    int         floatInput;         /* the stream delivers paFloat32 */
+    featExtractor *features;
+    player     *speaker;        /* fed from this callback in full-duplex mode */
+    echoCanceller *echo;        /* needs the duplex stream for its reference */
+    cleaner    *cleanup;
+    spool      *spool;          /* continuous copy of the raw input, or NULL */
+    sessionRecorder *session;   /* callback-level log for replays, or NULL */
+    listener   *utterances;     /* continuous listening pipeline, or NULL */
+    float       listen[FRAMES_PER_BUFFER];  /* input while a reply plays after capture */
+    short       block[FRAMES_PER_BUFFER];   /* int16 copy of a float block for the int16 consumers */
+    notifier    captured;       /* capture is complete or the stream has finished */
+    uint16_t    traceCallback;
+    metric     *callbackSeconds;    /* monitoring, see metrics.h */
+    metric     *inputOverflows;
+    metric     *outputUnderflows;
 }
 paData;
 
+/* Upper bounds of the callback time histogram, seconds; a 16-frame block lasts 1 ms. */
+static const double callbackBuckets[] = { 0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025 };
+
 void herr(PaError);
 
 static int recordCallback(
@@ -30,15 +89,58 @@ static int recordCallback(
                     PaStreamCallbackFlags statusFlags,
                     void *userData)
 {
-    (void) outputBuffer;
-    (void) timeInfo;
-    (void) statusFlags;
-    (void) userData;
-
     paData *data = (paData*)userData;
 
-    const short *rptr = (const short*)inputBuffer;
-    short *wptr = &data->recordedSamples[data->frameIndex];
+    /* Spool, session log and listening pipeline store int16; a float block is quantized once for all of them. */
+    const short *pcm = (const short *)inputBuffer;
+    if(data->floatInput && inputBuffer != NULL)
+    {
+        pcm = NULL;
+        if((data->session != NULL || data->spool != NULL || data->utterances != NULL)
+           && framesPerBuffer <= FRAMES_PER_BUFFER)
+        {
+            simdQuantize(data->block, (const float *)inputBuffer, (int)framesPerBuffer, NULL);
+            pcm = data->block;
+        }
+    }
+
+    if(data->session != NULL)
+    {
+        sessionRecord(data->session, pcm, framesPerBuffer, timeInfo, statusFlags);
+    }
+
+    if(data->spool != NULL && pcm != NULL)
+    {
+        spoolPush(data->spool, pcm, (long)framesPerBuffer);
+    }
+
+    if(outputBuffer != NULL)
+    {
+        playerFill(data->speaker, (short *)outputBuffer, framesPerBuffer, timeInfo);
+        aecReference(data->echo, (const short *)outputBuffer, framesPerBuffer, timeInfo->outputBufferDacTime);
+    }
+
+    if(data->utterances != NULL)
+    {
+        /* Continuous listening: the pipeline's capture stage takes it from here. */
+        const short *mic = pcm;
+        if(mic != NULL && data->echo != NULL && framesPerBuffer <= FRAMES_PER_BUFFER)
+        {
+            if(mic != data->block)
+            {
+                memcpy(data->block, mic, framesPerBuffer * sizeof(short));
+            }
+            if(aecCancel(data->echo, data->block, (long)framesPerBuffer, timeInfo->inputBufferAdcTime))
+            {
+                playerInterrupt(data->speaker);
+            }
+            mic = data->block;
+        }
+        listenPush(data->utterances, mic, (long)framesPerBuffer);
+        return paContinue;
+    }
+
+    float *wptr = &data->recordedSamples[data->frameIndex];
 
     unsigned long framesLeft = data->maxFrameIndex - data->frameIndex;
     long framesToCalc = framesLeft < framesPerBuffer ? framesLeft : framesPerBuffer;
@@ -50,17 +152,269 @@ static int recordCallback(
             *wptr++ = SAMPLE_SILENCE;
         }
     }
+    else if(data->floatInput)
+    {
+        memcpy(wptr, inputBuffer, framesToCalc * sizeof(float));
+    }
     else
     {
-        for( long i = 0; i < framesToCalc; i++ )
+        simdFromInt16(wptr, (const short *)inputBuffer, (int)framesToCalc);
+    }
+
+    if(data->echo != NULL)
+    {
+        float *mic = &data->recordedSamples[data->frameIndex];
+        long micCount = framesToCalc;
+
+        /* After capture, keep listening so the user can talk over the reply. */
+        if(framesToCalc == 0 && inputBuffer != NULL && framesPerBuffer <= FRAMES_PER_BUFFER)
+        {
+            mic = data->listen;
+            micCount = (long)framesPerBuffer;
+            if(data->floatInput)
+            {
+                memcpy(mic, inputBuffer, framesPerBuffer * sizeof(float));
+            }
+            else
+            {
+                simdFromInt16(mic, (const short *)inputBuffer, (int)framesPerBuffer);
+            }
+        }
+        if(aecCancelFloat(data->echo, mic, micCount, timeInfo->inputBufferAdcTime))
         {
-            *wptr++ = *rptr++;
+            playerInterrupt(data->speaker);
         }
     }
 
+    cleanProcessFloat(data->cleanup, &data->recordedSamples[data->frameIndex],
+                      &data->recordedSamples[data->frameIndex], framesToCalc);
+    featPushFloat(data->features, &data->recordedSamples[data->frameIndex], framesToCalc);
+
     data->frameIndex += framesToCalc;
+    if(framesToCalc > 0 && data->frameIndex == data->maxFrameIndex)
+    {
+        notifySignal(&data->captured);
+    }
+
+    /* A duplex stream keeps running after capture so it can play the reply. */
+    return framesLeft < framesPerBuffer && outputBuffer == NULL ? paComplete : paContinue;
+}
+
+/* What PortAudio and the replayer call: recordCallback as one trace span, timed and counted for monitoring. */
+static int instrumentedCallback(
+                    const void *inputBuffer,
+                    void *outputBuffer,
+                    unsigned long framesPerBuffer,
+                    const PaStreamCallbackTimeInfo* timeInfo,
+                    PaStreamCallbackFlags statusFlags,
+                    void *userData)
+{
+    paData *data = (paData*)userData;
+    double start = clockNow();
+    traceBegin(data->traceCallback);
+    int result = recordCallback(inputBuffer, outputBuffer, framesPerBuffer, timeInfo, statusFlags, userData);
+    traceEnd(data->traceCallback);
+    metricObserve(data->callbackSeconds, clockNow() - start);
+    if(statusFlags & paInputOverflow)
+    {
+        metricInc(data->inputOverflows);
+    }
+    if(statusFlags & paOutputUnderflow)
+    {
+        metricInc(data->outputUnderflows);
+    }
+    return result;
+}
+
+static void streamFinished(void *userData)
+{
+    notifySignal(&((paData *)userData)->captured);
+}
+
+/* Plays a reply: its cached audio if it has any, else voice/<intent>.wav. */
+static void speak(player *speaker, intentId intent, const respReply *reply)
+{
+    if(speaker->stream == NULL)
+    {
+        return;
+    }
+
+    char clip[256];
+    snprintf(clip, sizeof(clip), "%s/%s.wav", VOICE_DIR, intentTable()[intent].name);
+
+    playerBegin(speaker);
+    long queued = reply->pcm != NULL ? playerWrite(speaker, reply->pcm, reply->pcmCount)
+                                     : playerPlayFile(speaker, clip);
+    playerEnd(speaker);
+
+    if(queued > 0 && playerDrain(speaker, PLAYBACK_TIMEOUT) == 0)
+    {
+        printf("Reply audible after %.1f ms (%lu underruns)%s\n",
+               playerLatency(speaker) * 1000.0, speaker->underruns,
+               playerWasInterrupted(speaker) ? ", interrupted" : "");
+    }
+}
+
+/*
+ *  The whole-recording buffers, float and quantized, taken together at
+ *  startup. Under a memory budget the recording is halved until both
+ *  fit, down to a second; NULL if they do not.
+ */
+static short *allocateRecording(paData *data, int frames)
+{
+    for(;;)
+    {
+        data->recordedSamples = (float *)memCalloc(frames, sizeof(float));
+        short *captured = (short *)memAlloc(frames * sizeof(short));
+        if(data->recordedSamples != NULL && captured != NULL)
+        {
+            data->maxFrameIndex = frames;
+            return captured;
+        }
+        memFree(data->recordedSamples);
+        memFree(captured);
+        data->recordedSamples = NULL;
+        if(!memPoolActive() || frames / 2 < SAMPLE_RATE)
+        {
+            return NULL;
+        }
+        frames /= 2;
+    }
+}
+
+/* Respond stage of continuous listening; ctx is the player. */
+static void answer(void *ctx, const listenReply *r)
+{
+    if(r->reply == NULL)
+    {
+        printf("[%lu] Nothing recognized (%.2f s of audio)\n", r->id, r->seconds);
+        fflush(stdout);
+        return;
+    }
+    printf("[%lu] Heard \"%s\" (confidence %.2f, %.0f ms after the end of speech%s)\n",
+           r->id, r->result->text, r->result->confidence, r->latency * 1000.0,
+           r->speculated ? ", reply prepared early" : "");
+    printf("Jarvis: %s\n", r->reply->text);
+    fflush(stdout);
+    speak((player *)ctx, r->intent, r->reply);
+}
+
+/* Queue in front of every stage, printed while listening. */
+static void printQueues(const pipeline *p)
+{
+    printf("Queues:");
+    for(int i = 1; i < p->count; i++)
+    {
+        pipeStats st;
+        pipelineGetStats(p, i, &st);
+        printf(" %s %lu", p->stages[i].name, (unsigned long)st.depth);
+    }
+    printf("\n");
+}
+
+/* Recognizes one recorded utterance with every backend and answers it. */
+static void recognizeOnce(const short *samples, long count, featExtractor *features,
+                          const config *settings, player *speaker)
+{
+    recognizer *backends[2];
+    int backendCount = 0;
+    /* One utterance per run: the cache only pays off if it outlives the process. */
+    fpCache *cache = fpCacheCreate(CACHE_ENTRIES, CACHE_SIMILARITY, CACHE_VERIFY_EVERY);
+    const char *cachePath = configString(settings, "cache_file", CACHE_FILE);
+    if(cache != NULL && cachePath[0] != '\0')
+    {
+        fpCacheLoad(cache, cachePath);
+    }
+
+    recognizer *remote = netStartup() == NET_OK ? recRemoteConfigure(settings) : NULL;
+    if(remote != NULL)
+    {
+        backends[backendCount++] = cache != NULL ? recCachedCreate(remote, cache, MIN_CONFIDENCE) : remote;
+    }
+    scheduler pool;
+    int pooled = schedInit(&pool, 0) == 0;
+    recognizer *local = recLocalCreate(GRAMMAR_FILE, pooled ? &pool : NULL);
+    if(pooled)
+    {
+        schedFree(&pool);
+    }
+    if(local != NULL)
+    {
+        backends[backendCount++] = local;
+    }
+
+    unsigned long frames = featRingWritten(&features->ring);
+    unsigned long firstFrame = frames > FEAT_RING_FRAMES - 1 ? frames - (FEAT_RING_FRAMES - 1) : 0;
+
+    /* Upload only the speech: billing and link usage are per second of audio. */
+    trimConfig trimCfg;
+    trimResult trimmed;
+    trimDefaults(&trimCfg);
+    trimConfigure(&trimCfg, settings);
+    if(trimUtterance(samples, count, SAMPLE_RATE, &trimCfg, &trimmed) == 0
+       && trimmed.count > 0)
+    {
+        printf("Trimmed %.2f s to %.2f s (speech from %.2f s, %d pauses shortened)\n",
+               (double)trimmed.originalCount / SAMPLE_RATE, (double)trimmed.count / SAMPLE_RATE,
+               (double)trimToOriginal(&trimmed, 0) / SAMPLE_RATE, trimmed.pausesShortened);
+    }
+    else
+    {
+        trimFree(&trimmed);
+    }
+
+    recUtterance utt =
+    {
+        .samples        =   trimmed.samples != NULL ? trimmed.samples : samples,
+        .sampleCount    =   trimmed.samples != NULL ? trimmed.count : count,
+        .sampleRate     =   SAMPLE_RATE,
+        .features       =   &features->ring,
+        .firstFrame     =   firstFrame,
+        .frameCount     =   frames - firstFrame,
+        .deadline       =   clockNow() + UTTERANCE_BUDGET,
+    };
+
+    recResult result;
+    if(recRace(backends, backendCount, &utt, MIN_CONFIDENCE, &result) == REC_OK)
+    {
+        printf("Heard \"%s\" (%s, confidence %.2f, %.0f ms)\n",
+               result.text, result.backend, result.confidence, result.latency * 1000.0);
+
+        responder replies;
+        if(responderInit(&replies, RESPONSE_CACHE, time(NULL)) == 0)
+        {
+            respReply reply;
+            intentId intent = intentMatch(result.text, NULL);
+            respondTo(&replies, intent, result.text, time(NULL), &reply);
+            printf("Jarvis: %s\n", reply.text);
+            speak(speaker, intent, &reply);
+            responderFree(&replies);
+        }
+    }
+    else
+    {
+        printf("Nothing recognized.\n");
+    }
 
-    return framesLeft < framesPerBuffer ? paComplete : paContinue;
+    for(int i = 0; i < backendCount; i++)
+    {
+        recDestroy(backends[i]);
+    }
+    trimFree(&trimmed);
+
+    if(cache != NULL)
+    {
+        fpCacheStats cs;
+        fpCacheGetStats(cache, &cs);
+        printf("Cache: %lu lookups, %lu hits, %lu false hits, %.1f us mean lookup\n",
+               cs.lookups, cs.hits, cs.falseHits,
+               cs.lookups ? cs.lookupSeconds * 1e6 / cs.lookups : 0.0);
+        if(cachePath[0] != '\0' && fpCacheSave(cache, cachePath) != 0)
+        {
+            printf("Could not write cache file %s.\n", cachePath);
+        }
+        fpCacheDestroy(cache);
+    }
 }
 
 int main(void)
@@ -71,19 +425,135 @@ int main(void)
     PaStream*           str;
     paData              data;
 
+    config settings;
+    cleanConfig cleanCfg;
+    configLoad(&settings, CONFIG_FILE);
+
+    /* `memory_budget_kb`: everything src/ allocates from here on comes out of one reserved pool (see mempool.h). */
+    size_t memoryBudget = (size_t)configNumber(&settings, "memory_budget_kb", 0) * 1024;
+    if(memoryBudget > 0 && memPoolStart(memoryBudget) != 0)
+    {
+        printf("Could not reserve a memory budget of %lu KB.\n", (unsigned long)(memoryBudget / 1024));
+        exit(127);
+    }
+
+    /* Continuous listening (`listen_seconds`): one utterance after another through the stages in listen.h. */
+    listenConfig listenCfg;
+    listenDefaults(&listenCfg);
+    listenConfigure(&listenCfg, &settings);
+
     data = (paData) 
     {
-        .maxFrameIndex      =   NUM_SECONDS * SAMPLE_RATE,
-        .frameIndex         =   0,
-        .recordedSamples    =   (short *)calloc(NUM_SECONDS * SAMPLE_RATE, sizeof(short)),
+        .features           =   (featExtractor *)memAlloc(sizeof(featExtractor)),
+        .echo               =   (echoCanceller *)memAlloc(sizeof(echoCanceller)),
+        .cleanup            =   (cleaner *)memAlloc(sizeof(cleaner)),
     };
 
-    if(data.recordedSamples == NULL)
+    /* Listening keeps no whole recording, so its footprint does not grow with NUM_SECONDS. */
+    short *captured = NULL;
+    if(listenCfg.seconds <= 0.0)
+    {
+        captured = allocateRecording(&data, NUM_SECONDS * SAMPLE_RATE);
+        if(captured != NULL && data.maxFrameIndex < NUM_SECONDS * SAMPLE_RATE)
+        {
+            printf("Memory budget leaves room for %.1f s of recording.\n", (double)data.maxFrameIndex / SAMPLE_RATE);
+        }
+    }
+
+    if((listenCfg.seconds <= 0.0 && captured == NULL) || data.features == NULL || data.echo == NULL
+       || data.cleanup == NULL)
     {
         printf("Could not allocate record array.\n");
         exit(127);
     }
 
+    if(featInit(data.features) != 0)
+    {
+        printf("Could not build the feature tables.\n");
+        exit(127);
+    }
+    notifyInit(&data.captured);
+
+    /* `trace_file`: per-thread trace rings from here on, dumped there at exit (see trace.h). */
+    const char *tracePath = configString(&settings, "trace_file", "");
+    if(tracePath[0] != '\0')
+    {
+        traceStart((unsigned long)configNumber(&settings, "trace_events", TRACE_EVENTS));
+        traceThread("main");
+    }
+    data.traceCallback = traceName("callback");
+
+    /* `metrics_port`, `metrics_file`: Prometheus text on METRICS_HOST, rewritten to a file (see metrics.h). */
+    data.callbackSeconds = metricHistogram("jarvis_callback_seconds", "", "Time spent in one audio callback.",
+                                           callbackBuckets, (int)(sizeof(callbackBuckets) / sizeof(callbackBuckets[0])));
+    data.inputOverflows = metricCounter("jarvis_input_overflows_total", "",
+                                        "Callbacks whose input had been overwritten by the device.");
+    data.outputUnderflows = metricCounter("jarvis_output_underflows_total", "",
+                                          "Callbacks after which the device ran out of output.");
+    metricsServer monitor;
+    int metricsPort = (int)configNumber(&settings, "metrics_port", 0);
+    const char *metricsPath = configString(&settings, "metrics_file", "");
+    int monitoring = metricsPort > 0 || metricsPath[0] != '\0';
+    if(monitoring && metricsServe(&monitor, METRICS_HOST, metricsPort, metricsPath,
+                                  configNumber(&settings, "metrics_interval", METRICS_INTERVAL)) != 0)
+    {
+        printf("Could not serve metrics on port %d; continuing without them.\n", metricsPort);
+        monitoring = 0;
+    }
+
+    cleanDefaults(&cleanCfg);
+    cleanConfigure(&cleanCfg, &settings);
+    if(cleanInit(data.cleanup, &cleanCfg) != 0)
+    {
+        printf("Could not build the clean-up tables.\n");
+        exit(127);
+    }
+
+    /* Everything the microphone hears, kept on disk for audits and replays. */
+    spoolConfig spoolCfg;
+    spool recording;
+    spoolDefaults(&spoolCfg);
+    spoolConfigure(&spoolCfg, &settings);
+    if(spoolCfg.dir[0] != '\0')
+    {
+        if(spoolOpen(&recording, &spoolCfg, SAMPLE_RATE) == 0)
+        {
+            data.spool = &recording;
+        }
+        else
+        {
+            printf("Could not open spool in %s; continuing without it.\n", spoolCfg.dir);
+        }
+    }
+
+    /* Callback-level log of this run (`record_file`), or a logged run to feed instead of the mic (`replay_file`). */
+    sessionRecorder session;
+    const char *recordPath = configString(&settings, "record_file", "");
+    if(recordPath[0] != '\0')
+    {
+        if(sessionRecordOpen(&session, recordPath, SAMPLE_RATE, 1) == 0)
+        {
+            data.session = &session;
+        }
+        else
+        {
+            printf("Could not create session file %s; continuing without it.\n", recordPath);
+        }
+    }
+
+    sessionReplay replay;
+    const char *replayPath = configString(&settings, "replay_file", "");
+    int replaying = replayPath[0] != '\0';
+    if(replaying && (sessionReplayOpen(&replay, replayPath) != 0 || replay.header.sampleRate != SAMPLE_RATE
+                     || replay.header.channels != 1))
+    {
+        printf("Not able to replay session file %s.\n", replayPath);
+        exit(127);
+    }
+
+    /* Float capture (`capture_float`) skips the int16 round trip; session logs are int16 and replay as such. */
+    data.floatInput = !replaying && configNumber(&settings, "capture_float", 0) != 0;
+
     atexit((void(*)())Pa_Terminate);
     herr(Pa_Initialize());
 
@@ -98,7 +568,7 @@ int main(void)
     inP = (PaStreamParameters) 
     {
         .channelCount                =   1,
-        .sampleFormat                =   PA_SAMPLE_TYPE,
+        .sampleFormat                =   data.floatInput ? paFloat32 : PA_SAMPLE_TYPE,
         .suggestedLatency            =   Pa_GetDeviceInfo(dev)->defaultLowInputLatency,
         .hostApiSpecificStreamInfo   =   NULL,
     };
@@ -119,39 +589,373 @@ int main(void)
         exit(127);
     }
 
+    /*------ INITIALIZE PLAYBACK ------*/
+
+    player speaker;
+    if(playerInit(&speaker, SAMPLE_RATE, PLAYBACK_RING) != 0)
+    {
+        printf("Could not allocate playback ring.\n");
+        exit(127);
+    }
+
+    PaDeviceIndex outDev = Pa_GetDefaultOutputDevice();
+    PaStreamParameters outP =
+    {
+        .device                      =   outDev,
+        .channelCount                =   1,
+        .sampleFormat                =   PA_SAMPLE_TYPE,
+        .suggestedLatency            =   outDev != paNoDevice ? Pa_GetDeviceInfo(outDev)->defaultLowOutputLatency : 0,
+        .hostApiSpecificStreamInfo   =   NULL,
+    };
+    int duplex = FULL_DUPLEX && outDev != paNoDevice && !replaying;
+    data.speaker = duplex ? &speaker : NULL;
+    if(duplex)
+    {
+        aecInit(data.echo, SAMPLE_RATE, AEC_FALLBACK_DELAY);
+    }
+    else
+    {
+        memFree(data.echo);
+        data.echo = NULL;
+    }
+
+    listener utterances;
+    const char *cachePath = configString(&settings, "cache_file", CACHE_FILE);
+    recognizer *listenRemote = NULL;
+    evLoop *streamLoop = NULL;
+    listenCfg.budget = UTTERANCE_BUDGET;
+    if(listenCfg.seconds > 0.0)
+    {
+        trimConfig trimCfg;
+        trimDefaults(&trimCfg);
+        trimConfigure(&trimCfg, &settings);
+        listenCallbacks callbacks = { NULL, answer, &speaker, NULL };
+        listenRemote = netStartup() == NET_OK ? recRemoteConfigure(&settings) : NULL;
+        /* `recognizer_stream`: audio goes out during speech, over a WebSocket run by its own loop. */
+        if(listenRemote != NULL && configNumber(&settings, "recognizer_stream", 0) != 0)
+        {
+            streamLoop = evLoopCreate(EV_BACKEND_AUTO);
+            if(streamLoop == NULL || evLoopSpawn(streamLoop) != 0
+               || (listenCfg.stream = recStreamConfigure(streamLoop, &settings, SAMPLE_RATE)) == NULL)
+            {
+                printf("Could not start streaming recognition.\n");
+                exit(127);
+            }
+        }
+        if(listenRemote == NULL || listenOpen(&utterances, &listenCfg, SAMPLE_RATE, &cleanCfg, &trimCfg,
+                                              listenRemote, &callbacks) != 0)
+        {
+            printf("Could not start listening.\n");
+            exit(127);
+        }
+        if(utterances.cache != NULL && cachePath[0] != '\0')
+        {
+            fpCacheLoad(utterances.cache, cachePath);
+        }
+        data.utterances = &utterances;
+    }
+
     /*------ RECORD ------*/
 
-    herr(Pa_OpenStream(
-          &str,
-          &inP,
-          NULL,
-          SAMPLE_RATE,
-          FRAMES_PER_BUFFER,
-          paClipOff,
-          recordCallback,
-          &data));
+    if(!replaying)
+    {
+        herr(Pa_OpenStream(
+              &str,
+              &inP,
+              duplex ? &outP : NULL,
+              SAMPLE_RATE,
+              FRAMES_PER_BUFFER,
+              paClipOff,
+              instrumentedCallback,
+              &data));
+        herr(Pa_SetStreamFinishedCallback(str, streamFinished));
+    }
+
+    /* Extra microphones from jarvis.conf, e.g. "capture_devices = 2, 5"; single-utterance mode only. */
+    captureArray mics;
+    PaDeviceIndex micDevices[CAPTURE_MAX_SOURCES];
+    int micCount = 0;
+    const char *list = data.utterances == NULL ? configString(&settings, "capture_devices", "") : "";
+    while(*list != '\0' && micCount < CAPTURE_MAX_SOURCES)
+    {
+        char *end;
+        long d = strtol(list, &end, 10);
+        if(end == list)
+        {
+            list++;
+            continue;
+        }
+        micDevices[micCount++] = (PaDeviceIndex)d;
+        list = end;
+    }
+    int micChannels = (int)configNumber(&settings, "capture_channels", 1);
+    int beamform = (int)configNumber(&settings, "beamform", 1);
+    if(micCount > 0)
+    {
+        herr(captureOpen(&mics, micDevices, micCount, micChannels, beamform, SAMPLE_RATE, data.maxFrameIndex,
+                         &cleanCfg));
+        herr(captureStart(&mics));
+    }
+
+    if(replaying)
+    {
+        sessionReplaySetFinished(&replay, streamFinished);
+        herr(sessionReplayStart(&replay, instrumentedCallback, &data, configNumber(&settings, "replay_speed", 1.0)));
+    }
+    else
+    {
+        herr(Pa_StartStream(str));
+    }
 
-    herr(Pa_StartStream(str));
+    if(duplex)
+    {
+        playerAttach(&speaker, str);
+    }
 
     printf("\n=== Now recording!! Please speak into the microphone. ===\n");
     fflush(stdout);
 
+    /* Woken by the callback at the end of capture or by the stream finishing; progress once a second. */
     PaError e;
-    while((e = Pa_IsStreamActive(str)) == 1)
+    double listenUntil = clockNow() + listenCfg.seconds;
+    double nextReport = clockNow() + 1.0;
+    for(;;)
     {
-        Pa_Sleep(1000);
-        printf("Index = %d\n", data.frameIndex);
+        unsigned seen = notifyPrepare(&data.captured);
+        e = replaying ? sessionReplayActive(&replay) : Pa_IsStreamActive(str);
+        if(e != 1 || (data.utterances != NULL ? clockNow() >= listenUntil : data.frameIndex >= data.maxFrameIndex))
+        {
+            break;
+        }
+        double until = data.utterances != NULL && listenUntil < nextReport ? listenUntil : nextReport;
+        if(notifyWait(&data.captured, seen, until - clockNow()) == 0 || clockNow() < nextReport)
+        {
+            continue;
+        }
+        nextReport += 1.0;
+        if(data.utterances != NULL)
+        {
+            printQueues(&utterances.pipe);
+        }
+        else
+        {
+            printf("Index = %d\n", data.frameIndex);
+        }
         fflush(stdout);
     }
-    herr(e);
+    herr(e < 0 ? e : paNoError);
 
-    sf_write_short(outfile, data.recordedSamples, data.maxFrameIndex);
+    if(data.utterances != NULL)
+    {
+        /* Answers everything already heard; the stream keeps running for the last reply. */
+        listenFinish(&utterances);
+        for(int i = 0; i < utterances.pipe.count; i++)
+        {
+            pipeStats st;
+            pipelineGetStats(&utterances.pipe, i, &st);
+            printf("Stage %-8s %lu items, %.1f ms busy, %.1f ms stalled, %.1f ms idle, queue max %lu\n",
+                   utterances.pipe.stages[i].name, st.items, st.busySeconds * 1000.0,
+                   st.stallSeconds * 1000.0, st.idleSeconds * 1000.0, (unsigned long)st.maxDepth);
+        }
+        printf("Listening: %lu utterances (%lu clicks discarded), %lu recognized, %lu failed, "
+               "%.0f ms mean and %.0f ms worst reply latency, %lu samples dropped\n",
+               utterances.stats.utterances, utterances.stats.discarded, utterances.stats.recognized,
+               utterances.stats.failed,
+               utterances.stats.utterances ? utterances.stats.latencySum * 1000.0 / utterances.stats.utterances : 0.0,
+               utterances.stats.latencyMax * 1000.0, utterances.stats.overruns);
+        if(listenCfg.cacheEntries > 0)
+        {
+            fpCacheStats cs;
+            fpCacheGetStats(utterances.cache, &cs);
+            printf("Cache: %lu lookups, %lu hits answered without an upload, %lu false hits, %.1f us mean lookup\n",
+                   cs.lookups, utterances.stats.cached, cs.falseHits,
+                   cs.lookups ? cs.lookupSeconds * 1e6 / cs.lookups : 0.0);
+        }
+        if(utterances.stats.deferred > 0)
+        {
+            printf("Memory budget: %lu speech blocks heard with no room for an utterance\n",
+                   utterances.stats.deferred);
+        }
+        if(listenCfg.stream != NULL)
+        {
+            recStreamStats st;
+            recStreamGetStats(listenCfg.stream, &st);
+            printf("Streaming: %lu utterances (%lu transcribed, %lu fell back to upload), %lu partials, "
+                   "%lu finals, %lu failures, %lu connects, %lu bytes sent\n",
+                   st.utterances, utterances.stats.streamed, utterances.stats.fallbacks, st.partials,
+                   st.finals, st.failures, st.connects, st.bytesSent);
+            printf("Speculation: %lu replies prepared from partials, %lu committed, %lu discarded\n",
+                   utterances.stats.speculations, utterances.stats.speculationHits,
+                   utterances.stats.speculationMisses);
+        }
+    }
+
+    printf("Feature frames = %lu\n", featRingWritten(&data.features->ring));
+
+    /* The only quantization of the primary capture, shared by output.flac and recognition. */
+    if(data.utterances == NULL)
+    {
+        simdDither dither;
+        simdDitherInit(&dither, DITHER_SEED);
+        simdQuantize(captured, data.recordedSamples, data.maxFrameIndex,
+                     configNumber(&settings, "dither", 1) != 0 ? &dither : NULL);
+    }
+
+    /* Recognize from whichever microphone heard the speaker most clearly. */
+    const short *heardSamples = captured;
+    long heardCount = data.maxFrameIndex;
+    featExtractor *heardFeatures = data.features;
+    if(micCount > 0)
+    {
+        captureStop(&mics);
+
+        vad primary;
+        vadInit(&primary);
+        for(unsigned long i = 0; i < featRingWritten(&data.features->ring); i++)
+        {
+            const featFrame *f = featRingGet(&data.features->ring, i);
+            if(f != NULL)
+            {
+                vadUpdate(&primary, f->logEnergy);
+            }
+        }
+
+        int best = captureBest(&mics);
+        for(int c = 0; c < mics.channelCount; c++)
+        {
+            printf("Mic %s: SNR %.1f dB, %lu samples dropped\n", mics.channels[c].name,
+                   vadSnr(&mics.channels[c].activity), mics.channels[c].overruns);
+        }
+        if(best >= 0 && vadSnr(&mics.channels[best].activity) > vadSnr(&primary))
+        {
+            printf("Using %s (primary SNR %.1f dB)\n", mics.channels[best].name, vadSnr(&primary));
+            heardSamples = mics.channels[best].recorded;
+            heardCount = mics.channels[best].recordedCount;
+            heardFeatures = mics.channels[best].features;
+        }
+    }
+
+    if(data.utterances == NULL)
+    {
+        sf_write_short(outfile, captured, data.maxFrameIndex);
+    }
+
+    if(replaying)
+    {
+        sessionReplayClose(&replay);
+        printf("Replay: %lu callbacks, %.1f us mean, %.1f us max, %lu over budget, %.1f ms worst lateness\n",
+               replay.stats.callbacks,
+               replay.stats.callbacks ? replay.stats.seconds * 1e6 / replay.stats.callbacks : 0.0,
+               replay.stats.maxSeconds * 1e6, replay.stats.overBudget, replay.stats.lateSeconds * 1000.0);
+    }
 
-    herr(Pa_CloseStream(str));
+    if(!duplex)
+    {
+        if(!replaying)
+        {
+            herr(Pa_CloseStream(str));
+        }
+        if(outDev != paNoDevice)
+        {
+            herr(playerOpen(&speaker, outDev));
+        }
+    }
 
     sf_close(outfile);
 
-    free(data.recordedSamples);
+    /*------ RECOGNIZE ------*/
+
+    if(data.utterances == NULL)
+    {
+        uint16_t traceRecognize = traceName("recognize");
+        traceBegin(traceRecognize);
+        recognizeOnce(heardSamples, heardCount, heardFeatures, &settings, &speaker);
+        traceEnd(traceRecognize);
+    }
+    if(micCount > 0)
+    {
+        captureClose(&mics);
+    }
+
+    if(duplex)
+    {
+        herr(Pa_StopStream(str));
+        herr(Pa_CloseStream(str));
+    }
+    playerClose(&speaker);
+
+    if(data.utterances != NULL)
+    {
+        if(utterances.cache != NULL && cachePath[0] != '\0' && fpCacheSave(utterances.cache, cachePath) != 0)
+        {
+            printf("Could not write cache file %s.\n", cachePath);
+        }
+        listenClose(&utterances);
+        recStreamDestroy(listenCfg.stream);
+        evLoopDestroy(streamLoop);
+        recDestroy(listenRemote);
+    }
+
+    if(data.session != NULL)
+    {
+        sessionRecordClose(data.session);
+        printf("Session log: %lu blocks, %lu frames, %lu bytes, %lu frames dropped\n",
+               session.stats.blocks, session.stats.frames, session.stats.bytes, session.stats.droppedFrames);
+    }
+
+    if(data.spool != NULL)
+    {
+        spoolClose(data.spool);
+        printf("Spool: %lu samples in %lu segments, %lu dropped in %lu gaps, %.1f ms slowest sync\n",
+               recording.stats.written, recording.stats.segments, recording.stats.dropped,
+               recording.stats.gaps, recording.stats.maxSyncSeconds * 1000.0);
+    }
+
+    if(data.echo != NULL)
+    {
+        printf("Echo canceller: %.1f us mean, %.1f us max per block, %lu over budget, %lu barge-ins\n",
+               data.echo->stats.blocks ? data.echo->stats.seconds * 1e6 / data.echo->stats.blocks : 0.0,
+               data.echo->stats.maxSeconds * 1e6, data.echo->stats.overBudget, data.echo->stats.bargeIns);
+        memFree(data.echo);
+    }
+
+    printf("Clean-up: %.0f ms processing, %.1f dB gain, %lu samples limited\n",
+           data.cleanup->stats.seconds * 1000.0, data.cleanup->stats.gainDb, data.cleanup->stats.limited);
+    notifyFree(&data.captured);
+    memFree(data.cleanup);
+    memFree(data.features);
+    memFree(data.recordedSamples);
+    memFree(captured);
+
+    if(monitoring)
+    {
+        metricsServerStop(&monitor);
+        printf("Metrics: %lu scrapes, %lu file writes (%lu failed)\n",
+               monitor.stats.scrapes, monitor.stats.dumps, monitor.stats.dumpErrors);
+    }
+
+    if(memPoolActive())
+    {
+        memPoolStats st;
+        memPoolGetStats(&st);
+        printf("Memory: %lu KB budget, %lu KB peak in use, %lu allocations, %lu refused, %lu KB peak resident\n",
+               (unsigned long)(st.budget / 1024), (unsigned long)(st.peak / 1024), st.allocations, st.refused,
+               (unsigned long)(memPeakResident() / 1024));
+    }
+
+    if(tracePath[0] != '\0')
+    {
+        traceStats st;
+        if(traceDump(tracePath, &st) == 0)
+        {
+            printf("Trace: %lu events from %lu threads in %s (%lu overwritten); bin/trace_json converts it\n",
+                   st.events, st.threads, tracePath, st.overwritten);
+        }
+        else
+        {
+            printf("Could not write trace file %s.\n", tracePath);
+        }
+    }
 
     return 0;
 }
@@ -0,0 +1,297 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#include "atomics.h"
+#include "mempool.h"
+#include "metrics.h"
+
+#define MEM_HEADER      (16)                        /* keeps every block 16-byte aligned */
+#define MEM_MIN_SHIFT   (5)                         /* 32-byte blocks */
+#define MEM_MAX_SHIFT   ((int)sizeof(size_t) * 8 - 2)
+#define MEM_MAGIC       (0x4c4f4f50u)               /* "POOL" */
+#define MEM_FREE        (0x45455246u)               /* "FREE" */
+
+/* Every block starts with one, free or not; a block's buddy always starts with one too. */
+typedef struct
+{
+    uint32_t        magic;
+    uint32_t        shift;          /* the block is 1 << shift bytes, header included */
+}
+memHeader;
+
+typedef struct memFreeBlock
+{
+    memHeader            header;
+    struct memFreeBlock *next;
+    struct memFreeBlock *prev;
+}
+memFreeBlock;
+
+/* All of it changes under lock; `active` is set once, before any pooled block exists. */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int active;
+static unsigned char *region;
+static memFreeBlock *freeLists[MEM_MAX_SHIFT + 1];
+static memPoolStats stats;
+static metric *refusedMetric;
+
+/*------ POOL ------*/
+
+static int inPool(const void *p)
+{
+    return (const unsigned char *)p >= region && (const unsigned char *)p < region + stats.budget;
+}
+
+static int shiftFor(size_t size)
+{
+    int shift = MEM_MIN_SHIFT;
+    while(shift < MEM_MAX_SHIFT && ((size_t)1 << shift) < size + MEM_HEADER)
+    {
+        shift++;
+    }
+    return ((size_t)1 << shift) >= size + MEM_HEADER ? shift : -1;
+}
+
+static void pushFree(unsigned char *p, int shift)
+{
+    memFreeBlock *b = (memFreeBlock *)p;
+    b->header.magic = MEM_FREE;
+    b->header.shift = (uint32_t)shift;
+    b->prev = NULL;
+    b->next = freeLists[shift];
+    if(b->next != NULL)
+    {
+        b->next->prev = b;
+    }
+    freeLists[shift] = b;
+}
+
+static void unlinkFree(memFreeBlock *b)
+{
+    int shift = (int)b->header.shift;
+    if(b->prev != NULL)
+    {
+        b->prev->next = b->next;
+    }
+    else
+    {
+        freeLists[shift] = b->next;
+    }
+    if(b->next != NULL)
+    {
+        b->next->prev = b->prev;
+    }
+    b->header.magic = 0;
+}
+
+/* A free block of 1 << shift bytes, split off a larger one if need be. NULL if none. */
+static unsigned char *takeBlock(int shift)
+{
+    int larger = shift;
+    while(larger <= MEM_MAX_SHIFT && freeLists[larger] == NULL)
+    {
+        larger++;
+    }
+    if(larger > MEM_MAX_SHIFT)
+    {
+        return NULL;
+    }
+    unsigned char *b = (unsigned char *)freeLists[larger];
+    unlinkFree(freeLists[larger]);
+    /* Keep the lower half, hand the upper halves to the classes in between. */
+    while(larger > shift)
+    {
+        larger--;
+        pushFree(b + ((size_t)1 << larger), larger);
+    }
+    size_t end = (size_t)(b - region) + ((size_t)1 << shift);
+    stats.carved = end > stats.carved ? end : stats.carved;
+    return b;
+}
+
+static void *poolAlloc(size_t size)
+{
+    int shift = shiftFor(size > 0 ? size : 1);
+    pthread_mutex_lock(&lock);
+    unsigned char *b = shift >= 0 ? takeBlock(shift) : NULL;
+    if(b != NULL)
+    {
+        memHeader *h = (memHeader *)b;
+        h->magic = MEM_MAGIC;
+        h->shift = (uint32_t)shift;
+        stats.inUse += (size_t)1 << shift;
+        stats.peak = stats.inUse > stats.peak ? stats.inUse : stats.peak;
+        stats.allocations++;
+    }
+    else
+    {
+        stats.refused++;
+    }
+    pthread_mutex_unlock(&lock);
+    if(b == NULL)
+    {
+        metricInc(refusedMetric);
+        return NULL;
+    }
+    return b + MEM_HEADER;
+}
+
+static void poolFree(void *p)
+{
+    memHeader *h = (memHeader *)((unsigned char *)p - MEM_HEADER);
+    if(h->magic != MEM_MAGIC)
+    {
+        abort();        /* a double free or a stray pointer: the free lists would be corrupt from here */
+    }
+    int shift = (int)h->shift;
+    pthread_mutex_lock(&lock);
+    stats.inUse -= (size_t)1 << shift;
+    /* Blocks sit at multiples of their size, so the buddy is one bit away; merge while it is free and whole. */
+    size_t offset = (size_t)((unsigned char *)h - region);
+    while(shift < MEM_MAX_SHIFT)
+    {
+        size_t buddy = offset ^ ((size_t)1 << shift);
+        memHeader *bh = (memHeader *)(region + buddy);
+        if(buddy + ((size_t)1 << shift) > stats.budget || bh->magic != MEM_FREE || (int)bh->shift != shift)
+        {
+            break;
+        }
+        unlinkFree((memFreeBlock *)bh);
+        offset = offset < buddy ? offset : buddy;
+        shift++;
+    }
+    h->magic = 0;
+    pushFree(region + offset, shift);
+    pthread_mutex_unlock(&lock);
+}
+
+static double poolGauge(void *ctx)
+{
+    pthread_mutex_lock(&lock);
+    double v = (double)*(const size_t *)ctx;
+    pthread_mutex_unlock(&lock);
+    return v;
+}
+
+int memPoolStart(size_t budget)
+{
+    pthread_mutex_lock(&lock);
+    if(active || budget < ((size_t)1 << MEM_MIN_SHIFT) || (region = (unsigned char *)malloc(budget)) == NULL)
+    {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+    /* Touched now, so running out later is a refused allocation and not a page the system cannot give. */
+    memset(region, 0, budget);
+    stats.budget = budget;
+    /* The largest aligned blocks that tile it; whatever is under the smallest class stays unused. */
+    size_t offset = 0;
+    for(int shift = MEM_MAX_SHIFT; shift >= MEM_MIN_SHIFT; shift--)
+    {
+        if(budget & ((size_t)1 << shift))
+        {
+            pushFree(region + offset, shift);
+            offset += (size_t)1 << shift;
+        }
+    }
+    atomicStore(&active, 1);
+    pthread_mutex_unlock(&lock);
+
+    refusedMetric = metricCounter("jarvis_memory_refused_total", "", "Allocations the memory budget could not hold.");
+    metricGaugeFunc("jarvis_memory_budget_bytes", "", "Size of the memory pool.", poolGauge, &stats.budget);
+    metricGaugeFunc("jarvis_memory_in_use_bytes", "", "Pool bytes in live blocks.", poolGauge, &stats.inUse);
+    metricGaugeFunc("jarvis_memory_peak_bytes", "", "Most pool bytes ever in live blocks.", poolGauge, &stats.peak);
+    return 0;
+}
+
+int memPoolActive(void)
+{
+    return atomicLoad(&active);
+}
+
+void memPoolGetStats(memPoolStats *out)
+{
+    pthread_mutex_lock(&lock);
+    *out = stats;
+    pthread_mutex_unlock(&lock);
+}
+
+/*------ ALLOCATION ------*/
+
+void *memAlloc(size_t size)
+{
+    return atomicLoad(&active) ? poolAlloc(size) : malloc(size);
+}
+
+void *memCalloc(size_t count, size_t size)
+{
+    if(!atomicLoad(&active))
+    {
+        return calloc(count, size);
+    }
+    if(size != 0 && count > (size_t)-1 / size)
+    {
+        return NULL;
+    }
+    void *p = poolAlloc(count * size);
+    if(p != NULL)
+    {
+        memset(p, 0, count * size);
+    }
+    return p;
+}
+
+void *memRealloc(void *p, size_t size)
+{
+    if(p == NULL)
+    {
+        return memAlloc(size);
+    }
+    if(!atomicLoad(&active) || !inPool(p))
+    {
+        return realloc(p, size);
+    }
+    /* Grows in place up to the block's class, else moves to a larger one. */
+    size_t capacity = ((size_t)1 << ((memHeader *)((unsigned char *)p - MEM_HEADER))->shift) - MEM_HEADER;
+    if(size <= capacity)
+    {
+        return p;
+    }
+    void *moved = poolAlloc(size);
+    if(moved != NULL)
+    {
+        memcpy(moved, p, capacity);
+        poolFree(p);
+    }
+    return moved;
+}
+
+void memFree(void *p)
+{
+    if(p == NULL)
+    {
+        return;
+    }
+    if(atomicLoad(&active) && inPool(p))
+    {
+        poolFree(p);
+    }
+    else
+    {
+        free(p);
+    }
+}
+
+size_t memPeakResident(void)
+{
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage ru;
+    return getrusage(RUSAGE_SELF, &ru) == 0 ? (size_t)ru.ru_maxrss * 1024 : 0;
+#endif
+}
@@ -0,0 +1,56 @@
+#ifndef JARVIS_MEMPOOL_H
+#define JARVIS_MEMPOOL_H
+
+#include <stddef.h>
+
+/*
+ *  Hard memory budget for small boards.
+ *
+ *  Everything in src/ allocates through memAlloc, memCalloc, memRealloc
+ *  and memFree, which are plain malloc, calloc, realloc and free until
+ *  memPoolStart reserves a budget. From then on the whole budget is one
+ *  region, reserved and touched once at startup so it is resident from
+ *  the first second, and blocks come out of it in power-of-two size
+ *  classes, buddy style: a block sits at a multiple of its size within
+ *  the region and is split off a larger free block when its class has
+ *  none. A released block is merged with its buddy, and on up, for as
+ *  long as that is free too, so memory that was handed out in small
+ *  blocks is available as large ones again. A steady workload (one
+ *  utterance after another) keeps reusing the same blocks and malloc is
+ *  never called again. An allocation that does not fit is refused like a
+ *  failed malloc, and every caller already copes with NULL: continuous
+ *  listening, for one, keeps rolling its pre-roll until an utterance
+ *  fits again. Tables built once and shared for the rest of the process
+ *  (the MFCC and clean-up FFT plans) are static instead, so a budget
+ *  that happens to be full at their first use cannot leave them empty.
+ *
+ *  Thread stacks and the libraries' own allocations (PortAudio,
+ *  libsndfile, the resolver) are outside the pool; the peak resident set
+ *  shows how far the process as a whole stayed within the budget.
+ */
+
+typedef struct
+{
+    size_t          budget;
+    size_t          inUse;          /* live blocks, headers and rounding included */
+    size_t          peak;
+    size_t          carved;         /* the highest end of a block ever handed out */
+    unsigned long   allocations;
+    unsigned long   refused;        /* allocations the budget could not hold */
+}
+memPoolStats;
+
+/* Reserves budget bytes for every later allocation; -1 if they cannot be had or a pool exists. */
+int    memPoolStart(size_t budget);
+int    memPoolActive(void);
+void   memPoolGetStats(memPoolStats *out);
+
+void  *memAlloc(size_t size);
+void  *memCalloc(size_t count, size_t size);
+void  *memRealloc(void *p, size_t size);
+void   memFree(void *p);
+
+/* Largest resident set of the process so far, in bytes; 0 where unknown. */
+size_t memPeakResident(void);
+
+#endif
@@ -0,0 +1,402 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include "clock.h"
+#include "mempool.h"
+#include "metrics.h"
+#include "net.h"
+
+#define METRICS_REQUEST_MAX     (4096)
+#define METRICS_IO_TIMEOUT      (2.0)       /* per scrape, so a stuck client cannot hold the endpoint */
+#define METRICS_IDLE_WAKE       (1.0)
+
+/* Entries below metricCount are complete; only their values change after that. */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static metric metrics[METRICS_MAX];
+static int metricCount;
+static metric spare;
+
+/*------ REGISTRY ------*/
+
+/* Finds or adds name{labels}; a new entry is filled in before it becomes visible to renderers. */
+static metric *registerMetric(const char *name, const char *labels, const char *help, metricType type,
+                              metricFunc func, void *ctx, const double *bounds, int boundCount)
+{
+    metric *m = NULL;
+    pthread_mutex_lock(&lock);
+    for(int i = 0; i < metricCount && m == NULL; i++)
+    {
+        if(strcmp(metrics[i].name, name) == 0 && strcmp(metrics[i].labels, labels) == 0)
+        {
+            m = metrics[i].type == type ? &metrics[i] : &spare;
+        }
+    }
+    if(m == NULL && metricCount < METRICS_MAX)
+    {
+        m = &metrics[metricCount];
+        snprintf(m->name, sizeof(m->name), "%s", name);
+        snprintf(m->labels, sizeof(m->labels), "%s", labels);
+        snprintf(m->help, sizeof(m->help), "%s", help);
+        m->type = type;
+        m->func = func;
+        m->ctx = ctx;
+        m->bucketCount = boundCount < METRICS_BUCKETS ? boundCount : METRICS_BUCKETS;
+        if(m->bucketCount > 0)
+        {
+            memcpy(m->bounds, bounds, (size_t)m->bucketCount * sizeof(double));
+        }
+        atomicStore(&metricCount, metricCount + 1);
+    }
+    pthread_mutex_unlock(&lock);
+    return m != NULL ? m : &spare;
+}
+
+metric *metricCounter(const char *name, const char *labels, const char *help)
+{
+    return registerMetric(name, labels, help, METRIC_COUNTER, NULL, NULL, NULL, 0);
+}
+
+metric *metricGauge(const char *name, const char *labels, const char *help)
+{
+    return registerMetric(name, labels, help, METRIC_GAUGE, NULL, NULL, NULL, 0);
+}
+
+metric *metricGaugeFunc(const char *name, const char *labels, const char *help, metricFunc func, void *ctx)
+{
+    return registerMetric(name, labels, help, METRIC_GAUGE, func, ctx, NULL, 0);
+}
+
+metric *metricHistogram(const char *name, const char *labels, const char *help,
+                        const double *bounds, int boundCount)
+{
+    return registerMetric(name, labels, help, METRIC_HISTOGRAM, NULL, NULL, bounds, boundCount);
+}
+
+/*------ EXPOSITION ------*/
+
+typedef struct
+{
+    char       *data;
+    size_t      length;
+    size_t      capacity;
+    int         failed;
+}
+textBuffer;
+
+static void put(textBuffer *b, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int n = b->failed ? -1 : vsnprintf(b->data + b->length, b->capacity - b->length, format, args);
+    va_end(args);
+    if(n >= 0 && (size_t)n >= b->capacity - b->length)
+    {
+        size_t capacity = b->capacity * 2 > b->length + n + 1 ? b->capacity * 2 : b->length + n + 1;
+        char *grown = (char *)memRealloc(b->data, capacity);
+        if(grown == NULL)
+        {
+            b->failed = 1;
+            return;
+        }
+        b->data = grown;
+        b->capacity = capacity;
+        va_start(args, format);
+        vsnprintf(b->data + b->length, b->capacity - b->length, format, args);
+        va_end(args);
+    }
+    b->failed |= n < 0;
+    b->length += n > 0 ? (size_t)n : 0;
+}
+
+/* name_suffix{labels,extra} with the braces left out when there is nothing in them. */
+static void series(textBuffer *b, const metric *m, const char *suffix, const char *extra)
+{
+    int both = m->labels[0] != '\0' && extra[0] != '\0';
+    if(m->labels[0] == '\0' && extra[0] == '\0')
+    {
+        put(b, "%s%s ", m->name, suffix);
+    }
+    else
+    {
+        put(b, "%s%s{%s%s%s} ", m->name, suffix, m->labels, both ? "," : "", extra);
+    }
+}
+
+static void renderOne(textBuffer *b, const metric *m)
+{
+    if(m->type == METRIC_COUNTER)
+    {
+        series(b, m, "", "");
+        put(b, "%llu\n", (unsigned long long)atomicLoadRelaxed(&m->count));
+        return;
+    }
+    if(m->type == METRIC_GAUGE)
+    {
+        series(b, m, "", "");
+        put(b, "%.10g\n", m->func != NULL ? m->func(m->ctx) : metricBitsValue(atomicLoadRelaxed(&m->bits)));
+        return;
+    }
+
+    /* Buckets are summed here, so the +Inf bucket and the count always agree. */
+    uint64_t cumulative = 0;
+    char le[48];
+    for(int i = 0; i <= m->bucketCount; i++)
+    {
+        cumulative += atomicLoadRelaxed(&m->buckets[i]);
+        if(i < m->bucketCount)
+        {
+            snprintf(le, sizeof(le), "le=\"%.10g\"", m->bounds[i]);
+        }
+        else
+        {
+            snprintf(le, sizeof(le), "le=\"+Inf\"");
+        }
+        series(b, m, "_bucket", le);
+        put(b, "%llu\n", (unsigned long long)cumulative);
+    }
+    series(b, m, "_sum", "");
+    put(b, "%.10g\n", metricBitsValue(atomicLoadRelaxed(&m->bits)));
+    series(b, m, "_count", "");
+    put(b, "%llu\n", (unsigned long long)cumulative);
+}
+
+char *metricsRender(size_t *length)
+{
+    static const char *types[] = { "counter", "gauge", "histogram" };
+    textBuffer b = { (char *)memAlloc(4096), 0, 4096, 0 };
+    if(b.data == NULL)
+    {
+        return NULL;
+    }
+    b.data[0] = '\0';
+
+    /* A family's series must be together; they were registered in any order. */
+    int count = atomicLoad(&metricCount);
+    for(int i = 0; i < count; i++)
+    {
+        int first = 1;
+        for(int j = 0; j < i && first; j++)
+        {
+            first = strcmp(metrics[j].name, metrics[i].name) != 0;
+        }
+        if(!first)
+        {
+            continue;
+        }
+        /* Help text only needs to be given for one series of a family. */
+        const char *help = metrics[i].help;
+        for(int j = i + 1; j < count && help[0] == '\0'; j++)
+        {
+            help = strcmp(metrics[j].name, metrics[i].name) == 0 ? metrics[j].help : help;
+        }
+        put(&b, "# HELP %s %s\n# TYPE %s %s\n", metrics[i].name, help, metrics[i].name, types[metrics[i].type]);
+        for(int j = i; j < count; j++)
+        {
+            if(strcmp(metrics[j].name, metrics[i].name) == 0)
+            {
+                renderOne(&b, &metrics[j]);
+            }
+        }
+    }
+
+    if(b.failed)
+    {
+        memFree(b.data);
+        return NULL;
+    }
+    *length = b.length;
+    return b.data;
+}
+
+int metricsDump(const char *path)
+{
+    size_t length;
+    char *text = metricsRender(&length);
+    char temp[300];
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    FILE *f = text != NULL ? fopen(temp, "wb") : NULL;
+    int ok = f != NULL && fwrite(text, 1, length, f) == length;
+    ok = f != NULL && fclose(f) == 0 && ok;
+    memFree(text);
+#ifdef _WIN32
+    /* rename does not replace an existing file here. */
+    if(ok)
+    {
+        remove(path);
+    }
+#endif
+    if(!ok || rename(temp, path) != 0)
+    {
+        remove(temp);
+        return -1;
+    }
+    return 0;
+}
+
+/*------ PROCESS ------*/
+
+/* Resident set now and at its peak, in bytes (0 where unknown). */
+static double residentBytes(void *ctx)
+{
+    (void)ctx;
+    double bytes = 0.0;
+#ifndef _WIN32
+    FILE *f = fopen("/proc/self/statm", "r");
+    unsigned long size, resident;
+    if(f != NULL)
+    {
+        if(fscanf(f, "%lu %lu", &size, &resident) == 2)
+        {
+            bytes = (double)resident * (double)sysconf(_SC_PAGESIZE);
+        }
+        fclose(f);
+    }
+#endif
+    return bytes;
+}
+
+static double peakResidentBytes(void *ctx)
+{
+    (void)ctx;
+    return (double)memPeakResident();
+}
+
+/*------ ENDPOINT ------*/
+
+/* Answers one connection: the registry for GET /metrics, 404 for anything else. */
+static void serveOne(metricsServer *s, int fd)
+{
+    char request[METRICS_REQUEST_MAX];
+    size_t length = 0;
+    double deadline = clockNow() + METRICS_IO_TIMEOUT;
+    request[0] = '\0';
+    while(length < sizeof(request) - 1 && strstr(request, "\r\n\r\n") == NULL)
+    {
+        long n = netRecv(fd, request + length, sizeof(request) - 1 - length, deadline, &s->stop);
+        if(n <= 0)
+        {
+            break;
+        }
+        length += (size_t)n;
+        request[length] = '\0';
+    }
+
+    const char *path = request + 4;
+    size_t pathLength = strcspn(path, " ?\r\n");
+    char header[256];
+    char *text = NULL;
+    size_t textLength = 0;
+    if(strncmp(request, "GET ", 4) == 0 && pathLength == 8 && strncmp(path, "/metrics", 8) == 0
+       && (text = metricsRender(&textLength)) != NULL)
+    {
+        snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; "
+                 "charset=utf-8\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n", (unsigned long)textLength);
+        s->stats.scrapes++;
+    }
+    else
+    {
+        snprintf(header, sizeof(header), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n"
+                 "Connection: close\r\n\r\n");
+        s->stats.rejected++;
+    }
+    if(netSendAll(fd, header, strlen(header), deadline, &s->stop) == NET_OK && text != NULL)
+    {
+        netSendAll(fd, text, textLength, deadline, &s->stop);
+    }
+    memFree(text);
+    netClose(fd);
+}
+
+static void dumpNow(metricsServer *s)
+{
+    if(metricsDump(s->dumpPath) == 0)
+    {
+        s->stats.dumps++;
+    }
+    else
+    {
+        s->stats.dumpErrors++;
+    }
+}
+
+static void *serverThread(void *arg)
+{
+    metricsServer *s = (metricsServer *)arg;
+    int dumping = s->dumpPath[0] != '\0';
+    double nextDump = clockNow() + s->dumpInterval;
+    while(!atomicLoad(&s->stop))
+    {
+        double until = dumping ? nextDump : clockNow() + METRICS_IDLE_WAKE;
+        if(s->fd >= 0)
+        {
+            int fd = netAccept(s->fd, until, &s->stop);
+            if(fd >= 0)
+            {
+                serveOne(s, fd);
+            }
+        }
+        else
+        {
+            unsigned seen = notifyPrepare(&s->wake);
+            if(!atomicLoad(&s->stop))
+            {
+                notifyWait(&s->wake, seen, until - clockNow());
+            }
+        }
+        if(dumping && clockNow() >= nextDump)
+        {
+            dumpNow(s);
+            nextDump = clockNow() + s->dumpInterval;
+        }
+    }
+    if(dumping)
+    {
+        dumpNow(s);
+    }
+    return NULL;
+}
+
+int metricsServe(metricsServer *s, const char *host, int port, const char *dumpPath, double dumpInterval)
+{
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    snprintf(s->dumpPath, sizeof(s->dumpPath), "%s", dumpPath != NULL ? dumpPath : "");
+    s->dumpInterval = dumpInterval > 0.0 ? dumpInterval : 1.0;
+    if(port > 0 && (netStartup() != NET_OK || (s->fd = netListen(host, port, 16)) < 0))
+    {
+        s->fd = -1;
+        return -1;
+    }
+
+    metricGaugeFunc("jarvis_resident_memory_bytes", "", "Resident set size of the process.", residentBytes, NULL);
+    metricGaugeFunc("jarvis_peak_resident_memory_bytes", "", "Largest resident set size so far.",
+                    peakResidentBytes, NULL);
+
+    notifyInit(&s->wake);
+    if(pthread_create(&s->thread, NULL, serverThread, s) != 0)
+    {
+        notifyFree(&s->wake);
+        if(s->fd >= 0)
+        {
+            netClose(s->fd);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+void metricsServerStop(metricsServer *s)
+{
+    atomicStore(&s->stop, 1);
+    notifySignal(&s->wake);
+    pthread_join(s->thread, NULL);
+    notifyFree(&s->wake);
+    if(s->fd >= 0)
+    {
+        netClose(s->fd);
+    }
+}
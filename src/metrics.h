@@ -0,0 +1,160 @@
+#ifndef JARVIS_METRICS_H
+#define JARVIS_METRICS_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include "atomics.h"
+#include "notify.h"
+
+/*
+ *  Process-wide metrics registry for monitoring, in the Prometheus text
+ *  exposition format.
+ *
+ *  Modules register their counters, gauges and histograms once (the same
+ *  name and labels give back the same metric, so every session or
+ *  pipeline feeding "jarvis_queue_depth{stage="upload"}" adds to one
+ *  series) and update them with a relaxed atomic add or store: no lock,
+ *  no system call, nothing a scrape could hold up. Rendering only reads
+ *  those values, so a slow scraper costs the pipeline nothing. Gauges
+ *  that are cheaper to compute than to keep (memory use, ratios) are
+ *  functions evaluated at render time on the scraping thread.
+ *
+ *  metricsServe answers GET /metrics on a local port from its own
+ *  thread and can write the same text to a file every few seconds
+ *  (e.g. for node_exporter's textfile collector).
+ */
+
+#define METRICS_MAX         (256)
+#define METRICS_NAME_MAX    (64)
+#define METRICS_LABELS_MAX  (64)
+#define METRICS_HELP_MAX    (96)
+#define METRICS_BUCKETS     (16)
+
+typedef enum
+{
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM
+}
+metricType;
+
+/* A gauge computed when rendered; must be safe to call from any thread. */
+typedef double (*metricFunc)(void *ctx);
+
+typedef struct
+{
+    char            name[METRICS_NAME_MAX];
+    char            labels[METRICS_LABELS_MAX];     /* e.g. stage="upload", or empty */
+    char            help[METRICS_HELP_MAX];
+    metricType      type;
+    uint64_t        count;                          /* counter value */
+    uint64_t        bits;                           /* gauge value or histogram sum, as a double's bits */
+    metricFunc      func;
+    void           *ctx;
+    int             bucketCount;
+    double          bounds[METRICS_BUCKETS];        /* upper bounds, ascending */
+    uint64_t        buckets[METRICS_BUCKETS + 1];   /* per bucket, +Inf last; cumulative when rendered */
+}
+metric;
+
+/*
+ *  Registration takes a lock; call once per metric, outside the hot
+ *  path. When the registry is full a shared unexported metric is
+ *  returned, so updates never need a NULL check.
+ */
+metric *metricCounter(const char *name, const char *labels, const char *help);
+metric *metricGauge(const char *name, const char *labels, const char *help);
+metric *metricGaugeFunc(const char *name, const char *labels, const char *help, metricFunc func, void *ctx);
+metric *metricHistogram(const char *name, const char *labels, const char *help,
+                        const double *bounds, int boundCount);
+
+/* The registry as exposition text, NUL-terminated; memFree() it. NULL when out of memory. */
+char *metricsRender(size_t *length);
+
+/* Writes the text to path through a temporary file, so readers never see half of it. */
+int   metricsDump(const char *path);
+
+static inline double metricBitsValue(uint64_t bits)
+{
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+static inline uint64_t metricValueBits(double v)
+{
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+static inline void metricAdd(metric *m, uint64_t n)
+{
+    atomicAddRelaxed(&m->count, n);
+}
+
+static inline void metricInc(metric *m)
+{
+    atomicAddRelaxed(&m->count, 1);
+}
+
+static inline void metricSet(metric *m, double v)
+{
+    atomicStoreRelaxed(&m->bits, metricValueBits(v));
+}
+
+/* Gauges shared by several writers move by a delta instead of being set. */
+static inline void metricMove(metric *m, double delta)
+{
+    uint64_t seen = atomicLoadRelaxed(&m->bits);
+    while(!atomicCas(&m->bits, &seen, metricValueBits(metricBitsValue(seen) + delta)))
+    {
+    }
+}
+
+static inline void metricObserve(metric *m, double v)
+{
+    int i = 0;
+    while(i < m->bucketCount && v > m->bounds[i])
+    {
+        i++;
+    }
+    atomicAddRelaxed(&m->buckets[i], 1);
+    metricMove(m, v);
+}
+
+/*------ ENDPOINT ------*/
+
+typedef struct
+{
+    unsigned long   scrapes;
+    unsigned long   rejected;       /* requests for anything but /metrics */
+    unsigned long   dumps;
+    unsigned long   dumpErrors;
+}
+metricsServerStats;
+
+typedef struct
+{
+    int             fd;             /* listening socket, or -1 for file dumps only */
+    char            dumpPath[256];
+    double          dumpInterval;
+    int             stop;
+    pthread_t       thread;
+    notifier        wake;
+    metricsServerStats stats;       /* written by the server thread */
+}
+metricsServer;
+
+/*
+ *  Serves the registry on host:port (port 0: no endpoint) and, with a
+ *  dumpPath, writes it there every dumpInterval seconds, from one
+ *  thread. Returns -1 if the port cannot be bound or the thread started.
+ */
+int  metricsServe(metricsServer *s, const char *host, int port, const char *dumpPath, double dumpInterval);
+
+/* Stops the thread, writing the dump one last time. */
+void metricsServerStop(metricsServer *s);
+
+#endif
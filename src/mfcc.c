@@ -0,0 +1,307 @@
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+#include "atomics.h"
+#include "fft.h"
+#include "mfcc.h"
+#include "simd.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define HALF_FFT            (FEAT_FFT_SIZE / 2)
+#define CEPS_STRIDE         (28)    /* FEAT_NUM_MELS padded to a multiple of 4 */
+#define MEL_LOW_HZ          (20.0)
+#define MEL_HIGH_HZ         (FEAT_SAMPLE_RATE / 2.0)
+#define LOG_FLOOR           (1e-10f)
+#define SPEECH_ABOVE_FLOOR  (3.0f)      /* ln units, ~13 dB over the quietest frame */
+#define SPEECH_BELOW_PEAK   (7.0f)      /* ln units, ~30 dB under the loudest frame */
+
+/*
+ *  Everything that only depends on the frame geometry is computed once
+ *  and then treated as read-only, so featCompute does no trig at all.
+ */
+typedef struct
+{
+    float       window[FEAT_FRAME_LEN];
+    fftPlan     plan;                       /* HALF_FFT points; the real frame is packed into them */
+    float       planRe[HALF_FFT / 2];       /* the plan's storage, outside the memory pool */
+    float       planIm[HALF_FFT / 2];
+    int         planOrder[HALF_FFT];
+    float       splitRe[HALF_FFT + 1];      /* e^{-2 pi i k / N} for the real split */
+    float       splitIm[HALF_FFT + 1];
+    short       melStart[FEAT_NUM_MELS];
+    short       melLength[FEAT_NUM_MELS];
+    float       melWeights[FEAT_NUM_MELS][FEAT_NUM_BINS];
+    float       dct[FEAT_NUM_CEPS][CEPS_STRIDE];
+}
+featTables;
+
+static featTables tables;
+static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT;
+
+static double hzToMel(double hz)
+{
+    return 2595.0 * log10(1.0 + hz / 700.0);
+}
+
+static double melToHz(double mel)
+{
+    return 700.0 * (pow(10.0, mel / 2595.0) - 1.0);
+}
+
+static void buildTables(void)
+{
+    featTables *t = &tables;
+    for(int i = 0; i < FEAT_FRAME_LEN; i++)
+    {
+        t->window[i] = (float)(0.54 - 0.46 * cos(2.0 * M_PI * i / (FEAT_FRAME_LEN - 1)));
+    }
+
+    fftPlanBuild(&t->plan, HALF_FFT, t->planRe, t->planIm, t->planOrder);
+
+    for(int k = 0; k <= HALF_FFT; k++)
+    {
+        t->splitRe[k] = (float)cos(-2.0 * M_PI * k / FEAT_FFT_SIZE);
+        t->splitIm[k] = (float)sin(-2.0 * M_PI * k / FEAT_FFT_SIZE);
+    }
+
+    /* Triangular filters equally spaced on the mel scale. */
+    double lowMel = hzToMel(MEL_LOW_HZ);
+    double highMel = hzToMel(MEL_HIGH_HZ);
+    double edges[FEAT_NUM_MELS + 2];
+    for(int m = 0; m < FEAT_NUM_MELS + 2; m++)
+    {
+        double hz = melToHz(lowMel + (highMel - lowMel) * m / (FEAT_NUM_MELS + 1));
+        edges[m] = hz * FEAT_FFT_SIZE / FEAT_SAMPLE_RATE;
+    }
+
+    memset(t->melWeights, 0, sizeof(t->melWeights));
+    for(int m = 0; m < FEAT_NUM_MELS; m++)
+    {
+        int first = -1, last = -1;
+        for(int k = 0; k < FEAT_NUM_BINS; k++)
+        {
+            double w = 0.0;
+            if(k > edges[m] && k <= edges[m + 1])
+            {
+                w = (k - edges[m]) / (edges[m + 1] - edges[m]);
+            }
+            else if(k > edges[m + 1] && k < edges[m + 2])
+            {
+                w = (edges[m + 2] - k) / (edges[m + 2] - edges[m + 1]);
+            }
+            if(w > 0.0)
+            {
+                if(first < 0)
+                {
+                    first = k;
+                }
+                last = k;
+            }
+            t->melWeights[m][k] = (float)w;
+        }
+        if(first < 0)
+        {
+            /* Narrow low filters can fall between bins; keep the nearest one. */
+            first = last = (int)(edges[m + 1] + 0.5);
+            t->melWeights[m][first] = 1.0f;
+        }
+        t->melStart[m] = (short)first;
+        t->melLength[m] = (short)(last - first + 1);
+    }
+
+    /* Orthonormal DCT-II, rows padded with zeros for the SIMD dot product. */
+    memset(t->dct, 0, sizeof(t->dct));
+    for(int c = 0; c < FEAT_NUM_CEPS; c++)
+    {
+        double scale = c == 0 ? sqrt(1.0 / FEAT_NUM_MELS) : sqrt(2.0 / FEAT_NUM_MELS);
+        for(int m = 0; m < FEAT_NUM_MELS; m++)
+        {
+            t->dct[c][m] = (float)(scale * cos(M_PI * c * (m + 0.5) / FEAT_NUM_MELS));
+        }
+    }
+}
+
+static const featTables *getTables(void)
+{
+    pthread_once(&tablesOnce, buildTables);
+    return &tables;
+}
+
+void featCompute(const float *frame, float preceding, featFrame *out)
+{
+    const featTables *t = getTables();
+
+    float windowed[FEAT_FFT_SIZE];
+    float re[HALF_FFT], im[HALF_FFT];
+    float power[FEAT_NUM_BINS + 3];
+
+    out->logEnergy = logf(simdEnergy(frame, FEAT_FRAME_LEN) + LOG_FLOOR);
+
+    windowed[0] = frame[0] - FEAT_PREEMPHASIS * preceding;
+    for(int i = 1; i < FEAT_FRAME_LEN; i++)
+    {
+        windowed[i] = frame[i] - FEAT_PREEMPHASIS * frame[i - 1];
+    }
+    simdMul(windowed, windowed, t->window, FEAT_FRAME_LEN);
+    memset(windowed + FEAT_FRAME_LEN, 0, (FEAT_FFT_SIZE - FEAT_FRAME_LEN) * sizeof(float));
+
+    /* Pack the real frame as HALF_FFT complex points, then split. */
+    for(int n = 0; n < HALF_FFT; n++)
+    {
+        re[n] = windowed[2 * n];
+        im[n] = windowed[2 * n + 1];
+    }
+    fftForward(&t->plan, re, im);
+
+    for(int k = 0; k <= HALF_FFT; k++)
+    {
+        int a = k % HALF_FFT;
+        int b = (HALF_FFT - k) % HALF_FFT;
+        float evenRe = 0.5f * (re[a] + re[b]);
+        float evenIm = 0.5f * (im[a] - im[b]);
+        float oddRe = 0.5f * (im[a] + im[b]);
+        float oddIm = -0.5f * (re[a] - re[b]);
+        float xr = evenRe + t->splitRe[k] * oddRe - t->splitIm[k] * oddIm;
+        float xi = evenIm + t->splitRe[k] * oddIm + t->splitIm[k] * oddRe;
+        power[k] = xr * xr + xi * xi;
+    }
+    power[FEAT_NUM_BINS] = power[FEAT_NUM_BINS + 1] = power[FEAT_NUM_BINS + 2] = 0.0f;
+
+    float logMel[CEPS_STRIDE];
+    for(int m = 0; m < FEAT_NUM_MELS; m++)
+    {
+        int s = t->melStart[m];
+        float e = simdDot(&t->melWeights[m][s], &power[s], t->melLength[m]);
+        logMel[m] = logf(e + LOG_FLOOR);
+        out->logMel[m] = logMel[m];
+    }
+    for(int m = FEAT_NUM_MELS; m < CEPS_STRIDE; m++)
+    {
+        logMel[m] = 0.0f;
+    }
+
+    for(int c = 0; c < FEAT_NUM_CEPS; c++)
+    {
+        out->mfcc[c] = simdDot(t->dct[c], logMel, CEPS_STRIDE);
+    }
+}
+
+int featInit(featExtractor *fx)
+{
+    const featTables *t = getTables();
+    memset(fx->pending, 0, sizeof(fx->pending));
+    fx->pendingCount = 0;
+    fx->preceding = 0.0f;
+    atomicStore(&fx->ring.written, 0);
+    return t->plan.size > 0 ? 0 : -1;
+}
+
+static void emitFrame(featExtractor *fx)
+{
+    unsigned long index = atomicLoadRelaxed(&fx->ring.written);
+    featCompute(fx->pending, fx->preceding, &fx->ring.frames[index & (FEAT_RING_FRAMES - 1)]);
+    atomicStore(&fx->ring.written, index + 1);
+
+    fx->preceding = fx->pending[FEAT_FRAME_SHIFT - 1];
+    memmove(fx->pending, fx->pending + FEAT_FRAME_SHIFT,
+            (FEAT_FRAME_LEN - FEAT_FRAME_SHIFT) * sizeof(float));
+    fx->pendingCount = FEAT_FRAME_LEN - FEAT_FRAME_SHIFT;
+}
+
+void featPush(featExtractor *fx, const short *samples, long count)
+{
+    const float scale = 1.0f / 32768.0f;
+    for(long i = 0; i < count; i++)
+    {
+        fx->pending[fx->pendingCount++] = samples[i] * scale;
+        if(fx->pendingCount == FEAT_FRAME_LEN)
+        {
+            emitFrame(fx);
+        }
+    }
+}
+
+void featPushFloat(featExtractor *fx, const float *samples, long count)
+{
+    for(long i = 0; i < count; i++)
+    {
+        fx->pending[fx->pendingCount++] = samples[i];
+        if(fx->pendingCount == FEAT_FRAME_LEN)
+        {
+            emitFrame(fx);
+        }
+    }
+}
+
+unsigned long featRingWritten(const featRing *ring)
+{
+    return atomicLoad(&ring->written);
+}
+
+int featRingValid(const featRing *ring, unsigned long index)
+{
+    unsigned long written = atomicLoad(&ring->written);
+    return index < written && written - index < FEAT_RING_FRAMES;
+}
+
+const featFrame *featRingGet(const featRing *ring, unsigned long index)
+{
+    if(!featRingValid(ring, index))
+    {
+        return NULL;
+    }
+    return &ring->frames[index & (FEAT_RING_FRAMES - 1)];
+}
+
+unsigned long featSpeechRange(const featRing *ring, unsigned long first, unsigned long count,
+                              unsigned long *speechStart)
+{
+    float lo = 0.0f, hi = 0.0f;
+    unsigned long seen = 0;
+
+    for(unsigned long i = first; i < first + count; i++)
+    {
+        const featFrame *f = featRingGet(ring, i);
+        if(f == NULL)
+        {
+            continue;
+        }
+        if(seen == 0 || f->logEnergy < lo)
+        {
+            lo = f->logEnergy;
+        }
+        if(seen == 0 || f->logEnergy > hi)
+        {
+            hi = f->logEnergy;
+        }
+        seen++;
+    }
+
+    float threshold = lo + SPEECH_ABOVE_FLOOR;
+    if(hi - SPEECH_BELOW_PEAK > threshold)
+    {
+        threshold = hi - SPEECH_BELOW_PEAK;
+    }
+
+    unsigned long start = 0, end = 0;
+    int found = 0;
+    for(unsigned long i = first; i < first + count; i++)
+    {
+        const featFrame *f = featRingGet(ring, i);
+        if(f != NULL && f->logEnergy > threshold && hi - lo > SPEECH_ABOVE_FLOOR)
+        {
+            if(!found)
+            {
+                start = i;
+                found = 1;
+            }
+            end = i + 1;
+        }
+    }
+
+    *speechStart = found ? start : first;
+    return found ? end - start : 0;
+}
@@ -0,0 +1,83 @@
+#ifndef JARVIS_MFCC_H
+#define JARVIS_MFCC_H
+
+/*
+ *  Streaming log-mel / MFCC front end.
+ *
+ *  Capture blocks of any size are pushed in with featPush(). Every
+ *  FEAT_FRAME_SHIFT samples a FEAT_FRAME_LEN window is pre-emphasised,
+ *  Hamming windowed, transformed, mel filtered and DCT'd, and the result
+ *  is published into a frame-aligned ring. Readers take pointers straight
+ *  into the ring instead of copying.
+ */
+
+#define FEAT_SAMPLE_RATE    (16000)
+#define FEAT_FRAME_LEN      (400)   /* 25 ms */
+#define FEAT_FRAME_SHIFT    (160)   /* 10 ms */
+#define FEAT_FFT_SIZE       (512)
+#define FEAT_NUM_BINS       (FEAT_FFT_SIZE / 2 + 1)
+#define FEAT_NUM_MELS       (26)
+#define FEAT_NUM_CEPS       (13)
+#define FEAT_PREEMPHASIS    (0.97f)
+#define FEAT_RING_FRAMES    (1024)  /* power of two, ~10 s of frames */
+
+typedef struct
+{
+    float       logMel[FEAT_NUM_MELS];
+    float       mfcc[FEAT_NUM_CEPS];
+    float       logEnergy;
+}
+featFrame;
+
+typedef struct
+{
+    featFrame       frames[FEAT_RING_FRAMES];
+    unsigned long   written;        /* frames published so far */
+}
+featRing;
+
+typedef struct
+{
+    float       pending[FEAT_FRAME_LEN];    /* raw samples of the next frame */
+    int         pendingCount;
+    float       preceding;                  /* raw sample just before pending[0] */
+    featRing    ring;
+}
+featExtractor;
+
+/* Prepares the shared tables on first use and resets the extractor; -1 if the tables could not be built. */
+int  featInit(featExtractor *fx);
+
+/* Feeds int16 capture samples. Safe to call from the audio callback. */
+void featPush(featExtractor *fx, const short *samples, long count);
+
+/* Same as featPush for float samples in [-1, 1). */
+void featPushFloat(featExtractor *fx, const float *samples, long count);
+
+/*
+ *  Computes one frame from FEAT_FRAME_LEN raw samples; preceding is the
+ *  sample before frame[0], needed by the pre-emphasis filter. The log
+ *  energy is taken before pre-emphasis so endpointing sees voiced speech.
+ */
+void featCompute(const float *frame, float preceding, featFrame *out);
+
+/* Number of frames published so far; use as an upper bound for featRingGet. */
+unsigned long featRingWritten(const featRing *ring);
+
+/*
+ *  Returns a pointer into the ring for frame index, or NULL if it has not
+ *  been written yet or was already overwritten. Readers that may lag far
+ *  behind should call featRingValid after consuming the frame.
+ */
+const featFrame *featRingGet(const featRing *ring, unsigned long index);
+int featRingValid(const featRing *ring, unsigned long index);
+
+/*
+ *  Energy endpointing over frames [first, first + count): narrows the
+ *  range to the frames that rise clearly above the quietest ones.
+ *  Returns the number of speech frames (0 if the range is all silence).
+ */
+unsigned long featSpeechRange(const featRing *ring, unsigned long first, unsigned long count,
+                              unsigned long *speechStart);
+
+#endif
@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <string.h>
+#include "clock.h"
+#include "net.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define poll            WSAPoll
+#define netLastError()  WSAGetLastError()
+#define NET_INPROGRESS  WSAEWOULDBLOCK
+#define NET_AGAIN       WSAEWOULDBLOCK
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#define netLastError()  errno
+#define NET_INPROGRESS  EINPROGRESS
+#define NET_AGAIN       EAGAIN
+#endif
+
+/* A peer that hangs up must fail the send, not raise SIGPIPE in a process that may be someone else's. */
+#ifdef MSG_NOSIGNAL
+#define NET_SEND_FLAGS  MSG_NOSIGNAL
+#else
+#define NET_SEND_FLAGS  0
+#endif
+
+int netStartup(void)
+{
+#ifdef _WIN32
+    WSADATA wsa;
+    return WSAStartup(MAKEWORD(2, 2), &wsa) == 0 ? NET_OK : NET_ERROR;
+#else
+    return NET_OK;
+#endif
+}
+
+static int setNonBlocking(int fd)
+{
+#ifdef _WIN32
+    u_long on = 1;
+    return ioctlsocket(fd, FIONBIO, &on) == 0 ? NET_OK : NET_ERROR;
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0 ? NET_OK : NET_ERROR;
+#endif
+}
+
+/* Where send has no MSG_NOSIGNAL (macOS, BSD), the socket itself is told not to signal. */
+static void noSigPipe(int fd)
+{
+#if defined(SO_NOSIGPIPE) && !defined(MSG_NOSIGNAL)
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, (const char *)&one, sizeof(one));
+#else
+    (void)fd;
+#endif
+}
+
+/* Waits for events on fd in short slices; returns NET_OK when ready. */
+static int waitFor(int fd, short events, double deadline, volatile int *cancel)
+{
+    for(;;)
+    {
+        if(cancel != NULL && *cancel)
+        {
+            return NET_CANCELLED;
+        }
+
+        double left = deadline - clockNow();
+        if(left <= 0.0)
+        {
+            return NET_TIMEOUT;
+        }
+
+        int ms = (int)(left * 1000.0) + 1;
+        if(ms > NET_POLL_SLICE_MS)
+        {
+            ms = NET_POLL_SLICE_MS;
+        }
+
+        struct pollfd p = { .fd = fd, .events = events, .revents = 0 };
+        int r = poll(&p, 1, ms);
+        if(r > 0)
+        {
+            return NET_OK;
+        }
+#ifndef _WIN32
+        if(r < 0 && errno != EINTR)
+        {
+            return NET_ERROR;
+        }
+#else
+        if(r < 0)
+        {
+            return NET_ERROR;
+        }
+#endif
+    }
+}
+
+int netConnect(const char *host, int port, double deadline, volatile int *cancel)
+{
+    char service[16];
+    struct addrinfo hints, *list = NULL;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%d", port);
+
+    if(getaddrinfo(host, service, &hints, &list) != 0)
+    {
+        return NET_ERROR;
+    }
+
+    int result = NET_ERROR;
+    for(struct addrinfo *ai = list; ai != NULL; ai = ai->ai_next)
+    {
+        int fd = (int)socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if(fd < 0)
+        {
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char *)&one, sizeof(one));
+        noSigPipe(fd);
+
+        if(setNonBlocking(fd) != NET_OK)
+        {
+            netClose(fd);
+            continue;
+        }
+
+        if(connect(fd, ai->ai_addr, (int)ai->ai_addrlen) == 0)
+        {
+            result = fd;
+            break;
+        }
+        if(netLastError() != NET_INPROGRESS)
+        {
+            netClose(fd);
+            continue;
+        }
+
+        int w = waitFor(fd, POLLOUT, deadline, cancel);
+        if(w != NET_OK)
+        {
+            netClose(fd);
+            result = w;
+            if(w == NET_CANCELLED || w == NET_TIMEOUT)
+            {
+                break;
+            }
+            continue;
+        }
+
+        int err = 0;
+        socklen_t errLength = sizeof(err);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, (char *)&err, &errLength);
+        if(err == 0)
+        {
+            result = fd;
+            break;
+        }
+        netClose(fd);
+        result = NET_ERROR;
+    }
+
+    freeaddrinfo(list);
+    return result;
+}
+
+int netResolve(const char *host, int port, netAddress *out)
+{
+    char service[16];
+    struct addrinfo hints, *list = NULL;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%d", port);
+
+    out->length = 0;
+    if(getaddrinfo(host, service, &hints, &list) != 0)
+    {
+        return NET_ERROR;
+    }
+    /* Only the first address: trying the rest would need another round trip through the loop. */
+    int result = NET_ERROR;
+    if(list->ai_addrlen <= sizeof(out->storage))
+    {
+        memcpy(out->storage, list->ai_addr, list->ai_addrlen);
+        out->length = (unsigned int)list->ai_addrlen;
+        out->family = list->ai_family;
+        result = NET_OK;
+    }
+    freeaddrinfo(list);
+    return result;
+}
+
+int netConnectStart(const netAddress *address, int *fd)
+{
+    *fd = -1;
+    if(address->length == 0)
+    {
+        return NET_ERROR;
+    }
+
+    int result = NET_ERROR;
+    int s = (int)socket(address->family, SOCK_STREAM, 0);
+    if(s >= 0)
+    {
+        int one = 1;
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char *)&one, sizeof(one));
+        noSigPipe(s);
+        if(setNonBlocking(s) == NET_OK)
+        {
+            if(connect(s, (const struct sockaddr *)address->storage, (int)address->length) == 0)
+            {
+                result = NET_OK;
+            }
+            else if(netLastError() == NET_INPROGRESS)
+            {
+                result = NET_PENDING;
+            }
+        }
+        if(result == NET_ERROR)
+        {
+            netClose(s);
+        }
+        else
+        {
+            *fd = s;
+        }
+    }
+    return result;
+}
+
+int netConnectFinish(int fd)
+{
+    int err = 0;
+    socklen_t errLength = sizeof(err);
+    if(getsockopt(fd, SOL_SOCKET, SO_ERROR, (char *)&err, &errLength) != 0 || err != 0)
+    {
+        return NET_ERROR;
+    }
+    return NET_OK;
+}
+
+long netSendSome(int fd, const void *buf, size_t length)
+{
+    long n = (long)send(fd, (const char *)buf, (int)length, NET_SEND_FLAGS);
+    if(n >= 0)
+    {
+        return n;
+    }
+    return netLastError() == NET_AGAIN ? NET_PENDING : NET_ERROR;
+}
+
+long netRecvSome(int fd, void *buf, size_t length)
+{
+    long n = (long)recv(fd, (char *)buf, (int)length, 0);
+    if(n > 0)
+    {
+        return n;
+    }
+    if(n == 0)
+    {
+        return NET_CLOSED;
+    }
+    return netLastError() == NET_AGAIN ? NET_PENDING : NET_ERROR;
+}
+
+int netSendAll(int fd, const void *buf, size_t length, double deadline, volatile int *cancel)
+{
+    const char *p = (const char *)buf;
+    while(length > 0)
+    {
+        long n = (long)send(fd, p, (int)length, NET_SEND_FLAGS);
+        if(n > 0)
+        {
+            p += n;
+            length -= (size_t)n;
+            continue;
+        }
+        if(n < 0 && netLastError() != NET_AGAIN)
+        {
+            return NET_ERROR;
+        }
+        int w = waitFor(fd, POLLOUT, deadline, cancel);
+        if(w != NET_OK)
+        {
+            return w;
+        }
+    }
+    return NET_OK;
+}
+
+long netRecv(int fd, void *buf, size_t length, double deadline, volatile int *cancel)
+{
+    for(;;)
+    {
+        long n = (long)recv(fd, (char *)buf, (int)length, 0);
+        if(n > 0)
+        {
+            return n;
+        }
+        if(n == 0)
+        {
+            return NET_CLOSED;
+        }
+        if(netLastError() != NET_AGAIN)
+        {
+            return NET_ERROR;
+        }
+        int w = waitFor(fd, POLLIN, deadline, cancel);
+        if(w != NET_OK)
+        {
+            return w;
+        }
+    }
+}
+
+int netListen(const char *host, int port, int backlog)
+{
+    char service[16];
+    struct addrinfo hints, *list = NULL;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    snprintf(service, sizeof(service), "%d", port);
+
+    if(getaddrinfo(host, service, &hints, &list) != 0)
+    {
+        return NET_ERROR;
+    }
+
+    int fd = (int)socket(list->ai_family, list->ai_socktype, list->ai_protocol);
+    if(fd >= 0)
+    {
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const char *)&one, sizeof(one));
+        if(bind(fd, list->ai_addr, (int)list->ai_addrlen) != 0 || listen(fd, backlog) != 0 ||
+           setNonBlocking(fd) != NET_OK)
+        {
+            netClose(fd);
+            fd = NET_ERROR;
+        }
+    }
+    freeaddrinfo(list);
+    return fd < 0 ? NET_ERROR : fd;
+}
+
+int netLocalPort(int fd)
+{
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+    if(getsockname(fd, (struct sockaddr *)&address, &length) != 0 || address.sin_family != AF_INET)
+    {
+        return NET_ERROR;
+    }
+    return ntohs(address.sin_port);
+}
+
+int netAccept(int listenFd, double deadline, volatile int *cancel)
+{
+    for(;;)
+    {
+        int fd = (int)accept(listenFd, NULL, NULL);
+        if(fd >= 0)
+        {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char *)&one, sizeof(one));
+            noSigPipe(fd);
+            setNonBlocking(fd);
+            return fd;
+        }
+        if(netLastError() != NET_AGAIN)
+        {
+            return NET_ERROR;
+        }
+        int w = waitFor(listenFd, POLLIN, deadline, cancel);
+        if(w != NET_OK)
+        {
+            return w;
+        }
+    }
+}
+
+void netClose(int fd)
+{
+#ifdef _WIN32
+    closesocket(fd);
+#else
+    close(fd);
+#endif
+}
+
+const char *netErrorText(int e)
+{
+    switch(e)
+    {
+        case NET_OK:        return "ok";
+        case NET_TIMEOUT:   return "deadline exceeded";
+        case NET_CANCELLED: return "cancelled";
+        case NET_CLOSED:    return "connection closed";
+        case NET_PENDING:   return "would block";
+        default:            return "network error";
+    }
+}
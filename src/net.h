@@ -0,0 +1,58 @@
+#ifndef JARVIS_NET_H
+#define JARVIS_NET_H
+
+#include <stddef.h>
+
+/*
+ *  Blocking-style socket helpers with an absolute deadline (clockNow()
+ *  seconds) and an optional cancel flag. Sockets are non-blocking under
+ *  the hood and polled in short slices, so a cancelled or expired call
+ *  returns within NET_POLL_SLICE_MS.
+ */
+
+#define NET_OK              (0)
+#define NET_ERROR           (-1)
+#define NET_TIMEOUT         (-2)
+#define NET_CANCELLED       (-3)
+#define NET_CLOSED          (-4)
+#define NET_PENDING         (-5)     /* non-blocking call would block: wait for readiness */
+
+#define NET_POLL_SLICE_MS   (20)
+
+int  netStartup(void);
+int  netConnect(const char *host, int port, double deadline, volatile int *cancel);
+int  netSendAll(int fd, const void *buf, size_t length, double deadline, volatile int *cancel);
+long netRecv(int fd, void *buf, size_t length, double deadline, volatile int *cancel);
+void netClose(int fd);
+const char *netErrorText(int e);
+
+/* A resolved host and port, so that connecting on an event loop never waits for the resolver. */
+typedef struct
+{
+    long long       storage[16];    /* room and alignment for a struct sockaddr_storage */
+    unsigned int    length;         /* 0: not resolved */
+    int             family;
+}
+netAddress;
+
+/* Blocking lookup of the first address of host; call it off loop threads. */
+int  netResolve(const char *host, int port, netAddress *out);
+
+/*
+ *  Non-blocking primitives for event-loop callers (see evloop.h): nothing
+ *  here waits. netConnectStart returns NET_OK with *fd connected, or
+ *  NET_PENDING with *fd to watch for EV_WRITE and then netConnectFinish.
+ */
+int  netConnectStart(const netAddress *address, int *fd);
+int  netConnectFinish(int fd);
+long netSendSome(int fd, const void *buf, size_t length);
+long netRecvSome(int fd, void *buf, size_t length);
+
+/* Listening side, used by the local stand-in servers and endpoints. */
+int  netListen(const char *host, int port, int backlog);
+int  netAccept(int listenFd, double deadline, volatile int *cancel);
+
+/* The port fd is bound to (the one picked when netListen was given 0), NET_ERROR if unknown. */
+int  netLocalPort(int fd);
+
+#endif
@@ -0,0 +1,89 @@
+#ifdef __linux__
+#define _DEFAULT_SOURCE                 /* syscall() for the futex */
+#endif
+#include <limits.h>
+#include "atomics.h"
+#include "clock.h"
+#include "notify.h"
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+void notifyInit(notifier *n)
+{
+    n->seq = 0;
+    n->waiters = 0;
+#ifndef __linux__
+    pthread_mutex_init(&n->lock, NULL);
+    pthread_cond_init(&n->changed, NULL);
+#endif
+}
+
+void notifyFree(notifier *n)
+{
+#ifndef __linux__
+    pthread_cond_destroy(&n->changed);
+    pthread_mutex_destroy(&n->lock);
+#else
+    (void)n;
+#endif
+}
+
+unsigned notifyPrepare(notifier *n)
+{
+    return atomicLoadSeqCst(&n->seq);
+}
+
+/*
+ *  The waiter announces itself before re-reading seq and the signaller
+ *  bumps seq before reading waiters, both sequentially consistent, so at
+ *  least one of them sees the other.
+ */
+int notifyWait(notifier *n, unsigned seen, double seconds)
+{
+    if(seconds <= 0.0)
+    {
+        return atomicLoadSeqCst(&n->seq) != seen ? 0 : -1;
+    }
+#ifdef __linux__
+    struct timespec ts = { (time_t)seconds, (long)((seconds - (double)(time_t)seconds) * 1e9) };
+    atomicAddSeqCst(&n->waiters, 1);
+    /* Returns at once if seq already moved; spurious wake-ups just end the wait early. */
+    syscall(SYS_futex, &n->seq, FUTEX_WAIT_PRIVATE, seen, &ts, NULL, 0);
+    atomicAddSeqCst(&n->waiters, -1);
+#else
+    struct timespec ts = clockAbsolute(seconds);
+    pthread_mutex_lock(&n->lock);
+    atomicAddSeqCst(&n->waiters, 1);
+    while(atomicLoadSeqCst(&n->seq) == seen)
+    {
+        if(pthread_cond_timedwait(&n->changed, &n->lock, &ts) != 0)
+        {
+            break;
+        }
+    }
+    atomicAddSeqCst(&n->waiters, -1);
+    pthread_mutex_unlock(&n->lock);
+#endif
+    return atomicLoadSeqCst(&n->seq) != seen ? 0 : -1;
+}
+
+void notifySignal(notifier *n)
+{
+    atomicAddSeqCst(&n->seq, 1);
+    if(atomicLoadSeqCst(&n->waiters) == 0)
+    {
+        return;
+    }
+#ifdef __linux__
+    syscall(SYS_futex, &n->seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+    /* Taking the lock orders this after a waiter that has not reached its wait yet. */
+    pthread_mutex_lock(&n->lock);
+    pthread_cond_broadcast(&n->changed);
+    pthread_mutex_unlock(&n->lock);
+#endif
+}
@@ -0,0 +1,43 @@
+#ifndef JARVIS_NOTIFY_H
+#define JARVIS_NOTIFY_H
+
+#include <pthread.h>
+
+/*
+ *  Wake-up for threads that wait on state kept elsewhere (a ring, a
+ *  queue, a flag). An event count: the waiter takes a ticket, re-checks
+ *  its condition, then sleeps until the count moves past the ticket, so
+ *  a signal between the check and the sleep is never lost.
+ *
+ *      unsigned seen = notifyPrepare(&n);
+ *      if(!ready())
+ *          notifyWait(&n, seen, 0.1);
+ *
+ *  Linux sleeps on a futex; elsewhere a mutex and condition variable.
+ *  notifySignal is one atomic add and load while nobody waits, so it is
+ *  cheap enough for an audio callback, and never blocks there on Linux.
+ */
+
+typedef struct
+{
+    unsigned            seq;
+    int                 waiters;
+#ifndef __linux__
+    pthread_mutex_t     lock;
+    pthread_cond_t      changed;
+#endif
+}
+notifier;
+
+void     notifyInit(notifier *n);
+void     notifyFree(notifier *n);
+
+unsigned notifyPrepare(notifier *n);
+
+/* Sleeps until a signal after seen or for at most seconds; returns 0 if signalled, -1 on timeout. */
+int      notifyWait(notifier *n, unsigned seen, double seconds);
+
+/* Wakes every waiter. Any thread. */
+void     notifySignal(notifier *n);
+
+#endif
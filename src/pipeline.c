@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atomics.h"
+#include "clock.h"
+#include "mempool.h"
+#include "pipeline.h"
+#include "trace.h"
+
+#define PIPE_WAIT       (0.1)       /* seconds; every wake-up is signalled, this only bounds a lost one */
+
+/* Upper bounds of the per-item stage time histogram, seconds. */
+static const double stageBuckets[] = { 0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1.0, 5.0 };
+
+/*------ QUEUE ------*/
+
+static int queueInit(pipeQueue *q, size_t capacity)
+{
+    size_t size = 1;
+    while(size < capacity)
+    {
+        size <<= 1;
+    }
+    memset(q, 0, sizeof(*q));
+    q->slots = (void **)memCalloc(size, sizeof(void *));
+    if(q->slots == NULL)
+    {
+        return -1;
+    }
+    q->mask = size - 1;
+    return 0;
+}
+
+/* Producer side; returns 0 if the queue is full. */
+static int queuePush(pipeQueue *q, void *item, size_t *depth)
+{
+    size_t head = q->head;
+    size_t tail = atomicLoad(&q->tail);
+    if(head - tail > q->mask)
+    {
+        return 0;
+    }
+    q->slots[head & q->mask] = item;
+    atomicStore(&q->head, head + 1);
+    *depth = head + 1 - tail;
+    return 1;
+}
+
+/* Consumer side; NULL if the queue is empty. */
+static void *queuePop(pipeQueue *q, size_t *depth)
+{
+    size_t tail = q->tail;
+    size_t head = atomicLoad(&q->head);
+    if(head == tail)
+    {
+        return NULL;
+    }
+    void *item = q->slots[tail & q->mask];
+    atomicStore(&q->tail, tail + 1);
+    *depth = head - tail - 1;
+    return item;
+}
+
+/*------ STAGES ------*/
+
+/* Waits for the stage's next wake-up unless one came after seen. */
+static void idle(pipeStage *st, unsigned seen, double start)
+{
+    notifyWait(&st->wake, seen, PIPE_WAIT);
+    st->stats.idleSeconds += clockNow() - start;
+}
+
+static void forward(pipeStage *st, pipeStage *next, void *item)
+{
+    double start = clockNow();
+    size_t depth;
+    for(;;)
+    {
+        unsigned seen = notifyPrepare(&next->room);
+        if(queuePush(&next->in, item, &depth))
+        {
+            break;
+        }
+        notifyWait(&next->room, seen, PIPE_WAIT);
+    }
+    notifySignal(&next->wake);
+    traceCounter(next->traceQueue, depth);
+    metricMove(next->metricDepth, 1.0);
+    if(depth > next->stats.maxDepth)
+    {
+        next->stats.maxDepth = depth;
+    }
+    st->stats.stallSeconds += clockNow() - start;
+}
+
+/* Hands completed items on; returns how many are still in flight. */
+static size_t forwardCompleted(pipeStage *st, pipeStage *next)
+{
+    void *done[64];
+    size_t count, inFlight;
+    do
+    {
+        pthread_mutex_lock(&st->completedLock);
+        count = st->completedCount < 64 ? st->completedCount : 64;
+        st->completedCount -= count;
+        memcpy(done, st->completed + st->completedCount, count * sizeof(void *));
+        inFlight = st->inFlight + st->completedCount;
+        pthread_mutex_unlock(&st->completedLock);
+
+        for(size_t i = 0; i < count; i++)
+        {
+            st->stats.items++;
+            metricInc(st->metricItems);
+            if(next != NULL)
+            {
+                forward(st, next, done[i]);
+            }
+        }
+    }
+    while(count == 64);
+    return inFlight;
+}
+
+static void *pop(pipeStage *st)
+{
+    size_t depth;
+    void *item = queuePop(&st->in, &depth);
+    if(item != NULL)
+    {
+        notifySignal(&st->room);
+        traceCounter(st->traceQueue, depth);
+        metricMove(st->metricDepth, -1.0);
+    }
+    return item;
+}
+
+static void asyncStage(pipeStage *st, pipeStage *prev, pipeStage *next)
+{
+    pipeline *p = st->owner;
+    for(;;)
+    {
+        double start = clockNow();
+        unsigned seen = notifyPrepare(&st->wake);
+        size_t inFlight = forwardCompleted(st, next);
+        void *item = inFlight < p->capacity ? pop(st) : NULL;
+        if(item == NULL)
+        {
+            if(inFlight == 0 && atomicLoad(&prev->done) && (item = pop(st)) == NULL)
+            {
+                break;
+            }
+            if(item == NULL)
+            {
+                idle(st, seen, start);
+                continue;
+            }
+        }
+
+        pthread_mutex_lock(&st->completedLock);
+        st->inFlight++;
+        pthread_mutex_unlock(&st->completedLock);
+        start = clockNow();
+        traceBegin(st->traceSpan);
+        item = st->func(st->ctx, item);
+        traceEnd(st->traceSpan);
+        st->stats.busySeconds += clockNow() - start;
+        if(item != NULL)
+        {
+            pipelineComplete(p, (int)(st - p->stages), item);
+        }
+    }
+}
+
+static void syncStage(pipeStage *st, pipeStage *prev, pipeStage *next)
+{
+    pipeline *p = st->owner;
+    for(;;)
+    {
+        double start = clockNow();
+        unsigned seen = notifyPrepare(&st->wake);
+        void *item;
+        if(prev == NULL)
+        {
+            traceBegin(st->traceSpan);
+            item = st->func(st->ctx, NULL);
+            traceEnd(st->traceSpan);
+            if(item == NULL)
+            {
+                if(atomicLoad(&p->stopping))
+                {
+                    break;
+                }
+                idle(st, seen, start);
+                continue;
+            }
+        }
+        else
+        {
+            item = pop(st);
+            if(item == NULL)
+            {
+                /* Upstream finished before this check, so all of its pushes are visible. */
+                if(atomicLoad(&prev->done) && (item = pop(st)) == NULL)
+                {
+                    break;
+                }
+                if(item == NULL)
+                {
+                    idle(st, seen, start);
+                    continue;
+                }
+            }
+            start = clockNow();
+            traceBegin(st->traceSpan);
+            item = st->func(st->ctx, item);
+            traceEnd(st->traceSpan);
+        }
+        double busy = clockNow() - start;
+        st->stats.items++;
+        st->stats.busySeconds += busy;
+        metricInc(st->metricItems);
+        if(prev != NULL)
+        {
+            metricObserve(st->metricSeconds, busy);
+        }
+
+        if(item != NULL && next != NULL)
+        {
+            forward(st, next, item);
+        }
+    }
+}
+
+static void *stageThread(void *arg)
+{
+    pipeStage *st = (pipeStage *)arg;
+    pipeline *p = st->owner;
+    int index = (int)(st - p->stages);
+    pipeStage *prev = index > 0 ? &p->stages[index - 1] : NULL;
+    pipeStage *next = index + 1 < p->count ? &p->stages[index + 1] : NULL;
+
+    traceThread(st->name);
+    if(st->async)
+    {
+        asyncStage(st, prev, next);
+    }
+    else
+    {
+        syncStage(st, prev, next);
+    }
+    atomicStore(&st->done, 1);
+    if(next != NULL)
+    {
+        notifySignal(&next->wake);
+    }
+    return NULL;
+}
+
+/*------ PIPELINE ------*/
+
+void pipelineInit(pipeline *p, size_t capacity)
+{
+    memset(p, 0, sizeof(*p));
+    p->capacity = capacity > 0 ? capacity : 1;
+}
+
+int pipelineAdd(pipeline *p, const char *name, pipeFunc func, void *ctx)
+{
+    if(p->count == PIPE_MAX_STAGES || p->started)
+    {
+        return -1;
+    }
+    pipeStage *st = &p->stages[p->count];
+    memset(st, 0, sizeof(*st));
+    if(p->count > 0 && queueInit(&st->in, p->capacity) != 0)
+    {
+        return -1;
+    }
+    st->name = name;
+    st->func = func;
+    st->ctx = ctx;
+    st->owner = p;
+    char queueName[TRACE_NAME_MAX];
+    snprintf(queueName, sizeof(queueName), "%s queue", name);
+    st->traceSpan = traceName(name);
+    st->traceQueue = traceName(queueName);
+    char labels[METRICS_LABELS_MAX];
+    snprintf(labels, sizeof(labels), "stage=\"%s\"", name);
+    st->metricDepth = metricGauge("jarvis_queue_depth", labels, "Items queued in front of the stage.");
+    st->metricItems = metricCounter("jarvis_stage_items_total", labels, "Items the stage has handled.");
+    st->metricSeconds = metricHistogram("jarvis_stage_seconds", labels, "Time the stage spent on one item.",
+                                        stageBuckets, (int)(sizeof(stageBuckets) / sizeof(stageBuckets[0])));
+    notifyInit(&st->wake);
+    notifyInit(&st->room);
+    p->count++;
+    return 0;
+}
+
+int pipelineAddAsync(pipeline *p, const char *name, pipeFunc func, void *ctx)
+{
+    /* The source produces items rather than taking them, so it cannot be asynchronous. */
+    if(p->count == 0 || pipelineAdd(p, name, func, ctx) != 0)
+    {
+        return -1;
+    }
+    pipeStage *st = &p->stages[p->count - 1];
+    st->completed = (void **)memCalloc(p->capacity, sizeof(void *));
+    if(st->completed == NULL)
+    {
+        memFree(st->in.slots);
+        notifyFree(&st->wake);
+        notifyFree(&st->room);
+        p->count--;
+        return -1;
+    }
+    pthread_mutex_init(&st->completedLock, NULL);
+    st->async = 1;
+    return p->count - 1;
+}
+
+void pipelineComplete(pipeline *p, int stage, void *item)
+{
+    pipeStage *st = &p->stages[stage];
+    pthread_mutex_lock(&st->completedLock);
+    st->inFlight--;
+    st->completed[st->completedCount++] = item;
+    pthread_mutex_unlock(&st->completedLock);
+    notifySignal(&st->wake);
+}
+
+void pipelineWake(pipeline *p)
+{
+    if(p->count > 0)
+    {
+        notifySignal(&p->stages[0].wake);
+    }
+}
+
+int pipelineStart(pipeline *p)
+{
+    for(int i = 0; i < p->count; i++)
+    {
+        if(pthread_create(&p->stages[i].thread, NULL, stageThread, &p->stages[i]) != 0)
+        {
+            /* Earlier stages drain and exit once they see the stop. */
+            atomicStore(&p->stopping, 1);
+            pipelineWake(p);
+            for(int j = 0; j < i; j++)
+            {
+                pthread_join(p->stages[j].thread, NULL);
+            }
+            return -1;
+        }
+    }
+    p->started = 1;
+    return 0;
+}
+
+void pipelineStop(pipeline *p)
+{
+    atomicStore(&p->stopping, 1);
+    pipelineWake(p);
+    if(!p->started)
+    {
+        return;
+    }
+    for(int i = 0; i < p->count; i++)
+    {
+        pthread_join(p->stages[i].thread, NULL);
+    }
+    p->started = 0;
+}
+
+void pipelineFree(pipeline *p)
+{
+    pipelineStop(p);
+    for(int i = 0; i < p->count; i++)
+    {
+        memFree(p->stages[i].in.slots);
+        p->stages[i].in.slots = NULL;
+        notifyFree(&p->stages[i].wake);
+        notifyFree(&p->stages[i].room);
+        if(p->stages[i].async)
+        {
+            pthread_mutex_destroy(&p->stages[i].completedLock);
+            memFree(p->stages[i].completed);
+            p->stages[i].completed = NULL;
+        }
+    }
+    p->count = 0;
+}
+
+void pipelineGetStats(const pipeline *p, int stage, pipeStats *out)
+{
+    const pipeStage *st = &p->stages[stage];
+    *out = st->stats;
+    out->depth = stage > 0 ? atomicLoad(&st->in.head) - atomicLoad(&st->in.tail) : 0;
+}
@@ -0,0 +1,131 @@
+#ifndef JARVIS_PIPELINE_H
+#define JARVIS_PIPELINE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "metrics.h"
+#include "notify.h"
+
+/*
+ *  Stage-per-thread pipeline.
+ *
+ *  Each stage runs on its own thread and hands items to the next through
+ *  a bounded single-producer / single-consumer queue of pointers, so
+ *  while one utterance is being uploaded the next can already be cleaned
+ *  and encoded. A full queue blocks the stage in front of it
+ *  (backpressure), which makes the slowest stage set the throughput and
+ *  keeps memory bounded; the first stage is a source, run again whenever
+ *  pipelineWake says it may have something. Idle stages sleep until an
+ *  item, a free slot or a completion wakes them. Per stage the pipeline
+ *  keeps the queue depth and the time spent working, waiting for input
+ *  and stalled on a full queue. With tracing on (trace.h) every stage
+ *  call is a span on the stage's thread and queue depths are counters.
+ *  The same numbers feed the process-wide metrics (metrics.h), labelled
+ *  by stage name and summed over pipelines.
+ */
+
+#define PIPE_MAX_STAGES     (8)
+
+/*
+ *  Stage function. Gets ctx and the item from the previous stage (NULL
+ *  for the source) and returns the item for the next stage, or NULL
+ *  when there is nothing to pass on: the source has nothing ready, or
+ *  the item was consumed. The last stage owns and frees what it gets.
+ */
+typedef void *(*pipeFunc)(void *ctx, void *item);
+
+typedef struct pipeline pipeline;
+
+typedef struct
+{
+    void          **slots;
+    size_t          mask;
+    size_t          head;           /* written by the producer */
+    char            pad[64];        /* keep head and tail on separate cache lines */
+    size_t          tail;           /* written by the consumer */
+}
+pipeQueue;
+
+/* Written by the stage's own thread; approximate while it runs. */
+typedef struct
+{
+    unsigned long   items;
+    double          busySeconds;
+    double          idleSeconds;    /* waiting for input */
+    double          stallSeconds;   /* blocked on a full output queue */
+    size_t          depth;          /* items queued in front of the stage */
+    size_t          maxDepth;
+}
+pipeStats;
+
+typedef struct
+{
+    const char     *name;
+    pipeFunc        func;
+    void           *ctx;
+    pipeQueue       in;             /* unused by the source */
+    pthread_t       thread;
+    int             done;
+    pipeline       *owner;
+    pipeStats       stats;
+    notifier        wake;           /* input, completions, upstream done, stop */
+    notifier        room;           /* a slot in `in` was freed */
+    uint16_t        traceSpan;      /* trace names: the stage's work, its queue depth */
+    uint16_t        traceQueue;
+    metric         *metricDepth;    /* jarvis_queue_depth, jarvis_stage_items_total, jarvis_stage_seconds */
+    metric         *metricItems;
+    metric         *metricSeconds;
+
+    /* Asynchronous stages: items started but not yet completed. */
+    int             async;
+    pthread_mutex_t completedLock;
+    void          **completed;
+    size_t          completedCount;
+    size_t          inFlight;
+}
+pipeStage;
+
+struct pipeline
+{
+    pipeStage       stages[PIPE_MAX_STAGES];
+    int             count;
+    size_t          capacity;
+    int             started;
+    int             stopping;
+};
+
+/* capacity is the length of every queue, rounded up to a power of two. */
+void pipelineInit(pipeline *p, size_t capacity);
+
+/* Adds a stage behind the others; the first one added is the source. Returns -1 when full. */
+int  pipelineAdd(pipeline *p, const char *name, pipeFunc func, void *ctx);
+
+/*
+ *  Adds an asynchronous stage: func starts work on the item and returns
+ *  NULL, and whoever finishes it (any thread, e.g. an event loop) hands
+ *  it on with pipelineComplete. func may also return the item to pass
+ *  it on at once. At most capacity items are in flight, so backpressure
+ *  still reaches the stages in front. Returns the stage index or -1.
+ */
+int  pipelineAddAsync(pipeline *p, const char *name, pipeFunc func, void *ctx);
+void pipelineComplete(pipeline *p, int stage, void *item);
+
+/* Any thread, e.g. an audio callback: the source has new input. Cheap when the source is busy. */
+void pipelineWake(pipeline *p);
+
+/* Starts one thread per stage; returns -1 (nothing running) on failure. */
+int  pipelineStart(pipeline *p);
+
+/*
+ *  Stops polling the source once it returns NULL, lets every queued
+ *  item run through the remaining stages, and joins the threads.
+ */
+void pipelineStop(pipeline *p);
+
+void pipelineFree(pipeline *p);
+
+/* Snapshot of one stage's counters, with its current queue depth. */
+void pipelineGetStats(const pipeline *p, int stage, pipeStats *out);
+
+#endif
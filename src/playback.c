@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <string.h>
+#include "../include/sndfile.h"
+#include "atomics.h"
+#include "clock.h"
+#include "playback.h"
+
+#define PLAYER_CHUNK        (256)   /* samples read from a clip per ring write */
+#define PLAYER_WAIT_MS      (2)     /* producer back-off while the ring is full */
+
+static int playerCallback(
+                    const void *inputBuffer,
+                    void *outputBuffer,
+                    unsigned long framesPerBuffer,
+                    const PaStreamCallbackTimeInfo* timeInfo,
+                    PaStreamCallbackFlags statusFlags,
+                    void *userData)
+{
+    (void) inputBuffer;
+    (void) statusFlags;
+
+    playerFill((player *)userData, (short *)outputBuffer, framesPerBuffer, timeInfo);
+    return paContinue;
+}
+
+int playerInit(player *p, double sampleRate, size_t ringSamples)
+{
+    memset(p, 0, sizeof(*p));
+    p->sampleRate = sampleRate;
+    return sampleRingInit(&p->ring, ringSamples);
+}
+
+PaError playerOpen(player *p, PaDeviceIndex device)
+{
+    if(device == paNoDevice)
+    {
+        return paInvalidDevice;
+    }
+
+    PaStreamParameters outP =
+    {
+        .device                     =   device,
+        .channelCount               =   1,
+        .sampleFormat               =   paInt16,
+        .suggestedLatency           =   Pa_GetDeviceInfo(device)->defaultLowOutputLatency,
+        .hostApiSpecificStreamInfo  =   NULL,
+    };
+
+    PaStream *stream;
+    PaError e = Pa_OpenStream(&stream, NULL, &outP, p->sampleRate, paFramesPerBufferUnspecified,
+                              paClipOff, playerCallback, p);
+    if(e != paNoError)
+    {
+        return e;
+    }
+    if((e = Pa_StartStream(stream)) != paNoError)
+    {
+        Pa_CloseStream(stream);
+        return e;
+    }
+    p->stream = stream;
+    p->ownsStream = 1;
+    return paNoError;
+}
+
+void playerAttach(player *p, PaStream *stream)
+{
+    p->stream = stream;
+    p->ownsStream = 0;
+}
+
+void playerClose(player *p)
+{
+    if(p->ownsStream && p->stream != NULL)
+    {
+        Pa_StopStream(p->stream);
+        Pa_CloseStream(p->stream);
+    }
+    p->stream = NULL;
+    sampleRingFree(&p->ring);
+}
+
+void playerFill(player *p, short *out, unsigned long frames, const PaStreamCallbackTimeInfo *timeInfo)
+{
+    /* The producer may still be queueing an interrupted reply. */
+    if(atomicLoadRelaxed(&p->interrupted) == atomicLoad(&p->replies))
+    {
+        sampleRingClear(&p->ring);
+    }
+
+    unsigned long n = (unsigned long)sampleRingRead(&p->ring, out, frames);
+    if(n < frames)
+    {
+        memset(out + n, 0, (frames - n) * sizeof(short));
+    }
+
+    /* replies is released after readyTime, so reading it first makes readyTime safe to use. */
+    unsigned long reply = atomicLoad(&p->replies);
+    if(n > 0 && p->heardReply != reply)
+    {
+        p->firstAudible = timeInfo != NULL ? timeInfo->outputBufferDacTime : 0.0;
+        atomicStore(&p->heardReply, reply);
+    }
+    else if(n < frames && p->heardReply == reply && reply != 0 && !atomicLoad(&p->ending))
+    {
+        atomicAddRelaxed(&p->underruns, 1);
+    }
+    atomicAddRelaxed(&p->played, n);
+}
+
+void playerInterrupt(player *p)
+{
+    atomicStore(&p->interrupted, atomicLoad(&p->replies));
+    sampleRingClear(&p->ring);
+}
+
+int playerWasInterrupted(const player *p)
+{
+    return p->replies != 0 && atomicLoad(&p->interrupted) == p->replies;
+}
+
+void playerBegin(player *p)
+{
+    atomicStore(&p->ending, 0);
+    p->readyTime = p->stream != NULL ? Pa_GetStreamTime(p->stream) : 0.0;
+    atomicAdd(&p->replies, 1);
+}
+
+long playerWrite(player *p, const short *samples, long count)
+{
+    long written = 0;
+    while(written < count && !playerWasInterrupted(p))
+    {
+        written += (long)sampleRingWrite(&p->ring, samples + written, (size_t)(count - written));
+        if(written < count)
+        {
+            if(p->stream == NULL || Pa_IsStreamActive(p->stream) != 1)
+            {
+                break;
+            }
+            Pa_Sleep(PLAYER_WAIT_MS);
+        }
+    }
+    return written;
+}
+
+void playerEnd(player *p)
+{
+    atomicStore(&p->ending, 1);
+}
+
+long playerPlayFile(player *p, const char *path)
+{
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+    SNDFILE *file = sf_open(path, SFM_READ, &info);
+    if(file == NULL)
+    {
+        return -1;
+    }
+    if(info.channels != 1 || info.samplerate != (int)p->sampleRate)
+    {
+        printf("%s: expected mono audio at %.0f Hz.\n", path, p->sampleRate);
+        sf_close(file);
+        return -1;
+    }
+
+    short chunk[PLAYER_CHUNK];
+    long queued = 0;
+    sf_count_t n;
+    while((n = sf_readf_short(file, chunk, PLAYER_CHUNK)) > 0)
+    {
+        long w = playerWrite(p, chunk, (long)n);
+        queued += w;
+        if(w < n)
+        {
+            break;
+        }
+    }
+    sf_close(file);
+    return queued;
+}
+
+int playerDrain(player *p, double timeout)
+{
+    double deadline = clockNow() + timeout;
+    while(sampleRingAvailable(&p->ring) > 0)
+    {
+        if(clockNow() >= deadline || p->stream == NULL || Pa_IsStreamActive(p->stream) != 1)
+        {
+            return -1;
+        }
+        Pa_Sleep(PLAYER_WAIT_MS);
+    }
+
+    /* The last block is still in the host buffers for about the output latency. */
+    const PaStreamInfo *info = p->stream != NULL ? Pa_GetStreamInfo(p->stream) : NULL;
+    if(info != NULL && info->outputLatency > 0.0)
+    {
+        Pa_Sleep((long)(info->outputLatency * 1000.0) + 1);
+    }
+    return 0;
+}
+
+double playerLatency(const player *p)
+{
+    if(p->replies == 0 || atomicLoad(&p->heardReply) != p->replies)
+    {
+        return -1.0;
+    }
+    return p->firstAudible - p->readyTime;
+}
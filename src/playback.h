@@ -0,0 +1,76 @@
+#ifndef JARVIS_PLAYBACK_H
+#define JARVIS_PLAYBACK_H
+
+#include "../include/portaudio.h"
+#include "ring.h"
+
+/*
+ *  Output stage for spoken replies.
+ *
+ *  Reply audio is pushed into a lock-free ring as it is produced and the
+ *  PortAudio callback pulls from it, so playback starts with the first
+ *  block instead of after the whole reply. The player either owns an
+ *  output-only stream (playerOpen) or is fed from the capture callback
+ *  of a full-duplex stream (playerFill), in which case capture and
+ *  playback run on one stream clock.
+ *
+ *  Latency is measured on that clock: from playerBegin, when the reply
+ *  is ready, to the DAC time of its first sample.
+ */
+
+typedef struct
+{
+    sampleRing      ring;
+    PaStream       *stream;         /* clock source; owned only if opened by playerOpen */
+    int             ownsStream;
+    double          sampleRate;
+
+    /* Written by the producer. */
+    double          readyTime;
+    unsigned long   replies;        /* playerBegin count */
+    int             ending;         /* the current reply has been fully queued */
+
+    /* Written by the callback. */
+    double          firstAudible;
+    unsigned long   heardReply;     /* reply whose first sample has reached the DAC */
+    unsigned long   interrupted;    /* reply cut short by barge-in */
+    unsigned long   played;
+    unsigned long   underruns;
+}
+player;
+
+/* Prepares the ring; the stream is set by playerOpen or playerAttach. */
+int  playerInit(player *p, double sampleRate, size_t ringSamples);
+
+/* Opens and starts an output-only stream on device that plays from the ring. */
+PaError playerOpen(player *p, PaDeviceIndex device);
+
+/* Uses an already running (full-duplex) stream as the clock source. */
+void playerAttach(player *p, PaStream *stream);
+
+/* Stops an owned stream and frees the ring. */
+void playerClose(player *p);
+
+/* Callback side: fills frames mono int16 samples, padding with silence. */
+void playerFill(player *p, short *out, unsigned long frames, const PaStreamCallbackTimeInfo *timeInfo);
+
+/* Callback side: drops the rest of the current reply (barge-in). */
+void playerInterrupt(player *p);
+
+/* Producer side; playerWrite stops early once the reply is interrupted. */
+void playerBegin(player *p);
+long playerWrite(player *p, const short *samples, long count);
+void playerEnd(player *p);
+
+/* Streams a mono clip at the player's sample rate; returns samples queued or -1. */
+long playerPlayFile(player *p, const char *path);
+
+/* Waits until everything queued has been played; returns 0, or -1 on timeout. */
+int  playerDrain(player *p, double timeout);
+
+int  playerWasInterrupted(const player *p);
+
+/* Seconds from playerBegin to the first audible sample of the last reply, or -1. */
+double playerLatency(const player *p);
+
+#endif
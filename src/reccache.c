@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <string.h>
+#include "fingerprint.h"
+#include "mempool.h"
+#include "recognizer.h"
+
+/*
+ *  Wraps another backend with the fingerprint cache: a hit answers from
+ *  memory without touching the inner backend, a miss falls through and
+ *  confident results are remembered.
+ */
+typedef struct
+{
+    recognizer      base;
+    recognizer     *inner;
+    fpCache        *cache;
+    float           minConfidence;      /* results below this are not cached */
+}
+recCached;
+
+static int cachedRecognize(recognizer *self, const recUtterance *utt,
+                           volatile int *cancel, recResult *out)
+{
+    recCached *r = (recCached *)self;
+    audioFingerprint print;
+    int havePrint = utt->features != NULL &&
+                    fpCompute(utt->features, utt->firstFrame, utt->frameCount, &print) == 0;
+
+    int slot = -1;
+    int verify = 0;
+    if(havePrint)
+    {
+        slot = fpCacheLookup(r->cache, &print, out->text, sizeof(out->text), &out->confidence, &verify);
+        if(slot >= 0 && !verify)
+        {
+            out->backend = "cache";
+            return REC_OK;
+        }
+    }
+
+    char cached[REC_TEXT_MAX];
+    if(slot >= 0)
+    {
+        memcpy(cached, out->text, sizeof(cached));
+    }
+
+    int status = r->inner->recognize(r->inner, utt, cancel, out);
+
+    if(slot >= 0 && status == REC_OK)
+    {
+        fpCacheVerified(r->cache, slot, &print, strcmp(cached, out->text) == 0);
+    }
+    if(havePrint && status == REC_OK && out->confidence >= r->minConfidence)
+    {
+        fpCacheInsert(r->cache, &print, out->text, out->confidence);
+    }
+    return status;
+}
+
+static void cachedDestroy(recognizer *self)
+{
+    recCached *r = (recCached *)self;
+    recDestroy(r->inner);
+    memFree(r);
+}
+
+recognizer *recCachedCreate(recognizer *inner, fpCache *cache, float minConfidence)
+{
+    recCached *r = (recCached *)memCalloc(1, sizeof(recCached));
+    if(r == NULL)
+    {
+        return NULL;
+    }
+    r->base.name = inner->name;
+    r->base.recognize = cachedRecognize;
+    r->base.destroy = cachedDestroy;
+    r->inner = inner;
+    r->cache = cache;
+    r->minConfidence = minConfidence;
+    return &r->base;
+}
@@ -0,0 +1,369 @@
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/sndfile.h"
+#include "clock.h"
+#include "mempool.h"
+#include "recognizer.h"
+#include "simd.h"
+
+#define LOCAL_MAX_TEMPLATES     (64)
+#define LOCAL_DIMS              (FEAT_NUM_CEPS - 1)     /* c1..c12, c0 is loudness */
+#define LOCAL_MAX_DISTANCE      (6.0f)                  /* mean per-step distance for a match */
+
+typedef struct
+{
+    char        phrase[REC_TEXT_MAX];
+    float      *frames;                 /* frameCount x LOCAL_DIMS, mean normalised */
+    int         frameCount;
+}
+localTemplate;
+
+typedef struct
+{
+    recognizer      base;
+    localTemplate   templates[LOCAL_MAX_TEMPLATES];
+    int             templateCount;
+}
+recLocal;
+
+/* Copies the speech part of a feature range out as mean-normalised cepstra. */
+static int extractSequence(const featRing *ring, unsigned long first, unsigned long count, float **out)
+{
+    unsigned long start;
+    unsigned long n = featSpeechRange(ring, first, count, &start);
+    if(n == 0)
+    {
+        return 0;
+    }
+
+    float *seq = (float *)memAlloc(n * LOCAL_DIMS * sizeof(float));
+    float mean[LOCAL_DIMS] = { 0 };
+    if(seq == NULL)
+    {
+        return 0;
+    }
+
+    unsigned long got = 0;
+    for(unsigned long i = start; i < start + n; i++)
+    {
+        const featFrame *f = featRingGet(ring, i);
+        if(f == NULL)
+        {
+            continue;
+        }
+        memcpy(&seq[got * LOCAL_DIMS], &f->mfcc[1], LOCAL_DIMS * sizeof(float));
+        simdMulAdd(mean, &f->mfcc[1], 1.0f, LOCAL_DIMS);
+        got++;
+    }
+    for(int d = 0; d < LOCAL_DIMS; d++)
+    {
+        mean[d] /= (float)(got ? got : 1);
+    }
+    for(unsigned long i = 0; i < got; i++)
+    {
+        simdMulAdd(&seq[i * LOCAL_DIMS], mean, -1.0f, LOCAL_DIMS);
+    }
+
+    *out = seq;
+    return (int)got;
+}
+
+static int sequenceFromSamples(const short *samples, long count, float **out)
+{
+    featExtractor *fx = (featExtractor *)memAlloc(sizeof(featExtractor));
+    if(fx == NULL || featInit(fx) != 0)
+    {
+        memFree(fx);
+        return 0;
+    }
+    featPush(fx, samples, count);
+    unsigned long written = featRingWritten(&fx->ring);
+    unsigned long first = written > FEAT_RING_FRAMES - 1 ? written - (FEAT_RING_FRAMES - 1) : 0;
+    int n = extractSequence(&fx->ring, first, written - first, out);
+    memFree(fx);
+    return n;
+}
+
+static float frameDistance(const float *a, const float *b)
+{
+    float diff[LOCAL_DIMS];
+    for(int d = 0; d < LOCAL_DIMS; d++)
+    {
+        diff[d] = a[d] - b[d];
+    }
+    return sqrtf(simdEnergy(diff, LOCAL_DIMS));
+}
+
+/* Symmetric DTW with two rolling rows, normalised by n + m. */
+static float dtw(const float *a, int n, const float *b, int m)
+{
+    float *prev = (float *)memAlloc((size_t)(m + 1) * 2 * sizeof(float));
+    float *cur;
+    if(prev == NULL)
+    {
+        return FLT_MAX;
+    }
+    cur = prev + m + 1;
+
+    prev[0] = 0.0f;
+    for(int j = 1; j <= m; j++)
+    {
+        prev[j] = FLT_MAX;
+    }
+
+    for(int i = 1; i <= n; i++)
+    {
+        cur[0] = FLT_MAX;
+        for(int j = 1; j <= m; j++)
+        {
+            float best = prev[j - 1];
+            if(prev[j] < best)
+            {
+                best = prev[j];
+            }
+            if(cur[j - 1] < best)
+            {
+                best = cur[j - 1];
+            }
+            cur[j] = best == FLT_MAX ? FLT_MAX
+                   : best + frameDistance(&a[(i - 1) * LOCAL_DIMS], &b[(j - 1) * LOCAL_DIMS]);
+        }
+        float *t = prev;
+        prev = cur;
+        cur = t;
+    }
+
+    float d = prev[m] / (float)(n + m);
+    memFree(prev < cur ? prev : cur);
+    return d;
+}
+
+static int localRecognize(recognizer *self, const recUtterance *utt,
+                          volatile int *cancel, recResult *out)
+{
+    recLocal *r = (recLocal *)self;
+    float *seq = NULL;
+    int n;
+
+    if(utt->features != NULL)
+    {
+        n = extractSequence(utt->features, utt->firstFrame, utt->frameCount, &seq);
+    }
+    else
+    {
+        n = sequenceFromSamples(utt->samples, utt->sampleCount, &seq);
+    }
+    if(n == 0)
+    {
+        return REC_NO_MATCH;
+    }
+
+    int best = -1;
+    float bestDistance = FLT_MAX;
+    float distances[LOCAL_MAX_TEMPLATES];
+
+    for(int t = 0; t < r->templateCount; t++)
+    {
+        if(*cancel)
+        {
+            memFree(seq);
+            return REC_CANCELLED;
+        }
+        if(utt->deadline > 0.0 && clockNow() > utt->deadline)
+        {
+            memFree(seq);
+            return REC_TIMEOUT;
+        }
+        const localTemplate *tp = &r->templates[t];
+        distances[t] = dtw(seq, n, tp->frames, tp->frameCount);
+        if(distances[t] < bestDistance)
+        {
+            bestDistance = distances[t];
+            best = t;
+        }
+    }
+    memFree(seq);
+
+    if(best < 0 || bestDistance > LOCAL_MAX_DISTANCE)
+    {
+        return REC_NO_MATCH;
+    }
+
+    /* Confidence is the margin to the closest competing phrase. */
+    float rival = LOCAL_MAX_DISTANCE;
+    for(int t = 0; t < r->templateCount; t++)
+    {
+        if(strcmp(r->templates[t].phrase, r->templates[best].phrase) != 0 && distances[t] < rival)
+        {
+            rival = distances[t];
+        }
+    }
+
+    snprintf(out->text, sizeof(out->text), "%s", r->templates[best].phrase);
+    out->confidence = rival > 0.0f ? 1.0f - bestDistance / rival : 0.0f;
+    if(out->confidence < 0.0f)
+    {
+        out->confidence = 0.0f;
+    }
+    return REC_OK;
+}
+
+static void localDestroy(recognizer *self)
+{
+    recLocal *r = (recLocal *)self;
+    for(int t = 0; t < r->templateCount; t++)
+    {
+        memFree(r->templates[t].frames);
+    }
+    memFree(r);
+}
+
+static char *trim(char *s)
+{
+    while(*s == ' ' || *s == '\t')
+    {
+        s++;
+    }
+    char *e = s + strlen(s);
+    while(e > s && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r' || e[-1] == '\n'))
+    {
+        *--e = '\0';
+    }
+    return s;
+}
+
+static int loadTemplate(localTemplate *t, const char *phrase, const char *path)
+{
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+
+    SNDFILE *sf = sf_open(path, SFM_READ, &info);
+    if(sf == NULL)
+    {
+        fprintf(stderr, "Grammar: cannot open %s\n", path);
+        return -1;
+    }
+    if(info.samplerate != FEAT_SAMPLE_RATE || info.channels < 1)
+    {
+        fprintf(stderr, "Grammar: %s must be %d Hz\n", path, FEAT_SAMPLE_RATE);
+        sf_close(sf);
+        return -1;
+    }
+
+    short *interleaved = (short *)memAlloc((size_t)info.frames * info.channels * sizeof(short));
+    if(interleaved == NULL)
+    {
+        sf_close(sf);
+        return -1;
+    }
+    sf_count_t frames = sf_readf_short(sf, interleaved, info.frames);
+    sf_close(sf);
+
+    /* Only the first channel is used. */
+    for(sf_count_t i = 0; i < frames; i++)
+    {
+        interleaved[i] = interleaved[i * info.channels];
+    }
+
+    t->frameCount = sequenceFromSamples(interleaved, (long)frames, &t->frames);
+    memFree(interleaved);
+
+    if(t->frameCount == 0)
+    {
+        fprintf(stderr, "Grammar: no speech found in %s\n", path);
+        return -1;
+    }
+    snprintf(t->phrase, sizeof(t->phrase), "%s", phrase);
+    return 0;
+}
+
+typedef struct
+{
+    localTemplate  *slot;
+    char            phrase[REC_TEXT_MAX];
+    char            path[512];
+    int             status;
+}
+loadJob;
+
+static void loadTask(void *arg)
+{
+    loadJob *job = (loadJob *)arg;
+    job->status = loadTemplate(job->slot, job->phrase, job->path);
+}
+
+recognizer *recLocalCreate(const char *grammarPath, scheduler *pool)
+{
+    FILE *f = fopen(grammarPath, "r");
+    if(f == NULL)
+    {
+        return NULL;
+    }
+
+    recLocal *r = (recLocal *)memCalloc(1, sizeof(recLocal));
+    loadJob *jobs = (loadJob *)memCalloc(LOCAL_MAX_TEMPLATES, sizeof(loadJob));
+    if(r == NULL || jobs == NULL)
+    {
+        memFree(jobs);
+        memFree(r);
+        fclose(f);
+        return NULL;
+    }
+    r->base.name = "local";
+    r->base.recognize = localRecognize;
+    r->base.destroy = localDestroy;
+
+    int count = 0;
+    char line[512];
+    while(fgets(line, sizeof(line), f) != NULL && count < LOCAL_MAX_TEMPLATES)
+    {
+        char *eq = strchr(line, '=');
+        if(line[0] == '#' || eq == NULL)
+        {
+            continue;
+        }
+        *eq = '\0';
+        loadJob *job = &jobs[count];
+        job->slot = &r->templates[count];
+        snprintf(job->phrase, sizeof(job->phrase), "%s", trim(line));
+        snprintf(job->path, sizeof(job->path), "%s", trim(eq + 1));
+        count++;
+    }
+    fclose(f);
+
+    /* Decoding and feature extraction dominate start-up; every recording is independent. */
+    schedGroup loading;
+    schedGroupInit(&loading);
+    for(int i = 0; i < count; i++)
+    {
+        if(pool == NULL || schedSubmit(pool, &loading, loadTask, &jobs[i]) != 0)
+        {
+            loadTask(&jobs[i]);
+        }
+    }
+    if(pool != NULL)
+    {
+        schedWait(pool, &loading);
+    }
+    schedGroupDestroy(&loading);
+
+    /* Keep the grammar order, without the recordings that failed. */
+    for(int i = 0; i < count; i++)
+    {
+        if(jobs[i].status == 0)
+        {
+            r->templates[r->templateCount++] = *jobs[i].slot;
+        }
+    }
+    memFree(jobs);
+
+    if(r->templateCount == 0)
+    {
+        localDestroy(&r->base);
+        return NULL;
+    }
+    return &r->base;
+}
@@ -0,0 +1,142 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "clock.h"
+#include "recognizer.h"
+
+#define RACE_MAX_BACKENDS   (8)
+
+int recRun(recognizer *r, const recUtterance *utt, volatile int *cancel, recResult *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->backend = r->name;
+
+    double start = clockNow();
+    out->status = r->recognize(r, utt, cancel, out);
+    out->latency = clockNow() - start;
+    return out->status;
+}
+
+void recDestroy(recognizer *r)
+{
+    if(r != NULL)
+    {
+        r->destroy(r);
+    }
+}
+
+/*------ RACE ------*/
+
+typedef struct raceState raceState;
+
+typedef struct
+{
+    raceState          *race;
+    recognizer         *backend;
+    recResult           result;
+    pthread_t           thread;
+}
+raceEntry;
+
+struct raceState
+{
+    pthread_mutex_t     lock;
+    pthread_cond_t      done;
+    const recUtterance *utt;
+    float               minConfidence;
+    volatile int        cancel;
+    int                 finished;
+    int                 winner;
+    raceEntry           entries[RACE_MAX_BACKENDS];
+};
+
+static void *raceWorker(void *arg)
+{
+    raceEntry *e = (raceEntry *)arg;
+    raceState *s = e->race;
+
+    recRun(e->backend, s->utt, &s->cancel, &e->result);
+
+    pthread_mutex_lock(&s->lock);
+    if(s->winner < 0 && e->result.status == REC_OK && e->result.confidence >= s->minConfidence)
+    {
+        s->winner = (int)(e - s->entries);
+        s->cancel = 1;
+    }
+    s->finished++;
+    pthread_cond_signal(&s->done);
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+int recRace(recognizer **backends, int count, const recUtterance *utt,
+            float minConfidence, recResult *out)
+{
+    raceState s;
+    int started = 0;
+
+    if(count > RACE_MAX_BACKENDS)
+    {
+        count = RACE_MAX_BACKENDS;
+    }
+
+    memset(&s, 0, sizeof(s));
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.done, NULL);
+    s.utt = utt;
+    s.minConfidence = minConfidence;
+    s.winner = -1;
+
+    for(int i = 0; i < count; i++)
+    {
+        s.entries[i].race = &s;
+        s.entries[i].backend = backends[i];
+        s.entries[i].result.status = REC_ERROR;
+        if(pthread_create(&s.entries[i].thread, NULL, raceWorker, &s.entries[i]) != 0)
+        {
+            break;
+        }
+        started++;
+    }
+
+    pthread_mutex_lock(&s.lock);
+    while(s.winner < 0 && s.finished < started)
+    {
+        pthread_cond_wait(&s.done, &s.lock);
+    }
+    s.cancel = 1;
+    pthread_mutex_unlock(&s.lock);
+
+    /* Losers observe the cancel flag within one poll slice. */
+    for(int i = 0; i < started; i++)
+    {
+        pthread_join(s.entries[i].thread, NULL);
+    }
+
+    int best = s.winner;
+    if(best < 0)
+    {
+        for(int i = 0; i < started; i++)
+        {
+            const recResult *r = &s.entries[i].result;
+            if(r->status == REC_OK && (best < 0 || r->confidence > s.entries[best].result.confidence))
+            {
+                best = i;
+            }
+        }
+    }
+
+    if(best >= 0)
+    {
+        *out = s.entries[best].result;
+    }
+    else
+    {
+        memset(out, 0, sizeof(*out));
+        out->status = started > 0 ? s.entries[0].result.status : REC_ERROR;
+    }
+
+    pthread_cond_destroy(&s.done);
+    pthread_mutex_destroy(&s.lock);
+    return out->status;
+}
@@ -0,0 +1,220 @@
+#ifndef JARVIS_RECOGNIZER_H
+#define JARVIS_RECOGNIZER_H
+
+#include "config.h"
+#include "evloop.h"
+#include "fingerprint.h"
+#include "flac.h"
+#include "http.h"
+#include "mfcc.h"
+#include "scheduler.h"
+
+/*
+ *  Pluggable speech recognizers. Every backend sees the same captured
+ *  utterance (PCM plus the feature frames already computed during
+ *  capture) and fills a recResult. recognize() must poll *cancel and
+ *  return REC_CANCELLED promptly once it is set.
+ */
+
+#define REC_TEXT_MAX        (256)
+
+#define REC_OK              (0)
+#define REC_NO_MATCH        (1)
+#define REC_ERROR           (-1)
+#define REC_CANCELLED       (-2)
+#define REC_TIMEOUT         (-3)
+
+typedef struct
+{
+    const short        *samples;
+    long                sampleCount;
+    int                 sampleRate;
+    const featRing     *features;       /* may be NULL */
+    unsigned long       firstFrame;
+    unsigned long       frameCount;
+    double              deadline;       /* clockNow() budget for the whole utterance, 0 = none */
+}
+recUtterance;
+
+typedef struct
+{
+    int         status;
+    char        text[REC_TEXT_MAX];
+    float       confidence;
+    double      latency;                /* seconds spent in recognize() */
+    const char *backend;
+}
+recResult;
+
+typedef struct recognizer recognizer;
+
+struct recognizer
+{
+    const char *name;
+    int       (*recognize)(recognizer *self, const recUtterance *utt,
+                           volatile int *cancel, recResult *out);
+    void      (*destroy)(recognizer *self);
+};
+
+/* Remote HTTP speech-to-text backend (FLAC upload, JSON hypotheses). */
+recognizer *recRemoteCreate(const char *host, int port, const char *path, double timeout);
+
+/*
+ *  Extra endpoints for the remote backend. Retries rotate through them,
+ *  and once an attempt has been outstanding longer than the observed
+ *  p95 latency a hedged duplicate is sent to the next one; the first
+ *  answer wins and the other attempts are cancelled. With a single
+ *  endpoint nothing is hedged; adding one that is already there
+ *  (same host and port) does nothing.
+ */
+int recRemoteAddEndpoint(recognizer *r, const char *host, int port, const char *path);
+
+/*
+ *  The default speech-to-text service; the keys recognizer_host,
+ *  recognizer_port and recognizer_path point it elsewhere. Hedging needs
+ *  a second endpoint: recognizer_hedge_host and recognizer_hedge_port
+ *  (default: recognizer_port), serving the same path.
+ */
+recognizer *recRemoteConfigure(const config *settings);
+
+typedef struct
+{
+    int         maxAttempts;        /* total attempts per utterance, hedges included */
+    double      backoff;            /* first retry delay in seconds, doubled each time */
+    double      hedgeQuantile;      /* latency quantile that triggers a hedge */
+    double      hedgeDelay;         /* hedge delay used until enough latencies are known */
+}
+recRemotePolicy;
+
+typedef struct
+{
+    unsigned long   requests;
+    unsigned long   attempts;
+    unsigned long   retries;
+    unsigned long   hedges;
+    unsigned long   hedgeWins;
+    unsigned long   timeouts;
+}
+recRemoteStats;
+
+void recRemoteSetPolicy(recognizer *r, const recRemotePolicy *policy);
+void recRemoteGetStats(recognizer *r, recRemoteStats *out);
+
+/*
+ *  The remote backend's upload and parse steps on their own, for callers
+ *  that encode, upload and parse on different threads. recRemoteSend
+ *  posts an encoded payload with the same retries and hedging as
+ *  recognize() and, on REC_OK, hands over the winning response (free it
+ *  with httpResponseFree). deadline is a clockNow() time, 0 for none.
+ */
+int recRemoteSend(recognizer *r, flacPayload *payload, int sampleRate, double deadline,
+                  volatile int *cancel, httpResponse *out);
+int recRemoteParse(const char *body, size_t length, recResult *out);
+
+/*
+ *  recRemoteSend without a blocked thread: callable from any thread, the
+ *  send runs on loop and done(ctx, status, response) is called there
+ *  once, owning the response on REC_OK. Returns REC_ERROR, without
+ *  calling done, if the send could not be queued.
+ */
+typedef void (*recRemoteDoneFunc)(void *ctx, int status, httpResponse *response);
+
+int recRemoteSubmit(recognizer *r, evLoop *loop, flacPayload *payload, int sampleRate, double deadline,
+                    recRemoteDoneFunc done, void *ctx);
+
+/*
+ *  Endpoints are resolved once, when they are added, and submitted
+ *  attempts connect to those addresses; an attempt to an endpoint that
+ *  did not resolve fails at once. recRemoteResolve retries the lookup
+ *  for those (REC_ERROR if one still fails). It blocks, so call it off
+ *  the loop thread.
+ */
+int recRemoteResolve(recognizer *r);
+
+/*
+ *  Streaming remote backend: audio goes out while the user is still
+ *  speaking and interim hypotheses come back, over one persistent
+ *  WebSocket that carries utterance after utterance:
+ *
+ *      -> {"event":"start","id":7,"rate":16000}
+ *      -> binary frames, 16-bit little-endian PCM of utterance 7
+ *      -> {"event":"end","id":7}
+ *      <- {"id":7,"final":false,"status":0,"hypotheses":[{"utterance":"what time","confidence":0.4}]}
+ *      <- ... then the same with "final":true
+ *
+ *  Begin, Audio and End are called from one producer thread and never
+ *  block: frames are queued and written by the loop thread, which
+ *  connects (again, after an error) when there is something to send.
+ *  The host is looked up at creation; only if that failed does Begin
+ *  look it up again, and until it succeeds utterances fail as if the
+ *  connection had.
+ *  func runs on the loop thread, for every partial and exactly once with
+ *  final set: REC_OK, REC_NO_MATCH, REC_ERROR when the connection failed
+ *  or REC_TIMEOUT at the deadline given to End.
+ */
+typedef struct recStream recStream;
+
+typedef void (*recStreamFunc)(void *ctx, const recResult *result, int final);
+
+typedef struct
+{
+    unsigned long   utterances;
+    unsigned long   partials;
+    unsigned long   finals;         /* REC_OK or REC_NO_MATCH from the server */
+    unsigned long   failures;       /* connection errors and timeouts */
+    unsigned long   connects;
+    unsigned long   bytesSent;
+}
+recStreamStats;
+
+recStream    *recStreamCreate(evLoop *loop, const char *host, int port, const char *path, int sampleRate);
+
+/*
+ *  NULL unless recognizer_stream is set; recognizer_host and
+ *  recognizer_port are shared with the upload backend and
+ *  recognizer_stream_path names the WebSocket endpoint.
+ */
+recStream    *recStreamConfigure(evLoop *loop, const config *settings, int sampleRate);
+
+/* Starts an utterance; returns its id, 0 if too many are open. */
+unsigned long recStreamBegin(recStream *s, recStreamFunc func, void *ctx);
+int           recStreamAudio(recStream *s, unsigned long id, const short *samples, long count);
+
+/* No more audio for id; the final must arrive by deadline (clockNow() time, 0 = none). */
+int           recStreamEnd(recStream *s, unsigned long id, double deadline);
+
+void          recStreamGetStats(recStream *s, recStreamStats *out);
+
+/* Closes the connection; utterances still open end with REC_CANCELLED. Not from the loop thread. */
+void          recStreamDestroy(recStream *s);
+
+/*
+ *  Local small-vocabulary backend: DTW over MFCC sequences against
+ *  reference recordings listed in a grammar file, one per line:
+ *      phrase text = path/to/recording.flac
+ *  The recordings are loaded as tasks on pool if one is given, else one
+ *  after the other.
+ */
+recognizer *recLocalCreate(const char *grammarPath, scheduler *pool);
+
+/*
+ *  Puts the fingerprint cache in front of another backend (takes
+ *  ownership of inner). Results at or above minConfidence are cached.
+ */
+recognizer *recCachedCreate(recognizer *inner, fpCache *cache, float minConfidence);
+
+/* Runs one backend synchronously and times it. */
+int recRun(recognizer *r, const recUtterance *utt, volatile int *cancel, recResult *out);
+
+/*
+ *  Race mode: every backend runs on its own thread over the same
+ *  utterance. The first result with status REC_OK and confidence of at
+ *  least minConfidence wins and the others are cancelled; if nobody is
+ *  confident, the most confident completed result is returned.
+ */
+int recRace(recognizer **backends, int count, const recUtterance *utt,
+            float minConfidence, recResult *out);
+
+void recDestroy(recognizer *r);
+
+#endif
@@ -0,0 +1,811 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atomics.h"
+#include "clock.h"
+#include "evloop.h"
+#include "flac.h"
+#include "http.h"
+#include "json.h"
+#include "mempool.h"
+#include "metrics.h"
+#include "net.h"
+#include "recognizer.h"
+
+#define REMOTE_MAX_TOKENS       (128)
+#define REMOTE_MAX_ENDPOINTS    (4)
+#define REMOTE_MAX_ATTEMPTS     (8)
+#define REMOTE_LATENCY_WINDOW   (128)
+#define REMOTE_MIN_SAMPLES      (20)        /* latencies needed before trusting the quantile */
+#define REMOTE_WAIT_SLICE       (0.01)      /* how often the caller's cancel flag is polled */
+
+#define ATTEMPT_RUNNING         (1)
+
+#define REMOTE_HOST             "www.google.com"
+#define REMOTE_PORT             (80)
+#define REMOTE_PATH             "/speech-api/v1/recognize?xjerr=1&client=chromium&lang=en-US"
+#define REMOTE_TIMEOUT          (5.0)
+
+typedef struct
+{
+    char        host[128];
+    char        path[256];
+    int         port;
+    netAddress  address;            /* for the event loop, which must not wait for the resolver */
+    int         resolved;           /* address is valid; set once, after it */
+}
+remoteEndpoint;
+
+typedef struct
+{
+    recognizer          base;
+    remoteEndpoint      endpoints[REMOTE_MAX_ENDPOINTS];
+    int                 endpointCount;
+    double              timeout;
+    recRemotePolicy     policy;
+    unsigned            jitterSeed;
+    pthread_mutex_t     resolveLock;        /* recRemoteResolve against itself */
+
+    pthread_mutex_t     statsLock;
+    float               latencies[REMOTE_LATENCY_WINDOW];
+    unsigned long       latencyCount;
+    recRemoteStats      stats;
+    metric             *metricRequests;     /* jarvis_recognizer_*, summed over recognizers */
+    metric             *metricRetries;
+    metric             *metricHedges;
+    metric             *metricHedgeWins;
+    metric             *metricTimeouts;
+    metric             *metricSeconds;
+}
+recRemote;
+
+/*
+ *  All attempts for one utterance share a group. Attempt threads are
+ *  detached and hold a reference, so a cancelled loser can finish
+ *  unwinding after recognize() has already returned the winner.
+ */
+typedef struct attemptGroup attemptGroup;
+
+typedef struct
+{
+    attemptGroup       *group;
+    remoteEndpoint      endpoint;
+    double              started;
+    double              finished;
+    int                 status;
+    int                 hedge;
+    httpResponse        response;
+}
+remoteAttempt;
+
+struct attemptGroup
+{
+    pthread_mutex_t     lock;
+    pthread_cond_t      changed;
+    int                 refs;
+    volatile int        cancel;
+    flacPayload        *payload;
+    char                contentType[64];
+    double              deadline;
+    int                 attemptCount;
+    remoteAttempt       attempts[REMOTE_MAX_ATTEMPTS];
+};
+
+/* Upper bounds of the request latency histogram, seconds. */
+static const double requestBuckets[] = { 0.05, 0.1, 0.2, 0.3, 0.5, 0.75, 1.0, 1.5, 2.0, 3.0, 5.0 };
+
+static const recRemotePolicy defaultPolicy =
+{
+    .maxAttempts        =   3,
+    .backoff            =   0.05,
+    .hedgeQuantile      =   0.95,
+    .hedgeDelay         =   1.0,
+};
+
+/*------ LATENCY TRACKING ------*/
+
+static void recordLatency(recRemote *r, double seconds)
+{
+    metricObserve(r->metricSeconds, seconds);
+    pthread_mutex_lock(&r->statsLock);
+    r->latencies[r->latencyCount++ % REMOTE_LATENCY_WINDOW] = (float)seconds;
+    pthread_mutex_unlock(&r->statsLock);
+}
+
+static double hedgeDelay(recRemote *r)
+{
+    float sorted[REMOTE_LATENCY_WINDOW];
+    int n;
+
+    pthread_mutex_lock(&r->statsLock);
+    n = r->latencyCount < REMOTE_LATENCY_WINDOW ? (int)r->latencyCount : REMOTE_LATENCY_WINDOW;
+    memcpy(sorted, r->latencies, (size_t)n * sizeof(float));
+    pthread_mutex_unlock(&r->statsLock);
+
+    if(n < REMOTE_MIN_SAMPLES)
+    {
+        return r->policy.hedgeDelay;
+    }
+
+    for(int i = 1; i < n; i++)
+    {
+        float v = sorted[i];
+        int j = i;
+        while(j > 0 && sorted[j - 1] > v)
+        {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    int q = (int)(r->policy.hedgeQuantile * (n - 1) + 0.5);
+    return sorted[q];
+}
+
+/*------ ATTEMPTS ------*/
+
+static void groupRelease(attemptGroup *g)
+{
+    if(atomicAdd(&g->refs, -1) != 0)
+    {
+        return;
+    }
+    for(int i = 0; i < g->attemptCount; i++)
+    {
+        httpResponseFree(&g->attempts[i].response);
+    }
+    flacPayloadRelease(g->payload);
+    pthread_cond_destroy(&g->changed);
+    pthread_mutex_destroy(&g->lock);
+    memFree(g);
+}
+
+static void *attemptWorker(void *arg)
+{
+    remoteAttempt *a = (remoteAttempt *)arg;
+    attemptGroup *g = a->group;
+    const flacBuffer *body = &g->payload->buffer;
+    httpResponse resp;
+
+    int e = httpPost(a->endpoint.host, a->endpoint.port, a->endpoint.path, g->contentType,
+                     body->data, body->length, g->deadline, &g->cancel, &resp);
+    if(e == NET_OK && resp.status != 200)
+    {
+        httpResponseFree(&resp);
+        e = NET_ERROR;
+    }
+
+    pthread_mutex_lock(&g->lock);
+    a->status = e;
+    a->response = resp;
+    a->finished = clockNow();
+    pthread_cond_broadcast(&g->changed);
+    pthread_mutex_unlock(&g->lock);
+
+    groupRelease(g);
+    return NULL;
+}
+
+/* Called with the group lock held. */
+static int startAttempt(attemptGroup *g, const remoteEndpoint *endpoint, int hedge)
+{
+    pthread_t thread;
+    remoteAttempt *a = &g->attempts[g->attemptCount];
+
+    memset(a, 0, sizeof(*a));
+    a->group = g;
+    a->endpoint = *endpoint;
+    a->status = ATTEMPT_RUNNING;
+    a->hedge = hedge;
+    a->started = clockNow();
+
+    atomicAdd(&g->refs, 1);
+    if(pthread_create(&thread, NULL, attemptWorker, a) != 0)
+    {
+        atomicAdd(&g->refs, -1);
+        return -1;
+    }
+    pthread_detach(thread);
+    g->attemptCount++;
+    return 0;
+}
+
+/*------ PARSE ------*/
+
+/*
+ *  The service answers with one JSON object per line, e.g.
+ *  {"status":0,"id":"","hypotheses":[{"utterance":"what time is it","confidence":0.91}]}
+ *  The first line carrying a hypothesis wins.
+ */
+static int parseHypothesis(const char *body, size_t length, recResult *out)
+{
+    jsonToken tokens[REMOTE_MAX_TOKENS];
+    const char *line = body;
+    const char *end = body + length;
+
+    while(line < end)
+    {
+        const char *nl = memchr(line, '\n', (size_t)(end - line));
+        size_t n = nl != NULL ? (size_t)(nl - line) : (size_t)(end - line);
+
+        int count = jsonParse(line, n, tokens, REMOTE_MAX_TOKENS);
+        if(count > 0)
+        {
+            int hyps = jsonObjectGet(line, tokens, count, 0, "hypotheses");
+            int first = jsonArrayGet(tokens, count, hyps, 0);
+            int utter = jsonObjectGet(line, tokens, count, first, "utterance");
+            if(utter >= 0 && jsonString(line, &tokens[utter], out->text, sizeof(out->text)) >= 0)
+            {
+                int conf = jsonObjectGet(line, tokens, count, first, "confidence");
+                out->confidence = conf >= 0 ? (float)jsonNumber(line, &tokens[conf]) : 0.0f;
+                return REC_OK;
+            }
+        }
+        line += n + 1;
+    }
+    return REC_NO_MATCH;
+}
+
+/*------ RECOGNIZE ------*/
+
+static double backoffDelay(recRemote *r, int retry)
+{
+    double d = r->policy.backoff;
+    for(int i = 0; i < retry; i++)
+    {
+        d *= 2.0;
+    }
+    pthread_mutex_lock(&r->statsLock);
+    r->jitterSeed = r->jitterSeed * 1664525u + 1013904223u;
+    double jitter = 0.75 + 0.5 * (double)(r->jitterSeed >> 8) / (double)(1u << 24);
+    pthread_mutex_unlock(&r->statsLock);
+    return d * jitter;
+}
+
+static void countStat(recRemote *r, unsigned long *counter, metric *m)
+{
+    metricInc(m);
+    pthread_mutex_lock(&r->statsLock);
+    (*counter)++;
+    pthread_mutex_unlock(&r->statsLock);
+}
+
+/*
+ *  Uploads payload until one attempt succeeds, the budget runs out or
+ *  *cancel is set. On REC_OK the winning response moves to *response.
+ *  *deadline receives the effective deadline, which also covers parsing.
+ */
+static int remoteSend(recRemote *r, flacPayload *payload, int sampleRate, double budget,
+                      volatile int *cancel, httpResponse *response, double *deadline)
+{
+    double now = clockNow();
+    *deadline = now + r->timeout;
+
+    if(budget > 0.0 && budget < *deadline)
+    {
+        *deadline = budget;
+    }
+    if(*deadline <= now)
+    {
+        return REC_TIMEOUT;
+    }
+
+    attemptGroup *g = (attemptGroup *)memCalloc(1, sizeof(attemptGroup));
+    if(g == NULL)
+    {
+        return REC_ERROR;
+    }
+    g->payload = flacPayloadRetain(payload);
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->changed, NULL);
+    g->refs = 1;
+    g->deadline = *deadline;
+    snprintf(g->contentType, sizeof(g->contentType), "audio/x-flac; rate=%d", sampleRate);
+
+    countStat(r, &r->stats.requests, r->metricRequests);
+
+    int status = REC_ERROR;
+    int winner = -1;
+    int retries = 0;
+    int handled = 0;
+    int cursor = 0;
+    double retryAt = 0.0;
+    double hedgeAt = now + hedgeDelay(r);
+
+    pthread_mutex_lock(&g->lock);
+    if(startAttempt(g, &r->endpoints[cursor++ % r->endpointCount], 0) != 0)
+    {
+        pthread_mutex_unlock(&g->lock);
+        groupRelease(g);
+        return REC_ERROR;
+    }
+
+    for(;;)
+    {
+        int running = 0;
+        int failed = 0;
+        int lastError = NET_ERROR;
+        for(int i = 0; i < g->attemptCount; i++)
+        {
+            int s = g->attempts[i].status;
+            if(s == NET_OK && winner < 0)
+            {
+                winner = i;
+            }
+            else if(s == ATTEMPT_RUNNING)
+            {
+                running++;
+            }
+            else if(s != NET_OK)
+            {
+                lastError = s;
+                failed++;
+            }
+        }
+
+        now = clockNow();
+        if(winner >= 0)
+        {
+            break;
+        }
+        if(*cancel)
+        {
+            status = REC_CANCELLED;
+            break;
+        }
+        if(now >= *deadline)
+        {
+            status = REC_TIMEOUT;
+            break;
+        }
+
+        /* Every failed attempt is replaced after a backoff, even if a hedge is still running. */
+        if(failed > handled && retryAt == 0.0)
+        {
+            handled = failed;
+            if(g->attemptCount < r->policy.maxAttempts && lastError != NET_TIMEOUT)
+            {
+                retryAt = now + backoffDelay(r, retries++);
+            }
+        }
+        if(running == 0 && retryAt == 0.0)
+        {
+            status = lastError == NET_TIMEOUT ? REC_TIMEOUT : REC_ERROR;
+            break;
+        }
+
+        if(retryAt != 0.0 && now >= retryAt)
+        {
+            countStat(r, &r->stats.retries, r->metricRetries);
+            startAttempt(g, &r->endpoints[cursor++ % r->endpointCount], 0);
+            retryAt = 0.0;
+            hedgeAt = now + hedgeDelay(r);
+            continue;
+        }
+        if(running == 1 && now >= hedgeAt && g->attemptCount < r->policy.maxAttempts && r->endpointCount > 1)
+        {
+            countStat(r, &r->stats.hedges, r->metricHedges);
+            startAttempt(g, &r->endpoints[cursor++ % r->endpointCount], 1);
+            hedgeAt = *deadline;
+            continue;
+        }
+
+        double wake = now + REMOTE_WAIT_SLICE;
+        if(retryAt != 0.0 && retryAt < wake)
+        {
+            wake = retryAt;
+        }
+        if(running == 1 && r->endpointCount > 1 && hedgeAt < wake)
+        {
+            wake = hedgeAt;
+        }
+        struct timespec ts = clockAbsolute(wake - now);
+        pthread_cond_timedwait(&g->changed, &g->lock, &ts);
+    }
+
+    if(winner >= 0)
+    {
+        remoteAttempt *a = &g->attempts[winner];
+        recordLatency(r, a->finished - a->started);
+        if(a->hedge)
+        {
+            countStat(r, &r->stats.hedgeWins, r->metricHedgeWins);
+        }
+        *response = a->response;
+        memset(&a->response, 0, sizeof(a->response));
+        status = REC_OK;
+    }
+
+    /* Losers see the cancel flag within one network poll slice. */
+    g->cancel = 1;
+    pthread_mutex_unlock(&g->lock);
+
+    if(status == REC_TIMEOUT)
+    {
+        countStat(r, &r->stats.timeouts, r->metricTimeouts);
+    }
+
+    pthread_mutex_lock(&r->statsLock);
+    r->stats.attempts += (unsigned long)g->attemptCount;
+    pthread_mutex_unlock(&r->statsLock);
+
+    groupRelease(g);
+    return status;
+}
+
+/*------ ASYNCHRONOUS SEND ------*/
+
+/*
+ *  remoteSend's state machine on an event loop: attempts are async HTTP
+ *  requests and the backoff, hedge and deadline waits are loop timers,
+ *  so a send costs no thread at all while it is in flight.
+ */
+typedef struct asyncSend asyncSend;
+
+typedef struct
+{
+    asyncSend          *send;
+    httpRequest        *request;        /* NULL once finished */
+    double              started;
+    int                 hedge;
+}
+asyncAttempt;
+
+struct asyncSend
+{
+    recRemote          *remote;
+    evLoop             *loop;
+    flacPayload        *payload;
+    char                contentType[64];
+    double              budget;
+    double              deadline;
+    asyncAttempt        attempts[REMOTE_MAX_ATTEMPTS];
+    int                 attemptCount;
+    int                 running;
+    int                 retries;
+    int                 cursor;
+    int                 lastError;
+    unsigned long       retryTimer;
+    unsigned long       hedgeTimer;
+    unsigned long       deadlineTimer;
+    recRemoteDoneFunc   done;
+    void               *ctx;
+};
+
+static void asyncComplete(asyncSend *a, int status, httpResponse *response)
+{
+    recRemote *r = a->remote;
+    for(int i = 0; i < a->attemptCount; i++)
+    {
+        if(a->attempts[i].request != NULL)
+        {
+            httpCancel(a->attempts[i].request);
+        }
+    }
+    evTimerCancel(a->loop, a->retryTimer);
+    evTimerCancel(a->loop, a->hedgeTimer);
+    evTimerCancel(a->loop, a->deadlineTimer);
+
+    pthread_mutex_lock(&r->statsLock);
+    r->stats.attempts += (unsigned long)a->attemptCount;
+    if(status == REC_TIMEOUT)
+    {
+        r->stats.timeouts++;
+        metricInc(r->metricTimeouts);
+    }
+    pthread_mutex_unlock(&r->statsLock);
+
+    httpResponse none = { 0, NULL, 0 };
+    a->done(a->ctx, status, status == REC_OK ? response : &none);
+    flacPayloadRelease(a->payload);
+    memFree(a);
+}
+
+static void asyncAttemptDone(evLoop *loop, int result, httpResponse *response, void *ctx);
+static void asyncHedge(evLoop *loop, void *ctx);
+
+/* Starts the next attempt; a request that cannot even start counts as failed. */
+static void asyncLaunch(asyncSend *a, int hedge)
+{
+    recRemote *r = a->remote;
+    const remoteEndpoint *e = &r->endpoints[a->cursor++ % r->endpointCount];
+    asyncAttempt *at = &a->attempts[a->attemptCount++];
+    const flacBuffer *body = &a->payload->buffer;
+
+    at->send = a;
+    at->hedge = hedge;
+    at->started = clockNow();
+    at->request = atomicLoad(&e->resolved)
+                  ? httpPostAsync(a->loop, e->host, &e->address, e->path, a->contentType, body->data, body->length,
+                                  a->deadline, asyncAttemptDone, at)
+                  : NULL;
+    if(at->request == NULL)
+    {
+        httpResponse none = { 0, NULL, 0 };
+        a->running++;
+        asyncAttemptDone(a->loop, NET_ERROR, &none, at);
+        return;
+    }
+    a->running++;
+    if(a->running == 1 && a->attemptCount < r->policy.maxAttempts && r->endpointCount > 1)
+    {
+        evTimerCancel(a->loop, a->hedgeTimer);
+        a->hedgeTimer = evTimerStart(a->loop, at->started + hedgeDelay(r), asyncHedge, a);
+    }
+}
+
+static void asyncRetry(evLoop *loop, void *ctx)
+{
+    asyncSend *a = (asyncSend *)ctx;
+    (void)loop;
+    a->retryTimer = 0;
+    countStat(a->remote, &a->remote->stats.retries, a->remote->metricRetries);
+    asyncLaunch(a, 0);
+}
+
+static void asyncHedge(evLoop *loop, void *ctx)
+{
+    asyncSend *a = (asyncSend *)ctx;
+    (void)loop;
+    a->hedgeTimer = 0;
+    if(a->running == 1 && a->attemptCount < a->remote->policy.maxAttempts)
+    {
+        countStat(a->remote, &a->remote->stats.hedges, a->remote->metricHedges);
+        asyncLaunch(a, 1);
+    }
+}
+
+static void asyncExpire(evLoop *loop, void *ctx)
+{
+    asyncSend *a = (asyncSend *)ctx;
+    (void)loop;
+    a->deadlineTimer = 0;
+    asyncComplete(a, REC_TIMEOUT, NULL);
+}
+
+static void asyncAttemptDone(evLoop *loop, int result, httpResponse *response, void *ctx)
+{
+    asyncAttempt *at = (asyncAttempt *)ctx;
+    asyncSend *a = at->send;
+    recRemote *r = a->remote;
+    (void)loop;
+
+    at->request = NULL;
+    a->running--;
+    if(result == NET_OK && response->status == 200)
+    {
+        recordLatency(r, clockNow() - at->started);
+        if(at->hedge)
+        {
+            countStat(r, &r->stats.hedgeWins, r->metricHedgeWins);
+        }
+        asyncComplete(a, REC_OK, response);
+        return;
+    }
+    httpResponseFree(response);
+    a->lastError = result == NET_OK ? NET_ERROR : result;
+
+    /* Same rules as remoteSend: replace the failure after a backoff unless the budget is gone. */
+    if(a->retryTimer == 0 && a->attemptCount < r->policy.maxAttempts && a->lastError != NET_TIMEOUT)
+    {
+        a->retryTimer = evTimerStart(a->loop, clockNow() + backoffDelay(r, a->retries++), asyncRetry, a);
+    }
+    if(a->running == 0 && a->retryTimer == 0)
+    {
+        asyncComplete(a, a->lastError == NET_TIMEOUT ? REC_TIMEOUT : REC_ERROR, NULL);
+    }
+}
+
+/* Loop thread: the first attempt of a submitted send. */
+static void asyncStart(evLoop *loop, void *ctx)
+{
+    asyncSend *a = (asyncSend *)ctx;
+    double now = clockNow();
+    a->deadline = now + a->remote->timeout;
+    if(a->budget > 0.0 && a->budget < a->deadline)
+    {
+        a->deadline = a->budget;
+    }
+    if(a->deadline <= now)
+    {
+        asyncComplete(a, REC_TIMEOUT, NULL);
+        return;
+    }
+    countStat(a->remote, &a->remote->stats.requests, a->remote->metricRequests);
+    a->deadlineTimer = evTimerStart(loop, a->deadline, asyncExpire, a);
+    asyncLaunch(a, 0);
+}
+
+int recRemoteSubmit(recognizer *self, evLoop *loop, flacPayload *payload, int sampleRate, double deadline,
+                    recRemoteDoneFunc done, void *ctx)
+{
+    asyncSend *a = (asyncSend *)memCalloc(1, sizeof(asyncSend));
+    if(a == NULL)
+    {
+        return REC_ERROR;
+    }
+    a->remote = (recRemote *)self;
+    a->loop = loop;
+    a->payload = flacPayloadRetain(payload);
+    a->budget = deadline;
+    a->done = done;
+    a->ctx = ctx;
+    snprintf(a->contentType, sizeof(a->contentType), "audio/x-flac; rate=%d", sampleRate);
+    if(evPost(loop, asyncStart, a) != 0)
+    {
+        flacPayloadRelease(a->payload);
+        memFree(a);
+        return REC_ERROR;
+    }
+    return REC_OK;
+}
+
+static int remoteRecognize(recognizer *self, const recUtterance *utt,
+                           volatile int *cancel, recResult *out)
+{
+    recRemote *r = (recRemote *)self;
+    flacPayload *payload = flacPayloadCreate(utt->samples, utt->sampleCount, utt->sampleRate);
+    if(payload == NULL)
+    {
+        return REC_ERROR;
+    }
+
+    httpResponse response;
+    double deadline;
+    int status = remoteSend(r, payload, utt->sampleRate, utt->deadline, cancel, &response, &deadline);
+    flacPayloadRelease(payload);
+    if(status != REC_OK)
+    {
+        return status;
+    }
+
+    /* The budget covers parsing too. */
+    status = clockNow() < deadline ? parseHypothesis(response.body, response.bodyLength, out) : REC_TIMEOUT;
+    if(status == REC_TIMEOUT)
+    {
+        countStat(r, &r->stats.timeouts, r->metricTimeouts);
+    }
+    httpResponseFree(&response);
+    return status;
+}
+
+static void remoteDestroy(recognizer *self)
+{
+    recRemote *r = (recRemote *)self;
+    pthread_mutex_destroy(&r->resolveLock);
+    pthread_mutex_destroy(&r->statsLock);
+    memFree(r);
+}
+
+static void setEndpoint(remoteEndpoint *e, const char *host, int port, const char *path)
+{
+    snprintf(e->host, sizeof(e->host), "%s", host);
+    snprintf(e->path, sizeof(e->path), "%s", path);
+    e->port = port;
+    e->resolved = netResolve(host, port, &e->address) == NET_OK;
+}
+
+recognizer *recRemoteCreate(const char *host, int port, const char *path, double timeout)
+{
+    recRemote *r = (recRemote *)memCalloc(1, sizeof(recRemote));
+    if(r == NULL)
+    {
+        return NULL;
+    }
+    r->base.name = "remote";
+    r->base.recognize = remoteRecognize;
+    r->base.destroy = remoteDestroy;
+    setEndpoint(&r->endpoints[0], host, port, path);
+    r->endpointCount = 1;
+    r->timeout = timeout;
+    r->policy = defaultPolicy;
+    r->jitterSeed = (unsigned)(clockNow() * 1e6);
+    pthread_mutex_init(&r->statsLock, NULL);
+    pthread_mutex_init(&r->resolveLock, NULL);
+    r->metricRequests = metricCounter("jarvis_recognizer_requests_total", "",
+                                      "Utterances sent to the remote recognizer.");
+    r->metricRetries = metricCounter("jarvis_recognizer_retries_total", "", "Attempts started after a failed one.");
+    r->metricHedges = metricCounter("jarvis_recognizer_hedges_total", "", "Hedged attempts to a second endpoint.");
+    r->metricHedgeWins = metricCounter("jarvis_recognizer_hedge_wins_total", "", "Requests a hedged attempt won.");
+    r->metricTimeouts = metricCounter("jarvis_recognizer_timeouts_total", "", "Requests that ran out of budget.");
+    r->metricSeconds = metricHistogram("jarvis_recognizer_request_seconds", "",
+                                       "Time from sending an attempt to its successful answer.",
+                                       requestBuckets, (int)(sizeof(requestBuckets) / sizeof(requestBuckets[0])));
+    return &r->base;
+}
+
+int recRemoteAddEndpoint(recognizer *self, const char *host, int port, const char *path)
+{
+    recRemote *r = (recRemote *)self;
+    for(int i = 0; i < r->endpointCount; i++)
+    {
+        /* A second copy would only hedge a request against itself. */
+        if(strcmp(r->endpoints[i].host, host) == 0 && r->endpoints[i].port == port)
+        {
+            return REC_OK;
+        }
+    }
+    if(r->endpointCount == REMOTE_MAX_ENDPOINTS)
+    {
+        return REC_ERROR;
+    }
+    setEndpoint(&r->endpoints[r->endpointCount++], host, port, path);
+    return REC_OK;
+}
+
+int recRemoteResolve(recognizer *self)
+{
+    recRemote *r = (recRemote *)self;
+    int status = REC_OK;
+    pthread_mutex_lock(&r->resolveLock);
+    for(int i = 0; i < r->endpointCount; i++)
+    {
+        remoteEndpoint *e = &r->endpoints[i];
+        if(atomicLoad(&e->resolved))
+        {
+            continue;
+        }
+        if(netResolve(e->host, e->port, &e->address) == NET_OK)
+        {
+            atomicStore(&e->resolved, 1);
+        }
+        else
+        {
+            status = REC_ERROR;
+        }
+    }
+    pthread_mutex_unlock(&r->resolveLock);
+    return status;
+}
+
+recognizer *recRemoteConfigure(const config *settings)
+{
+    const char *host = configString(settings, "recognizer_host", REMOTE_HOST);
+    const char *path = configString(settings, "recognizer_path", REMOTE_PATH);
+    int port = (int)configNumber(settings, "recognizer_port", REMOTE_PORT);
+
+    const char *hedgeHost = configString(settings, "recognizer_hedge_host", "");
+    int hedgePort = (int)configNumber(settings, "recognizer_hedge_port", port);
+
+    recognizer *remote = recRemoteCreate(host, port, path, REMOTE_TIMEOUT);
+    if(remote != NULL && hedgeHost[0] != '\0')
+    {
+        recRemoteAddEndpoint(remote, hedgeHost, hedgePort, path);
+    }
+    return remote;
+}
+
+void recRemoteSetPolicy(recognizer *self, const recRemotePolicy *policy)
+{
+    recRemote *r = (recRemote *)self;
+    r->policy = *policy;
+    if(r->policy.maxAttempts < 1)
+    {
+        r->policy.maxAttempts = 1;
+    }
+    if(r->policy.maxAttempts > REMOTE_MAX_ATTEMPTS)
+    {
+        r->policy.maxAttempts = REMOTE_MAX_ATTEMPTS;
+    }
+}
+
+void recRemoteGetStats(recognizer *self, recRemoteStats *out)
+{
+    recRemote *r = (recRemote *)self;
+    pthread_mutex_lock(&r->statsLock);
+    *out = r->stats;
+    pthread_mutex_unlock(&r->statsLock);
+}
+
+int recRemoteSend(recognizer *self, flacPayload *payload, int sampleRate, double deadline,
+                  volatile int *cancel, httpResponse *out)
+{
+    double effective;
+    return remoteSend((recRemote *)self, payload, sampleRate, deadline, cancel, out, &effective);
+}
+
+int recRemoteParse(const char *body, size_t length, recResult *out)
+{
+    return parseHypothesis(body, length, out);
+}
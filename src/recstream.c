@@ -0,0 +1,720 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "atomics.h"
+#include "clock.h"
+#include "json.h"
+#include "mempool.h"
+#include "net.h"
+#include "notify.h"
+#include "recognizer.h"
+#include "websocket.h"
+
+#define STREAM_MAX_OPEN     (16)        /* utterances begun and not yet final */
+#define STREAM_MAX_TOKENS   (128)
+#define STREAM_HEADER_MAX   (4096)      /* handshake response */
+#define STREAM_CHUNK        (8192)
+#define STREAM_MESSAGE_MAX  (65536)     /* longest frame accepted from the server */
+#define STREAM_HOST         "www.google.com"
+#define STREAM_PORT         (80)
+#define STREAM_PATH         "/stream"
+
+enum
+{
+    STREAM_IDLE,
+    STREAM_CONNECTING,
+    STREAM_HANDSHAKE,
+    STREAM_OPEN
+};
+
+typedef struct
+{
+    unsigned char  *data;
+    size_t          length;
+    size_t          capacity;
+}
+byteBuffer;
+
+typedef struct
+{
+    unsigned long   id;             /* 0: free slot */
+    recStreamFunc   func;
+    void           *ctx;
+    double          begun;
+    double          ended;          /* 0 until End */
+    double          deadline;       /* 0: none */
+    unsigned long   timer;
+}
+streamUtterance;
+
+struct recStream
+{
+    evLoop         *loop;
+    char            host[128];
+    char            path[256];
+    int             port;
+    int             sampleRate;
+    netAddress      address;
+    int             resolved;       /* address is valid; written by the producer until set */
+
+    /* Shared by the producer and the loop thread. */
+    pthread_mutex_t lock;
+    byteBuffer      queued;         /* frames the loop has not taken yet */
+    int             flushPosted;
+    streamUtterance open[STREAM_MAX_OPEN];
+    unsigned long   nextId;
+    unsigned        maskSeed;
+    recStreamStats  stats;
+
+    /* Loop thread only. */
+    int             state;
+    int             fd;
+    byteBuffer      wire;           /* to be written, from wireSent on */
+    size_t          wireSent;
+    byteBuffer      in;             /* received, not yet parsed */
+    char            key[WS_KEY_LENGTH + 1];
+
+    int             torn;
+    notifier        closed;
+};
+
+/*------ BUFFERS ------*/
+
+static int bufferAppend(byteBuffer *b, const void *p, size_t n)
+{
+    if(b->length + n > b->capacity)
+    {
+        size_t cap = b->capacity ? b->capacity : STREAM_CHUNK;
+        while(cap < b->length + n)
+        {
+            cap *= 2;
+        }
+        unsigned char *d = (unsigned char *)memRealloc(b->data, cap);
+        if(d == NULL)
+        {
+            return -1;
+        }
+        b->data = d;
+        b->capacity = cap;
+    }
+    memcpy(b->data + b->length, p, n);
+    b->length += n;
+    return 0;
+}
+
+static void bufferConsume(byteBuffer *b, size_t n)
+{
+    memmove(b->data, b->data + n, b->length - n);
+    b->length -= n;
+}
+
+/* Appends a masked client frame; mask keys only need to be unpredictable to intermediaries. */
+static int appendFrame(byteBuffer *b, unsigned *seed, int opcode, const void *payload, size_t length)
+{
+    unsigned char header[WS_HEADER_MAX];
+    unsigned char mask[4];
+    for(int i = 0; i < 4; i++)
+    {
+        *seed = *seed * 1664525u + 1013904223u;
+        mask[i] = (unsigned char)(*seed >> 24);
+    }
+    size_t h = wsHeader(header, opcode, length, mask);
+    size_t at = b->length + h;
+    if(bufferAppend(b, header, h) != 0 || bufferAppend(b, payload, length) != 0)
+    {
+        return -1;
+    }
+    wsMask(b->data + at, length, mask, 0);
+    return 0;
+}
+
+/*------ UTTERANCES ------*/
+
+/* Lock held. */
+static streamUtterance *findOpen(recStream *s, unsigned long id)
+{
+    for(int i = 0; i < STREAM_MAX_OPEN; i++)
+    {
+        if(s->open[i].id == id)
+        {
+            return &s->open[i];
+        }
+    }
+    return NULL;
+}
+
+static void deliver(const streamUtterance *u, int status, recResult *result, int final)
+{
+    result->status = status;
+    result->backend = "stream";
+    result->latency = clockNow() - (u->ended > 0.0 ? u->ended : u->begun);
+    u->func(u->ctx, result, final);
+}
+
+/* Loop thread: ends every open utterance with status and forgets everything queued for them. */
+static void failOpen(recStream *s, int status)
+{
+    streamUtterance failed[STREAM_MAX_OPEN];
+    int count = 0;
+    pthread_mutex_lock(&s->lock);
+    for(int i = 0; i < STREAM_MAX_OPEN; i++)
+    {
+        if(s->open[i].id != 0)
+        {
+            if(s->open[i].timer != 0)
+            {
+                evTimerCancel(s->loop, s->open[i].timer);
+            }
+            failed[count++] = s->open[i];
+            s->open[i].id = 0;
+        }
+    }
+    s->queued.length = 0;
+    if(status != REC_CANCELLED)
+    {
+        s->stats.failures += (unsigned long)count;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    for(int i = 0; i < count; i++)
+    {
+        recResult r;
+        memset(&r, 0, sizeof(r));
+        deliver(&failed[i], status, &r, 1);
+    }
+}
+
+static void expire(evLoop *loop, void *ctx)
+{
+    recStream *s = (recStream *)ctx;
+    streamUtterance late[STREAM_MAX_OPEN];
+    int count = 0;
+    double now = clockNow();
+    (void)loop;
+    pthread_mutex_lock(&s->lock);
+    for(int i = 0; i < STREAM_MAX_OPEN; i++)
+    {
+        streamUtterance *u = &s->open[i];
+        if(u->id != 0 && u->timer != 0 && u->deadline <= now)
+        {
+            late[count++] = *u;
+            u->id = 0;
+        }
+    }
+    s->stats.failures += (unsigned long)count;
+    pthread_mutex_unlock(&s->lock);
+
+    for(int i = 0; i < count; i++)
+    {
+        recResult r;
+        memset(&r, 0, sizeof(r));
+        deliver(&late[i], REC_TIMEOUT, &r, 1);
+    }
+}
+
+/* A server message: {"id":7,"final":false,"status":0,"hypotheses":[...]} */
+static void handleMessage(recStream *s, const char *text, size_t length)
+{
+    jsonToken tokens[STREAM_MAX_TOKENS];
+    int count = jsonParse(text, length, tokens, STREAM_MAX_TOKENS);
+    if(count <= 0)
+    {
+        return;
+    }
+    int idTok = jsonObjectGet(text, tokens, count, 0, "id");
+    int finalTok = jsonObjectGet(text, tokens, count, 0, "final");
+    int statusTok = jsonObjectGet(text, tokens, count, 0, "status");
+    unsigned long id = idTok >= 0 ? (unsigned long)jsonNumber(text, &tokens[idTok]) : 0;
+    if(id == 0)
+    {
+        return;
+    }
+    int final = finalTok >= 0 && text[tokens[finalTok].start] == 't';
+
+    recResult r;
+    memset(&r, 0, sizeof(r));
+    int status = statusTok >= 0 && jsonNumber(text, &tokens[statusTok]) != 0.0
+                 ? REC_ERROR : recRemoteParse(text, length, &r);
+    if(!final && status != REC_OK)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    streamUtterance *u = findOpen(s, id);
+    streamUtterance copy;
+    if(u != NULL)
+    {
+        copy = *u;
+        if(final)
+        {
+            if(u->timer != 0)
+            {
+                evTimerCancel(s->loop, u->timer);
+            }
+            u->id = 0;
+            if(status == REC_ERROR)
+            {
+                s->stats.failures++;
+            }
+            else
+            {
+                s->stats.finals++;
+            }
+        }
+        else
+        {
+            s->stats.partials++;
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    if(u != NULL)
+    {
+        deliver(&copy, status, &r, final);
+    }
+}
+
+/*------ CONNECTION ------*/
+
+static void ready(evLoop *loop, int fd, int events, void *ctx);
+
+static void disconnect(recStream *s, int status)
+{
+    if(s->fd >= 0)
+    {
+        evUnwatch(s->loop, s->fd);
+        netClose(s->fd);
+        s->fd = -1;
+    }
+    s->state = STREAM_IDLE;
+    s->wire.length = 0;
+    s->wireSent = 0;
+    s->in.length = 0;
+    failOpen(s, status);
+}
+
+static void arm(recStream *s)
+{
+    int pending = s->state == STREAM_CONNECTING || s->wireSent < s->wire.length;
+    if(evWatch(s->loop, s->fd, EV_READ | (pending ? EV_WRITE : 0), ready, s) != 0)
+    {
+        disconnect(s, REC_ERROR);
+    }
+}
+
+/* Moves queued frames behind whatever is still being written; open connections only. */
+static void takeQueued(recStream *s)
+{
+    pthread_mutex_lock(&s->lock);
+    if(s->queued.length > 0 && bufferAppend(&s->wire, s->queued.data, s->queued.length) == 0)
+    {
+        s->queued.length = 0;
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+static int writeSome(recStream *s)
+{
+    while(s->wireSent < s->wire.length)
+    {
+        long n = netSendSome(s->fd, s->wire.data + s->wireSent, s->wire.length - s->wireSent);
+        if(n == NET_PENDING)
+        {
+            return 0;
+        }
+        if(n < 0)
+        {
+            disconnect(s, REC_ERROR);
+            return -1;
+        }
+        s->wireSent += (size_t)n;
+        pthread_mutex_lock(&s->lock);
+        s->stats.bytesSent += (unsigned long)n;
+        pthread_mutex_unlock(&s->lock);
+    }
+    s->wire.length = 0;
+    s->wireSent = 0;
+    return 0;
+}
+
+/* Checks the 101 answer; returns the bytes it took, 0 if incomplete, -1 if refused. */
+static long handshakeDone(recStream *s)
+{
+    const char *text = (const char *)s->in.data;
+    const char *end = NULL;
+    for(size_t i = 0; i + 4 <= s->in.length; i++)
+    {
+        if(memcmp(text + i, "\r\n\r\n", 4) == 0)
+        {
+            end = text + i;
+            break;
+        }
+    }
+    if(end == NULL)
+    {
+        return s->in.length > STREAM_HEADER_MAX ? -1 : 0;
+    }
+    if(s->in.length < 12 || strncmp(text + 9, "101", 3) != 0)
+    {
+        return -1;
+    }
+
+    char expected[WS_ACCEPT_LENGTH + 1];
+    wsAcceptKey(s->key, expected);
+    for(const char *line = strstr(text, "\r\n"); line != NULL && line < end; line = strstr(line + 2, "\r\n"))
+    {
+        if(strncasecmp(line + 2, "Sec-WebSocket-Accept:", 21) == 0)
+        {
+            const char *v = line + 23;
+            while(*v == ' ')
+            {
+                v++;
+            }
+            return strncmp(v, expected, WS_ACCEPT_LENGTH) == 0 ? (long)(end - text) + 4 : -1;
+        }
+    }
+    return -1;
+}
+
+static int readFrames(recStream *s)
+{
+    for(;;)
+    {
+        wsFrame f;
+        int parsed = wsParse(s->in.data, s->in.length, &f);
+        if(parsed < 0 || (parsed > 0 && (!f.fin || f.length > STREAM_MESSAGE_MAX)))
+        {
+            disconnect(s, REC_ERROR);
+            return -1;
+        }
+        if(parsed == 0 || s->in.length < f.headerLength + f.length)
+        {
+            return 0;
+        }
+        unsigned char *payload = s->in.data + f.headerLength;
+        if(f.masked)
+        {
+            wsMask(payload, (size_t)f.length, f.mask, 0);
+        }
+        switch(f.opcode)
+        {
+            case WS_TEXT:
+                handleMessage(s, (const char *)payload, (size_t)f.length);
+                break;
+            case WS_PING:
+                if(appendFrame(&s->wire, &s->maskSeed, WS_PONG, payload, (size_t)f.length) != 0)
+                {
+                    disconnect(s, REC_ERROR);
+                    return -1;
+                }
+                break;
+            case WS_CLOSE:
+                disconnect(s, REC_ERROR);
+                return -1;
+            default:
+                break;
+        }
+        bufferConsume(&s->in, f.headerLength + (size_t)f.length);
+    }
+}
+
+static int readSome(recStream *s)
+{
+    for(;;)
+    {
+        unsigned char chunk[STREAM_CHUNK];
+        long n = netRecvSome(s->fd, chunk, sizeof(chunk));
+        if(n == NET_PENDING)
+        {
+            return 0;
+        }
+        if(n < 0 || bufferAppend(&s->in, chunk, (size_t)n) != 0)
+        {
+            disconnect(s, REC_ERROR);
+            return -1;
+        }
+        if(s->state == STREAM_HANDSHAKE)
+        {
+            long taken = handshakeDone(s);
+            if(taken < 0)
+            {
+                disconnect(s, REC_ERROR);
+                return -1;
+            }
+            if(taken == 0)
+            {
+                continue;
+            }
+            bufferConsume(&s->in, (size_t)taken);
+            s->state = STREAM_OPEN;
+            pthread_mutex_lock(&s->lock);
+            s->stats.connects++;
+            pthread_mutex_unlock(&s->lock);
+            takeQueued(s);
+        }
+        if(readFrames(s) != 0)
+        {
+            return -1;
+        }
+    }
+}
+
+static void startHandshake(recStream *s)
+{
+    char request[1024];
+    wsMakeKey(&s->maskSeed, s->key);
+    int n = snprintf(request, sizeof(request),
+                     "GET %s HTTP/1.1\r\nHost: %s:%d\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                     "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n",
+                     s->path, s->host, s->port, s->key);
+    s->state = STREAM_HANDSHAKE;
+    if(n <= 0 || bufferAppend(&s->wire, request, (size_t)n) != 0)
+    {
+        disconnect(s, REC_ERROR);
+    }
+}
+
+static void ready(evLoop *loop, int fd, int events, void *ctx)
+{
+    recStream *s = (recStream *)ctx;
+    (void)loop;
+    (void)fd;
+    if(s->state == STREAM_CONNECTING)
+    {
+        if(netConnectFinish(s->fd) != NET_OK)
+        {
+            disconnect(s, REC_ERROR);
+            return;
+        }
+        startHandshake(s);
+        if(s->state == STREAM_IDLE)
+        {
+            return;
+        }
+    }
+    if(writeSome(s) != 0)
+    {
+        return;
+    }
+    if((events & (EV_READ | EV_ERROR)) && readSome(s) != 0)
+    {
+        return;
+    }
+    /* Frames taken or pongs queued while reading go out now. */
+    if(writeSome(s) == 0)
+    {
+        arm(s);
+    }
+}
+
+static void streamConnect(recStream *s)
+{
+    int e = atomicLoad(&s->resolved) ? netConnectStart(&s->address, &s->fd) : NET_ERROR;
+    if(e != NET_OK && e != NET_PENDING)
+    {
+        s->fd = -1;
+        disconnect(s, REC_ERROR);
+        return;
+    }
+    s->state = STREAM_CONNECTING;
+    if(e == NET_OK)
+    {
+        startHandshake(s);
+        if(s->state == STREAM_IDLE)
+        {
+            return;
+        }
+    }
+    arm(s);
+}
+
+/* Posted by the producer whenever it queued something. */
+static void flush(evLoop *loop, void *ctx)
+{
+    recStream *s = (recStream *)ctx;
+    pthread_mutex_lock(&s->lock);
+    s->flushPosted = 0;
+    for(int i = 0; i < STREAM_MAX_OPEN; i++)
+    {
+        streamUtterance *u = &s->open[i];
+        if(u->id != 0 && u->deadline > 0.0 && u->timer == 0)
+        {
+            u->timer = evTimerStart(loop, u->deadline, expire, s);
+        }
+    }
+    int waiting = s->queued.length > 0;
+    pthread_mutex_unlock(&s->lock);
+
+    if(s->state == STREAM_IDLE)
+    {
+        if(waiting)
+        {
+            streamConnect(s);
+        }
+    }
+    else if(s->state == STREAM_OPEN)
+    {
+        takeQueued(s);
+        if(writeSome(s) == 0)
+        {
+            arm(s);
+        }
+    }
+}
+
+static void teardown(evLoop *loop, void *ctx)
+{
+    recStream *s = (recStream *)ctx;
+    (void)loop;
+    disconnect(s, REC_CANCELLED);
+    atomicStore(&s->torn, 1);
+    notifySignal(&s->closed);
+}
+
+/*------ PRODUCER ------*/
+
+/* Lock held on entry, released here; posts a flush if the loop has not been told yet. */
+static void unlockAndFlush(recStream *s)
+{
+    int post = !s->flushPosted && s->queued.length > 0;
+    s->flushPosted |= post;
+    pthread_mutex_unlock(&s->lock);
+    if(post && evPost(s->loop, flush, s) != 0)
+    {
+        pthread_mutex_lock(&s->lock);
+        s->flushPosted = 0;
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+recStream *recStreamCreate(evLoop *loop, const char *host, int port, const char *path, int sampleRate)
+{
+    recStream *s = (recStream *)memCalloc(1, sizeof(recStream));
+    if(s == NULL)
+    {
+        return NULL;
+    }
+    s->loop = loop;
+    snprintf(s->host, sizeof(s->host), "%s", host);
+    snprintf(s->path, sizeof(s->path), "%s", path);
+    s->port = port;
+    s->sampleRate = sampleRate;
+    s->resolved = netResolve(host, port, &s->address) == NET_OK;
+    s->fd = -1;
+    s->maskSeed = (unsigned)(clockNow() * 1e6);
+    pthread_mutex_init(&s->lock, NULL);
+    notifyInit(&s->closed);
+    return s;
+}
+
+recStream *recStreamConfigure(evLoop *loop, const config *settings, int sampleRate)
+{
+    if(configNumber(settings, "recognizer_stream", 0) == 0)
+    {
+        return NULL;
+    }
+    const char *host = configString(settings, "recognizer_host", STREAM_HOST);
+    const char *path = configString(settings, "recognizer_stream_path", STREAM_PATH);
+    int port = (int)configNumber(settings, "recognizer_port", STREAM_PORT);
+    return recStreamCreate(loop, host, port, path, sampleRate);
+}
+
+unsigned long recStreamBegin(recStream *s, recStreamFunc func, void *ctx)
+{
+    unsigned long id = 0;
+    if(!atomicLoadRelaxed(&s->resolved) && netResolve(s->host, s->port, &s->address) == NET_OK)
+    {
+        atomicStore(&s->resolved, 1);
+    }
+    pthread_mutex_lock(&s->lock);
+    streamUtterance *u = findOpen(s, 0);
+    if(u != NULL)
+    {
+        char text[128];
+        int n = snprintf(text, sizeof(text), "{\"event\":\"start\",\"id\":%lu,\"rate\":%d}",
+                         s->nextId + 1, s->sampleRate);
+        if(appendFrame(&s->queued, &s->maskSeed, WS_TEXT, text, (size_t)n) == 0)
+        {
+            id = ++s->nextId;
+            memset(u, 0, sizeof(*u));
+            u->id = id;
+            u->func = func;
+            u->ctx = ctx;
+            u->begun = clockNow();
+            s->stats.utterances++;
+        }
+    }
+    unlockAndFlush(s);
+    return id;
+}
+
+int recStreamAudio(recStream *s, unsigned long id, const short *samples, long count)
+{
+    int status = REC_ERROR;
+    pthread_mutex_lock(&s->lock);
+    streamUtterance *u = id != 0 ? findOpen(s, id) : NULL;
+    /* The hosts Jarvis runs on are little-endian, so samples go out as they are. */
+    if(u != NULL && u->ended == 0.0
+       && appendFrame(&s->queued, &s->maskSeed, WS_BINARY, samples, (size_t)count * sizeof(short)) == 0)
+    {
+        status = REC_OK;
+    }
+    unlockAndFlush(s);
+    return status;
+}
+
+int recStreamEnd(recStream *s, unsigned long id, double deadline)
+{
+    int status = REC_ERROR;
+    pthread_mutex_lock(&s->lock);
+    streamUtterance *u = id != 0 ? findOpen(s, id) : NULL;
+    if(u != NULL && u->ended == 0.0)
+    {
+        char text[64];
+        int n = snprintf(text, sizeof(text), "{\"event\":\"end\",\"id\":%lu}", id);
+        if(appendFrame(&s->queued, &s->maskSeed, WS_TEXT, text, (size_t)n) == 0)
+        {
+            u->ended = clockNow();
+            u->deadline = deadline;
+            status = REC_OK;
+        }
+    }
+    unlockAndFlush(s);
+    return status;
+}
+
+void recStreamGetStats(recStream *s, recStreamStats *out)
+{
+    pthread_mutex_lock(&s->lock);
+    *out = s->stats;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void recStreamDestroy(recStream *s)
+{
+    if(s == NULL)
+    {
+        return;
+    }
+    if(evPost(s->loop, teardown, s) == 0)
+    {
+        for(;;)
+        {
+            unsigned seen = notifyPrepare(&s->closed);
+            if(atomicLoad(&s->torn))
+            {
+                break;
+            }
+            notifyWait(&s->closed, seen, 1.0);
+        }
+    }
+    notifyFree(&s->closed);
+    pthread_mutex_destroy(&s->lock);
+    memFree(s->queued.data);
+    memFree(s->wire.data);
+    memFree(s->in.data);
+    memFree(s);
+}
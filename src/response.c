@@ -0,0 +1,371 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mempool.h"
+#include "response.h"
+
+#define TPL_MINUTE  (60)
+#define TPL_DAY     (86400)
+
+static const char *const varNames[TPL_VAR_COUNT] =
+{
+    [TPL_VAR_TRANSCRIPT]    = "transcript",
+    [TPL_VAR_TIME]          = "time",
+    [TPL_VAR_WEEKDAY]       = "weekday",
+    [TPL_VAR_MONTH]         = "month",
+    [TPL_VAR_DAY]           = "day",
+};
+
+/* Reentrant localtime: several sessions may render replies at once. */
+static void localTime(time_t t, struct tm *out)
+{
+#ifdef _WIN32
+    localtime_s(out, &t);
+#else
+    localtime_r(&t, out);
+#endif
+}
+
+/* Seconds a rendered variable stays correct, 0 = never changes, -1 = never cacheable. */
+static const int varLifetime[TPL_VAR_COUNT] =
+{
+    [TPL_VAR_TRANSCRIPT]    = -1,
+    [TPL_VAR_TIME]          = TPL_MINUTE,
+    [TPL_VAR_WEEKDAY]       = TPL_DAY,
+    [TPL_VAR_MONTH]         = TPL_DAY,
+    [TPL_VAR_DAY]           = TPL_DAY,
+};
+
+/* Fixed English names so replies do not depend on the C locale. */
+static const char *const weekdays[7] =
+{
+    "Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday"
+};
+
+static const char *const months[12] =
+{
+    "January", "February", "March", "April", "May", "June",
+    "July", "August", "September", "October", "November", "December"
+};
+
+static int addOp(respTemplate *t, int literal, int var, size_t offset, size_t length)
+{
+    if(t->opCount == TPL_MAX_OPS || offset > 0xFFFF || length > 0xFFFF)
+    {
+        return -1;
+    }
+    tplOp *op = &t->ops[t->opCount++];
+    op->literal = (unsigned char)literal;
+    op->var = (unsigned char)var;
+    op->offset = (unsigned short)offset;
+    op->length = (unsigned short)length;
+    return 0;
+}
+
+int tplCompile(respTemplate *t, const char *source)
+{
+    memset(t, 0, sizeof(*t));
+    t->source = source;
+
+    size_t literalStart = 0;
+    size_t i = 0;
+    while(source[i] != '\0')
+    {
+        if(source[i] != '{')
+        {
+            i++;
+            continue;
+        }
+        const char *close = strchr(source + i, '}');
+        if(close == NULL)
+        {
+            return -1;
+        }
+        size_t nameLength = (size_t)(close - (source + i + 1));
+        int var = -1;
+        for(int v = 0; v < TPL_VAR_COUNT; v++)
+        {
+            if(strlen(varNames[v]) == nameLength && strncmp(source + i + 1, varNames[v], nameLength) == 0)
+            {
+                var = v;
+                break;
+            }
+        }
+        if(var < 0)
+        {
+            return -1;
+        }
+
+        if(i > literalStart && addOp(t, 1, 0, literalStart, i - literalStart) != 0)
+        {
+            return -1;
+        }
+        if(addOp(t, 0, var, 0, 0) != 0)
+        {
+            return -1;
+        }
+
+        if(varLifetime[var] < 0)
+        {
+            t->uncacheable = 1;
+        }
+        else if(t->timeGranularity == 0 || varLifetime[var] < t->timeGranularity)
+        {
+            t->timeGranularity = varLifetime[var];
+        }
+        i = (size_t)(close - source) + 1;
+        literalStart = i;
+    }
+    if(i > literalStart && addOp(t, 1, 0, literalStart, i - literalStart) != 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/* Appends at most the bytes that fit, keeping count of the full length. */
+static void append(char *out, size_t capacity, size_t *length, const char *text, size_t n)
+{
+    if(*length + 1 < capacity)
+    {
+        size_t room = capacity - 1 - *length;
+        memcpy(out + *length, text, n < room ? n : room);
+    }
+    *length += n;
+}
+
+size_t tplRender(const respTemplate *t, const respContext *ctx, char *out, size_t capacity)
+{
+    size_t length = 0;
+    struct tm local;
+    int haveLocal = 0;
+
+    for(int i = 0; i < t->opCount; i++)
+    {
+        const tplOp *op = &t->ops[i];
+        if(op->literal)
+        {
+            append(out, capacity, &length, t->source + op->offset, op->length);
+            continue;
+        }
+
+        if(op->var != TPL_VAR_TRANSCRIPT && !haveLocal)
+        {
+            localTime(ctx->now, &local);
+            haveLocal = 1;
+        }
+
+        char value[32];
+        const char *text = value;
+        switch(op->var)
+        {
+            case TPL_VAR_TRANSCRIPT:
+                text = ctx->transcript != NULL ? ctx->transcript : "";
+                break;
+            case TPL_VAR_TIME:
+            {
+                int hour = local.tm_hour % 12;
+                snprintf(value, sizeof(value), "%d:%02d %s", hour == 0 ? 12 : hour, local.tm_min,
+                         local.tm_hour < 12 ? "AM" : "PM");
+                break;
+            }
+            case TPL_VAR_WEEKDAY:
+                text = weekdays[local.tm_wday];
+                break;
+            case TPL_VAR_MONTH:
+                text = months[local.tm_mon];
+                break;
+            case TPL_VAR_DAY:
+                snprintf(value, sizeof(value), "%d", local.tm_mday);
+                break;
+            default:
+                value[0] = '\0';
+                break;
+        }
+        append(out, capacity, &length, text, strlen(text));
+    }
+
+    if(capacity > 0)
+    {
+        out[length < capacity ? length : capacity - 1] = '\0';
+    }
+    return length;
+}
+
+time_t tplValidUntil(const respTemplate *t, time_t now)
+{
+    if(t->timeGranularity == 0)
+    {
+        return 0;
+    }
+    struct tm local;
+    localTime(now, &local);
+    if(t->timeGranularity == TPL_MINUTE)
+    {
+        return now - local.tm_sec + TPL_MINUTE;
+    }
+    local.tm_sec = 0;
+    local.tm_min = 0;
+    local.tm_hour = 0;
+    local.tm_mday++;
+    local.tm_isdst = -1;
+    return mktime(&local);
+}
+
+/*------ CACHE ------*/
+
+static respCacheEntry *cacheFind(responder *r, int intent, time_t now)
+{
+    for(int i = 0; i < r->capacity; i++)
+    {
+        respCacheEntry *e = &r->entries[i];
+        if(e->lastUsed != 0 && e->intent == intent)
+        {
+            if(e->validUntil != 0 && now >= e->validUntil)
+            {
+                return NULL;
+            }
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/* Renders intent into its slot, reusing a stale entry for it before evicting the LRU one. */
+static respCacheEntry *cacheFill(responder *r, int intent, time_t now)
+{
+    int slot = -1;
+    for(int i = 0; i < r->capacity; i++)
+    {
+        if(r->entries[i].lastUsed != 0 && r->entries[i].intent == intent)
+        {
+            slot = i;
+            break;
+        }
+    }
+    if(slot < 0)
+    {
+        slot = 0;
+        for(int i = 0; i < r->capacity; i++)
+        {
+            if(r->entries[i].lastUsed < r->entries[slot].lastUsed)
+            {
+                slot = i;
+            }
+        }
+    }
+
+    respCacheEntry *e = &r->entries[slot];
+    const respTemplate *t = &r->templates[intent];
+    respContext ctx = { NULL, now };
+    e->length = tplRender(t, &ctx, e->text, sizeof(e->text));
+    if(e->length >= sizeof(e->text))
+    {
+        e->length = sizeof(e->text) - 1;
+    }
+    e->intent = intent;
+    e->validUntil = tplValidUntil(t, now);
+    e->pcm = NULL;
+    e->pcmCount = 0;
+    e->lastUsed = ++r->clock;
+    r->stats.renders++;
+    return e;
+}
+
+int responderInit(responder *r, int cacheCapacity, time_t now)
+{
+    memset(r, 0, sizeof(*r));
+    r->entries = (respCacheEntry *)memCalloc((size_t)cacheCapacity, sizeof(respCacheEntry));
+    if(r->entries == NULL)
+    {
+        return -1;
+    }
+    r->capacity = cacheCapacity;
+    r->metricLookups = metricCounter("jarvis_cache_lookups_total", "cache=\"reply\"",
+                                     "Cache lookups: rendered replies, and transcripts by audio fingerprint.");
+    r->metricHits = metricCounter("jarvis_cache_hits_total", "cache=\"reply\"", "Cache lookups that hit.");
+
+    const intentDef *defs = intentTable();
+    for(int i = 0; i < INTENT_COUNT; i++)
+    {
+        if(tplCompile(&r->templates[i], defs[i].reply) != 0)
+        {
+            printf("Bad reply template for intent %s.\n", defs[i].name);
+            memFree(r->entries);
+            r->entries = NULL;
+            return -1;
+        }
+    }
+
+    /* Warm the cache with replies that never change. */
+    int warmed = 0;
+    for(int i = 0; i < INTENT_COUNT && warmed < cacheCapacity; i++)
+    {
+        if(!r->templates[i].uncacheable && r->templates[i].timeGranularity == 0)
+        {
+            cacheFill(r, i, now);
+            warmed++;
+        }
+    }
+    return 0;
+}
+
+void responderFree(responder *r)
+{
+    memFree(r->entries);
+    r->entries = NULL;
+    r->capacity = 0;
+}
+
+void respondTo(responder *r, intentId intent, const char *transcript, time_t now, respReply *out)
+{
+    const respTemplate *t = &r->templates[intent];
+    r->stats.lookups++;
+    metricInc(r->metricLookups);
+
+    if(t->uncacheable || r->capacity == 0)
+    {
+        respContext ctx = { transcript, now };
+        size_t length = tplRender(t, &ctx, r->scratch, sizeof(r->scratch));
+        r->stats.renders++;
+        out->text = r->scratch;
+        out->length = length < sizeof(r->scratch) ? length : sizeof(r->scratch) - 1;
+        out->pcm = NULL;
+        out->pcmCount = 0;
+        out->cached = 0;
+        return;
+    }
+
+    respCacheEntry *e = cacheFind(r, intent, now);
+    out->cached = e != NULL;
+    if(e != NULL)
+    {
+        r->stats.hits++;
+        metricInc(r->metricHits);
+        e->lastUsed = ++r->clock;
+    }
+    else
+    {
+        e = cacheFill(r, intent, now);
+    }
+    out->text = e->text;
+    out->length = e->length;
+    out->pcm = e->pcm;
+    out->pcmCount = e->pcmCount;
+}
+
+int responderAttachAudio(responder *r, intentId intent, const short *pcm, long count, time_t now)
+{
+    if(r->templates[intent].uncacheable || r->capacity == 0)
+    {
+        return -1;
+    }
+    respCacheEntry *e = cacheFind(r, intent, now);
+    if(e == NULL)
+    {
+        e = cacheFill(r, intent, now);
+    }
+    e->pcm = pcm;
+    e->pcmCount = count;
+    return 0;
+}
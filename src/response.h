@@ -0,0 +1,129 @@
+#ifndef JARVIS_RESPONSE_H
+#define JARVIS_RESPONSE_H
+
+#include <stddef.h>
+#include <time.h>
+#include "intent.h"
+#include "metrics.h"
+
+/*
+ *  Reply templates and the rendered-response cache.
+ *
+ *  A template such as "Today is {weekday}, {month} {day}." is compiled
+ *  once into literal and variable ops that point back into the source
+ *  string; rendering walks the ops into a caller buffer and never
+ *  allocates. Each variable has a lifetime, so a rendered reply can be
+ *  cached until its earliest variable changes: forever for static text,
+ *  to the end of the minute for {time}, never for {transcript}.
+ */
+
+#define TPL_MAX_OPS         (16)
+#define RESP_TEXT_MAX       (256)
+
+typedef enum
+{
+    TPL_VAR_TRANSCRIPT,
+    TPL_VAR_TIME,           /* "3:07 PM" */
+    TPL_VAR_WEEKDAY,        /* "Tuesday" */
+    TPL_VAR_MONTH,          /* "May" */
+    TPL_VAR_DAY,            /* "24" */
+    TPL_VAR_COUNT
+}
+tplVar;
+
+typedef struct
+{
+    unsigned char   literal;        /* 1 = copy source[offset, offset + length) */
+    unsigned char   var;
+    unsigned short  offset;
+    unsigned short  length;
+}
+tplOp;
+
+typedef struct
+{
+    const char     *source;
+    tplOp           ops[TPL_MAX_OPS];
+    int             opCount;
+    int             uncacheable;    /* uses {transcript} */
+    int             timeGranularity;    /* seconds the render stays valid, 0 = forever */
+}
+respTemplate;
+
+typedef struct
+{
+    const char     *transcript;
+    time_t          now;
+}
+respContext;
+
+/* Returns 0, or -1 for unknown variables or too many ops. */
+int tplCompile(respTemplate *t, const char *source);
+
+/* Renders into out (always NUL terminated); returns the untruncated length. */
+size_t tplRender(const respTemplate *t, const respContext *ctx, char *out, size_t capacity);
+
+/* First time at or after now when a render of t would change, 0 = never. */
+time_t tplValidUntil(const respTemplate *t, time_t now);
+
+typedef struct
+{
+    int             intent;
+    time_t          validUntil;     /* 0 = until evicted */
+    char            text[RESP_TEXT_MAX];
+    size_t          length;
+    const short    *pcm;            /* pre-synthesized audio, owned by the caller */
+    long            pcmCount;
+    unsigned long   lastUsed;       /* LRU stamp, 0 = empty slot */
+}
+respCacheEntry;
+
+typedef struct
+{
+    unsigned long   lookups;
+    unsigned long   hits;
+    unsigned long   renders;
+}
+respStats;
+
+/*
+ *  Owned by the response stage; not thread-safe. Pointers returned by
+ *  respondTo stay valid until the next call.
+ */
+typedef struct
+{
+    respTemplate    templates[INTENT_COUNT];
+    respCacheEntry *entries;
+    int             capacity;
+    unsigned long   clock;
+    char            scratch[RESP_TEXT_MAX];
+    respStats       stats;
+    metric         *metricLookups;  /* jarvis_cache_lookups_total and _hits_total, cache="reply" */
+    metric         *metricHits;
+}
+responder;
+
+/* Compiles every intent template and pre-renders the static ones. */
+int  responderInit(responder *r, int cacheCapacity, time_t now);
+void responderFree(responder *r);
+
+typedef struct
+{
+    const char     *text;
+    size_t          length;
+    const short    *pcm;            /* NULL until audio has been attached */
+    long            pcmCount;
+    int             cached;
+}
+respReply;
+
+void respondTo(responder *r, intentId intent, const char *transcript, time_t now, respReply *out);
+
+/*
+ *  Attaches synthesized audio to the cached reply of a static intent so
+ *  later hits can be played without synthesis. Returns -1 if the intent
+ *  is not cacheable.
+ */
+int  responderAttachAudio(responder *r, intentId intent, const short *pcm, long count, time_t now);
+
+#endif
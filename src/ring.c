@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <string.h>
+#include "atomics.h"
+#include "mempool.h"
+#include "ring.h"
+
+int sampleRingInit(sampleRing *r, size_t capacity)
+{
+    size_t size = 1;
+    while(size < capacity)
+    {
+        size <<= 1;
+    }
+    memset(r, 0, sizeof(*r));
+    r->samples = (short *)memCalloc(size, sizeof(short));
+    if(r->samples == NULL)
+    {
+        return -1;
+    }
+    r->mask = size - 1;
+    return 0;
+}
+
+void sampleRingFree(sampleRing *r)
+{
+    memFree(r->samples);
+    r->samples = NULL;
+}
+
+size_t sampleRingAvailable(const sampleRing *r)
+{
+    return atomicLoad(&r->head) - atomicLoad(&r->tail);
+}
+
+size_t sampleRingSpace(const sampleRing *r)
+{
+    return r->mask + 1 - sampleRingAvailable(r);
+}
+
+size_t sampleRingWrite(sampleRing *r, const short *samples, size_t count)
+{
+    size_t head = atomicLoadRelaxed(&r->head);
+    size_t space = r->mask + 1 - (head - atomicLoad(&r->tail));
+    if(count > space)
+    {
+        count = space;
+    }
+
+    size_t at = head & r->mask;
+    size_t first = r->mask + 1 - at;
+    if(first > count)
+    {
+        first = count;
+    }
+    memcpy(r->samples + at, samples, first * sizeof(short));
+    memcpy(r->samples, samples + first, (count - first) * sizeof(short));
+
+    atomicStore(&r->head, head + count);
+    return count;
+}
+
+size_t sampleRingRead(sampleRing *r, short *samples, size_t count)
+{
+    size_t tail = atomicLoadRelaxed(&r->tail);
+    size_t available = atomicLoad(&r->head) - tail;
+    if(count > available)
+    {
+        count = available;
+    }
+
+    size_t at = tail & r->mask;
+    size_t first = r->mask + 1 - at;
+    if(first > count)
+    {
+        first = count;
+    }
+    memcpy(samples, r->samples + at, first * sizeof(short));
+    memcpy(samples + first, r->samples, (count - first) * sizeof(short));
+
+    atomicStore(&r->tail, tail + count);
+    return count;
+}
+
+void sampleRingClear(sampleRing *r)
+{
+    atomicStore(&r->tail, atomicLoad(&r->head));
+}
@@ -0,0 +1,38 @@
+#ifndef JARVIS_RING_H
+#define JARVIS_RING_H
+
+#include <stddef.h>
+
+/*
+ *  Single-producer / single-consumer ring of int16 samples. The audio
+ *  callback sits on one side and a normal thread on the other, so
+ *  neither side ever takes a lock or allocates. Indices run freely and
+ *  are masked on access; capacity is rounded up to a power of two.
+ */
+
+typedef struct
+{
+    short          *samples;
+    size_t          mask;
+    size_t          head;           /* written by the producer */
+    char            pad[64];        /* keep head and tail on separate cache lines */
+    size_t          tail;           /* written by the consumer */
+}
+sampleRing;
+
+int  sampleRingInit(sampleRing *r, size_t capacity);
+void sampleRingFree(sampleRing *r);
+
+/* Producer side: copies up to count samples, returns how many fit. */
+size_t sampleRingWrite(sampleRing *r, const short *samples, size_t count);
+
+/* Consumer side: copies up to count samples, returns how many were available. */
+size_t sampleRingRead(sampleRing *r, short *samples, size_t count);
+
+size_t sampleRingAvailable(const sampleRing *r);
+size_t sampleRingSpace(const sampleRing *r);
+
+/* Consumer side: drops everything currently queued. */
+void sampleRingClear(sampleRing *r);
+
+#endif
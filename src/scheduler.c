@@ -0,0 +1,387 @@
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sched.h>
+#include <unistd.h>
+#endif
+#include "atomics.h"
+#include "clock.h"
+#include "mempool.h"
+#include "scheduler.h"
+
+#define SCHED_DEQUE         (256)       /* initial slots per worker, grows on demand */
+#define SCHED_STEAL_MAX     (64)        /* most tasks moved by one steal */
+#define SCHED_SPINS         (64)        /* empty rounds before a worker parks */
+
+static void yieldCpu(void)
+{
+#ifdef _WIN32
+    Sleep(0);
+#else
+    sched_yield();
+#endif
+}
+
+int schedCores(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int n = (int)info.dwNumberOfProcessors;
+#else
+    int n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return n > 0 ? n : 1;
+}
+
+/*------ DEQUES ------*/
+
+/* Called with w->lock held. */
+static int dequeGrow(schedWorker *w)
+{
+    size_t size = (w->mask + 1) * 2;
+    schedTask *tasks = (schedTask *)memAlloc(size * sizeof(schedTask));
+    if(tasks == NULL)
+    {
+        return -1;
+    }
+    for(size_t i = w->top; i != w->bottom; i++)
+    {
+        tasks[i & (size - 1)] = w->tasks[i & w->mask];
+    }
+    memFree(w->tasks);
+    w->tasks = tasks;
+    w->mask = size - 1;
+    return 0;
+}
+
+static int dequePush(schedWorker *w, const schedTask *t)
+{
+    pthread_mutex_lock(&w->lock);
+    if(w->bottom - w->top > w->mask && dequeGrow(w) != 0)
+    {
+        pthread_mutex_unlock(&w->lock);
+        return -1;
+    }
+    w->tasks[w->bottom & w->mask] = *t;
+    w->bottom++;
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+/* Owner side: newest first. */
+static int dequePop(schedWorker *w, schedTask *t)
+{
+    int got = 0;
+    pthread_mutex_lock(&w->lock);
+    if(w->bottom != w->top)
+    {
+        w->bottom--;
+        *t = w->tasks[w->bottom & w->mask];
+        got = 1;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return got;
+}
+
+/* Thief side: takes half (rounded up) of the victim's oldest tasks. */
+static int dequeStealHalf(schedWorker *victim, schedTask *out)
+{
+    pthread_mutex_lock(&victim->lock);
+    size_t n = victim->bottom - victim->top;
+    size_t k = (n + 1) / 2;
+    if(k > SCHED_STEAL_MAX)
+    {
+        k = SCHED_STEAL_MAX;
+    }
+    for(size_t i = 0; i < k; i++)
+    {
+        out[i] = victim->tasks[(victim->top + i) & victim->mask];
+    }
+    victim->top += k;
+    pthread_mutex_unlock(&victim->lock);
+    return (int)k;
+}
+
+/*------ WORKERS ------*/
+
+static void runTask(schedWorker *w, const schedTask *t)
+{
+    double start = clockNow();
+    double waited = start - t->queued;
+    t->func(t->arg);
+    w->stats.busySeconds += clockNow() - start;
+    w->stats.waitSeconds += waited;
+    if(waited > w->stats.maxWaitSeconds)
+    {
+        w->stats.maxWaitSeconds = waited;
+    }
+    w->stats.executed++;
+
+    /* Under the lock, so a waiter that saw the count reach 0 may destroy the group right away. */
+    schedGroup *g = t->group;
+    if(g != NULL)
+    {
+        pthread_mutex_lock(&g->lock);
+        if(atomicAdd(&g->pending, -1) == 0)
+        {
+            pthread_cond_broadcast(&g->done);
+        }
+        pthread_mutex_unlock(&g->lock);
+    }
+}
+
+/* Own deque first, then steal; returns 0 if there is nothing anywhere. */
+static int findTask(schedWorker *w, schedTask *t)
+{
+    scheduler *s = w->owner;
+    if(dequePop(w, t))
+    {
+        atomicAdd(&s->pending, -1);
+        return 1;
+    }
+
+    /* Workers still being started are not counted yet. */
+    int count = atomicLoad(&s->count);
+    if(count < 2)
+    {
+        return 0;
+    }
+    schedTask loot[SCHED_STEAL_MAX];
+    w->seed = w->seed * 1664525u + 1013904223u;
+    int start = (int)((w->seed >> 8) % (unsigned)count);
+    for(int i = 0; i < count; i++)
+    {
+        schedWorker *victim = &s->workers[(start + i) % count];
+        if(victim == w)
+        {
+            continue;
+        }
+        int k = dequeStealHalf(victim, loot);
+        if(k == 0)
+        {
+            continue;
+        }
+        w->stats.steals++;
+        w->stats.stolen += (unsigned long)k;
+
+        /* Run the oldest now, keep the rest in order for ourselves and other thieves. */
+        for(int j = k - 1; j >= 1; j--)
+        {
+            if(dequePush(w, &loot[j]) != 0)
+            {
+                runTask(w, &loot[j]);
+                atomicAdd(&s->pending, -1);
+            }
+        }
+        *t = loot[0];
+        atomicAdd(&s->pending, -1);
+        return 1;
+    }
+    return 0;
+}
+
+static void *workerThread(void *arg)
+{
+    schedWorker *w = (schedWorker *)arg;
+    scheduler *s = w->owner;
+    pthread_setspecific(s->self, w);
+
+    int idle = 0;
+    for(;;)
+    {
+        schedTask t;
+        if(findTask(w, &t))
+        {
+            runTask(w, &t);
+            idle = 0;
+            continue;
+        }
+        if(atomicLoad(&s->stopping) && atomicLoad(&s->pending) == 0)
+        {
+            break;
+        }
+        if(++idle < SCHED_SPINS)
+        {
+            yieldCpu();
+            continue;
+        }
+
+        /*
+         *  Park. parked is raised before pending is checked and submitters
+         *  raise pending before checking parked, so one of the two sees the
+         *  other and the wake-up cannot be lost.
+         */
+        atomicAddSeqCst(&s->parked, 1);
+        pthread_mutex_lock(&s->parkLock);
+        if(atomicLoadSeqCst(&s->pending) == 0 && !s->stopping)
+        {
+            w->stats.parks++;
+            pthread_cond_wait(&s->wake, &s->parkLock);
+        }
+        pthread_mutex_unlock(&s->parkLock);
+        atomicAddSeqCst(&s->parked, -1);
+        idle = 0;
+    }
+    return NULL;
+}
+
+/*------ API ------*/
+
+int schedInit(scheduler *s, int workers)
+{
+    memset(s, 0, sizeof(*s));
+    if(workers <= 0)
+    {
+        workers = schedCores();
+    }
+    if(workers > SCHED_MAX_WORKERS)
+    {
+        workers = SCHED_MAX_WORKERS;
+    }
+
+    s->workers = (schedWorker *)memCalloc((size_t)workers, sizeof(schedWorker));
+    if(s->workers == NULL || pthread_key_create(&s->self, NULL) != 0)
+    {
+        memFree(s->workers);
+        return -1;
+    }
+    pthread_mutex_init(&s->parkLock, NULL);
+    pthread_cond_init(&s->wake, NULL);
+
+    for(int i = 0; i < workers; i++)
+    {
+        schedWorker *w = &s->workers[i];
+        pthread_mutex_init(&w->lock, NULL);
+        w->tasks = (schedTask *)memAlloc(SCHED_DEQUE * sizeof(schedTask));
+        w->mask = SCHED_DEQUE - 1;
+        w->owner = s;
+        w->seed = 2654435761u * (unsigned)(i + 1);
+        if(w->tasks == NULL || pthread_create(&w->thread, NULL, workerThread, w) != 0)
+        {
+            memFree(w->tasks);
+            pthread_mutex_destroy(&w->lock);
+            schedFree(s);
+            return -1;
+        }
+        atomicStore(&s->count, i + 1);
+    }
+    return 0;
+}
+
+void schedFree(scheduler *s)
+{
+    pthread_mutex_lock(&s->parkLock);
+    atomicStore(&s->stopping, 1);
+    pthread_cond_broadcast(&s->wake);
+    pthread_mutex_unlock(&s->parkLock);
+
+    for(int i = 0; i < s->count; i++)
+    {
+        pthread_join(s->workers[i].thread, NULL);
+        memFree(s->workers[i].tasks);
+        pthread_mutex_destroy(&s->workers[i].lock);
+    }
+    pthread_cond_destroy(&s->wake);
+    pthread_mutex_destroy(&s->parkLock);
+    pthread_key_delete(s->self);
+    memFree(s->workers);
+    s->workers = NULL;
+    s->count = 0;
+}
+
+void schedGroupInit(schedGroup *g)
+{
+    g->pending = 0;
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->done, NULL);
+}
+
+void schedGroupDestroy(schedGroup *g)
+{
+    pthread_cond_destroy(&g->done);
+    pthread_mutex_destroy(&g->lock);
+}
+
+int schedSubmit(scheduler *s, schedGroup *group, schedFunc func, void *arg)
+{
+    schedTask t = { func, arg, group, clockNow() };
+    schedWorker *w = (schedWorker *)pthread_getspecific(s->self);
+    if(w == NULL)
+    {
+        w = &s->workers[atomicAdd(&s->next, 1) % (unsigned)s->count];
+    }
+
+    if(group != NULL)
+    {
+        atomicAdd(&group->pending, 1);
+    }
+    if(dequePush(w, &t) != 0)
+    {
+        if(group != NULL)
+        {
+            atomicAdd(&group->pending, -1);
+        }
+        return -1;
+    }
+
+    atomicAddSeqCst(&s->pending, 1);
+    if(atomicLoadSeqCst(&s->parked) > 0)
+    {
+        pthread_mutex_lock(&s->parkLock);
+        pthread_cond_signal(&s->wake);
+        pthread_mutex_unlock(&s->parkLock);
+    }
+    return 0;
+}
+
+void schedWait(scheduler *s, schedGroup *g)
+{
+    schedWorker *w = (schedWorker *)pthread_getspecific(s->self);
+    if(w != NULL)
+    {
+        /* A worker must not block: it may be the only one able to run the group's tasks. */
+        while(atomicLoad(&g->pending) > 0)
+        {
+            schedTask t;
+            if(findTask(w, &t))
+            {
+                runTask(w, &t);
+            }
+            else
+            {
+                yieldCpu();
+            }
+        }
+        /* The last task may still be unlocking the group. */
+        pthread_mutex_lock(&g->lock);
+        pthread_mutex_unlock(&g->lock);
+        return;
+    }
+
+    pthread_mutex_lock(&g->lock);
+    while(atomicLoad(&g->pending) > 0)
+    {
+        pthread_cond_wait(&g->done, &g->lock);
+    }
+    pthread_mutex_unlock(&g->lock);
+}
+
+void schedGetStats(const scheduler *s, schedStats *out)
+{
+    memset(out, 0, sizeof(*out));
+    for(int i = 0; i < s->count; i++)
+    {
+        const schedStats *w = &s->workers[i].stats;
+        out->executed += w->executed;
+        out->stolen += w->stolen;
+        out->steals += w->steals;
+        out->parks += w->parks;
+        out->busySeconds += w->busySeconds;
+        out->waitSeconds += w->waitSeconds;
+        if(w->maxWaitSeconds > out->maxWaitSeconds)
+        {
+            out->maxWaitSeconds = w->maxWaitSeconds;
+        }
+    }
+}
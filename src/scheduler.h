@@ -0,0 +1,109 @@
+#ifndef JARVIS_SCHEDULER_H
+#define JARVIS_SCHEDULER_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/*
+ *  Work-stealing task scheduler for uneven batch work.
+ *
+ *  Every worker owns a deque. Tasks submitted from a worker go to the
+ *  bottom of its own deque and are taken back LIFO, so a job that splits
+ *  itself keeps its data warm; tasks submitted from other threads are
+ *  dealt round-robin. A worker that runs dry steals half of the oldest
+ *  tasks of a random victim in one go, so one long job cannot hold a
+ *  queue of short ones hostage and a burst spreads in a few steals.
+ *  Workers with nothing to run or steal spin briefly and then park on a
+ *  condition variable until new work is submitted.
+ *
+ *  Deques are short mutex-protected rings (a steal copies out under the
+ *  victim's lock and never holds two), which keeps them portable to the
+ *  MinGW pthreads build. Completion is tracked with groups; waiting from
+ *  inside a task runs other tasks instead of blocking the worker.
+ */
+
+#define SCHED_MAX_WORKERS   (64)
+
+typedef void (*schedFunc)(void *arg);
+
+typedef struct
+{
+    int                 pending;
+    pthread_mutex_t     lock;
+    pthread_cond_t      done;
+}
+schedGroup;
+
+typedef struct
+{
+    schedFunc           func;
+    void               *arg;
+    schedGroup         *group;      /* may be NULL */
+    double              queued;     /* clockNow() at submit */
+}
+schedTask;
+
+typedef struct
+{
+    unsigned long       executed;
+    unsigned long       stolen;         /* tasks taken from other workers */
+    unsigned long       steals;         /* successful steal operations */
+    unsigned long       parks;
+    double              busySeconds;
+    double              waitSeconds;    /* submit to start, summed over tasks */
+    double              maxWaitSeconds;
+}
+schedStats;
+
+typedef struct scheduler scheduler;
+
+typedef struct
+{
+    pthread_mutex_t     lock;
+    schedTask          *tasks;
+    size_t              mask;
+    size_t              top;            /* oldest, where thieves take */
+    size_t              bottom;         /* newest, where the owner pushes and pops */
+    scheduler          *owner;
+    unsigned            seed;
+    pthread_t           thread;
+    schedStats          stats;          /* written by this worker only */
+    char                pad[64];
+}
+schedWorker;
+
+struct scheduler
+{
+    schedWorker        *workers;
+    int                 count;
+    pthread_key_t       self;           /* schedWorker * of the calling thread */
+    int                 pending;        /* queued tasks not yet started */
+    int                 parked;
+    int                 stopping;
+    unsigned            next;           /* round-robin target for outside submits */
+    pthread_mutex_t     parkLock;
+    pthread_cond_t      wake;
+};
+
+/* Number of online processors, at least 1. */
+int  schedCores(void);
+
+/* Starts `workers` threads (schedCores() if <= 0); returns -1 on failure. */
+int  schedInit(scheduler *s, int workers);
+
+/* Runs everything still queued, then stops and joins the workers. */
+void schedFree(scheduler *s);
+
+void schedGroupInit(schedGroup *g);
+void schedGroupDestroy(schedGroup *g);
+
+/* Queues func(arg), counted in group if not NULL. Returns -1 if out of memory (nothing queued). */
+int  schedSubmit(scheduler *s, schedGroup *group, schedFunc func, void *arg);
+
+/* Returns once every task of the group has finished. Inside a task, runs other tasks meanwhile. */
+void schedWait(scheduler *s, schedGroup *g);
+
+/* Sum over workers; approximate while tasks are running. */
+void schedGetStats(const scheduler *s, schedStats *out);
+
+#endif
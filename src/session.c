@@ -0,0 +1,439 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "atomics.h"
+#include "clock.h"
+#include "mempool.h"
+#include "session.h"
+
+#define SESSION_RING        (1 << 17)
+#define SESSION_IDLE_MS     (2)
+#define SESSION_FLAGS       (0x001F)    /* PortAudio statusFlags that exist */
+#define SESSION_DROPPED     (0x4000)    /* record is preceded by dropped frames (u32 follows) */
+#define SESSION_ABSOLUTE    (0x8000)    /* absolute stamps (3 doubles) follow */
+#define SESSION_NS_LIMIT    (2.0)       /* seconds of stamp offset an int32 of ns holds */
+
+/* What the callback hands the writer through the ring, ahead of the samples. */
+typedef struct
+{
+    uint32_t    frames;
+    uint32_t    flags;
+    uint32_t    dropped;
+    uint32_t    reserved;
+    double      adc;
+    double      current;
+    double      dac;
+}
+sessionBlock;
+
+#define BLOCK_WORDS     ((sizeof(sessionBlock) + sizeof(short) - 1) / sizeof(short))
+
+/* The fixed 16 bytes of a record on disk. */
+typedef struct
+{
+    uint16_t    frames;
+    uint16_t    flags;
+    int32_t     adcNs;
+    int32_t     currentNs;
+    int32_t     dacNs;
+}
+sessionRecordHeader;
+
+static void sleepSeconds(double seconds)
+{
+#ifdef _WIN32
+    Sleep((DWORD)(seconds * 1000.0));
+#else
+    struct timespec ts = { (time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9) };
+    nanosleep(&ts, NULL);
+#endif
+}
+
+/*------ RECORDER ------*/
+
+static int writeAll(sessionRecorder *r, const void *data, size_t bytes)
+{
+    r->stats.bytes += bytes;
+    return fwrite(data, 1, bytes, r->file) == bytes ? 0 : -1;
+}
+
+/* Stamp offsets from the prediction, or absolute stamps when they do not fit. */
+static void writeRecord(sessionRecorder *r, const sessionBlock *b, const short *samples)
+{
+    double step = (double)r->lastFrames / r->sampleRate;
+    double adc = r->lastAdc + step, current = r->lastCurrent + step, dac = r->lastDac + step;
+    sessionRecordHeader h = { (uint16_t)b->frames, (uint16_t)(b->flags & SESSION_FLAGS), 0, 0, 0 };
+
+    if(!r->started || fabs(b->adc - adc) >= SESSION_NS_LIMIT || fabs(b->current - current) >= SESSION_NS_LIMIT
+       || fabs(b->dac - dac) >= SESSION_NS_LIMIT)
+    {
+        h.flags |= SESSION_ABSOLUTE;
+        adc = b->adc;
+        current = b->current;
+        dac = b->dac;
+    }
+    else
+    {
+        h.adcNs = (int32_t)lrint((b->adc - adc) * 1e9);
+        h.currentNs = (int32_t)lrint((b->current - current) * 1e9);
+        h.dacNs = (int32_t)lrint((b->dac - dac) * 1e9);
+        adc += h.adcNs * 1e-9;
+        current += h.currentNs * 1e-9;
+        dac += h.dacNs * 1e-9;
+    }
+    h.flags |= b->dropped > 0 ? SESSION_DROPPED : 0;
+
+    writeAll(r, &h, sizeof(h));
+    if(b->dropped > 0)
+    {
+        writeAll(r, &b->dropped, sizeof(b->dropped));
+    }
+    if(h.flags & SESSION_ABSOLUTE)
+    {
+        double stamps[3] = { adc, current, dac };
+        writeAll(r, stamps, sizeof(stamps));
+    }
+    writeAll(r, samples, b->frames * r->channels * sizeof(short));
+
+    /* Predict from what the reader will reconstruct, so rounding never accumulates. */
+    r->lastAdc = adc;
+    r->lastCurrent = current;
+    r->lastDac = dac;
+    r->lastFrames = (long)b->frames;
+    r->started = 1;
+    r->stats.blocks++;
+    r->stats.frames += b->frames;
+}
+
+static void *recordWriter(void *arg)
+{
+    sessionRecorder *r = (sessionRecorder *)arg;
+    short *samples = (short *)memAlloc((size_t)SESSION_MAX_FRAMES * r->channels * sizeof(short));
+    short words[BLOCK_WORDS];
+
+    for(;;)
+    {
+        int running = atomicLoad(&r->running);
+        if(samples == NULL || sampleRingAvailable(&r->ring) < BLOCK_WORDS)
+        {
+            if(!running)
+            {
+                break;
+            }
+            sleepSeconds(SESSION_IDLE_MS / 1000.0);
+            continue;
+        }
+
+        sessionBlock b;
+        sampleRingRead(&r->ring, words, BLOCK_WORDS);
+        memcpy(&b, words, sizeof(b));
+
+        /* The samples follow the header immediately; wait for the callback to finish copying them. */
+        size_t need = b.frames * r->channels, got = 0;
+        while(got < need)
+        {
+            size_t n = sampleRingRead(&r->ring, samples + got, need - got);
+            got += n;
+            if(n == 0)
+            {
+                sleepSeconds(SESSION_IDLE_MS / 1000.0);
+            }
+        }
+        writeRecord(r, &b, samples);
+    }
+    fflush(r->file);
+    memFree(samples);
+    return NULL;
+}
+
+int sessionRecordOpen(sessionRecorder *r, const char *path, int sampleRate, int channels)
+{
+    memset(r, 0, sizeof(*r));
+    r->sampleRate = sampleRate;
+    r->channels = channels;
+    r->file = fopen(path, "wb");
+    if(r->file == NULL)
+    {
+        return -1;
+    }
+    sessionFileHeader h = { SESSION_MAGIC, SESSION_VERSION, (uint32_t)sampleRate, (uint32_t)channels };
+    if(writeAll(r, &h, sizeof(h)) != 0 || sampleRingInit(&r->ring, SESSION_RING) != 0)
+    {
+        fclose(r->file);
+        r->file = NULL;
+        return -1;
+    }
+    atomicStore(&r->running, 1);
+    if(pthread_create(&r->writer, NULL, recordWriter, r) != 0)
+    {
+        sampleRingFree(&r->ring);
+        fclose(r->file);
+        r->file = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void sessionRecord(sessionRecorder *r, const void *input, unsigned long frames,
+                   const PaStreamCallbackTimeInfo *timeInfo, PaStreamCallbackFlags statusFlags)
+{
+    static const short silence[256];
+    const short *in = (const short *)input;
+    double offset = 0.0;
+
+    while(frames > 0)
+    {
+        unsigned long n = frames < SESSION_MAX_FRAMES ? frames : SESSION_MAX_FRAMES;
+        size_t count = n * r->channels;
+        if(sampleRingSpace(&r->ring) < BLOCK_WORDS + count)
+        {
+            r->pendingDrop += n;
+            atomicAddRelaxed(&r->stats.droppedFrames, n);
+        }
+        else
+        {
+            sessionBlock b = { (uint32_t)n, (uint32_t)statusFlags, (uint32_t)r->pendingDrop, 0, 0.0, 0.0, 0.0 };
+            if(timeInfo != NULL)
+            {
+                b.adc = timeInfo->inputBufferAdcTime + offset;
+                b.current = timeInfo->currentTime + offset;
+                b.dac = timeInfo->outputBufferDacTime + offset;
+            }
+            short words[BLOCK_WORDS];
+            memcpy(words, &b, sizeof(b));
+            sampleRingWrite(&r->ring, words, BLOCK_WORDS);
+            for(size_t done = 0; done < count; )
+            {
+                size_t k = count - done < 256 ? count - done : 256;
+                sampleRingWrite(&r->ring, in != NULL ? in + done : silence, k);
+                done += k;
+            }
+            r->pendingDrop = 0;
+        }
+        if(in != NULL)
+        {
+            in += count;
+        }
+        frames -= n;
+        offset += (double)n / r->sampleRate;
+    }
+}
+
+void sessionRecordClose(sessionRecorder *r)
+{
+    if(r->file == NULL)
+    {
+        return;
+    }
+    atomicStore(&r->running, 0);
+    pthread_join(r->writer, NULL);
+    fclose(r->file);
+    r->file = NULL;
+    sampleRingFree(&r->ring);
+}
+
+/*------ REPLAY ------*/
+
+int sessionReplayOpen(sessionReplay *p, const char *path)
+{
+    memset(p, 0, sizeof(*p));
+    p->file = fopen(path, "rb");
+    if(p->file == NULL)
+    {
+        return -1;
+    }
+    if(fread(&p->header, sizeof(p->header), 1, p->file) != 1 || p->header.magic != SESSION_MAGIC
+       || p->header.version != SESSION_VERSION || p->header.sampleRate == 0
+       || p->header.channels == 0 || p->header.channels > 64)
+    {
+        fclose(p->file);
+        p->file = NULL;
+        return -1;
+    }
+    p->samples = (short *)memCalloc((size_t)SESSION_MAX_FRAMES * p->header.channels, sizeof(short));
+    p->silence = (short *)memCalloc((size_t)SESSION_MAX_FRAMES * p->header.channels, sizeof(short));
+    if(p->samples == NULL || p->silence == NULL)
+    {
+        memFree(p->samples);
+        memFree(p->silence);
+        fclose(p->file);
+        p->file = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Waits for the block's turn, then runs the callback on it; returns the callback's result. */
+static int feed(sessionReplay *p, const short *samples, unsigned long frames, double due,
+                const PaStreamCallbackTimeInfo *timeInfo, PaStreamCallbackFlags flags, double start)
+{
+    if(p->speed > 0.0)
+    {
+        double target = start + due / p->speed;
+        double wait = target - clockNow();
+        if(wait > 0.0)
+        {
+            sleepSeconds(wait);
+        }
+        double late = clockNow() - target;
+        p->stats.lateSeconds = late > p->stats.lateSeconds ? late : p->stats.lateSeconds;
+    }
+
+    double before = clockNow();
+    int result = p->callback(samples, NULL, frames, timeInfo, flags, p->userData);
+    double took = clockNow() - before;
+
+    p->stats.callbacks++;
+    p->stats.seconds += took;
+    p->stats.maxSeconds = took > p->stats.maxSeconds ? took : p->stats.maxSeconds;
+    if(took > (double)frames / p->header.sampleRate)
+    {
+        p->stats.overBudget++;
+    }
+    return result;
+}
+
+static void *replayThread(void *arg)
+{
+    sessionReplay *p = (sessionReplay *)arg;
+    double rate = p->header.sampleRate;
+    double start = clockNow();
+    double adc = 0.0, current = 0.0, dac = 0.0, first = 0.0;
+    int stamped = -1;
+    long lastFrames = 0;
+    unsigned long fed = 0;
+    int result = paContinue;
+
+    while(result == paContinue && !atomicLoad(&p->stop))
+    {
+        sessionRecordHeader h;
+        if(fread(&h, sizeof(h), 1, p->file) != 1)
+        {
+            break;
+        }
+        uint32_t dropped = 0;
+        if((h.flags & SESSION_DROPPED) && fread(&dropped, sizeof(dropped), 1, p->file) != 1)
+        {
+            break;
+        }
+        double step = lastFrames / rate;
+        if(h.flags & SESSION_ABSOLUTE)
+        {
+            double stamps[3];
+            if(fread(stamps, sizeof(stamps), 1, p->file) != 1)
+            {
+                break;
+            }
+            adc = stamps[0];
+            current = stamps[1];
+            dac = stamps[2];
+        }
+        else
+        {
+            adc += step + h.adcNs * 1e-9;
+            current += step + h.currentNs * 1e-9;
+            dac += step + h.dacNs * 1e-9;
+        }
+        size_t count = (size_t)h.frames * p->header.channels;
+        if(h.frames > SESSION_MAX_FRAMES || fread(p->samples, sizeof(short), count, p->file) != count)
+        {
+            break;
+        }
+
+        /* Hosts without timestamps record zeros; those sessions are paced by the sample clock. */
+        if(stamped < 0)
+        {
+            stamped = current != 0.0 || adc != 0.0;
+            first = current - dropped / rate;
+        }
+        double shift = start - first;
+
+        /* Frames the recorder lost come back as flagged silence, just ahead of this block. */
+        while(dropped > 0 && result == paContinue)
+        {
+            unsigned long n = dropped < SESSION_MAX_FRAMES ? dropped : SESSION_MAX_FRAMES;
+            double back = dropped / rate;
+            PaStreamCallbackTimeInfo ti = { 0.0, 0.0, 0.0 };
+            if(stamped)
+            {
+                ti.currentTime = current - back + shift;
+                ti.inputBufferAdcTime = adc - back + shift;
+                ti.outputBufferDacTime = dac - back + shift;
+            }
+            result = feed(p, p->silence, n, stamped ? current - back - first : fed / rate, &ti,
+                          paInputOverflow, start);
+            fed += n;
+            dropped -= (uint32_t)n;
+        }
+        if(result != paContinue)
+        {
+            break;
+        }
+
+        PaStreamCallbackTimeInfo ti = { 0.0, 0.0, 0.0 };
+        if(stamped)
+        {
+            ti.currentTime = current + shift;
+            ti.inputBufferAdcTime = adc + shift;
+            ti.outputBufferDacTime = dac + shift;
+        }
+        result = feed(p, p->samples, h.frames, stamped ? current - first : fed / rate, &ti,
+                      h.flags & SESSION_FLAGS, start);
+        fed += h.frames;
+        lastFrames = h.frames;
+    }
+    atomicStore(&p->active, 0);
+    if(p->finished != NULL)
+    {
+        p->finished(p->userData);
+    }
+    return NULL;
+}
+
+PaError sessionReplayStart(sessionReplay *p, PaStreamCallback *callback, void *userData, double speed)
+{
+    p->callback = callback;
+    p->userData = userData;
+    p->speed = speed;
+    atomicStore(&p->active, 1);
+    if(pthread_create(&p->thread, NULL, replayThread, p) != 0)
+    {
+        atomicStore(&p->active, 0);
+        return paInsufficientMemory;
+    }
+    p->joinable = 1;
+    return paNoError;
+}
+
+void sessionReplaySetFinished(sessionReplay *p, PaStreamFinishedCallback *finished)
+{
+    p->finished = finished;
+}
+
+int sessionReplayActive(sessionReplay *p)
+{
+    return atomicLoad(&p->active);
+}
+
+void sessionReplayClose(sessionReplay *p)
+{
+    if(p->joinable)
+    {
+        atomicStore(&p->stop, 1);
+        pthread_join(p->thread, NULL);
+        p->joinable = 0;
+    }
+    if(p->file != NULL)
+    {
+        fclose(p->file);
+        p->file = NULL;
+    }
+    memFree(p->samples);
+    memFree(p->silence);
+    p->samples = NULL;
+    p->silence = NULL;
+}
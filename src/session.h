@@ -0,0 +1,119 @@
+#ifndef JARVIS_SESSION_H
+#define JARVIS_SESSION_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "../include/portaudio.h"
+#include "ring.h"
+
+/*
+ *  Record and replay of capture sessions at the callback level.
+ *
+ *  The recorder logs every input block exactly as the callback received
+ *  it: frames, samples, statusFlags and the three timeInfo stamps. Like
+ *  the spool, the callback side only copies into a ring and a thread does
+ *  the file I/O. Records are 16 bytes plus samples: stamps are stored as
+ *  nanosecond offsets from the time predicted by the previous block, with
+ *  an absolute stamp only when that does not fit.
+ *
+ *  The replayer feeds a recording to any PaStreamCallback from its own
+ *  thread, with the original callback spacing (speed 1), faster (speed
+ *  > 1) or back to back (speed 0). Stamps keep their recorded spacing,
+ *  shifted onto clockNow(), so the pipeline sees the same stream clock at
+ *  any speed. Blocks the recorder had to drop come back as silence with
+ *  paInputOverflow set, which is what the pipeline would have missed.
+ */
+
+#define SESSION_MAGIC       (0x4345524Au)   /* "JREC" */
+#define SESSION_VERSION     (1)
+#define SESSION_MAX_FRAMES  (8192)          /* longer callback blocks are split */
+
+typedef struct
+{
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    sampleRate;
+    uint32_t    channels;
+}
+sessionFileHeader;
+
+typedef struct
+{
+    unsigned long   blocks;
+    unsigned long   frames;
+    unsigned long   droppedFrames;  /* ring full; replayed as silence */
+    unsigned long   bytes;
+}
+sessionStats;
+
+typedef struct
+{
+    FILE           *file;
+    int             sampleRate;
+    int             channels;
+    sampleRing      ring;           /* callback -> writer: block header words, then samples */
+    unsigned long   pendingDrop;    /* producer only */
+    double          lastAdc;        /* writer: previous block, for the stamp prediction */
+    double          lastCurrent;
+    double          lastDac;
+    long            lastFrames;
+    int             started;
+    pthread_t       writer;
+    int             running;
+    sessionStats    stats;
+}
+sessionRecorder;
+
+/* Creates path; returns -1 if it cannot be written. */
+int  sessionRecordOpen(sessionRecorder *r, const char *path, int sampleRate, int channels);
+
+/* Callback side: never blocks; timeInfo may be NULL. Input must be int16. */
+void sessionRecord(sessionRecorder *r, const void *input, unsigned long frames,
+                   const PaStreamCallbackTimeInfo *timeInfo, PaStreamCallbackFlags statusFlags);
+
+void sessionRecordClose(sessionRecorder *r);
+
+typedef struct
+{
+    unsigned long   callbacks;
+    double          seconds;        /* inside the callback */
+    double          maxSeconds;
+    unsigned long   overBudget;     /* callbacks that took longer than their audio lasts */
+    double          lateSeconds;    /* worst lag behind the requested timing */
+}
+replayStats;
+
+typedef struct
+{
+    FILE               *file;
+    sessionFileHeader   header;
+    short              *samples;
+    short              *silence;        /* stands in for dropped frames */
+    PaStreamCallback   *callback;
+    PaStreamFinishedCallback *finished;
+    void               *userData;
+    double              speed;
+    pthread_t           thread;
+    int                 joinable;
+    int                 active;
+    int                 stop;
+    replayStats         stats;
+}
+sessionReplay;
+
+int  sessionReplayOpen(sessionReplay *p, const char *path);
+
+/* Starts feeding callback on a new thread; returns paNoError or an error. */
+PaError sessionReplayStart(sessionReplay *p, PaStreamCallback *callback, void *userData, double speed);
+
+/* As Pa_SetStreamFinishedCallback: runs on the replay thread once feeding stops. Call before starting. */
+void sessionReplaySetFinished(sessionReplay *p, PaStreamFinishedCallback *finished);
+
+/* 1 while blocks are still being fed, 0 once the file ended or the callback finished. */
+int  sessionReplayActive(sessionReplay *p);
+
+/* Stops early if still running, waits for the thread, closes the file. */
+void sessionReplayClose(sessionReplay *p);
+
+#endif
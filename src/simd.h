@@ -0,0 +1,206 @@
+#ifndef JARVIS_SIMD_H
+#define JARVIS_SIMD_H
+
+#include <math.h>
+
+/*
+ *  Small float kernels shared by the DSP stages. SSE is used when the
+ *  compiler targets it, otherwise the scalar loops are used (ARM boards,
+ *  plain i386 MinGW builds). The int16 conversions need SSE2.
+ */
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define JARVIS_SSE 1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define JARVIS_SSE2 1
+#endif
+
+/* sum(a[i] * b[i]) */
+static inline float simdDot(const float *a, const float *b, int n)
+{
+    int i = 0;
+    float s = 0.0f;
+#ifdef JARVIS_SSE
+    __m128 acc = _mm_setzero_ps();
+    for(; i + 4 <= n; i += 4)
+    {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    float t[4];
+    _mm_storeu_ps(t, acc);
+    s = (t[0] + t[1]) + (t[2] + t[3]);
+#endif
+    for(; i < n; i++)
+    {
+        s += a[i] * b[i];
+    }
+    return s;
+}
+
+/* y[i] = a[i] * b[i] */
+static inline void simdMul(float *y, const float *a, const float *b, int n)
+{
+    int i = 0;
+#ifdef JARVIS_SSE
+    for(; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(y + i, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+#endif
+    for(; i < n; i++)
+    {
+        y[i] = a[i] * b[i];
+    }
+}
+
+/* y[i] += g * x[i] */
+static inline void simdMulAdd(float *y, const float *x, float g, int n)
+{
+    int i = 0;
+#ifdef JARVIS_SSE
+    __m128 vg = _mm_set1_ps(g);
+    for(; i + 4 <= n; i += 4)
+    {
+        __m128 vy = _mm_loadu_ps(y + i);
+        _mm_storeu_ps(y + i, _mm_add_ps(vy, _mm_mul_ps(vg, _mm_loadu_ps(x + i))));
+    }
+#endif
+    for(; i < n; i++)
+    {
+        y[i] += g * x[i];
+    }
+}
+
+/* y[i] = g * x[i] */
+static inline void simdScale(float *y, const float *x, float g, int n)
+{
+    int i = 0;
+#ifdef JARVIS_SSE
+    __m128 vg = _mm_set1_ps(g);
+    for(; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(y + i, _mm_mul_ps(vg, _mm_loadu_ps(x + i)));
+    }
+#endif
+    for(; i < n; i++)
+    {
+        y[i] = g * x[i];
+    }
+}
+
+/* sum(x[i]^2) */
+static inline float simdEnergy(const float *x, int n)
+{
+    return simdDot(x, x, n);
+}
+
+/* y[i] = x[i] / 32768 */
+static inline void simdFromInt16(float *y, const short *x, int n)
+{
+    int i = 0;
+#ifdef JARVIS_SSE2
+    __m128 vs = _mm_set1_ps(1.0f / 32768.0f);
+    for(; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(x + i));
+        __m128i sign = _mm_srai_epi16(v, 15);
+        _mm_storeu_ps(y + i, _mm_mul_ps(vs, _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, sign))));
+        _mm_storeu_ps(y + i + 4, _mm_mul_ps(vs, _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, sign))));
+    }
+#endif
+    for(; i < n; i++)
+    {
+        y[i] = x[i] * (1.0f / 32768.0f);
+    }
+}
+
+/* Dither state for simdQuantize: one xorshift generator per SIMD lane. */
+typedef struct
+{
+    unsigned    state[4];
+}
+simdDither;
+
+static inline void simdDitherInit(simdDither *d, unsigned seed)
+{
+    for(int i = 0; i < 4; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        d->state[i] = seed != 0 ? seed : 1;
+    }
+}
+
+/* Triangular noise in (-1, 1) LSB: the difference of two uniform 16-bit draws. */
+static inline float simdTpdf(unsigned *s)
+{
+    unsigned x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *s = x;
+    return ((float)(x >> 16) - (float)(x & 0xffff)) * (1.0f / 65536.0f);
+}
+
+#ifdef JARVIS_SSE2
+static inline __m128 simdTpdf4(__m128i *s)
+{
+    __m128i x = *s;
+    x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+    x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+    *s = x;
+    __m128 a = _mm_cvtepi32_ps(_mm_srli_epi32(x, 16));
+    __m128 b = _mm_cvtepi32_ps(_mm_and_si128(x, _mm_set1_epi32(0xffff)));
+    return _mm_mul_ps(_mm_sub_ps(a, b), _mm_set1_ps(1.0f / 65536.0f));
+}
+#endif
+
+/*
+ *  y[i] = x[i] * 32768, rounded to nearest and saturated to int16. With a
+ *  dither state TPDF noise is added before rounding, so the rounding
+ *  error stays noise instead of distortion on quiet signals; NULL rounds
+ *  plainly.
+ */
+static inline void simdQuantize(short *y, const float *x, int n, simdDither *d)
+{
+    int i = 0;
+#ifdef JARVIS_SSE2
+    const __m128 vs = _mm_set1_ps(32768.0f);
+    const __m128 lo = _mm_set1_ps(-32768.0f);
+    const __m128 hi = _mm_set1_ps(32767.0f);
+    __m128i s = d != NULL ? _mm_loadu_si128((const __m128i *)d->state) : _mm_setzero_si128();
+    for(; i + 8 <= n; i += 8)
+    {
+        __m128 a = _mm_mul_ps(vs, _mm_loadu_ps(x + i));
+        __m128 b = _mm_mul_ps(vs, _mm_loadu_ps(x + i + 4));
+        if(d != NULL)
+        {
+            a = _mm_add_ps(a, simdTpdf4(&s));
+            b = _mm_add_ps(b, simdTpdf4(&s));
+        }
+        /* Clamp first: out-of-range floats convert to INT_MIN, whatever their sign. */
+        a = _mm_min_ps(_mm_max_ps(a, lo), hi);
+        b = _mm_min_ps(_mm_max_ps(b, lo), hi);
+        _mm_storeu_si128((__m128i *)(y + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+    if(d != NULL)
+    {
+        _mm_storeu_si128((__m128i *)d->state, s);
+    }
+#endif
+    for(; i < n; i++)
+    {
+        float v = x[i] * 32768.0f;
+        if(d != NULL)
+        {
+            v += simdTpdf(&d->state[i & 3]);
+        }
+        y[i] = (short)lrintf(v > 32767.0f ? 32767.0f : (v < -32768.0f ? -32768.0f : v));
+    }
+}
+
+#endif
@@ -0,0 +1,602 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "atomics.h"
+#include "clock.h"
+#include "spool.h"
+
+#define SPOOL_RING          (1 << 17)   /* ~8 s at 16 kHz before the callback has to drop */
+#define SPOOL_CHUNK         (4096)
+#define SPOOL_IDLE_MS       (10)
+
+void spoolDefaults(spoolConfig *cfg)
+{
+    cfg->dir[0] = '\0';
+    cfg->hours = 1.0;
+    cfg->segmentSeconds = 60;
+}
+
+void spoolConfigure(spoolConfig *cfg, const config *settings)
+{
+    const char *dir = configString(settings, "spool_dir", NULL);
+    if(dir != NULL)
+    {
+        snprintf(cfg->dir, sizeof(cfg->dir), "%s", dir);
+    }
+    cfg->hours = configNumber(settings, "spool_hours", cfg->hours);
+    cfg->segmentSeconds = (int)configNumber(settings, "spool_segment_seconds", cfg->segmentSeconds);
+}
+
+/*------ FILE MAPPING ------*/
+
+static void sleepMs(int ms)
+{
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+#endif
+}
+
+static void makeDir(const char *dir)
+{
+#ifdef _WIN32
+    _mkdir(dir);
+#else
+    mkdir(dir, 0755);
+#endif
+}
+
+/* Maps path, creating and sizing it when writable; length 0 maps the whole existing file. */
+static int mapFile(spoolMap *m, const char *path, size_t length, int writable)
+{
+    memset(m, 0, sizeof(*m));
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ | (writable ? GENERIC_WRITE : 0),
+                              FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                              writable ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        return -1;
+    }
+    if(length == 0)
+    {
+        length = GetFileSize(file, NULL);
+    }
+    HANDLE mapping = length > 0 ? CreateFileMappingA(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY,
+                                                     (DWORD)((unsigned long long)length >> 32),
+                                                     (DWORD)length, NULL) : NULL;
+    void *data = mapping != NULL ? MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, length)
+                                 : NULL;
+    if(data == NULL)
+    {
+        if(mapping != NULL)
+        {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return -1;
+    }
+    m->handle = (intptr_t)file;
+    m->mapping = (intptr_t)mapping;
+#else
+    int fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if(length == 0)
+    {
+        length = (size_t)st.st_size;
+    }
+    else if(writable && (size_t)st.st_size != length && ftruncate(fd, (off_t)length) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    void *data = length > 0 ? mmap(NULL, length, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0)
+                            : MAP_FAILED;
+    if(data == MAP_FAILED)
+    {
+        close(fd);
+        return -1;
+    }
+    m->handle = fd;
+#endif
+    m->data = data;
+    m->length = length;
+    return 0;
+}
+
+static void unmapFile(spoolMap *m)
+{
+    if(m->data == NULL)
+    {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(m->data);
+    CloseHandle((HANDLE)m->mapping);
+    CloseHandle((HANDLE)m->handle);
+#else
+    munmap(m->data, m->length);
+    close((int)m->handle);
+#endif
+    m->data = NULL;
+}
+
+/* Pushes [offset, offset + length) towards the disk; wait makes it durable before returning. */
+static void syncFile(spoolMap *m, size_t offset, size_t length, int wait)
+{
+#ifdef _WIN32
+    FlushViewOfFile((char *)m->data + offset, length);
+    if(wait)
+    {
+        FlushFileBuffers((HANDLE)m->handle);
+    }
+#else
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = offset / page * page;
+    msync((char *)m->data + start, offset + length - start, wait ? MS_SYNC : MS_ASYNC);
+#endif
+}
+
+static void segmentPath(char *path, size_t size, const char *dir, uint32_t slot)
+{
+    snprintf(path, size, "%s/seg-%04u.pcm", dir, (unsigned)slot);
+}
+
+/*------ WRITER ------*/
+
+static spoolIndex *indexOf(const spool *s)
+{
+    return (spoolIndex *)s->index.data;
+}
+
+static spoolSegmentHeader *headerOf(const spool *s)
+{
+    return (spoolSegmentHeader *)s->segment.data;
+}
+
+static void syncSegment(spool *s, int wait)
+{
+    double start = clockNow();
+    if(s->segment.data != NULL)
+    {
+        uint32_t samples = atomicLoadRelaxed(&headerOf(s)->samples);
+        syncFile(&s->segment, 0, SPOOL_HEADER + samples * sizeof(short), wait);
+        spoolEntry *e = &indexOf(s)->entries[s->slot];
+        atomicStore(&e->samples, samples);
+        syncFile(&s->index, (size_t)((char *)e - (char *)s->index.data), sizeof(*e), wait);
+        s->stats.syncs++;
+    }
+    s->lastSync = clockNow();
+    double took = s->lastSync - start;
+    s->stats.maxSyncSeconds = took > s->stats.maxSyncSeconds ? took : s->stats.maxSyncSeconds;
+}
+
+static void finishSegment(spool *s)
+{
+    if(s->segment.data != NULL)
+    {
+        syncSegment(s, 1);
+        unmapFile(&s->segment);
+    }
+}
+
+static int beginSegment(spool *s)
+{
+    char path[300];
+    uint32_t slot = (uint32_t)(s->nextSequence % s->slots);
+    spoolEntry *e = &indexOf(s)->entries[slot];
+
+    /* Retire the slot first, so a crash here never pairs old samples with a new time. */
+    atomicStore(&e->sequence, 0);
+    syncFile(&s->index, (size_t)((char *)e - (char *)s->index.data), sizeof(*e), 0);
+
+    segmentPath(path, sizeof(path), s->cfg.dir, slot);
+    if(mapFile(&s->segment, path, SPOOL_HEADER + (size_t)s->capacity * sizeof(short), 1) != 0)
+    {
+        return -1;
+    }
+
+    spoolSegmentHeader *h = headerOf(s);
+    h->magic = SPOOL_MAGIC;
+    h->version = SPOOL_VERSION;
+    h->sampleRate = (uint32_t)s->sampleRate;
+    h->capacity = s->capacity;
+    h->sequence = s->nextSequence;
+    h->startTime = s->origin + (double)s->position / s->sampleRate;
+    atomicStore(&h->samples, 0);
+
+    e->startTime = h->startTime;
+    e->samples = 0;
+    atomicStore(&e->sequence, s->nextSequence);
+
+    s->slot = slot;
+    s->nextSequence++;
+    s->stats.segments++;
+    return 0;
+}
+
+static void store(spool *s, const short *samples, size_t count)
+{
+    while(count > 0)
+    {
+        if(s->segment.data == NULL || headerOf(s)->samples == s->capacity)
+        {
+            finishSegment(s);
+            if(beginSegment(s) != 0)
+            {
+                /* Disk full or gone: lose these samples but keep the timeline right. */
+                atomicAddRelaxed(&s->stats.dropped, (unsigned long)count);
+                s->position += count;
+                return;
+            }
+        }
+        spoolSegmentHeader *h = headerOf(s);
+        uint32_t used = h->samples;
+        size_t n = s->capacity - used < count ? s->capacity - used : count;
+        memcpy((char *)s->segment.data + SPOOL_HEADER + used * sizeof(short), samples, n * sizeof(short));
+        atomicStore(&h->samples, used + (uint32_t)n);
+
+        samples += n;
+        count -= n;
+        s->position += n;
+        s->stats.written += n;
+    }
+}
+
+static void *spoolWriter(void *arg)
+{
+    spool *s = (spool *)arg;
+    short chunk[SPOOL_CHUNK];
+
+    for(;;)
+    {
+        int running = atomicLoad(&s->running);
+        size_t available = sampleRingAvailable(&s->ring);
+        size_t want = available < SPOOL_CHUNK ? available : SPOOL_CHUNK;
+
+        /* Stop short of the next gap; at the gap, skip its duration and start a new segment. */
+        if(s->gapTail != atomicLoad(&s->gapHead))
+        {
+            const spoolGap *g = &s->gaps[s->gapTail & (SPOOL_GAPS - 1)];
+            size_t before = g->position - atomicLoadRelaxed(&s->ring.tail);
+            if(before == 0)
+            {
+                finishSegment(s);
+                s->position += g->samples;
+                s->stats.gaps++;
+                atomicStore(&s->gapTail, s->gapTail + 1);
+                continue;
+            }
+            want = want < before ? want : before;
+        }
+
+        if(want == 0)
+        {
+            if(!running)
+            {
+                break;
+            }
+            if(clockNow() - s->lastSync >= SPOOL_FLUSH)
+            {
+                syncSegment(s, 0);
+            }
+            sleepMs(SPOOL_IDLE_MS);
+            continue;
+        }
+
+        sampleRingRead(&s->ring, chunk, want);
+        store(s, chunk, want);
+        if(clockNow() - s->lastSync >= SPOOL_FLUSH)
+        {
+            syncSegment(s, 0);
+        }
+    }
+    finishSegment(s);
+    return NULL;
+}
+
+/*------ OPEN / PUSH / CLOSE ------*/
+
+/* Picks up numbering after a previous run, trusting segment headers over the lazily synced index. */
+static void recover(spool *s)
+{
+    spoolIndex *idx = indexOf(s);
+    s->nextSequence = 1;
+    for(uint32_t slot = 0; slot < s->slots; slot++)
+    {
+        spoolEntry *e = &idx->entries[slot];
+        if(e->sequence == 0)
+        {
+            continue;
+        }
+        s->nextSequence = e->sequence + 1 > s->nextSequence ? e->sequence + 1 : s->nextSequence;
+
+        char path[300];
+        spoolSegmentHeader h;
+        segmentPath(path, sizeof(path), s->cfg.dir, slot);
+        FILE *f = fopen(path, "rb");
+        int ok = f != NULL && fread(&h, sizeof(h), 1, f) == 1
+                 && h.magic == SPOOL_MAGIC && h.sequence == e->sequence && h.samples <= s->capacity;
+        if(f != NULL)
+        {
+            fclose(f);
+        }
+        if(!ok)
+        {
+            e->sequence = 0;
+            e->samples = 0;
+        }
+        else if(h.samples > e->samples)
+        {
+            e->samples = h.samples;
+        }
+    }
+    syncFile(&s->index, 0, s->index.length, 1);
+}
+
+int spoolOpen(spool *s, const spoolConfig *cfg, int sampleRate)
+{
+    memset(s, 0, sizeof(*s));
+    s->cfg = *cfg;
+    s->sampleRate = sampleRate;
+    s->capacity = (uint32_t)(cfg->segmentSeconds > 0 ? cfg->segmentSeconds : 60) * (uint32_t)sampleRate;
+    double slots = ceil(cfg->hours * 3600.0 * sampleRate / s->capacity);
+    s->slots = slots < 2 ? 2 : (slots > SPOOL_MAX_SLOTS ? SPOOL_MAX_SLOTS : (uint32_t)slots);
+    if(cfg->dir[0] == '\0')
+    {
+        return -1;
+    }
+
+    makeDir(cfg->dir);
+    char path[300];
+    snprintf(path, sizeof(path), "%s/index", cfg->dir);
+    if(mapFile(&s->index, path, sizeof(spoolIndex) + s->slots * sizeof(spoolEntry), 1) != 0)
+    {
+        return -1;
+    }
+
+    spoolIndex *idx = indexOf(s);
+    if(idx->magic != SPOOL_MAGIC || idx->version != SPOOL_VERSION || idx->sampleRate != (uint32_t)sampleRate
+       || idx->capacity != s->capacity || idx->slots != s->slots)
+    {
+        /* New spool, or the geometry changed: start over (old segments are simply overwritten). */
+        memset(idx, 0, s->index.length);
+        idx->magic = SPOOL_MAGIC;
+        idx->version = SPOOL_VERSION;
+        idx->sampleRate = (uint32_t)sampleRate;
+        idx->capacity = s->capacity;
+        idx->slots = s->slots;
+    }
+    recover(s);
+
+    if(sampleRingInit(&s->ring, SPOOL_RING) != 0)
+    {
+        unmapFile(&s->index);
+        return -1;
+    }
+    s->lastSync = clockNow();
+    atomicStore(&s->running, 1);
+    if(pthread_create(&s->writer, NULL, spoolWriter, s) != 0)
+    {
+        sampleRingFree(&s->ring);
+        unmapFile(&s->index);
+        return -1;
+    }
+    return 0;
+}
+
+void spoolPush(spool *s, const short *samples, long count)
+{
+    if(count <= 0)
+    {
+        return;
+    }
+    if(s->origin == 0.0)
+    {
+        /* Published to the writer by the ring's release store below. */
+        s->origin = clockWall() - (double)count / s->sampleRate;
+    }
+
+    int full = sampleRingSpace(&s->ring) < (size_t)count;
+    if(!full && s->pendingGap > 0)
+    {
+        size_t head = s->gapHead;
+        if(head - atomicLoad(&s->gapTail) < SPOOL_GAPS)
+        {
+            s->gaps[head & (SPOOL_GAPS - 1)].position = atomicLoadRelaxed(&s->ring.head);
+            s->gaps[head & (SPOOL_GAPS - 1)].samples = s->pendingGap;
+            atomicStore(&s->gapHead, head + 1);
+            s->pendingGap = 0;
+        }
+        else
+        {
+            full = 1;   /* keep the timeline exact: drop until the gap can be recorded */
+        }
+    }
+    if(full)
+    {
+        s->pendingGap += (unsigned long)count;
+        atomicAddRelaxed(&s->stats.dropped, (unsigned long)count);
+        return;
+    }
+    sampleRingWrite(&s->ring, samples, (size_t)count);
+}
+
+void spoolClose(spool *s)
+{
+    if(s->index.data == NULL)
+    {
+        return;
+    }
+    atomicStore(&s->running, 0);
+    pthread_join(s->writer, NULL);
+    syncFile(&s->index, 0, s->index.length, 1);
+    unmapFile(&s->index);
+    sampleRingFree(&s->ring);
+}
+
+/*------ READER ------*/
+
+int spoolReaderOpen(spoolReader *r, const char *dir)
+{
+    memset(r, 0, sizeof(*r));
+    snprintf(r->dir, sizeof(r->dir), "%s", dir);
+    char path[300];
+    snprintf(path, sizeof(path), "%s/index", dir);
+    if(mapFile(&r->index, path, 0, 0) != 0)
+    {
+        return -1;
+    }
+    const spoolIndex *idx = (const spoolIndex *)r->index.data;
+    if(r->index.length < sizeof(spoolIndex) || idx->magic != SPOOL_MAGIC || idx->version != SPOOL_VERSION
+       || r->index.length < sizeof(spoolIndex) + idx->slots * sizeof(spoolEntry))
+    {
+        unmapFile(&r->index);
+        return -1;
+    }
+    return 0;
+}
+
+void spoolReaderClose(spoolReader *r)
+{
+    unmapFile(&r->index);
+}
+
+int spoolReaderScan(spoolReader *r)
+{
+    const spoolIndex *idx = (const spoolIndex *)r->index.data;
+    r->used = 0;
+    for(uint32_t slot = 0; slot < idx->slots && slot < SPOOL_MAX_SLOTS; slot++)
+    {
+        const spoolEntry *e = &idx->entries[slot];
+        if(atomicLoad(&e->sequence) == 0 || atomicLoad(&e->samples) == 0)
+        {
+            continue;
+        }
+        /* Insertion sort by sequence; slots are already a rotation of that order. */
+        int at = r->used++;
+        while(at > 0 && idx->entries[r->order[at - 1]].sequence > e->sequence)
+        {
+            r->order[at] = r->order[at - 1];
+            at--;
+        }
+        r->order[at] = (int)slot;
+    }
+    return r->used;
+}
+
+double spoolReaderFirst(const spoolReader *r)
+{
+    const spoolIndex *idx = (const spoolIndex *)r->index.data;
+    return r->used > 0 ? idx->entries[r->order[0]].startTime : 0.0;
+}
+
+double spoolReaderLast(const spoolReader *r)
+{
+    const spoolIndex *idx = (const spoolIndex *)r->index.data;
+    if(r->used == 0)
+    {
+        return 0.0;
+    }
+    const spoolEntry *e = &idx->entries[r->order[r->used - 1]];
+    return e->startTime + (double)e->samples / idx->sampleRate;
+}
+
+long spoolReadAt(spoolReader *r, double from, short *out, long count, double *start)
+{
+    const spoolIndex *idx = (const spoolIndex *)r->index.data;
+    double rate = idx->sampleRate;
+
+    /* Last segment starting at or before `from`. */
+    int lo = 0, hi = r->used - 1, found = -1;
+    while(lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if(idx->entries[r->order[mid]].startTime <= from)
+        {
+            found = mid;
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+    int i = found;
+    double offset = 0.0;
+    if(i >= 0)
+    {
+        const spoolEntry *e = &idx->entries[r->order[i]];
+        offset = (from - e->startTime) * rate;
+        if(offset >= e->samples)
+        {
+            i++;
+            offset = 0.0;
+        }
+    }
+    else
+    {
+        i = 0;
+    }
+
+    long copied = 0;
+    double expect = 0.0;
+    for(; i < r->used && copied < count; i++)
+    {
+        const spoolEntry *e = &idx->entries[r->order[i]];
+        if(copied > 0 && fabs(e->startTime - expect) * rate > 1.0)
+        {
+            break;      /* gap */
+        }
+
+        char path[300];
+        spoolMap m;
+        segmentPath(path, sizeof(path), r->dir, (uint32_t)r->order[i]);
+        if(mapFile(&m, path, 0, 0) != 0)
+        {
+            break;
+        }
+        const spoolSegmentHeader *h = (const spoolSegmentHeader *)m.data;
+        uint32_t held = m.length >= SPOOL_HEADER ? atomicLoad(&h->samples) : 0;
+        long skip = (long)offset;
+        if(m.length < SPOOL_HEADER || h->sequence != e->sequence
+           || m.length < SPOOL_HEADER + held * sizeof(short) || skip >= (long)held)
+        {
+            unmapFile(&m);
+            break;
+        }
+        long n = (long)held - skip < count - copied ? (long)held - skip : count - copied;
+        memcpy(out + copied, (const char *)m.data + SPOOL_HEADER + skip * sizeof(short), n * sizeof(short));
+        if(copied == 0 && start != NULL)
+        {
+            *start = e->startTime + skip / rate;
+        }
+        copied += n;
+        expect = e->startTime + held / rate;
+        offset = 0.0;
+        unmapFile(&m);
+    }
+    return copied;
+}
@@ -0,0 +1,172 @@
+#ifndef JARVIS_SPOOL_H
+#define JARVIS_SPOOL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "config.h"
+#include "ring.h"
+
+/*
+ *  Crash-safe spool of everything the microphone hears.
+ *
+ *  Audio goes to a directory of fixed-size, memory-mapped segment files
+ *  (seg-NNNN.pcm, int16 mono after a small header) reused round-robin,
+ *  so the spool holds the last `spool_hours` and never grows. An index
+ *  file maps each slot to its sequence number, wall-clock start time and
+ *  sample count, which makes seeking to a timestamp a binary search.
+ *
+ *  The capture callback only copies into a lock-free ring; a background
+ *  thread moves the ring into the mapped segment, publishes the committed
+ *  sample count in the segment header, and syncs segment and index every
+ *  SPOOL_FLUSH seconds and whenever a segment fills. After a crash the
+ *  spool keeps everything up to the last sync (up to the last write if
+ *  only the process died) and numbering continues where it left off.
+ *  Samples the writer could not keep up with are dropped and recorded as
+ *  a gap: the next sample starts a new segment at its true time.
+ */
+
+#define SPOOL_MAGIC         (0x4C50534Au)       /* "JSPL" */
+#define SPOOL_VERSION       (1)
+#define SPOOL_HEADER        (64)                /* bytes before the samples of a segment */
+#define SPOOL_FLUSH         (1.0)               /* seconds between syncs */
+#define SPOOL_MAX_SLOTS     (4096)
+#define SPOOL_GAPS          (64)                /* pending drop records, power of two */
+
+/* Config keys: spool_dir (empty = off), spool_hours, spool_segment_seconds. */
+typedef struct
+{
+    char        dir[256];
+    double      hours;
+    int         segmentSeconds;
+}
+spoolConfig;
+
+void spoolDefaults(spoolConfig *cfg);
+void spoolConfigure(spoolConfig *cfg, const config *settings);
+
+/* On-disk layouts, host byte order. */
+typedef struct
+{
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    sampleRate;
+    uint32_t    capacity;       /* samples per segment */
+    uint64_t    sequence;       /* 0 = slot never used */
+    double      startTime;      /* wall clock of the first sample */
+    uint32_t    samples;        /* committed; written after the samples themselves */
+}
+spoolSegmentHeader;
+
+typedef struct
+{
+    uint64_t    sequence;
+    double      startTime;
+    uint32_t    samples;
+    uint32_t    reserved;
+}
+spoolEntry;
+
+typedef struct
+{
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    sampleRate;
+    uint32_t    capacity;
+    uint32_t    slots;
+    uint32_t    reserved;
+    spoolEntry  entries[];
+}
+spoolIndex;
+
+/* A mapped file; handle is a HANDLE on Windows. */
+typedef struct
+{
+    void       *data;
+    size_t      length;
+    intptr_t    handle;
+    intptr_t    mapping;
+}
+spoolMap;
+
+typedef struct
+{
+    unsigned long   written;        /* samples committed to segments */
+    unsigned long   dropped;        /* samples lost because the ring was full */
+    unsigned long   gaps;
+    unsigned long   segments;       /* segments started */
+    unsigned long   syncs;
+    double          maxSyncSeconds;
+}
+spoolStats;
+
+typedef struct
+{
+    size_t          position;       /* ring stream position of the first sample after the gap */
+    unsigned long   samples;
+}
+spoolGap;
+
+typedef struct
+{
+    spoolConfig     cfg;
+    int             sampleRate;
+    uint32_t        capacity;
+    uint32_t        slots;
+
+    sampleRing      ring;           /* callback -> writer */
+    spoolGap        gaps[SPOOL_GAPS];
+    size_t          gapHead;        /* producer */
+    size_t          gapTail;        /* writer */
+    unsigned long   pendingGap;     /* producer only */
+    double          origin;         /* wall clock of stream sample 0, set by the first push */
+
+    spoolMap        index;
+    spoolMap        segment;        /* current segment, or data == NULL */
+    uint32_t        slot;
+    uint64_t        nextSequence;
+    uint64_t        position;       /* samples since origin, gaps included */
+    double          lastSync;
+
+    pthread_t       writer;
+    int             running;
+    spoolStats      stats;
+}
+spool;
+
+/* Opens (or recovers) the spool in cfg->dir; returns -1 if it cannot. */
+int  spoolOpen(spool *s, const spoolConfig *cfg, int sampleRate);
+
+/* Callback side: never blocks, never allocates. */
+void spoolPush(spool *s, const short *samples, long count);
+
+/* Drains the ring, syncs, and unmaps everything. */
+void spoolClose(spool *s);
+
+/* Read side, usable from another process while the spool is being written. */
+typedef struct
+{
+    char            dir[256];
+    spoolMap        index;
+    int             order[SPOOL_MAX_SLOTS];     /* used slots, oldest first */
+    int             used;
+}
+spoolReader;
+
+int  spoolReaderOpen(spoolReader *r, const char *dir);
+void spoolReaderClose(spoolReader *r);
+
+/* Re-reads the index; returns the number of segments holding audio. */
+int  spoolReaderScan(spoolReader *r);
+
+/* Oldest and newest wall-clock times held, after a scan. */
+double spoolReaderFirst(const spoolReader *r);
+double spoolReaderLast(const spoolReader *r);
+
+/*
+ *  Copies up to count samples starting at wall-clock time `from` (or the
+ *  first sample after it); stops at a gap. *start receives the time of
+ *  out[0]. Returns the samples copied, 0 if nothing is held there.
+ */
+long spoolReadAt(spoolReader *r, double from, short *out, long count, double *start);
+
+#endif
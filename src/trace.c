@@ -0,0 +1,319 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "clock.h"
+#include "mempool.h"
+#include "trace.h"
+
+int traceOn;
+__thread traceRing *traceLocal;
+
+/* Everything below is only changed under lock, outside the hot path. */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static traceFileName names[TRACE_MAX_NAMES];       /* 0 is the empty name */
+static int nameCount = 1;
+static traceRing *rings[TRACE_MAX_THREADS];
+static int ringCount;
+static int idleCount;                               /* rings whose thread has exited */
+static uint32_t threadCount;
+static pthread_key_t ringKey;                       /* releases a thread's ring when it exits */
+static unsigned long ringEvents;
+static uint64_t originStamp;
+static double originClock;
+
+/*------ RECORDING ------*/
+
+/* Thread-exit destructor: the ring keeps its events, for dumps, until another thread takes it over. */
+static void traceRelease(void *ring)
+{
+    traceRing *r = (traceRing *)ring;
+    pthread_mutex_lock(&lock);
+    r->idle = 1;
+    atomicStore(&idleCount, idleCount + 1);
+    pthread_mutex_unlock(&lock);
+}
+
+void traceStart(unsigned long eventsPerThread)
+{
+    pthread_mutex_lock(&lock);
+    if(ringEvents == 0)
+    {
+        unsigned long size = 1;
+        while(size < eventsPerThread)
+        {
+            size <<= 1;
+        }
+        ringEvents = size;
+        pthread_key_create(&ringKey, traceRelease);
+        originClock = clockNow();
+        originStamp = traceStamp();
+    }
+    pthread_mutex_unlock(&lock);
+    atomicStore(&traceOn, 1);
+}
+
+void traceStop(void)
+{
+    atomicStore(&traceOn, 0);
+}
+
+uint16_t traceName(const char *name)
+{
+    uint16_t id = 0;
+    pthread_mutex_lock(&lock);
+    for(int i = 1; i < nameCount && id == 0; i++)
+    {
+        if(strncmp(names[i].text, name, TRACE_NAME_MAX - 1) == 0)
+        {
+            id = (uint16_t)i;
+        }
+    }
+    if(id == 0 && nameCount < TRACE_MAX_NAMES)
+    {
+        snprintf(names[nameCount].text, TRACE_NAME_MAX, "%s", name);
+        id = (uint16_t)nameCount++;
+    }
+    pthread_mutex_unlock(&lock);
+    return id;
+}
+
+traceRing *traceAttach(void)
+{
+    if(atomicLoadRelaxed(&ringCount) >= TRACE_MAX_THREADS && atomicLoadRelaxed(&idleCount) == 0)
+    {
+        return NULL;
+    }
+    pthread_mutex_lock(&lock);
+    traceRing *r = NULL;
+    for(int i = 0; i < ringCount && idleCount > 0 && r == NULL; i++)
+    {
+        if(rings[i]->idle)
+        {
+            r = rings[i];
+            r->idle = 0;
+            r->threadName = 0;
+            atomicStore(&r->head, 0);
+            atomicStore(&idleCount, idleCount - 1);
+        }
+    }
+    if(r == NULL && ringCount < TRACE_MAX_THREADS && ringEvents > 0)
+    {
+        r = (traceRing *)memCalloc(1, sizeof(traceRing));
+        if(r != NULL && (r->events = (traceEvent *)memCalloc(ringEvents, sizeof(traceEvent))) == NULL)
+        {
+            memFree(r);
+            r = NULL;
+        }
+        if(r != NULL)
+        {
+            r->mask = ringEvents - 1;
+            rings[ringCount] = r;
+            atomicStore(&ringCount, ringCount + 1);
+        }
+    }
+    if(r != NULL)
+    {
+        r->thread = ++threadCount;
+        pthread_setspecific(ringKey, r);
+    }
+    pthread_mutex_unlock(&lock);
+    traceLocal = r;
+    return r;
+}
+
+void traceThread(const char *name)
+{
+    if(!atomicLoadRelaxed(&traceOn))
+    {
+        return;
+    }
+    traceRing *r = traceLocal != NULL ? traceLocal : traceAttach();
+    if(r != NULL)
+    {
+        atomicStoreRelaxed(&r->threadName, traceName(name));
+    }
+}
+
+/*------ DUMP ------*/
+
+/* Copies the events of r still intact, oldest first; returns how many. */
+static unsigned long snapshot(traceRing *r, traceEvent *out, unsigned long *written)
+{
+    unsigned long size = r->mask + 1;
+    unsigned long head = atomicLoad(&r->head);
+    unsigned long first = head > size ? head - size : 0;
+    for(unsigned long i = first; i < head; i++)
+    {
+        out[i - first] = r->events[i & r->mask];
+    }
+    /* Whatever the writer reached meanwhile may have overwritten the oldest copies. */
+    atomicFence();
+    unsigned long now = atomicLoad(&r->head);
+    unsigned long intact = now >= size ? now - size + 1 : 0;
+    unsigned long skip = intact > first ? intact - first : 0;
+    skip = skip < head - first ? skip : head - first;
+    memmove(out, out + skip, (head - first - skip) * sizeof(traceEvent));
+    *written = head;
+    return head - first - skip;
+}
+
+int traceDump(const char *path, traceStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    FILE *f = fopen(path, "wb");
+    pthread_mutex_lock(&lock);
+    traceEvent *buffer = ringEvents > 0 ? (traceEvent *)memAlloc(ringEvents * sizeof(traceEvent)) : NULL;
+    if(f == NULL || buffer == NULL)
+    {
+        pthread_mutex_unlock(&lock);
+        memFree(buffer);
+        if(f != NULL)
+        {
+            fclose(f);
+        }
+        return -1;
+    }
+
+    double elapsed = clockNow() - originClock;
+    uint64_t stamp = traceStamp();
+    traceFileHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = TRACE_MAGIC;
+    h.version = TRACE_VERSION;
+    h.ticksPerSecond = elapsed > 0.0 ? (double)(stamp - originStamp) / elapsed : 1e9;
+    h.origin = originStamp;
+    h.nameCount = (uint32_t)nameCount;
+    h.ringCount = (uint32_t)ringCount;
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(names, sizeof(traceFileName), nameCount, f) == (size_t)nameCount;
+
+    for(int i = 0; i < ringCount && ok; i++)
+    {
+        traceFileRing fr;
+        memset(&fr, 0, sizeof(fr));
+        unsigned long written;
+        unsigned long count = snapshot(rings[i], buffer, &written);
+        fr.thread = rings[i]->thread;
+        fr.threadName = atomicLoadRelaxed(&rings[i]->threadName);
+        fr.written = written;
+        fr.count = (uint32_t)count;
+        ok = fwrite(&fr, sizeof(fr), 1, f) == 1 && fwrite(buffer, sizeof(traceEvent), count, f) == count;
+        stats->threads++;
+        stats->events += count;
+        stats->overwritten += written - count;
+    }
+    pthread_mutex_unlock(&lock);
+    memFree(buffer);
+    ok = fclose(f) == 0 && ok;
+    return ok ? 0 : -1;
+}
+
+/*------ EXPORT ------*/
+
+static void jsonString(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for(; *s != '\0'; s++)
+    {
+        if(*s == '"' || *s == '\\')
+        {
+            fputc('\\', out);
+        }
+        if((unsigned char)*s >= 0x20)
+        {
+            fputc(*s, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/* One thread's track: its name, then its events. */
+static void exportRing(const traceFileRing *fr, const traceEvent *events, const traceFileHeader *h,
+                       const traceFileName *table, int first, FILE *out)
+{
+    static const char phases[] = { 'B', 'E', 'i', 'C' };
+    fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+            first ? "" : ",\n", fr->thread);
+    jsonString(out, fr->threadName > 0 && fr->threadName < h->nameCount ? table[fr->threadName].text : "thread");
+    fprintf(out, "}}");
+
+    /* Ends whose begin was overwritten would close spans the viewer never saw opened. */
+    long depth = 0;
+    for(uint32_t i = 0; i < fr->count; i++)
+    {
+        const traceEvent *e = &events[i];
+        if(e->kind > TRACE_COUNTER || (e->kind == TRACE_END && depth == 0))
+        {
+            continue;
+        }
+        depth += e->kind == TRACE_BEGIN ? 1 : (e->kind == TRACE_END ? -1 : 0);
+        double us = (double)(int64_t)(e->stamp - h->origin) * 1e6 / h->ticksPerSecond;
+        fprintf(out, ",\n{\"name\":");
+        jsonString(out, e->name < h->nameCount ? table[e->name].text : "?");
+        fprintf(out, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u", phases[e->kind], us, fr->thread);
+        if(e->kind == TRACE_INSTANT)
+        {
+            fprintf(out, ",\"s\":\"t\",\"args\":{\"arg\":%u}", e->arg);
+        }
+        else if(e->kind == TRACE_COUNTER)
+        {
+            fprintf(out, ",\"args\":{\"value\":%u}", e->arg);
+        }
+        fprintf(out, "}");
+    }
+}
+
+static int exportFile(FILE *f, FILE *out)
+{
+    traceFileHeader h;
+    if(fread(&h, sizeof(h), 1, f) != 1 || h.magic != TRACE_MAGIC || h.version != TRACE_VERSION
+       || h.nameCount == 0 || h.nameCount > TRACE_MAX_NAMES || h.ticksPerSecond <= 0.0)
+    {
+        return -1;
+    }
+    traceFileName table[TRACE_MAX_NAMES];
+    if(fread(table, sizeof(traceFileName), h.nameCount, f) != h.nameCount)
+    {
+        return -1;
+    }
+    for(uint32_t i = 0; i < h.nameCount; i++)
+    {
+        table[i].text[TRACE_NAME_MAX - 1] = '\0';
+    }
+
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    traceEvent *events = NULL;
+    int status = 0;
+    for(uint32_t k = 0; k < h.ringCount && status == 0; k++)
+    {
+        traceFileRing fr;
+        traceEvent *grown = NULL;
+        if(fread(&fr, sizeof(fr), 1, f) != 1
+           || (grown = (traceEvent *)memRealloc(events, ((size_t)fr.count + 1) * sizeof(traceEvent))) == NULL)
+        {
+            status = -1;
+            break;
+        }
+        events = grown;
+        if(fread(events, sizeof(traceEvent), fr.count, f) != fr.count)
+        {
+            status = -1;
+            break;
+        }
+        exportRing(&fr, events, &h, table, k == 0, out);
+    }
+    fprintf(out, "\n]}\n");
+    memFree(events);
+    return status;
+}
+
+int traceExportJson(const char *path, FILE *out)
+{
+    FILE *f = fopen(path, "rb");
+    if(f == NULL)
+    {
+        return -1;
+    }
+    int status = exportFile(f, out);
+    fclose(f);
+    return status;
+}
@@ -0,0 +1,163 @@
+#ifndef JARVIS_TRACE_H
+#define JARVIS_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "atomics.h"
+
+/*
+ *  Hot-path tracing into per-thread binary rings.
+ *
+ *  Every thread that emits an event gets its own ring on first use and
+ *  is the only writer to it: an event is a 16-byte record (timestamp,
+ *  interned name, kind, argument) stored with one release of the head,
+ *  no lock and no system call, so tracing can stay on in production.
+ *  Timestamps are the TSC where there is one (calibrated against
+ *  clockNow() at dump time), monotonic nanoseconds elsewhere. Rings
+ *  overwrite their oldest events, so a dump holds the last
+ *  eventsPerThread events of every thread: a flight recorder for the
+ *  utterance that was slow.
+ *
+ *  traceDump writes the rings to a file (also while threads keep
+ *  tracing); traceExportJson, or bin/trace_json, turns that into the
+ *  Chrome trace event format that chrome://tracing and Perfetto open.
+ */
+
+#define TRACE_MAGIC         (0x4352544Au)   /* "JTRC" */
+#define TRACE_VERSION       (1)
+#define TRACE_MAX_THREADS   (64)
+#define TRACE_MAX_NAMES     (256)
+#define TRACE_NAME_MAX      (48)
+
+typedef enum
+{
+    TRACE_BEGIN,            /* a span opens on this thread */
+    TRACE_END,              /* the innermost open span closes */
+    TRACE_INSTANT,          /* arg: e.g. an utterance id */
+    TRACE_COUNTER           /* arg: the counter's new value, e.g. a queue depth */
+}
+traceKind;
+
+typedef struct
+{
+    uint64_t    stamp;
+    uint16_t    name;
+    uint8_t     kind;
+    uint8_t     reserved;
+    uint32_t    arg;
+}
+traceEvent;
+
+/* File layout: header, nameCount names, then per ring a traceFileRing and its events, oldest first. */
+typedef struct
+{
+    uint32_t    magic;
+    uint32_t    version;
+    double      ticksPerSecond;
+    uint64_t    origin;             /* stamp at traceStart */
+    uint32_t    nameCount;
+    uint32_t    ringCount;
+}
+traceFileHeader;
+
+typedef struct
+{
+    char        text[TRACE_NAME_MAX];
+}
+traceFileName;
+
+typedef struct
+{
+    uint32_t    thread;             /* attach order, 1-based; a reused ring gets a new one */
+    uint32_t    threadName;         /* name index, 0 = unnamed */
+    uint64_t    written;            /* events ever written; the difference to count was overwritten */
+    uint32_t    count;
+    uint32_t    reserved;
+}
+traceFileRing;
+
+typedef struct
+{
+    traceEvent     *events;
+    unsigned long   mask;
+    unsigned long   head;           /* written by the owning thread only */
+    uint32_t        thread;
+    uint32_t        threadName;
+    int             idle;           /* the owning thread has exited */
+}
+traceRing;
+
+/* Read on every event; set by traceStart and traceStop. */
+extern int traceOn;
+extern __thread traceRing *traceLocal;
+
+/*
+ *  Enables tracing; rings hold eventsPerThread events (rounded up to a
+ *  power of two, fixed by the first call). At most TRACE_MAX_THREADS
+ *  threads trace at once: the ring of a thread that has exited keeps its
+ *  events until the next thread to emit takes it over.
+ */
+void     traceStart(unsigned long eventsPerThread);
+void     traceStop(void);
+
+/* Interns a name; call once per trace point, outside the hot path. 0 if the table is full. */
+uint16_t traceName(const char *name);
+
+/* Names the calling thread's track in the export. */
+void     traceThread(const char *name);
+
+/* Slow path of traceEmit: registers the calling thread's ring. */
+traceRing *traceAttach(void);
+
+typedef struct
+{
+    unsigned long   threads;
+    unsigned long   events;         /* in the file */
+    unsigned long   overwritten;    /* lost to ring wrap-around */
+}
+traceStats;
+
+/* Writes every ring to path; returns -1 if it cannot be written. */
+int      traceDump(const char *path, traceStats *stats);
+
+/* Chrome trace event JSON for a dump; returns -1 if path is not a readable trace. */
+int      traceExportJson(const char *path, FILE *out);
+
+static inline uint64_t traceStamp(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static inline void traceEmit(uint16_t name, traceKind kind, uint32_t arg)
+{
+    if(!atomicLoadRelaxed(&traceOn))
+    {
+        return;
+    }
+    traceRing *r = traceLocal;
+    if(r == NULL && (r = traceAttach()) == NULL)
+    {
+        return;
+    }
+    unsigned long head = r->head;
+    traceEvent *e = &r->events[head & r->mask];
+    e->stamp = traceStamp();
+    e->name = name;
+    e->kind = (uint8_t)kind;
+    e->arg = arg;
+    atomicStore(&r->head, head + 1);
+}
+
+#define traceBegin(name)            traceEmit((name), TRACE_BEGIN, 0)
+#define traceEnd(name)              traceEmit((name), TRACE_END, 0)
+#define traceInstant(name, arg)     traceEmit((name), TRACE_INSTANT, (uint32_t)(arg))
+#define traceCounter(name, value)   traceEmit((name), TRACE_COUNTER, (uint32_t)(value))
+
+#endif
@@ -0,0 +1,187 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mempool.h"
+#include "trim.h"
+
+#define TRIM_ABOVE_FLOOR    (3.0f)      /* ln units, as featSpeechRange */
+#define TRIM_BELOW_PEAK     (7.0f)
+#define TRIM_GUARD_BLOCKS   (5)         /* pause blocks next to speech that are never zeroed */
+
+void trimDefaults(trimConfig *cfg)
+{
+    cfg->enabled = 1;
+    cfg->padMs = 200;
+    cfg->maxPauseMs = 400;
+    cfg->quietPauses = 1;
+}
+
+void trimConfigure(trimConfig *cfg, const config *settings)
+{
+    cfg->enabled = (int)configNumber(settings, "trim", cfg->enabled);
+    cfg->padMs = (int)configNumber(settings, "trim_pad_ms", cfg->padMs);
+    cfg->maxPauseMs = (int)configNumber(settings, "trim_max_pause_ms", cfg->maxPauseMs);
+    cfg->quietPauses = (int)configNumber(settings, "trim_quiet_pauses", cfg->quietPauses);
+}
+
+static void keep(trimResult *r, const short *samples, long from, long length)
+{
+    if(length <= 0)
+    {
+        return;
+    }
+    trimSpan *last = r->spanCount > 0 ? &r->spans[r->spanCount - 1] : NULL;
+    if(last != NULL && last->original + last->length == from)
+    {
+        last->length += length;
+    }
+    else
+    {
+        trimSpan *s = &r->spans[r->spanCount++];
+        s->trimmed = r->count;
+        s->original = from;
+        s->length = length;
+    }
+    memcpy(r->samples + r->count, samples + from, length * sizeof(short));
+    r->count += length;
+}
+
+int trimUtterance(const short *samples, long count, int sampleRate, const trimConfig *cfg, trimResult *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->originalCount = count;
+    out->samples = (short *)memAlloc((count > 0 ? count : 1) * sizeof(short));
+    if(out->samples == NULL)
+    {
+        return -1;
+    }
+    if(!cfg->enabled)
+    {
+        keep(out, samples, 0, count);
+        return 0;
+    }
+
+    long block = sampleRate / 100;
+    long blocks = count / block;
+    unsigned char *speech = (unsigned char *)memCalloc(blocks > 0 ? blocks : 1, 1);
+    float *energy = (float *)memAlloc((blocks > 0 ? blocks : 1) * sizeof(float));
+    if(speech == NULL || energy == NULL)
+    {
+        memFree(speech);
+        memFree(energy);
+        trimFree(out);
+        return -1;
+    }
+
+    float lo = 0.0f, hi = 0.0f;
+    for(long b = 0; b < blocks; b++)
+    {
+        double e = 0.0;
+        for(long i = b * block; i < (b + 1) * block; i++)
+        {
+            e += (double)samples[i] * samples[i];
+        }
+        energy[b] = logf((float)(e / (32768.0 * 32768.0)) + 1e-10f);
+        lo = b == 0 || energy[b] < lo ? energy[b] : lo;
+        hi = b == 0 || energy[b] > hi ? energy[b] : hi;
+    }
+    float threshold = lo + TRIM_ABOVE_FLOOR;
+    threshold = hi - TRIM_BELOW_PEAK > threshold ? hi - TRIM_BELOW_PEAK : threshold;
+
+    long first = -1, last = -1;
+    for(long b = 0; b < blocks; b++)
+    {
+        speech[b] = hi - lo > TRIM_ABOVE_FLOOR && energy[b] > threshold;
+        if(speech[b])
+        {
+            first = first < 0 ? b : first;
+            last = b;
+        }
+    }
+    memFree(energy);
+
+    if(first < 0)
+    {
+        memFree(speech);
+        return 0;
+    }
+
+    long pad = (long)cfg->padMs * sampleRate / 1000;
+    long maxPause = (long)cfg->maxPauseMs * sampleRate / 1000;
+    long start = first * block - pad > 0 ? first * block - pad : 0;
+    long end = (last + 1) * block + pad < count ? (last + 1) * block + pad : count;
+
+    /* Walk the pauses between first and last speech, cutting the middle out of long ones. */
+    long from = start;
+    long b = first;
+    while(b <= last)
+    {
+        if(speech[b])
+        {
+            b++;
+            continue;
+        }
+        long pauseStart = b;
+        while(!speech[b])
+        {
+            b++;
+        }
+        long length = (b - pauseStart) * block;
+        if(length > maxPause && out->spanCount < TRIM_MAX_SPANS - 1)
+        {
+            keep(out, samples, from, pauseStart * block + maxPause / 2 - from);
+            from = b * block - maxPause / 2;
+            out->pausesShortened++;
+        }
+    }
+    keep(out, samples, from, end - from);
+
+    /* Silence the kept pauses away from speech; FLAC codes runs of zeros almost for free. */
+    if(cfg->quietPauses)
+    {
+        for(b = first + 1; b < last; b++)
+        {
+            int nearSpeech = 0;
+            for(long g = b - TRIM_GUARD_BLOCKS; g <= b + TRIM_GUARD_BLOCKS && !nearSpeech; g++)
+            {
+                nearSpeech = g >= first && g <= last && speech[g] == 1;
+            }
+            speech[b] = nearSpeech ? speech[b] : 2;
+        }
+        for(int s = 0; s < out->spanCount; s++)
+        {
+            const trimSpan *span = &out->spans[s];
+            for(long o = span->original; o < span->original + span->length; o++)
+            {
+                long ob = o / block;
+                if(ob < blocks && speech[ob] == 2)
+                {
+                    out->samples[span->trimmed + (o - span->original)] = 0;
+                }
+            }
+        }
+    }
+
+    memFree(speech);
+    return 0;
+}
+
+void trimFree(trimResult *r)
+{
+    memFree(r->samples);
+    r->samples = NULL;
+    r->count = 0;
+}
+
+long trimToOriginal(const trimResult *r, long trimmedSample)
+{
+    for(int s = 0; s < r->spanCount; s++)
+    {
+        const trimSpan *span = &r->spans[s];
+        if(trimmedSample < span->trimmed + span->length)
+        {
+            return span->original + (trimmedSample > span->trimmed ? trimmedSample - span->trimmed : 0);
+        }
+    }
+    return r->originalCount;
+}
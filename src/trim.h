@@ -0,0 +1,62 @@
+#ifndef JARVIS_TRIM_H
+#define JARVIS_TRIM_H
+
+#include "config.h"
+
+/*
+ *  Shrinks an utterance before upload: leading and trailing silence is
+ *  cut down to a short pad, internal pauses longer than the limit are
+ *  shortened to it, and (optionally) what is left of the pauses is
+ *  replaced by digital silence, which FLAC stores in a few bytes. The
+ *  result carries a map from trimmed sample positions back to the
+ *  original recording.
+ *
+ *  Speech is found with the same floor/peak energy rule as
+ *  featSpeechRange, on 10 ms blocks of the samples themselves.
+ */
+
+#define TRIM_MAX_SPANS      (64)
+
+/* Config keys: trim, trim_pad_ms, trim_max_pause_ms, trim_quiet_pauses. */
+typedef struct
+{
+    int     enabled;
+    int     padMs;          /* kept before the first and after the last speech */
+    int     maxPauseMs;     /* longest internal pause left in */
+    int     quietPauses;    /* zero the pause samples that are kept */
+}
+trimConfig;
+
+void trimDefaults(trimConfig *cfg);
+void trimConfigure(trimConfig *cfg, const config *settings);
+
+typedef struct
+{
+    long    trimmed;        /* first sample of the span in the trimmed audio */
+    long    original;       /* ... and in the original recording */
+    long    length;
+}
+trimSpan;
+
+typedef struct
+{
+    short      *samples;    /* owned, free with trimFree */
+    long        count;
+    long        originalCount;
+    trimSpan    spans[TRIM_MAX_SPANS];
+    int         spanCount;
+    int         pausesShortened;
+}
+trimResult;
+
+/*
+ *  Returns 0 on success (count is 0 if no speech was found) or -1 if out
+ *  of memory. With trimming disabled the result is an unmodified copy.
+ */
+int  trimUtterance(const short *samples, long count, int sampleRate, const trimConfig *cfg, trimResult *out);
+void trimFree(trimResult *r);
+
+/* Maps a sample position in the trimmed audio to the original recording. */
+long trimToOriginal(const trimResult *r, long trimmedSample);
+
+#endif
@@ -0,0 +1,229 @@
+#include <string.h>
+#include "websocket.h"
+
+#define WS_GUID     "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+/*------ SHA-1 AND BASE64 ------*/
+
+static unsigned rotl(unsigned x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+/* Only ever hashes a key plus the GUID, so one call over a short message is enough. */
+static void sha1(const unsigned char *msg, size_t length, unsigned char digest[20])
+{
+    unsigned h[5] = { 0x67452301u, 0xefcdab89u, 0x98badcfeu, 0x10325476u, 0xc3d2e1f0u };
+    unsigned long long bits = (unsigned long long)length * 8;
+    size_t total = ((length + 8) / 64 + 1) * 64;
+
+    for(size_t block = 0; block < total; block += 64)
+    {
+        unsigned w[80];
+        for(int i = 0; i < 16; i++)
+        {
+            unsigned word = 0;
+            for(int j = 0; j < 4; j++)
+            {
+                size_t at = block + (size_t)i * 4 + (size_t)j;
+                unsigned char b;
+                if(at < length)
+                {
+                    b = msg[at];
+                }
+                else if(at == length)
+                {
+                    b = 0x80;
+                }
+                else if(at >= total - 8)
+                {
+                    b = (unsigned char)(bits >> (8 * (total - 1 - at)));
+                }
+                else
+                {
+                    b = 0;
+                }
+                word = (word << 8) | b;
+            }
+            w[i] = word;
+        }
+        for(int i = 16; i < 80; i++)
+        {
+            w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        unsigned a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for(int i = 0; i < 80; i++)
+        {
+            unsigned f, k;
+            if(i < 20)
+            {
+                f = (b & c) | (~b & d);
+                k = 0x5a827999u;
+            }
+            else if(i < 40)
+            {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1u;
+            }
+            else if(i < 60)
+            {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8f1bbcdcu;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6u;
+            }
+            unsigned t = rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    for(int i = 0; i < 20; i++)
+    {
+        digest[i] = (unsigned char)(h[i / 4] >> (24 - 8 * (i % 4)));
+    }
+}
+
+static void base64(const unsigned char *in, size_t length, char *out)
+{
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+    for(size_t i = 0; i < length; i += 3)
+    {
+        unsigned v = (unsigned)in[i] << 16;
+        v |= i + 1 < length ? (unsigned)in[i + 1] << 8 : 0;
+        v |= i + 2 < length ? in[i + 2] : 0;
+        out[o++] = digits[(v >> 18) & 63];
+        out[o++] = digits[(v >> 12) & 63];
+        out[o++] = i + 1 < length ? digits[(v >> 6) & 63] : '=';
+        out[o++] = i + 2 < length ? digits[v & 63] : '=';
+    }
+    out[o] = '\0';
+}
+
+/*------ HANDSHAKE ------*/
+
+void wsMakeKey(unsigned *seed, char *out)
+{
+    unsigned char nonce[16];
+    for(int i = 0; i < 16; i++)
+    {
+        *seed = *seed * 1664525u + 1013904223u;
+        nonce[i] = (unsigned char)(*seed >> 24);
+    }
+    base64(nonce, sizeof(nonce), out);
+}
+
+void wsAcceptKey(const char *key, char *out)
+{
+    unsigned char text[128];
+    unsigned char digest[20];
+    size_t n = strlen(key);
+    n = n < sizeof(text) - sizeof(WS_GUID) ? n : sizeof(text) - sizeof(WS_GUID);
+    memcpy(text, key, n);
+    memcpy(text + n, WS_GUID, sizeof(WS_GUID) - 1);
+    sha1(text, n + sizeof(WS_GUID) - 1, digest);
+    base64(digest, sizeof(digest), out);
+}
+
+/*------ FRAMES ------*/
+
+size_t wsHeader(unsigned char *out, int opcode, size_t length, const unsigned char *mask)
+{
+    size_t n = 0;
+    unsigned char maskBit = mask != NULL ? 0x80 : 0x00;
+    out[n++] = (unsigned char)(0x80 | (opcode & 0x0f));
+    if(length < 126)
+    {
+        out[n++] = (unsigned char)(maskBit | length);
+    }
+    else if(length < 65536)
+    {
+        out[n++] = (unsigned char)(maskBit | 126);
+        out[n++] = (unsigned char)(length >> 8);
+        out[n++] = (unsigned char)length;
+    }
+    else
+    {
+        out[n++] = (unsigned char)(maskBit | 127);
+        for(int i = 7; i >= 0; i--)
+        {
+            out[n++] = (unsigned char)((unsigned long long)length >> (8 * i));
+        }
+    }
+    if(mask != NULL)
+    {
+        memcpy(out + n, mask, 4);
+        n += 4;
+    }
+    return n;
+}
+
+void wsMask(unsigned char *data, size_t length, const unsigned char *mask, size_t offset)
+{
+    for(size_t i = 0; i < length; i++)
+    {
+        data[i] ^= mask[(offset + i) & 3];
+    }
+}
+
+int wsParse(const unsigned char *buf, size_t length, wsFrame *out)
+{
+    if(length < 2)
+    {
+        return 0;
+    }
+    memset(out, 0, sizeof(*out));
+    out->fin = (buf[0] & 0x80) != 0;
+    out->opcode = buf[0] & 0x0f;
+    out->masked = (buf[1] & 0x80) != 0;
+    if(buf[0] & 0x70)
+    {
+        return -1;      /* no extensions were negotiated */
+    }
+
+    size_t n = 2;
+    unsigned long long payload = buf[1] & 0x7f;
+    if(payload == 126 || payload == 127)
+    {
+        size_t bytes = payload == 126 ? 2 : 8;
+        if(length < n + bytes)
+        {
+            return 0;
+        }
+        payload = 0;
+        for(size_t i = 0; i < bytes; i++)
+        {
+            payload = (payload << 8) | buf[n++];
+        }
+    }
+    if(out->masked)
+    {
+        if(length < n + 4)
+        {
+            return 0;
+        }
+        memcpy(out->mask, buf + n, 4);
+        n += 4;
+    }
+    /* Control frames are short and never fragmented. */
+    if(out->opcode >= WS_CLOSE && (payload > 125 || !out->fin))
+    {
+        return -1;
+    }
+    out->headerLength = n;
+    out->length = payload;
+    return 1;
+}
@@ -0,0 +1,50 @@
+#ifndef JARVIS_WEBSOCKET_H
+#define JARVIS_WEBSOCKET_H
+
+#include <stddef.h>
+
+/*
+ *  The RFC 6455 pieces both ends of the streaming recognizer need: the
+ *  handshake keys and frame headers. No I/O happens here; the client
+ *  (recstream.c) runs on the event loop, the stand-in server on blocking
+ *  sockets. Fragmented messages are not used by either side.
+ */
+
+#define WS_CONTINUATION     (0x0)
+#define WS_TEXT             (0x1)
+#define WS_BINARY           (0x2)
+#define WS_CLOSE            (0x8)
+#define WS_PING             (0x9)
+#define WS_PONG             (0xa)
+
+#define WS_HEADER_MAX       (14)
+#define WS_KEY_LENGTH       (24)        /* base64 of 16 bytes */
+#define WS_ACCEPT_LENGTH    (28)        /* base64 of a SHA-1 */
+
+typedef struct
+{
+    int             fin;
+    int             opcode;
+    int             masked;
+    unsigned char   mask[4];
+    size_t          headerLength;
+    unsigned long long length;          /* payload bytes */
+}
+wsFrame;
+
+/* A fresh Sec-WebSocket-Key from seed; out holds WS_KEY_LENGTH + 1 bytes. */
+void   wsMakeKey(unsigned *seed, char *out);
+
+/* The Sec-WebSocket-Accept a server must answer key with; out holds WS_ACCEPT_LENGTH + 1 bytes. */
+void   wsAcceptKey(const char *key, char *out);
+
+/* Writes a final frame's header (a mask is required from clients, NULL from servers); returns its length. */
+size_t wsHeader(unsigned char *out, int opcode, size_t length, const unsigned char *mask);
+
+/* XORs data with mask; offset is the position of data[0] in the payload. */
+void   wsMask(unsigned char *data, size_t length, const unsigned char *mask, size_t offset);
+
+/* Parses a header from the start of buf: 1 when complete, 0 if more bytes are needed, -1 if malformed. */
+int    wsParse(const unsigned char *buf, size_t length, wsFrame *out);
+
+#endif
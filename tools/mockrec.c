@@ -0,0 +1,439 @@
+/*
+ *  Local stand-in for the speech-to-text service.
+ *
+ *  Accepts the same FLAC POST as the real endpoint and answers with a
+ *  fixed hypothesis after an injectable delay, so hedging, retries and
+ *  deadline budgets can be exercised without the network:
+ *
+ *      mockrec -p 8099 -d 80 -j 20 -s 0.05 -S 2000 -f 0.01 -t "what time is it"
+ *
+ *  -d/-j   base delay and uniform jitter in ms
+ *  -s/-S   fraction of requests that stall, and for how long (ms)
+ *  -f      fraction of requests answered with 503
+ *  -p 0    any free port; the banner says which
+ *  -r fd   once listening, write the port and a newline to fd and close
+ *          it, for a parent that must know the server is up (bench.h)
+ *
+ *  A WebSocket upgrade on any path speaks the streaming protocol of
+ *  recognizer.h instead: one more word of the text is sent as a partial
+ *  for every -P ms of audio received (300), and the final follows -F ms
+ *  after the end of the utterance (20), as from a recognizer that has
+ *  decoded everything but the last frames by then. -f fails finals.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include "../src/atomics.h"
+#include "../src/clock.h"
+#include "../src/net.h"
+#include "../src/websocket.h"
+
+#define MOCK_IO_TIMEOUT     (30.0)
+#define MOCK_IDLE_TIMEOUT   (600.0)     /* a streaming connection with nothing to say */
+#define MOCK_HEADER_MAX     (4096)
+#define MOCK_FRAME_MAX      (65536)
+
+typedef struct
+{
+    int         port;
+    int         delayMs;
+    int         jitterMs;
+    double      slowFraction;
+    int         slowMs;
+    double      failFraction;
+    double      confidence;
+    const char *text;
+    int         partialMs;
+    int         finalMs;
+    unsigned    seed;
+    unsigned long served;
+}
+mockConfig;
+
+static mockConfig config =
+{
+    .port           =   8099,
+    .delayMs        =   50,
+    .jitterMs       =   0,
+    .slowFraction   =   0.0,
+    .slowMs         =   0,
+    .failFraction   =   0.0,
+    .confidence     =   0.9,
+    .text           =   "what time is it",
+    .partialMs      =   300,
+    .finalMs        =   20,
+    .seed           =   1,
+};
+
+static double uniform(void)
+{
+    unsigned s = atomicAdd(&config.seed, 2654435761u);
+    s ^= s >> 15;
+    s *= 2246822519u;
+    s ^= s >> 13;
+    return (double)(s >> 8) / (double)(1u << 24);
+}
+
+static void sleepMs(int ms)
+{
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+/* Reads one request, keeping its header in header; returns 0 once headers and the declared body arrived. */
+static int readRequest(int fd, double deadline, char *header, size_t capacity)
+{
+    char buf[16384];
+    size_t length = 0;
+    long need = -1;
+
+    for(;;)
+    {
+        long n = netRecv(fd, buf + length, sizeof(buf) - 1 - length, deadline, NULL);
+        if(n < 0)
+        {
+            return -1;
+        }
+        length += (size_t)n;
+        buf[length] = '\0';
+
+        char *sep = strstr(buf, "\r\n\r\n");
+        if(sep != NULL && need < 0)
+        {
+            long body = 0;
+            for(const char *line = strstr(buf, "\r\n"); line != NULL && line < sep; line = strstr(line + 2, "\r\n"))
+            {
+                if(strncasecmp(line + 2, "Content-Length:", 15) == 0)
+                {
+                    body = strtol(line + 17, NULL, 10);
+                }
+            }
+            need = (long)(sep - buf) + 4 + body;
+            size_t n = (size_t)(sep - buf) + 4 < capacity - 1 ? (size_t)(sep - buf) + 4 : capacity - 1;
+            memcpy(header, buf, n);
+            header[n] = '\0';
+        }
+        if(need >= 0 && (long)length >= need)
+        {
+            return 0;
+        }
+        if(length == sizeof(buf) - 1)
+        {
+            /* Body larger than the buffer: keep only the count. */
+            if(need < 0)
+            {
+                return -1;
+            }
+            need -= (long)length;
+            length = 0;
+        }
+    }
+}
+
+/*------ STREAMING ------*/
+
+static const char *headerValue(const char *header, const char *name)
+{
+    size_t n = strlen(name);
+    for(const char *line = strstr(header, "\r\n"); line != NULL; line = strstr(line + 2, "\r\n"))
+    {
+        if(strncasecmp(line + 2, name, n) == 0 && line[2 + n] == ':')
+        {
+            const char *v = line + 3 + n;
+            while(*v == ' ')
+            {
+                v++;
+            }
+            return v;
+        }
+    }
+    return NULL;
+}
+
+static int sendFrame(int fd, int opcode, const char *payload, size_t length)
+{
+    unsigned char header[WS_HEADER_MAX];
+    size_t h = wsHeader(header, opcode, length, NULL);
+    double deadline = clockNow() + MOCK_IO_TIMEOUT;
+    if(netSendAll(fd, header, h, deadline, NULL) != NET_OK)
+    {
+        return -1;
+    }
+    return length > 0 ? netSendAll(fd, payload, length, deadline, NULL) : NET_OK;
+}
+
+/* The first words of the text, as a partial or the final hypothesis. */
+static int sendHypothesis(int fd, unsigned long id, int words, int final)
+{
+    char prefix[256];
+    const char *p = config.text;
+    int total = 0;
+    while(*p != '\0' && (words < 0 || total < words))
+    {
+        while(*p == ' ')
+        {
+            p++;
+        }
+        while(*p != '\0' && *p != ' ')
+        {
+            p++;
+        }
+        total++;
+    }
+    snprintf(prefix, sizeof(prefix), "%.*s", (int)(p - config.text), config.text);
+
+    char message[512];
+    int n;
+    if(final && uniform() < config.failFraction)
+    {
+        n = snprintf(message, sizeof(message), "{\"id\":%lu,\"final\":true,\"status\":5,\"hypotheses\":[]}", id);
+    }
+    else
+    {
+        n = snprintf(message, sizeof(message),
+                     "{\"id\":%lu,\"final\":%s,\"status\":0,\"hypotheses\":[{\"utterance\":\"%s\",\"confidence\":%.2f}]}",
+                     id, final ? "true" : "false", prefix, final ? config.confidence : config.confidence * 0.5);
+    }
+    return sendFrame(fd, WS_TEXT, message, (size_t)n);
+}
+
+static int wordCount(const char *text)
+{
+    int words = 0;
+    for(const char *p = text; *p != '\0'; p++)
+    {
+        words += *p != ' ' && (p == text || p[-1] == ' ');
+    }
+    return words;
+}
+
+/* One message from the client; returns -1 to hang up. */
+static int streamMessage(int fd, int opcode, const unsigned char *payload, size_t length,
+                         unsigned long *id, long *samples, int *sent, int *rate)
+{
+    if(opcode == WS_TEXT)
+    {
+        char text[256];
+        snprintf(text, sizeof(text), "%.*s", (int)(length < sizeof(text) ? length : sizeof(text) - 1),
+                 (const char *)payload);
+        const char *idText = strstr(text, "\"id\":");
+        unsigned long messageId = idText != NULL ? strtoul(idText + 5, NULL, 10) : 0;
+        if(strstr(text, "\"start\"") != NULL)
+        {
+            const char *rateText = strstr(text, "\"rate\":");
+            *id = messageId;
+            *samples = 0;
+            *sent = 0;
+            *rate = rateText != NULL ? atoi(rateText + 7) : 16000;
+        }
+        else if(strstr(text, "\"end\"") != NULL)
+        {
+            sleepMs(config.finalMs);
+            atomicAdd(&config.served, 1);
+            return sendHypothesis(fd, messageId, -1, 1) == NET_OK ? 0 : -1;
+        }
+    }
+    else if(opcode == WS_BINARY && *id != 0)
+    {
+        *samples += (long)(length / 2);
+        int due = (int)(*samples * 1000 / ((long)*rate * (config.partialMs > 0 ? config.partialMs : 1)));
+        int words = wordCount(config.text);
+        due = due < words ? due : words;
+        if(due > *sent)
+        {
+            *sent = due;
+            return sendHypothesis(fd, *id, due, 0) == NET_OK ? 0 : -1;
+        }
+    }
+    else if(opcode == WS_PING)
+    {
+        return sendFrame(fd, WS_PONG, (const char *)payload, length) == NET_OK ? 0 : -1;
+    }
+    else if(opcode == WS_CLOSE)
+    {
+        sendFrame(fd, WS_CLOSE, NULL, 0);
+        return -1;
+    }
+    return 0;
+}
+
+static void serveStream(int fd, const char *header)
+{
+    const char *key = headerValue(header, "Sec-WebSocket-Key");
+    char keyText[WS_KEY_LENGTH + 1];
+    char accept[WS_ACCEPT_LENGTH + 1];
+    char response[256];
+    if(key == NULL)
+    {
+        return;
+    }
+    snprintf(keyText, sizeof(keyText), "%s", key);
+    wsAcceptKey(keyText, accept);
+    int n = snprintf(response, sizeof(response),
+                     "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                     "Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+    if(netSendAll(fd, response, (size_t)n, clockNow() + MOCK_IO_TIMEOUT, NULL) != NET_OK)
+    {
+        return;
+    }
+
+    unsigned char *buf = (unsigned char *)malloc(MOCK_FRAME_MAX + WS_HEADER_MAX);
+    size_t length = 0;
+    unsigned long id = 0;
+    long samples = 0;
+    int sent = 0, rate = 16000;
+    while(buf != NULL)
+    {
+        long got = netRecv(fd, buf + length, MOCK_FRAME_MAX + WS_HEADER_MAX - length,
+                           clockNow() + MOCK_IDLE_TIMEOUT, NULL);
+        if(got <= 0)
+        {
+            break;
+        }
+        length += (size_t)got;
+
+        wsFrame f;
+        int parsed;
+        while((parsed = wsParse(buf, length, &f)) > 0 && length >= f.headerLength + f.length)
+        {
+            /* Clients always mask, and nothing here needs fragments. */
+            unsigned char *payload = buf + f.headerLength;
+            if(!f.masked || !f.fin)
+            {
+                parsed = -1;
+                break;
+            }
+            wsMask(payload, (size_t)f.length, f.mask, 0);
+            if(streamMessage(fd, f.opcode, payload, (size_t)f.length, &id, &samples, &sent, &rate) != 0)
+            {
+                parsed = -1;
+                break;
+            }
+            memmove(buf, buf + f.headerLength + f.length, length - f.headerLength - (size_t)f.length);
+            length -= f.headerLength + (size_t)f.length;
+        }
+        if(parsed < 0 || (parsed > 0 && f.length > MOCK_FRAME_MAX))
+        {
+            break;
+        }
+    }
+    free(buf);
+}
+
+/*------ REQUESTS ------*/
+
+static void *serve(void *arg)
+{
+    int fd = (int)(long)arg;
+    double deadline = clockNow() + MOCK_IO_TIMEOUT;
+    char response[1024];
+    char header[MOCK_HEADER_MAX];
+
+    if(readRequest(fd, deadline, header, sizeof(header)) != 0)
+    {
+        netClose(fd);
+        return NULL;
+    }
+    const char *upgrade = headerValue(header, "Upgrade");
+    if(upgrade != NULL && strncasecmp(upgrade, "websocket", 9) == 0)
+    {
+        serveStream(fd, header);
+    }
+    else
+    {
+        int delay = config.delayMs + (int)(uniform() * config.jitterMs);
+        if(uniform() < config.slowFraction)
+        {
+            delay += config.slowMs;
+        }
+        sleepMs(delay);
+
+        int n;
+        if(uniform() < config.failFraction)
+        {
+            n = snprintf(response, sizeof(response),
+                         "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        }
+        else
+        {
+            char body[512];
+            int bl = snprintf(body, sizeof(body),
+                              "{\"status\":0,\"id\":\"mock\",\"hypotheses\":[{\"utterance\":\"%s\",\"confidence\":%.2f}]}\n",
+                              config.text, config.confidence);
+            n = snprintf(response, sizeof(response),
+                         "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %d\r\n"
+                         "Connection: close\r\n\r\n%s", bl, body);
+        }
+        netSendAll(fd, response, (size_t)n, deadline, NULL);
+        atomicAdd(&config.served, 1);
+    }
+    netClose(fd);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int c, readyFd = -1;
+    while((c = getopt(argc, argv, "p:d:j:s:S:f:t:c:P:F:r:")) != -1)
+    {
+        switch(c)
+        {
+            case 'p': config.port = atoi(optarg); break;
+            case 'd': config.delayMs = atoi(optarg); break;
+            case 'j': config.jitterMs = atoi(optarg); break;
+            case 's': config.slowFraction = atof(optarg); break;
+            case 'S': config.slowMs = atoi(optarg); break;
+            case 'f': config.failFraction = atof(optarg); break;
+            case 't': config.text = optarg; break;
+            case 'c': config.confidence = atof(optarg); break;
+            case 'P': config.partialMs = atoi(optarg); break;
+            case 'F': config.finalMs = atoi(optarg); break;
+            case 'r': readyFd = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-p port] [-d ms] [-j ms] [-s frac] [-S ms] [-f frac] [-t text] [-c conf] [-P ms] [-F ms] [-r fd]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    netStartup();
+    int lfd = netListen("127.0.0.1", config.port, 128);
+    if(lfd < 0)
+    {
+        fprintf(stderr, "Error: cannot listen on port %d\n", config.port);
+        return 1;
+    }
+    config.port = netLocalPort(lfd);
+    printf("mockrec listening on 127.0.0.1:%d\n", config.port);
+    fflush(stdout);
+    if(readyFd >= 0)
+    {
+        char ready[16];
+        int n = snprintf(ready, sizeof(ready), "%d\n", config.port);
+        if(write(readyFd, ready, (size_t)n) != n)
+        {
+            fprintf(stderr, "Error: cannot report readiness on fd %d\n", readyFd);
+            return 1;
+        }
+        close(readyFd);
+    }
+
+    for(;;)
+    {
+        int fd = netAccept(lfd, clockNow() + 3600.0, NULL);
+        if(fd < 0)
+        {
+            continue;
+        }
+        pthread_t thread;
+        if(pthread_create(&thread, NULL, serve, (void *)(long)fd) != 0)
+        {
+            netClose(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
@@ -0,0 +1,265 @@
+/*
+ *  Runs one libjarvis session (see src/jarvis.h) per file, all in one
+ *  process, each fed from its own thread:
+ *
+ *      sessions [-c jarvis.conf] [-r] [-i] [-t out.trace] [-m port] [-b kb] file.wav ...
+ *
+ *  Files are pushed in 10 ms blocks as fast as the session takes them,
+ *  or at their real pace with -r. With -i all sessions upload through
+ *  one shared I/O thread instead of one upload thread each. Every event is printed as a JSON line
+ *  tagged with its session (partials too, with recognizer_stream set),
+ *  then one summary line per session. -t records a trace of the run
+ *  (src/trace.h) into out.trace; -m serves the metrics (src/metrics.h)
+ *  on 127.0.0.1:port/metrics while it runs. -b runs every session out of
+ *  one memory pool of kb kilobytes (src/mempool.h), as an embedded
+ *  deployment would, and prints how much of it was used.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../include/sndfile.h"
+#include "../src/clock.h"
+#include "../src/jarvis.h"
+#include "../src/mempool.h"
+#include "../src/metrics.h"
+#include "../src/trace.h"
+
+#define SAMPLE_RATE     (16000)
+#define BLOCK           (SAMPLE_RATE / 100)
+#define TRACE_EVENTS    (65536)
+
+static const char *eventNames[] = { "speech_start", "speech_end", "transcript", "intent", "partial" };
+
+typedef struct
+{
+    int                 index;
+    const char         *path;
+    const char         *configPath;
+    int                 realtime;
+    jarvisIo           *io;
+    pthread_mutex_t    *out;
+    jarvisStats         stats;
+    int                 failed;
+}
+feeder;
+
+static void onEvent(void *ctx, const jarvisEvent *e)
+{
+    feeder *f = (feeder *)ctx;
+    pthread_mutex_lock(f->out);
+    printf("{\"session\":%d,\"event\":\"%s\",\"utterance\":%lu", f->index, eventNames[e->type], e->utterance);
+    if(e->type == JARVIS_TRANSCRIPT)
+    {
+        printf(",\"status\":%d,\"text\":\"%s\",\"confidence\":%.2f,\"latency_ms\":%.1f",
+               e->status, e->text, e->confidence, e->latency * 1000.0);
+    }
+    else if(e->type == JARVIS_PARTIAL)
+    {
+        printf(",\"text\":\"%s\",\"confidence\":%.2f,\"intent\":\"%s\"", e->text, e->confidence, e->intent);
+    }
+    else if(e->type == JARVIS_INTENT)
+    {
+        printf(",\"intent\":\"%s\",\"reply\":\"%s\"", e->intent, e->text);
+    }
+    printf("}\n");
+    fflush(stdout);
+    pthread_mutex_unlock(f->out);
+}
+
+static void *feed(void *arg)
+{
+    feeder *f = (feeder *)arg;
+    char name[32];
+    snprintf(name, sizeof(name), "session %d", f->index);
+    traceThread(name);
+    SF_INFO info = { 0 };
+    SNDFILE *in = sf_open(f->path, SFM_READ, &info);
+    if(in == NULL || info.channels != 1 || info.samplerate != SAMPLE_RATE)
+    {
+        fprintf(stderr, "%s: needs mono %d Hz audio.\n", f->path, SAMPLE_RATE);
+        if(in != NULL)
+        {
+            sf_close(in);
+        }
+        f->failed = 1;
+        return NULL;
+    }
+
+    jarvisOptions options;
+    jarvisDefaults(&options);
+    options.realtime = f->realtime;
+    options.configPath = f->configPath;
+    options.onEvent = onEvent;
+    options.ctx = f;
+    options.io = f->io;
+    jarvisSession *s = jarvisCreate(&options);
+    if(s == NULL)
+    {
+        fprintf(stderr, "%s: could not create a session.\n", f->path);
+        sf_close(in);
+        f->failed = 1;
+        return NULL;
+    }
+
+    short block[BLOCK];
+    sf_count_t n;
+    double next = clockNow();
+    while((n = sf_read_short(in, block, BLOCK)) > 0)
+    {
+        jarvisPush(s, block, (long)n);
+        if(f->realtime)
+        {
+            next += (double)n / SAMPLE_RATE;
+            double wait = next - clockNow();
+            if(wait > 0.0)
+            {
+                struct timespec ts = { (time_t)wait, (long)((wait - (time_t)wait) * 1e9) };
+                nanosleep(&ts, NULL);
+            }
+        }
+    }
+    sf_close(in);
+
+    jarvisFinish(s);
+    jarvisGetStats(s, &f->stats);
+    jarvisDestroy(s);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    const char *configPath = NULL;
+    const char *tracePath = NULL;
+    int metricsPort = 0;
+    long budgetKb = 0;
+    int realtime = 0;
+    int shared = 0;
+    int first = 1;
+    for(; first < argc && argv[first][0] == '-'; first++)
+    {
+        if(strcmp(argv[first], "-c") == 0 && first + 1 < argc)
+        {
+            configPath = argv[++first];
+        }
+        else if(strcmp(argv[first], "-r") == 0)
+        {
+            realtime = 1;
+        }
+        else if(strcmp(argv[first], "-i") == 0)
+        {
+            shared = 1;
+        }
+        else if(strcmp(argv[first], "-t") == 0 && first + 1 < argc)
+        {
+            tracePath = argv[++first];
+        }
+        else if(strcmp(argv[first], "-m") == 0 && first + 1 < argc)
+        {
+            metricsPort = atoi(argv[++first]);
+        }
+        else if(strcmp(argv[first], "-b") == 0 && first + 1 < argc)
+        {
+            budgetKb = atol(argv[++first]);
+        }
+        else
+        {
+            break;
+        }
+    }
+    int count = argc - first;
+    if(count <= 0)
+    {
+        fprintf(stderr, "usage: %s [-c jarvis.conf] [-r] [-i] [-t out.trace] [-m port] [-b kb] file.wav ...\n",
+                argv[0]);
+        return 2;
+    }
+    if(budgetKb > 0 && memPoolStart((size_t)budgetKb * 1024) != 0)
+    {
+        fprintf(stderr, "Could not reserve %ld KB.\n", budgetKb);
+        return 1;
+    }
+    if(tracePath != NULL)
+    {
+        traceStart(TRACE_EVENTS);
+    }
+    metricsServer monitor;
+    if(metricsPort > 0 && metricsServe(&monitor, "127.0.0.1", metricsPort, NULL, 0.0) != 0)
+    {
+        fprintf(stderr, "Could not serve metrics on port %d.\n", metricsPort);
+        return 1;
+    }
+
+    pthread_mutex_t out;
+    pthread_mutex_init(&out, NULL);
+    feeder *feeders = (feeder *)calloc((size_t)count, sizeof(feeder));
+    pthread_t *threads = (pthread_t *)calloc((size_t)count, sizeof(pthread_t));
+    char *started = (char *)calloc((size_t)count, 1);
+    if(feeders == NULL || threads == NULL || started == NULL)
+    {
+        fprintf(stderr, "Could not allocate %d sessions.\n", count);
+        return 1;
+    }
+
+    jarvisIo *io = NULL;
+    if(shared && (io = jarvisIoCreate()) == NULL)
+    {
+        fprintf(stderr, "Could not start the I/O thread.\n");
+        return 1;
+    }
+
+    double start = clockNow();
+    for(int i = 0; i < count; i++)
+    {
+        feeders[i] = (feeder){ i, argv[first + i], configPath, realtime, io, &out, { 0 }, 0 };
+        started[i] = pthread_create(&threads[i], NULL, feed, &feeders[i]) == 0;
+        if(!started[i])
+        {
+            feeders[i].failed = 1;
+        }
+    }
+
+    int failed = 0;
+    for(int i = 0; i < count; i++)
+    {
+        if(started[i])
+        {
+            pthread_join(threads[i], NULL);
+        }
+        const jarvisStats *st = &feeders[i].stats;
+        printf("{\"session\":%d,\"file\":\"%s\",\"utterances\":%lu,\"recognized\":%lu,\"failed\":%lu,\"dropped\":%lu,"
+               "\"speculation_hits\":%lu,\"speculation_misses\":%lu,\"deferred\":%lu,\"cached\":%lu}\n", i,
+               feeders[i].path, st->utterances, st->recognized, st->failed, st->dropped, st->speculationHits,
+               st->speculationMisses, st->deferred, st->cached);
+        failed += feeders[i].failed;
+    }
+    printf("{\"sessions\":%d,\"failed\":%d,\"seconds\":%.3f}\n", count, failed, clockNow() - start);
+
+    traceStats traced;
+    if(tracePath != NULL && traceDump(tracePath, &traced) == 0)
+    {
+        printf("{\"trace\":\"%s\",\"threads\":%lu,\"events\":%lu,\"overwritten\":%lu}\n",
+               tracePath, traced.threads, traced.events, traced.overwritten);
+    }
+    if(metricsPort > 0)
+    {
+        metricsServerStop(&monitor);
+        printf("{\"metrics_port\":%d,\"scrapes\":%lu}\n", metricsPort, monitor.stats.scrapes);
+    }
+    if(memPoolActive())
+    {
+        memPoolStats pool;
+        memPoolGetStats(&pool);
+        printf("{\"memory_budget\":%lu,\"peak\":%lu,\"allocations\":%lu,\"refused\":%lu,\"peak_resident\":%lu}\n",
+               (unsigned long)pool.budget, (unsigned long)pool.peak, pool.allocations, pool.refused,
+               (unsigned long)memPeakResident());
+    }
+
+    jarvisIoDestroy(io);
+    pthread_mutex_destroy(&out);
+    free(started);
+    free(threads);
+    free(feeders);
+    return failed ? 1 : 0;
+}
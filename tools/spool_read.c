@@ -0,0 +1,85 @@
+/*
+ *  Reads audio back out of a capture spool (see src/spool.h), also while
+ *  Jarvis is still writing it:
+ *
+ *      spool_read spool/                       list segments
+ *      spool_read spool/ -30 10 out.wav        10 s starting 30 s before the newest sample
+ *      spool_read spool/ 1792000000.5 2 out.wav
+ *
+ *  A negative start is relative to the newest sample, otherwise it is
+ *  wall-clock seconds since the epoch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "../include/sndfile.h"
+#include "../src/clock.h"
+#include "../src/spool.h"
+
+static int list(spoolReader *r)
+{
+    const spoolIndex *idx = (const spoolIndex *)r->index.data;
+    for(int i = 0; i < r->used; i++)
+    {
+        const spoolEntry *e = &idx->entries[r->order[i]];
+        printf("{\"slot\":%d,\"sequence\":%llu,\"start\":%.3f,\"seconds\":%.3f}\n",
+               r->order[i], (unsigned long long)e->sequence, e->startTime, (double)e->samples / idx->sampleRate);
+    }
+    printf("{\"segments\":%d,\"first\":%.3f,\"last\":%.3f}\n", r->used, spoolReaderFirst(r), spoolReaderLast(r));
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    spoolReader *r = (spoolReader *)malloc(sizeof(spoolReader));
+    if(argc != 2 && argc != 5)
+    {
+        fprintf(stderr, "usage: %s DIR [FROM SECONDS OUT.wav]\n", argv[0]);
+        return 2;
+    }
+    if(r == NULL || spoolReaderOpen(r, argv[1]) != 0)
+    {
+        fprintf(stderr, "No spool in %s.\n", argv[1]);
+        return 1;
+    }
+    spoolReaderScan(r);
+    if(argc == 2)
+    {
+        return list(r);
+    }
+
+    const spoolIndex *idx = (const spoolIndex *)r->index.data;
+    double from = atof(argv[2]);
+    from = from < 0.0 ? spoolReaderLast(r) + from : from;
+    long count = (long)(atof(argv[3]) * idx->sampleRate);
+    short *samples = (short *)malloc((count > 0 ? count : 1) * sizeof(short));
+    if(samples == NULL)
+    {
+        fprintf(stderr, "Could not allocate %ld samples.\n", count);
+        return 1;
+    }
+
+    double seekStart = clockNow();
+    double start = 0.0;
+    long got = spoolReadAt(r, from, samples, count, &start);
+    double seek = clockNow() - seekStart;
+
+    SF_INFO info = { 0 };
+    info.samplerate = (int)idx->sampleRate;
+    info.channels = 1;
+    info.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+    SNDFILE *out = sf_open(argv[4], SFM_WRITE, &info);
+    if(out == NULL)
+    {
+        fprintf(stderr, "Not able to open output file %s.\n", argv[4]);
+        return 1;
+    }
+    sf_write_short(out, samples, got);
+    sf_close(out);
+
+    printf("{\"start\":%.3f,\"samples\":%ld,\"seconds\":%.3f,\"read_ms\":%.3f}\n",
+           start, got, (double)got / idx->sampleRate, seek * 1000.0);
+    free(samples);
+    spoolReaderClose(r);
+    free(r);
+    return got > 0 ? 0 : 1;
+}
@@ -0,0 +1,23 @@
+/*
+ *  Converts a trace dump (see src/trace.h) to the Chrome trace event
+ *  format, for chrome://tracing or https://ui.perfetto.dev:
+ *
+ *      trace_json jarvis.trace > trace.json
+ */
+#include <stdio.h>
+#include "../src/trace.h"
+
+int main(int argc, char **argv)
+{
+    if(argc != 2)
+    {
+        fprintf(stderr, "usage: %s FILE\n", argv[0]);
+        return 2;
+    }
+    if(traceExportJson(argv[1], stdout) != 0)
+    {
+        fprintf(stderr, "%s: not a readable trace.\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,310 @@
+/*
+ *  Batch transcription of recordings on the work-stealing scheduler
+ *  (see src/scheduler.h):
+ *
+ *      transcribe [-w workers] [-r host:port/path] file.wav ...
+ *
+ *  Every file becomes a chain of tasks, each submitting the next:
+ *
+ *      dsp         decode, clean-up and silence trimming
+ *      encode      FLAC
+ *      recognize   remote upload and parse, only with -r
+ *
+ *  Files of very different lengths are the normal case here; an idle
+ *  worker steals the queued files of a busy one instead of waiting. An
+ *  upload blocks its worker on the network, so with -r more workers than
+ *  cores pay off. One JSON line per file, then the scheduler's totals.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/sndfile.h"
+#include "../src/cleanup.h"
+#include "../src/clock.h"
+#include "../src/net.h"
+#include "../src/recognizer.h"
+#include "../src/scheduler.h"
+#include "../src/trim.h"
+
+#define SAMPLE_RATE     (16000)
+#define BLOCK           (256)
+#define REMOTE_TIMEOUT  (10.0)
+#define REMOTE_BUDGET   (30.0)
+
+enum { STEP_DSP, STEP_ENCODE, STEP_RECOGNIZE, STEP_COUNT };
+
+typedef struct batch batch;
+
+typedef struct
+{
+    batch          *owner;
+    const char     *path;
+    long            count;
+    trimResult      trimmed;
+    flacPayload    *payload;
+    size_t          bytes;
+    int             status;
+    recResult       result;
+    double          seconds[STEP_COUNT];
+    double          finished;
+}
+fileJob;
+
+struct batch
+{
+    scheduler       pool;
+    schedGroup      all;
+    cleanConfig     cleanCfg;
+    trimConfig      trimCfg;
+    recognizer     *remote;         /* NULL: stop after encoding */
+    volatile int    cancel;
+};
+
+/*------ TASKS ------*/
+
+static void recognizeTask(void *arg)
+{
+    fileJob *job = (fileJob *)arg;
+    batch *b = job->owner;
+    double start = clockNow();
+    httpResponse response;
+
+    job->status = recRemoteSend(b->remote, job->payload, SAMPLE_RATE, start + REMOTE_BUDGET, &b->cancel, &response);
+    if(job->status == REC_OK)
+    {
+        job->status = recRemoteParse(response.body, response.bodyLength, &job->result);
+        httpResponseFree(&response);
+    }
+    flacPayloadRelease(job->payload);
+    job->payload = NULL;
+    job->seconds[STEP_RECOGNIZE] = clockNow() - start;
+    job->finished = clockNow();
+}
+
+static void encodeTask(void *arg)
+{
+    fileJob *job = (fileJob *)arg;
+    batch *b = job->owner;
+    double start = clockNow();
+
+    job->payload = flacPayloadCreate(job->trimmed.samples, job->trimmed.count, SAMPLE_RATE);
+    job->status = job->payload != NULL ? REC_OK : REC_ERROR;
+    job->bytes = job->payload != NULL ? job->payload->buffer.length : 0;
+    job->seconds[STEP_ENCODE] = clockNow() - start;
+    job->finished = clockNow();
+
+    if(job->payload != NULL && b->remote != NULL)
+    {
+        if(schedSubmit(&b->pool, &b->all, recognizeTask, job) != 0)
+        {
+            recognizeTask(job);
+        }
+        return;
+    }
+    if(job->payload != NULL)
+    {
+        flacPayloadRelease(job->payload);
+        job->payload = NULL;
+    }
+}
+
+static short *readMono(const char *path, long *count)
+{
+    SF_INFO info = { 0 };
+    SNDFILE *f = sf_open(path, SFM_READ, &info);
+    if(f == NULL)
+    {
+        return NULL;
+    }
+    short *samples = NULL;
+    if(info.samplerate == SAMPLE_RATE && info.channels >= 1 && info.frames > 0)
+    {
+        samples = (short *)malloc((size_t)info.frames * info.channels * sizeof(short));
+    }
+    if(samples == NULL)
+    {
+        sf_close(f);
+        return NULL;
+    }
+    *count = (long)sf_readf_short(f, samples, info.frames);
+    sf_close(f);
+
+    /* Only the first channel is used. */
+    for(long i = 0; i < *count; i++)
+    {
+        samples[i] = samples[i * info.channels];
+    }
+    return samples;
+}
+
+static void dspTask(void *arg)
+{
+    fileJob *job = (fileJob *)arg;
+    batch *b = job->owner;
+    double start = clockNow();
+
+    job->status = REC_ERROR;
+    short *samples = readMono(job->path, &job->count);
+    short *cleaned = samples != NULL ? (short *)malloc(job->count * sizeof(short)) : NULL;
+    cleaner *c = (cleaner *)malloc(sizeof(cleaner));
+    if(cleaned != NULL && c != NULL)
+    {
+        cleanInit(c, &b->cleanCfg);
+        for(long i = 0; i < job->count; i += BLOCK)
+        {
+            long n = job->count - i < BLOCK ? job->count - i : BLOCK;
+            cleanProcess(c, &samples[i], &cleaned[i], n);
+        }
+        job->status = trimUtterance(cleaned, job->count, SAMPLE_RATE, &b->trimCfg, &job->trimmed) == 0
+                      && job->trimmed.count > 0 ? REC_OK : REC_NO_MATCH;
+    }
+    free(c);
+    free(cleaned);
+    free(samples);
+    job->seconds[STEP_DSP] = clockNow() - start;
+    job->finished = clockNow();
+
+    if(job->status == REC_OK && schedSubmit(&b->pool, &b->all, encodeTask, job) != 0)
+    {
+        encodeTask(job);
+    }
+}
+
+/*------ MAIN ------*/
+
+static void printJob(const fileJob *job, double started)
+{
+    char text[REC_TEXT_MAX * 2];
+    size_t n = 0;
+    for(const char *s = job->result.text; *s != '\0' && n + 2 < sizeof(text); s++)
+    {
+        if(*s == '"' || *s == '\\')
+        {
+            text[n++] = '\\';
+        }
+        text[n++] = *s;
+    }
+    text[n] = '\0';
+
+    printf("{\"file\":\"%s\",\"seconds\":%.3f,\"speech_seconds\":%.3f,\"flac_bytes\":%lu,\"status\":%d,"
+           "\"text\":\"%s\",\"dsp_ms\":%.3f,\"encode_ms\":%.3f,\"recognize_ms\":%.3f,\"done_ms\":%.3f}\n",
+           job->path, (double)job->count / SAMPLE_RATE, (double)job->trimmed.count / SAMPLE_RATE,
+           (unsigned long)job->bytes, job->status, text, job->seconds[STEP_DSP] * 1000.0,
+           job->seconds[STEP_ENCODE] * 1000.0, job->seconds[STEP_RECOGNIZE] * 1000.0,
+           (job->finished - started) * 1000.0);
+}
+
+static recognizer *parseRemote(const char *spec)
+{
+    char host[256];
+    int port = 80;
+    const char *path = strchr(spec, '/');
+    const char *colon = strchr(spec, ':');
+    if(colon != NULL && path != NULL && colon > path)
+    {
+        colon = NULL;
+    }
+    size_t hostLength = colon != NULL ? (size_t)(colon - spec) : (path != NULL ? (size_t)(path - spec) : strlen(spec));
+    if(hostLength == 0 || hostLength >= sizeof(host))
+    {
+        return NULL;
+    }
+    memcpy(host, spec, hostLength);
+    host[hostLength] = '\0';
+    if(colon != NULL)
+    {
+        port = atoi(colon + 1);
+    }
+    if(netStartup() != NET_OK)
+    {
+        return NULL;
+    }
+    return recRemoteCreate(host, port, path != NULL ? path : "/", REMOTE_TIMEOUT);
+}
+
+int main(int argc, char **argv)
+{
+    int workers = 0;
+    const char *remote = NULL;
+    int first = 1;
+    for(; first < argc && argv[first][0] == '-'; first++)
+    {
+        if(strcmp(argv[first], "-w") == 0 && first + 1 < argc)
+        {
+            workers = atoi(argv[++first]);
+        }
+        else if(strcmp(argv[first], "-r") == 0 && first + 1 < argc)
+        {
+            remote = argv[++first];
+        }
+        else
+        {
+            break;
+        }
+    }
+    if(first >= argc)
+    {
+        fprintf(stderr, "usage: %s [-w workers] [-r host:port/path] file.wav ...\n", argv[0]);
+        return 2;
+    }
+
+    batch *b = (batch *)calloc(1, sizeof(batch));
+    int count = argc - first;
+    fileJob *jobs = (fileJob *)calloc((size_t)count, sizeof(fileJob));
+    if(b == NULL || jobs == NULL)
+    {
+        fprintf(stderr, "Could not allocate %d jobs.\n", count);
+        return 1;
+    }
+    cleanDefaults(&b->cleanCfg);
+    trimDefaults(&b->trimCfg);
+    if(remote != NULL && (b->remote = parseRemote(remote)) == NULL)
+    {
+        fprintf(stderr, "Not able to use recognizer %s.\n", remote);
+        return 1;
+    }
+    if(schedInit(&b->pool, workers) != 0)
+    {
+        fprintf(stderr, "Not able to start the workers.\n");
+        return 1;
+    }
+    schedGroupInit(&b->all);
+
+    double started = clockNow();
+    for(int i = 0; i < count; i++)
+    {
+        jobs[i].owner = b;
+        jobs[i].path = argv[first + i];
+        if(schedSubmit(&b->pool, &b->all, dspTask, &jobs[i]) != 0)
+        {
+            dspTask(&jobs[i]);
+        }
+    }
+    schedWait(&b->pool, &b->all);
+    double wall = clockNow() - started;
+
+    schedStats stats;
+    schedGetStats(&b->pool, &stats);
+    int used = b->pool.count;
+    schedFree(&b->pool);
+    schedGroupDestroy(&b->all);
+
+    double audio = 0.0;
+    for(int i = 0; i < count; i++)
+    {
+        printJob(&jobs[i], started);
+        audio += (double)jobs[i].count / SAMPLE_RATE;
+        trimFree(&jobs[i].trimmed);
+    }
+    printf("{\"files\":%d,\"workers\":%d,\"wall_s\":%.3f,\"audio_s\":%.3f,\"realtime_x\":%.1f,"
+           "\"tasks\":%lu,\"steals\":%lu,\"stolen\":%lu,\"parks\":%lu,\"utilization\":%.3f,"
+           "\"mean_wait_ms\":%.3f,\"max_wait_ms\":%.3f}\n",
+           count, used, wall, audio, wall > 0.0 ? audio / wall : 0.0, stats.executed, stats.steals,
+           stats.stolen, stats.parks, wall > 0.0 ? stats.busySeconds / (used * wall) : 0.0,
+           stats.executed ? stats.waitSeconds * 1000.0 / stats.executed : 0.0, stats.maxWaitSeconds * 1000.0);
+
+    recDestroy(b->remote);
+    free(jobs);
+    free(b);
+    return 0;
+}